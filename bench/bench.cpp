@@ -0,0 +1,647 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       bench.cpp
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   benchmarks of the hot paths of the engine on synthetic data,
+//              built without R (see Makefile)
+//
+//  Usage:      gbmbench [-n rows] [-p predictors] [-i iterations] [filter...]
+//
+//              Runs every benchmark whose name, data or family contains one
+//              of the filters, or all of them.  Each writes one line of tab
+//              separated fields: benchmark, data, family, rows processed,
+//              seconds and rows per second.
+//
+//------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <Rcpp.h>
+
+#include "gbm.h"
+#include "timer.h"
+
+extern "C" {
+SEXP gbm(SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,
+         SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP);
+SEXP gbm_pred(SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP,SEXP);
+}
+
+unsigned long long bench_rng_state = 1;
+
+namespace {
+
+  const char *aszKinds[] = {"continuous", "categorical", "missing"};
+  const char *aszFamilies[] = {"gaussian", "bernoulli", "poisson", "gamma",
+                               "tweedie", "adaboost", "laplace", "quantile",
+                               "tdist", "huberized", "coxph",
+                               "pairwise_conc", "pairwise_ndcg",
+                               "pairwise_map", "pairwise_mrr",
+                               "multinomial"};
+  const int cGroupSize = 20;    // items per query group for pairwise
+  const int cDepth = 3;
+  const int cMinObsInNode = 10;
+  const double dShrinkage = 0.1;
+  const double dBagFraction = 0.5;
+
+  struct Options {
+    int cRows;
+    int cCols;
+    int cIterations;
+    std::vector<std::string> vecFilters;
+  };
+
+  // a synthetic data set, column-major like an R matrix
+  struct Data {
+    std::string kind;
+    std::string family;
+    int cRows;
+    int cCols;
+    int cTrain;
+    std::vector<double> adX;
+    std::vector<double> adY;
+    std::vector<double> adW;
+    std::vector<double> adOffset;
+    std::vector<double> adMisc;
+    std::vector<int> acVarClasses;
+    std::vector<int> aiXOrder;
+  };
+
+  SEXP RealVector(const std::vector<double> &ad)
+  {
+    SEXP x = bench_real(0);
+    x->d = ad;
+    return x;
+  }
+
+  SEXP IntVector(const std::vector<int> &ai)
+  {
+    SEXP x = bench_int(0);
+    x->i = ai;
+    return x;
+  }
+
+  bool Selected(const Options &options, const std::string &benchmark,
+                const std::string &kind, const std::string &family)
+  {
+    std::size_t i = 0;
+
+    if(options.vecFilters.empty()) return true;
+    for(i=0; i<options.vecFilters.size(); i++)
+      {
+        const std::string &filter = options.vecFilters[i];
+        if((benchmark.find(filter) != std::string::npos) ||
+           (kind.find(filter) != std::string::npos) ||
+           (family.find(filter) != std::string::npos))
+          {
+            return true;
+          }
+      }
+    return false;
+  }
+
+  void Report(const std::string &benchmark, const Data &data,
+              double cRows, double dSeconds)
+  {
+    printf("%s\t%s\t%s\t%.0f\t%.6f\t%.4g\n", benchmark.c_str(),
+           data.kind.c_str(), data.family.c_str(), cRows, dSeconds,
+           (dSeconds > 0.0) ? cRows/dSeconds : 0.0);
+    fflush(stdout);
+  }
+
+  // The predictors: all continuous, half of them categorical with 4 to 64
+  // levels, or continuous with half the values missing.
+  void MakePredictors(Data &data)
+  {
+    const int cRows = data.cRows;
+    int iRow = 0;
+    int iCol = 0;
+
+    data.adX.resize(std::size_t(cRows)*data.cCols);
+    data.acVarClasses.assign(data.cCols, 0);
+    for(iCol=0; iCol<data.cCols; iCol++)
+      {
+        const int cLevels = 4 << (iCol % 5);
+        const bool fCategorical = (data.kind == "categorical") && (iCol % 2);
+        if(fCategorical) data.acVarClasses[iCol] = cLevels;
+
+        for(iRow=0; iRow<cRows; iRow++)
+          {
+            double &dX = data.adX[std::size_t(iCol)*cRows + iRow];
+            dX = fCategorical ? double(int(unif_rand()*cLevels)) : unif_rand();
+            if((data.kind == "missing") && (unif_rand() < 0.5))
+              {
+                dX = NA_REAL;
+              }
+          }
+      }
+  }
+
+  // the response of each family to the same signal in the first predictors
+  void MakeResponse(Data &data)
+  {
+    const std::string &family = data.family;
+    const int cRows = data.cRows;
+    int iRow = 0;
+    int iCol = 0;
+
+    data.adY.resize(cRows);
+    data.adW.assign(cRows, 1.0);
+    data.adOffset.assign(1, NA_REAL);
+    data.adMisc.assign(1, NA_REAL);
+
+    for(iRow=0; iRow<cRows; iRow++)
+      {
+        double dF = 0.0;
+        for(iCol=0; iCol<std::min(3, data.cCols); iCol++)
+          {
+            const double dX = data.adX[std::size_t(iCol)*cRows + iRow];
+            const double dScale = data.acVarClasses[iCol] ?
+              1.0/data.acVarClasses[iCol] : 1.0;
+            dF += ISNA(dX) ? 0.5 : ((iCol == 1) ? -dX : dX)*dScale;
+          }
+        const double dNoise = 0.3*norm_rand();
+
+        if((family == "gaussian") || (family == "laplace") ||
+           (family == "quantile") || (family == "tdist"))
+          {
+            data.adY[iRow] = dF + dNoise;
+          }
+        else if((family == "bernoulli") || (family == "adaboost") ||
+                (family == "huberized"))
+          {
+            data.adY[iRow] = (unif_rand() < 1.0/(1.0 + std::exp(-2.0*dF))) ? 1 : 0;
+          }
+        else if(family == "poisson")
+          {
+            const double dLambda = std::exp(dF);
+            double dP = std::exp(-dLambda);
+            double dSum = dP;
+            const double dU = unif_rand();
+            int k = 0;
+            while((dU > dSum) && (k < 100))
+              {
+                k++;
+                dP *= dLambda/k;
+                dSum += dP;
+              }
+            data.adY[iRow] = k;
+          }
+        else if((family == "gamma") || (family == "tweedie"))
+          {
+            data.adY[iRow] = std::exp(0.5*dF)*exp_rand();
+            if((family == "tweedie") && (unif_rand() < 0.3)) data.adY[iRow] = 0;
+          }
+        else if(family == "coxph")
+          {
+            data.adY[iRow] = std::exp(-0.5*dF)*exp_rand();
+          }
+        else if(family == "multinomial")
+          {
+            data.adY[iRow] = (dF + dNoise < 0.2) ? 0 : ((dF + dNoise < 0.8) ? 1 : 2);
+          }
+        else // pairwise
+          {
+            data.adY[iRow] = double(int(3*unif_rand() + 2*dF));
+            if((family == "pairwise_map") || (family == "pairwise_mrr"))
+              {
+                data.adY[iRow] = (data.adY[iRow] > 1) ? 1 : 0;
+              }
+          }
+      }
+
+    if(family == "quantile") data.adMisc.assign(1, 0.7);
+    else if(family == "tdist") data.adMisc.assign(1, 4);
+    else if(family == "tweedie") data.adMisc.assign(1, 1.5);
+    else if(family == "multinomial") data.adMisc.assign(1, 3);
+  }
+
+  struct DecreasingY {
+    const double *adY;
+    bool operator()(int i, int j) const { return adY[i] > adY[j]; }
+  };
+
+  // coxph wants the training and validation rows each sorted by decreasing
+  // time, and pairwise wants the rows of a group together, sorted by
+  // decreasing label
+  void ArrangeRows(Data &data)
+  {
+    const int cRows = data.cRows;
+    std::vector<int> aiRow(cRows);
+    DecreasingY decreasing;
+    int iRow = 0;
+    int iCol = 0;
+
+    for(iRow=0; iRow<cRows; iRow++) aiRow[iRow] = iRow;
+    decreasing.adY = &data.adY[0];
+
+    if(data.family == "coxph")
+      {
+        std::stable_sort(aiRow.begin(), aiRow.begin() + data.cTrain, decreasing);
+        std::stable_sort(aiRow.begin() + data.cTrain, aiRow.end(), decreasing);
+        data.adMisc.resize(cRows);
+        for(iRow=0; iRow<cRows; iRow++)
+          {
+            data.adMisc[iRow] = (unif_rand() < 0.7) ? 1 : 0;
+          }
+      }
+    else if(data.family.compare(0, 8, "pairwise") == 0)
+      {
+        for(iRow=0; iRow+cGroupSize<=cRows; iRow+=cGroupSize)
+          {
+            std::stable_sort(aiRow.begin() + iRow,
+                             aiRow.begin() + iRow + cGroupSize, decreasing);
+          }
+        data.adMisc.resize(cRows + 1);
+        for(iRow=0; iRow<cRows; iRow++)
+          {
+            data.adMisc[iRow] = iRow/cGroupSize + 1;
+          }
+        // the cut-off rank goes last
+        data.adMisc[cRows] = (data.family == "pairwise_ndcg") ? 5 : 0;
+      }
+    else
+      {
+        return;
+      }
+
+    const std::vector<double> adY(data.adY);
+    const std::vector<double> adX(data.adX);
+    for(iRow=0; iRow<cRows; iRow++)
+      {
+        data.adY[iRow] = adY[aiRow[iRow]];
+        for(iCol=0; iCol<data.cCols; iCol++)
+          {
+            data.adX[std::size_t(iCol)*cRows + iRow] =
+              adX[std::size_t(iCol)*cRows + aiRow[iRow]];
+          }
+      }
+  }
+
+  void MakeData(Data &data, const Options &options,
+                const std::string &kind, const std::string &family)
+  {
+    bench_rng_state = 1;
+    data.kind = kind;
+    data.family = family;
+    data.cRows = options.cRows;
+    data.cCols = options.cCols;
+    // the training rows end at a group boundary
+    data.cTrain = (options.cRows*4/5)/cGroupSize*cGroupSize;
+
+    MakePredictors(data);
+    MakeResponse(data);
+    ArrangeRows(data);
+
+    data.aiXOrder.resize(std::size_t(data.cTrain)*data.cCols);
+    PresortColumns(&data.adX[0], data.cRows, data.cCols, data.cTrain,
+                   &data.aiXOrder[0], 1);
+  }
+
+  SEXP Matrix(const Data &data)
+  {
+    SEXP x = RealVector(data.adX);
+    x->nrow = data.cRows;
+    x->ncol = data.cCols;
+    return x;
+  }
+
+  // the engine draws from the same generator as the data
+  class CBenchRandom : public CRandom {
+  public:
+    double Uniform() { return unif_rand(); }
+  };
+
+  // a single NA offset or misc stands for none, as in gbm()
+  const double *OptionalPtr(const std::vector<double> &ad)
+  {
+    return ((ad.size() == 1) && ISNA(ad[0])) ? 0 : &ad[0];
+  }
+
+  // The engine objects for one data set, set up as the gbm entry point
+  // does, with the dataset a view of the vectors of data.
+  struct Engine {
+    Engine(const Data &data, int cTrees)
+      : alMonotoneVar(data.cCols, 0),
+        dataset(&data.adY[0], OptionalPtr(data.adOffset), &data.adX[0],
+                &data.aiXOrder[0], &data.adW[0], OptionalPtr(data.adMisc),
+                &data.acVarClasses[0], &alMonotoneVar[0],
+                data.cRows, data.cCols)
+    {
+      int cGroups = -1;
+      gbm.SetRandom(&random);
+      pDist = gbm_setup(dataset, data.family, cTrees, cDepth, cMinObsInNode,
+                        dShrinkage, dBagFraction, data.cTrain, data.cCols,
+                        0, cGroups);
+      gbm.Initialize(dataset, pDist.get(), dShrinkage, data.cTrain,
+                     data.cCols, dBagFraction, cDepth, cMinObsInNode,
+                     cGroups);
+      pDist->Initialize(dataset.y_ptr(), dataset.misc_ptr(false),
+                        dataset.offset_ptr(false), dataset.weight_ptr(),
+                        dataset.nrow());
+
+      double dInitF = 0.0;
+      pDist->InitF(dataset.y_ptr(), dataset.misc_ptr(false),
+                   dataset.offset_ptr(false), dataset.weight_ptr(),
+                   dInitF, data.cTrain);
+      adF.assign(std::size_t(dataset.nrow())*gbm.NumClasses(), dInitF);
+    }
+
+    std::vector<int> alMonotoneVar;
+    CDataset dataset;
+    CBenchRandom random;
+    std::auto_ptr<CDistribution> pDist;
+    CGBM gbm;
+    std::vector<double> adF;
+  };
+
+  // the loss function kernels of a distribution on the training rows
+  void BenchKernels(const Data &data, const Options &options)
+  {
+    Engine engine(data, options.cIterations);
+    CDistribution *pDist = engine.pDist.get();
+    const CDataset &dataset = engine.dataset;
+    std::vector<double> adZ(engine.adF.size());
+    const bag afInBag(data.cTrain, true);
+    double dDeviance = 0.0;
+    double dStart = 0.0;
+    int iRep = 0;
+
+    if(Selected(options, "gradient", data.kind, data.family))
+      {
+        pDist->UpdateParams(&engine.adF[0], dataset.offset_ptr(false),
+                            dataset.weight_ptr(), data.cTrain);
+        dStart = CPhaseTimer::Now();
+        for(iRep=0; iRep<options.cIterations; iRep++)
+          {
+            pDist->ComputeWorkingResponse(dataset.y_ptr(),
+                                          dataset.misc_ptr(false),
+                                          dataset.offset_ptr(false),
+                                          &engine.adF[0], &adZ[0],
+                                          dataset.weight_ptr(), afInBag,
+                                          data.cTrain);
+          }
+        Report("gradient", data, double(data.cTrain)*options.cIterations,
+               CPhaseTimer::Now() - dStart);
+      }
+
+    if(Selected(options, "deviance", data.kind, data.family))
+      {
+        dStart = CPhaseTimer::Now();
+        for(iRep=0; iRep<options.cIterations; iRep++)
+          {
+            dDeviance += pDist->Deviance(dataset.y_ptr(),
+                                         dataset.misc_ptr(false),
+                                         dataset.offset_ptr(false),
+                                         dataset.weight_ptr(),
+                                         &engine.adF[0], data.cTrain);
+          }
+        Report("deviance", data, double(data.cTrain)*options.cIterations,
+               CPhaseTimer::Now() - dStart);
+      }
+  }
+
+  // whole boosting iterations, and each of their phases
+  void BenchIterate(const Data &data, const Options &options)
+  {
+    if(!Selected(options, "iterate", data.kind, data.family)) return;
+
+    Engine engine(data, options.cIterations);
+    CDistribution *pDist = engine.pDist.get();
+    const CDataset &dataset = engine.dataset;
+    CPhaseTimer &timer = engine.gbm.Timer();
+    std::vector<double> adSeconds(CPhaseTimer::PHASES, 0.0);
+    std::vector<double> adRows(CPhaseTimer::PHASES, 0.0);
+    double dTrainError = 0.0;
+    double dValidError = 0.0;
+    double dOOBagImprove = 0.0;
+    int cNodes = 0;
+    int iIter = 0;
+    int iPhase = 0;
+
+    timer.SetEnabled(true);
+    const double dStart = CPhaseTimer::Now();
+    for(iIter=0; iIter<options.cIterations; iIter++)
+      {
+        timer.Clear();
+        timer.Start(CPhaseTimer::RESPONSE);
+        pDist->UpdateParams(&engine.adF[0], dataset.offset_ptr(false),
+                            dataset.weight_ptr(), data.cTrain);
+        timer.Stop(CPhaseTimer::RESPONSE);
+        engine.gbm.iterate(&engine.adF[0], dTrainError, dValidError,
+                           dOOBagImprove, cNodes);
+        for(iPhase=0; iPhase<CPhaseTimer::PHASES; iPhase++)
+          {
+            adSeconds[iPhase] += timer.Seconds(CPhaseTimer::Phase(iPhase));
+            adRows[iPhase] += timer.Rows(CPhaseTimer::Phase(iPhase));
+          }
+      }
+    Report("iterate", data, double(data.cTrain)*options.cIterations,
+           CPhaseTimer::Now() - dStart);
+
+    for(iPhase=0; iPhase<CPhaseTimer::PHASES; iPhase++)
+      {
+        if(adRows[iPhase] > 0.0)
+          {
+            Report(std::string("iterate.") +
+                   CPhaseTimer::Name(CPhaseTimer::Phase(iPhase)),
+                   data, adRows[iPhase], adSeconds[iPhase]);
+          }
+      }
+  }
+
+  // CNodeSearch::IncorporateObs() over every predictor in sorted order, as
+  // the split search at the root does
+  void BenchNodeSearch(const Data &data, const Options &options)
+  {
+    if(!Selected(options, "node_search", data.kind, data.family)) return;
+
+    CNodeFactory factory;
+    CNodeSearch search;
+    std::vector<double> adZ(data.cTrain);
+    double dSumZ = 0.0;
+    int iRow = 0;
+    int iCol = 0;
+    int iRep = 0;
+
+    for(iRow=0; iRow<data.cTrain; iRow++)
+      {
+        adZ[iRow] = norm_rand();
+        dSumZ += adZ[iRow];
+      }
+    factory.Initialize(cDepth);
+    search.Initialize(cMinObsInNode);
+
+    const double dStart = CPhaseTimer::Now();
+    for(iRep=0; iRep<options.cIterations; iRep++)
+      {
+        CNodeTerminal *pNode = factory.GetNewNodeTerminal();
+        CNode *pRoot = pNode;
+        search.Set(dSumZ, data.cTrain, data.cTrain, pNode, &pRoot, &factory);
+        for(iCol=0; iCol<data.cCols; iCol++)
+          {
+            const int *aiOrder = &data.aiXOrder[std::size_t(iCol)*data.cTrain];
+            const double *adX = &data.adX[std::size_t(iCol)*data.cRows];
+            search.ResetForNewVar(iCol, data.acVarClasses[iCol]);
+            for(iRow=0; iRow<data.cTrain; iRow++)
+              {
+                const int iObs = aiOrder[iRow];
+                search.IncorporateObs(adX[iObs], adZ[iObs], 1.0, 0);
+              }
+            if(data.acVarClasses[iCol] != 0)
+              {
+                search.EvaluateCategoricalSplit();
+              }
+            search.WrapUpCurrentVariable();
+          }
+        pNode->RecycleSelf(&factory);
+      }
+    Report("node_search", data,
+           double(data.cTrain)*data.cCols*options.cIterations,
+           CPhaseTimer::Now() - dStart);
+  }
+
+  SEXP Control()
+  {
+    return Rcpp::List::create(Rcpp::_["n.threads"]=1,
+                              Rcpp::_["fused.update"]=1,
+                              Rcpp::_["simd"]=1,
+                              Rcpp::_["pair.budget"]=0,
+                              Rcpp::_["newton"]=0,
+                              Rcpp::_["lambda"]=0.0,
+                              Rcpp::_["bag.type"]=std::string("sequential"),
+                              Rcpp::_["random.streams"]=0,
+                              Rcpp::_["column.sampling"]=std::string("level"),
+                              Rcpp::_["patience"]=0,
+                              Rcpp::_["stop.metric"]=std::string("auto"),
+                              Rcpp::_["valid.every"]=1,
+                              Rcpp::_["checkpoint.file"]=std::string(""),
+                              Rcpp::_["checkpoint.every"]=0,
+                              Rcpp::_["resume"]=0,
+                              Rcpp::_["timing"]=0);
+  }
+
+  // a fit through the gbm entry point, and gbm_pred() of all rows with
+  // its trees
+  void BenchPredict(const Data &data, const Options &options)
+  {
+    const bool fFit = Selected(options, "fit", data.kind, data.family);
+    const bool fPredict = Selected(options, "predict", data.kind, data.family);
+    if(!fFit && !fPredict) return;
+
+    const int cTrees = options.cIterations;
+    const Rcpp::List control(Control());
+
+    double dStart = CPhaseTimer::Now();
+    const Rcpp::List fit(gbm(RealVector(data.adY), RealVector(data.adOffset),
+                             Matrix(data), IntVector(data.aiXOrder),
+                             RealVector(data.adW), RealVector(data.adMisc),
+                             IntVector(data.acVarClasses),
+                             IntVector(std::vector<int>(data.cCols, 0)),
+                             bench_string(data.family), bench_int(1, cTrees),
+                             bench_int(1, cDepth), bench_int(1, cMinObsInNode),
+                             bench_real(1, dShrinkage),
+                             bench_real(1, dBagFraction),
+                             bench_int(1, data.cTrain),
+                             bench_int(1, data.cCols), bench_real(1, NA_REAL),
+                             bench_int(1, 0), bench_int(1, 0), bench_int(1, 0),
+                             control));
+    if(fFit)
+      {
+        Report("fit", data, double(data.cTrain)*cTrees,
+               CPhaseTimer::Now() - dStart);
+      }
+
+    if(fPredict)
+      {
+        dStart = CPhaseTimer::Now();
+        gbm_pred(Matrix(data), bench_int(1, cTrees), fit["initF"],
+                 bench_int(1, 1), fit["trees"], fit["c.splits"],
+                 IntVector(data.acVarClasses), bench_int(1, 0));
+        Report("predict", data, double(data.cRows)*cTrees,
+               CPhaseTimer::Now() - dStart);
+      }
+  }
+
+  void Usage()
+  {
+    fprintf(stderr,
+            "usage: gbmbench [-n rows] [-p predictors] [-i iterations] "
+            "[filter...]\n");
+    std::exit(2);
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int iArg = 0;
+  std::size_t iKind = 0;
+  std::size_t iFamily = 0;
+
+  options.cRows = 100000;
+  options.cCols = 10;
+  options.cIterations = 20;
+  for(iArg=1; iArg<argc; iArg++)
+    {
+      const std::string arg = argv[iArg];
+      if((arg == "-n") || (arg == "-p") || (arg == "-i"))
+        {
+          if(iArg+1 >= argc) Usage();
+          const int iValue = std::atoi(argv[++iArg]);
+          if(iValue < 1) Usage();
+          if(arg == "-n") options.cRows = std::max(iValue, 5*cGroupSize);
+          else if(arg == "-p") options.cCols = iValue;
+          else options.cIterations = iValue;
+        }
+      else if(arg[0] == '-')
+        {
+          Usage();
+        }
+      else
+        {
+          options.vecFilters.push_back(arg);
+        }
+    }
+
+  printf("benchmark\tdata\tfamily\trows\tseconds\trows_per_sec\n");
+  for(iKind=0; iKind<sizeof(aszKinds)/sizeof(aszKinds[0]); iKind++)
+    {
+      for(iFamily=0; iFamily<sizeof(aszFamilies)/sizeof(aszFamilies[0]); iFamily++)
+        {
+          const std::string kind = aszKinds[iKind];
+          const std::string family = aszFamilies[iFamily];
+          const char *aszBenchmarks[] = {"gradient", "deviance", "iterate",
+                                         "node_search", "fit", "predict"};
+          bool fAny = false;
+          std::size_t i = 0;
+
+          for(i=0; i<sizeof(aszBenchmarks)/sizeof(aszBenchmarks[0]); i++)
+            {
+              fAny = fAny || Selected(options, aszBenchmarks[i], kind, family);
+            }
+          if(!fAny) continue;
+
+          Data data;
+          MakeData(data, options, kind, family);
+          BenchKernels(data, options);
+          BenchIterate(data, options);
+          // these do not depend on the family
+          if(family == "gaussian")
+            {
+              BenchNodeSearch(data, options);
+              BenchPredict(data, options);
+            }
+        }
+    }
+
+  return 0;
+}
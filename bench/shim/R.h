@@ -0,0 +1,53 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       R.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   the parts of R's C API used by the R entry points, for
+//              building the benchmarks without R
+//
+//------------------------------------------------------------------------------
+
+#ifndef BENCH_R_H
+#define BENCH_R_H
+
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#define NA_REAL (std::numeric_limits<double>::quiet_NaN())
+#define ISNA(x) (std::isnan(x))
+#define Rprintf printf
+
+// a 64 bit linear congruential generator stands in for R's
+extern unsigned long long bench_rng_state;
+
+inline double unif_rand()
+{
+  bench_rng_state = bench_rng_state*6364136223846793005ULL +
+    1442695040888963407ULL;
+  return ((bench_rng_state >> 11) + 0.5)*(1.0/9007199254740992.0);
+}
+
+inline double norm_rand()
+{
+  const double dU = unif_rand();
+  const double dV = unif_rand();
+  return std::sqrt(-2.0*std::log(dU))*std::cos(6.283185307179586*dV);
+}
+
+inline double exp_rand()
+{
+  return -std::log(unif_rand());
+}
+
+inline void GetRNGstate() {}
+inline void PutRNGstate() {}
+
+#endif // BENCH_R_H
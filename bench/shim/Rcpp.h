@@ -0,0 +1,446 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       Rcpp.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   the parts of Rcpp used by the engine and the entry points,
+//              for building the benchmarks without R
+//
+//------------------------------------------------------------------------------
+
+#ifndef BENCH_RCPP_H
+#define BENCH_RCPP_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+
+#include "R.h"
+
+// An R object: a numeric, integer or generic vector, or a string.  Objects
+// are never freed; the benchmarks create few of them.
+struct SEXPREC
+{
+  enum Type { REAL, INTEGER, LIST, STRING };
+
+  Type type;
+  std::vector<double> d;
+  std::vector<int> i;
+  std::vector<SEXPREC*> l;
+  std::vector<std::string> names;
+  std::string s;
+  int nrow;
+  int ncol;
+
+  SEXPREC() : type(REAL), nrow(-1), ncol(-1) {}
+};
+typedef SEXPREC* SEXP;
+
+#define R_NilValue ((SEXP)0)
+
+inline SEXP bench_real(std::size_t n, double dValue = 0.0)
+{
+  SEXP x = new SEXPREC;
+  x->type = SEXPREC::REAL;
+  x->d.assign(n, dValue);
+  return x;
+}
+
+inline SEXP bench_int(std::size_t n, int iValue = 0)
+{
+  SEXP x = new SEXPREC;
+  x->type = SEXPREC::INTEGER;
+  x->i.assign(n, iValue);
+  return x;
+}
+
+inline SEXP bench_list(std::size_t n)
+{
+  SEXP x = new SEXPREC;
+  x->type = SEXPREC::LIST;
+  x->l.assign(n, R_NilValue);
+  return x;
+}
+
+inline SEXP bench_string(const std::string &s)
+{
+  SEXP x = new SEXPREC;
+  x->type = SEXPREC::STRING;
+  x->s = s;
+  return x;
+}
+
+namespace Rcpp {
+
+  // the elements of an object as a vector of T, converting if needed
+  template <typename T> struct elements;
+  template <> struct elements<double> {
+    static std::vector<double> &get(SEXP x) {
+      if(x->type == SEXPREC::INTEGER) {
+        x->d.assign(x->i.begin(), x->i.end());
+        x->type = SEXPREC::REAL;
+      }
+      return x->d;
+    }
+  };
+  template <> struct elements<int> {
+    static std::vector<int> &get(SEXP x) {
+      if(x->type == SEXPREC::REAL) {
+        x->i.resize(x->d.size());
+        for(std::size_t k=0; k<x->d.size(); k++) x->i[k] = int(x->d[k]);
+        x->type = SEXPREC::INTEGER;
+      }
+      return x->i;
+    }
+  };
+
+  struct Dimension {
+    Dimension(int nrow, int ncol) : nrow(nrow), ncol(ncol) {}
+    int nrow;
+    int ncol;
+  };
+
+  struct AttrProxy {
+    SEXP x;
+    AttrProxy &operator=(const Dimension &dim) {
+      x->nrow = dim.nrow;
+      x->ncol = dim.ncol;
+      return *this;
+    }
+  };
+
+  template <typename T>
+  class Vector {
+  public:
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    Vector() { Allocate(0, T()); }
+    Vector(SEXP x) : x(x) {}
+    explicit Vector(int n) { Allocate(n, T()); }
+    Vector(int n, T value) { Allocate(n, value); }
+    template <typename It> Vector(It first, It last) {
+      Allocate(0, T());
+      elements<T>::get(x).assign(first, last);
+    }
+
+    T *begin() const { return data().empty() ? 0 : &data()[0]; }
+    T *end() const { return begin() + data().size(); }
+    int size() const { return int(data().size()); }
+    T &operator[](int k) const { return data()[k]; }
+    void fill(T value) { std::fill(data().begin(), data().end(), value); }
+    AttrProxy attr(const char *) { AttrProxy proxy; proxy.x = x; return proxy; }
+    operator SEXP() const { return x; }
+
+    SEXP x;
+
+  protected:
+    std::vector<T> &data() const { return elements<T>::get(x); }
+
+  private:
+    void Allocate(int n, T value) {
+      x = (T(0.5) == T(0)) ? bench_int(0) : bench_real(0);
+      elements<T>::get(x).assign(n, value);
+    }
+  };
+  typedef Vector<double> NumericVector;
+  typedef Vector<int> IntegerVector;
+  typedef Vector<int> LogicalVector;
+
+  template <typename T>
+  class Matrix : public Vector<T> {
+  public:
+    Matrix(SEXP x) : Vector<T>(x) {}
+    Matrix(int nrow, int ncol) : Vector<T>(nrow*ncol) {
+      this->x->nrow = nrow;
+      this->x->ncol = ncol;
+    }
+    int nrow() const { return this->x->nrow; }
+    int ncol() const { return this->x->ncol; }
+    T &operator()(int i, int j) const {
+      return this->data()[std::size_t(j)*this->x->nrow + i];
+    }
+  };
+  typedef Matrix<double> NumericMatrix;
+  typedef Matrix<int> IntegerMatrix;
+
+  inline SEXP wrap(SEXP x) { return x; }
+  inline SEXP wrap(double d) { return bench_real(1, d); }
+  inline SEXP wrap(int i) { return bench_int(1, i); }
+  inline SEXP wrap(const std::string &s) { return bench_string(s); }
+  inline SEXP wrap(const std::vector<double> &v) {
+    SEXP x = bench_real(0); x->d = v; return x;
+  }
+  inline SEXP wrap(const std::vector<int> &v) {
+    SEXP x = bench_int(0); x->i = v; return x;
+  }
+  inline SEXP wrap(const std::vector<std::string> &v) {
+    SEXP x = bench_list(v.size());
+    for(std::size_t k=0; k<v.size(); k++) x->l[k] = bench_string(v[k]);
+    return x;
+  }
+  inline SEXP wrap(const std::vector< std::vector<int> > &v) {
+    SEXP x = bench_list(v.size());
+    for(std::size_t k=0; k<v.size(); k++) x->l[k] = wrap(v[k]);
+    return x;
+  }
+  template <typename T> inline SEXP wrap(const Vector<T> &v) { return v.x; }
+
+  struct Named {
+    std::string name;
+    SEXP x;
+  };
+  struct NamePlaceholder {
+    std::string name;
+    template <typename T> Named operator=(const T &value) const {
+      Named named;
+      named.name = name;
+      named.x = wrap(value);
+      return named;
+    }
+  };
+  struct NameMaker {
+    NamePlaceholder operator[](const char *name) const {
+      NamePlaceholder placeholder;
+      placeholder.name = name;
+      return placeholder;
+    }
+  };
+  static NameMaker _;
+
+  inline void append(SEXP x, const Named &named) {
+    x->l.push_back(named.x);
+    x->names.push_back(named.name);
+  }
+  template <typename T> inline void append(SEXP x, const T &value) {
+    x->l.push_back(wrap(value));
+    x->names.push_back("");
+  }
+
+  class List {
+  public:
+    List() : x(bench_list(0)) {}
+    List(SEXP x) : x(x) {}
+    explicit List(int n) : x(bench_list(n)) {}
+
+    SEXP &operator[](int k) const { return x->l[k]; }
+    SEXP operator[](const std::string &name) const {
+      for(std::size_t k=0; k<x->names.size(); k++) {
+        if(x->names[k] == name) return x->l[k];
+      }
+      throw std::invalid_argument("no list element named " + name);
+    }
+    int size() const { return int(x->l.size()); }
+    operator SEXP() const { return x; }
+
+#define BENCH_CREATE(ARGS) { SEXP x = bench_list(0); ARGS; return List(x); }
+    template <class A>
+    static List create(const A &a)
+      BENCH_CREATE(append(x,a))
+    template <class A, class B>
+    static List create(const A &a, const B &b)
+      BENCH_CREATE(append(x,a); append(x,b))
+    template <class A, class B, class C>
+    static List create(const A &a, const B &b, const C &c)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c))
+    template <class A, class B, class C, class D>
+    static List create(const A &a, const B &b, const C &c, const D &d)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d))
+    template <class A, class B, class C, class D, class E>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e))
+    template <class A, class B, class C, class D, class E, class F>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f))
+    template <class A, class B, class C, class D, class E, class F, class G>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L, class M>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l,
+                       const M &m)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l);
+                   append(x,m))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L, class M, class N>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l,
+                       const M &m, const N &n)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l);
+                   append(x,m); append(x,n))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L, class M, class N,
+              class O>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l,
+                       const M &m, const N &n, const O &o)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l);
+                   append(x,m); append(x,n); append(x,o))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L, class M, class N,
+              class O, class P>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l,
+                       const M &m, const N &n, const O &o, const P &p)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l);
+                   append(x,m); append(x,n); append(x,o); append(x,p))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L, class M, class N,
+              class O, class P, class Q>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l,
+                       const M &m, const N &n, const O &o, const P &p,
+                       const Q &q)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l);
+                   append(x,m); append(x,n); append(x,o); append(x,p);
+                   append(x,q))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L, class M, class N,
+              class O, class P, class Q, class R>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l,
+                       const M &m, const N &n, const O &o, const P &p,
+                       const Q &q, const R &r)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l);
+                   append(x,m); append(x,n); append(x,o); append(x,p);
+                   append(x,q); append(x,r))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L, class M, class N,
+              class O, class P, class Q, class R, class S>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l,
+                       const M &m, const N &n, const O &o, const P &p,
+                       const Q &q, const R &r, const S &s)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l);
+                   append(x,m); append(x,n); append(x,o); append(x,p);
+                   append(x,q); append(x,r); append(x,s))
+    template <class A, class B, class C, class D, class E, class F, class G,
+              class H, class I, class J, class K, class L, class M, class N,
+              class O, class P, class Q, class R, class S, class T>
+    static List create(const A &a, const B &b, const C &c, const D &d,
+                       const E &e, const F &f, const G &g, const H &h,
+                       const I &i, const J &j, const K &k, const L &l,
+                       const M &m, const N &n, const O &o, const P &p,
+                       const Q &q, const R &r, const S &s, const T &t)
+      BENCH_CREATE(append(x,a); append(x,b); append(x,c); append(x,d);
+                   append(x,e); append(x,f); append(x,g); append(x,h);
+                   append(x,i); append(x,j); append(x,k); append(x,l);
+                   append(x,m); append(x,n); append(x,o); append(x,p);
+                   append(x,q); append(x,r); append(x,s); append(x,t))
+#undef BENCH_CREATE
+
+    SEXP x;
+  };
+  typedef List GenericVector;
+  inline SEXP wrap(const List &list) { return list.x; }
+
+  template <typename T> T as(SEXP x);
+  template <> inline double as<double>(SEXP x) {
+    return (x->type == SEXPREC::REAL) ? x->d[0] : double(x->i[0]);
+  }
+  template <> inline int as<int>(SEXP x) { return int(as<double>(x)); }
+  template <> inline bool as<bool>(SEXP x) { return as<double>(x) != 0.0; }
+  template <> inline unsigned long as<unsigned long>(SEXP x) {
+    return (unsigned long)as<double>(x);
+  }
+  template <> inline std::string as<std::string>(SEXP x) { return x->s; }
+
+  struct RNGScope {};
+
+  class Environment {
+  public:
+    static Environment global_env() { return Environment(); }
+    SEXP operator[](const std::string &name) const { return vars()[name]; }
+    void assign(const std::string &name, SEXP x) { vars()[name] = x; }
+  private:
+    static std::map<std::string, SEXP> &vars() {
+      static std::map<std::string, SEXP> mapVars;
+      return mapVars;
+    }
+  };
+
+  inline void checkUserInterrupt() {}
+  inline void warning(const std::string &message) {
+    fprintf(stderr, "Warning: %s\n", message.c_str());
+  }
+}
+
+#define BEGIN_RCPP try {
+#define END_RCPP } catch(std::exception &ex) { \
+    fprintf(stderr, "Error: %s\n", ex.what()); \
+    std::exit(1); \
+  } return R_NilValue;
+
+#endif // BENCH_RCPP_H
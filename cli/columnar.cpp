@@ -0,0 +1,455 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       columnar.cpp
+//
+//------------------------------------------------------------------------------
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "columnar.h"
+#include "gbmexcept.h"
+
+namespace {
+
+  const char szMagic[8] = {'G','B','M','C','O','L','S','\0'};
+  const int32_t iVersion = 1;
+
+  // reads the fields of the header one after the other
+  class CHeaderReader
+  {
+  public:
+    CHeaderReader(const unsigned char *pStart, std::size_t cBytes)
+      : pStart(pStart), cBytes(cBytes), iNext(0) {}
+
+    template <typename T>
+    T Read()
+    {
+      T value;
+      Need(sizeof(T));
+      std::memcpy(&value, pStart + iNext, sizeof(T));
+      iNext += sizeof(T);
+      return value;
+    }
+
+    std::string ReadString()
+    {
+      const int32_t cLength = Read<int32_t>();
+      if(cLength < 0)
+        {
+          throw GBM::failure("the columnar file is corrupt");
+        }
+      Need(cLength);
+      const std::string s(reinterpret_cast<const char*>(pStart + iNext),
+                          cLength);
+      iNext += cLength;
+      return s;
+    }
+
+  private:
+    void Need(std::size_t cNeeded) const
+    {
+      if(cNeeded > cBytes - iNext)
+        {
+          throw GBM::failure("the columnar file is truncated");
+        }
+    }
+
+    const unsigned char *pStart;
+    std::size_t cBytes;
+    std::size_t iNext;
+  };
+
+  template <typename T>
+  void WriteValue(std::ofstream &out, const T &value)
+  {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void WriteString(std::ofstream &out, const std::string &s)
+  {
+    WriteValue(out, int32_t(s.size()));
+    out.write(s.data(), s.size());
+  }
+
+  void WritePadding(std::ofstream &out, int64_t &offset)
+  {
+    while(offset % 8 != 0)
+      {
+        out.put('\0');
+        offset++;
+      }
+  }
+}
+
+
+CColumnarFile::CColumnarFile()
+{
+  pMapping = 0;
+  cMappedBytes = 0;
+  cRows = 0;
+}
+
+
+CColumnarFile::~CColumnarFile()
+{
+  Close();
+}
+
+
+void CColumnarFile::Open
+(
+    const std::string &file
+)
+{
+  struct stat info;
+  int32_t i = 0;
+  int32_t iLevel = 0;
+
+  Close();
+
+  const int fd = open(file.c_str(), O_RDONLY);
+  if(fd < 0)
+    {
+      throw GBM::failure("cannot open " + file);
+    }
+  if((fstat(fd, &info) != 0) || (info.st_size == 0))
+    {
+      close(fd);
+      throw GBM::failure(file + " is empty or cannot be read");
+    }
+  cMappedBytes = info.st_size;
+  pMapping = mmap(0, cMappedBytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(pMapping == MAP_FAILED)
+    {
+      pMapping = 0;
+      throw GBM::failure("cannot map " + file);
+    }
+
+  const unsigned char *pStart = static_cast<const unsigned char*>(pMapping);
+  if(!IsColumnar(reinterpret_cast<const char*>(pStart), cMappedBytes))
+    {
+      Close();
+      throw GBM::failure(file + " is not a columnar data file");
+    }
+
+  try
+    {
+      CHeaderReader header(pStart + sizeof(szMagic),
+                           cMappedBytes - sizeof(szMagic));
+      if(header.Read<int32_t>() != iVersion)
+        {
+          throw GBM::failure("unsupported columnar file version");
+        }
+      const int32_t cColumns = header.Read<int32_t>();
+      cRows = header.Read<int64_t>();
+      if((cColumns < 0) || (cRows < 0) ||
+         (cRows > std::numeric_limits<int>::max()))
+        {
+          throw GBM::failure("the columnar file is corrupt");
+        }
+
+      vecColumns.resize(cColumns);
+      for(i=0; i<cColumns; i++)
+        {
+          Column &column = vecColumns[i];
+          const int32_t iType = header.Read<int32_t>();
+          if((iType < FLOAT64) || (iType > FACTOR))
+            {
+              throw GBM::failure("the columnar file has a column of unknown type");
+            }
+          column.type = Type(iType);
+          column.name = header.ReadString();
+          const int32_t cLevels = header.Read<int32_t>();
+          if((cLevels < 0) || ((cLevels > 0) != (column.type == FACTOR)))
+            {
+              throw GBM::failure("the columnar file is corrupt");
+            }
+          column.vecLevels.resize(cLevels);
+          for(iLevel=0; iLevel<cLevels; iLevel++)
+            {
+              column.vecLevels[iLevel] = header.ReadString();
+            }
+          column.offValues = header.Read<int64_t>();
+          column.offMissing = header.Read<int64_t>();
+
+          // check that the sections lie within the file
+          const int64_t cValueBytes = (column.type == FLOAT64) ? 8 : 4;
+          if(column.offValues % 8 != 0)
+            {
+              throw GBM::failure("the columnar file is corrupt");
+            }
+          Bytes(column.offValues, cRows*cValueBytes);
+          if(column.offMissing != 0)
+            {
+              Bytes(column.offMissing, (cRows + 7)/8);
+            }
+        }
+    }
+  catch(...)
+    {
+      Close();
+      throw;
+    }
+}
+
+
+void CColumnarFile::Close()
+{
+  if(pMapping)
+    {
+      munmap(pMapping, cMappedBytes);
+    }
+  pMapping = 0;
+  cMappedBytes = 0;
+  cRows = 0;
+  vecColumns.clear();
+}
+
+
+int CColumnarFile::Find
+(
+    const std::string &name
+) const
+{
+  for(std::size_t i=0; i<vecColumns.size(); i++)
+    {
+      if(vecColumns[i].name == name) return int(i);
+    }
+  return -1;
+}
+
+
+bool CColumnarFile::IsMissing
+(
+    int iCol,
+    int64_t iRow
+) const
+{
+  const Column &column = vecColumns[iCol];
+
+  if(column.offMissing == 0) return false;
+  const unsigned char *pbMissing =
+    static_cast<const unsigned char*>(pMapping) + column.offMissing;
+  return (pbMissing[iRow/8] >> (iRow%8)) & 1;
+}
+
+
+int64_t CColumnarFile::CountMissing
+(
+    int iCol
+) const
+{
+  int64_t cMissing = 0;
+
+  if(vecColumns[iCol].offMissing == 0) return 0;
+  for(int64_t iRow=0; iRow<cRows; iRow++)
+    {
+      if(IsMissing(iCol, iRow)) cMissing++;
+    }
+  return cMissing;
+}
+
+
+const double *CColumnarFile::Values
+(
+    int iCol,
+    std::vector<double> &adBuffer
+) const
+{
+  if(vecColumns[iCol].type == FLOAT64)
+    {
+      return Values(iCol, static_cast<double*>(0));
+    }
+  adBuffer.resize(cRows);
+  return Values(iCol, cRows > 0 ? &adBuffer[0] : 0);
+}
+
+
+const double *CColumnarFile::Values
+(
+    int iCol,
+    double *adBuffer
+) const
+{
+  const Column &column = vecColumns[iCol];
+  const unsigned char *pValues = Bytes(column.offValues, 0);
+  int64_t iRow = 0;
+
+  if(column.type == FLOAT64)
+    {
+      return reinterpret_cast<const double*>(pValues);
+    }
+
+  const int32_t *aiValues = reinterpret_cast<const int32_t*>(pValues);
+  for(iRow=0; iRow<cRows; iRow++)
+    {
+      adBuffer[iRow] = IsMissing(iCol, iRow) ?
+        std::numeric_limits<double>::quiet_NaN() : double(aiValues[iRow]);
+    }
+  return adBuffer;
+}
+
+
+bool CColumnarFile::IsColumnar
+(
+    const char *s,
+    std::size_t cLength
+)
+{
+  return (cLength >= sizeof(szMagic)) &&
+    (std::memcmp(s, szMagic, sizeof(szMagic)) == 0);
+}
+
+
+const unsigned char *CColumnarFile::Bytes
+(
+    int64_t offset,
+    int64_t cBytes
+) const
+{
+  if((offset < 0) || (cBytes < 0) || (uint64_t(offset) > cMappedBytes) ||
+     (uint64_t(cBytes) > cMappedBytes - offset))
+    {
+      throw GBM::failure("the columnar file is truncated");
+    }
+  return static_cast<const unsigned char*>(pMapping) + offset;
+}
+
+
+void CColumnarWriter::Write
+(
+    const std::string &file,
+    const std::vector<Column> &vecColumns,
+    int64_t cRows
+)
+{
+  std::size_t i = 0;
+  std::size_t iLevel = 0;
+  int64_t iRow = 0;
+  const int64_t cMissingBytes = (cRows + 7)/8;
+
+  // the header has a fixed size, which gives the offsets of the sections
+  int64_t offset = sizeof(szMagic) + 4 + 4 + 8;
+  for(i=0; i<vecColumns.size(); i++)
+    {
+      const Column &column = vecColumns[i];
+      offset += 4 + 4 + column.name.size() + 4 + 8 + 8;
+      for(iLevel=0; iLevel<column.vecLevels.size(); iLevel++)
+        {
+          offset += 4 + column.vecLevels[iLevel].size();
+        }
+    }
+  offset = (offset + 7)/8*8;
+
+  std::vector<int64_t> aoffValues(vecColumns.size());
+  std::vector<int64_t> aoffMissing(vecColumns.size(), 0);
+  for(i=0; i<vecColumns.size(); i++)
+    {
+      const Column &column = vecColumns[i];
+      bool fAnyMissing = false;
+
+      if(int64_t(column.adValues.size()) != cRows)
+        {
+          throw GBM::invalid_argument("the columns differ in length");
+        }
+      for(iRow=0; (iRow<cRows) && !fAnyMissing; iRow++)
+        {
+          fAnyMissing = std::isnan(column.adValues[iRow]);
+        }
+      aoffValues[i] = offset;
+      offset += cRows*((column.type == CColumnarFile::FLOAT64) ? 8 : 4);
+      offset = (offset + 7)/8*8;
+      if(fAnyMissing)
+        {
+          aoffMissing[i] = offset;
+          offset += cMissingBytes;
+          offset = (offset + 7)/8*8;
+        }
+    }
+
+  const std::string tmpFile = file + ".tmp";
+  {
+    std::ofstream out(tmpFile.c_str(), std::ios::binary | std::ios::trunc);
+    if(!out)
+      {
+        throw GBM::failure("cannot open " + tmpFile);
+      }
+
+    out.write(szMagic, sizeof(szMagic));
+    WriteValue(out, iVersion);
+    WriteValue(out, int32_t(vecColumns.size()));
+    WriteValue(out, cRows);
+    for(i=0; i<vecColumns.size(); i++)
+      {
+        const Column &column = vecColumns[i];
+        WriteValue(out, int32_t(column.type));
+        WriteString(out, column.name);
+        WriteValue(out, int32_t(column.vecLevels.size()));
+        for(iLevel=0; iLevel<column.vecLevels.size(); iLevel++)
+          {
+            WriteString(out, column.vecLevels[iLevel]);
+          }
+        WriteValue(out, aoffValues[i]);
+        WriteValue(out, aoffMissing[i]);
+      }
+
+    int64_t position = out.tellp();
+    WritePadding(out, position);
+    for(i=0; i<vecColumns.size(); i++)
+      {
+        const Column &column = vecColumns[i];
+        for(iRow=0; iRow<cRows; iRow++)
+          {
+            const double dValue = column.adValues[iRow];
+            if(column.type == CColumnarFile::FLOAT64)
+              {
+                WriteValue(out, dValue);
+                position += 8;
+              }
+            else
+              {
+                WriteValue(out, int32_t(std::isnan(dValue) ? 0 : dValue));
+                position += 4;
+              }
+          }
+        WritePadding(out, position);
+
+        if(aoffMissing[i] != 0)
+          {
+            std::vector<unsigned char> abMissing(cMissingBytes, 0);
+            for(iRow=0; iRow<cRows; iRow++)
+              {
+                if(std::isnan(column.adValues[iRow]))
+                  {
+                    abMissing[iRow/8] |= (unsigned char)(1 << (iRow%8));
+                  }
+              }
+            out.write(reinterpret_cast<const char*>(&abMissing[0]),
+                      cMissingBytes);
+            position += cMissingBytes;
+            WritePadding(out, position);
+          }
+      }
+
+    out.close();
+    if(!out)
+      {
+        throw GBM::failure("cannot write " + tmpFile);
+      }
+  }
+
+  if(std::rename(tmpFile.c_str(), file.c_str()) != 0)
+    {
+      throw GBM::failure("cannot rename " + tmpFile + " to " + file);
+    }
+}
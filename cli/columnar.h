@@ -0,0 +1,123 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       columnar.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   memory-mapped columnar data files of gbmtool
+//
+//------------------------------------------------------------------------------
+
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// A columnar file holds a table of cRows rows, column by column, so that
+// gbmtool can map it into memory and train on the columns in place.  All
+// numbers are in the byte order of the machine that wrote the file:
+//
+//   char    magic[8]        "GBMCOLS"
+//   int32   version         1
+//   int32   cColumns
+//   int64   cRows
+//   then for each column
+//     int32   type          0 = float64, 1 = int32, 2 = factor
+//     string  name
+//     int32   cLevels       0 unless a factor
+//     string  level[cLevels]
+//     int64   offValues     byte offset of the cRows values, a multiple of 8
+//     int64   offMissing    byte offset of the NA bitmap, 0 if none is NA
+//
+// where a string is an int32 length followed by its bytes.  A factor holds
+// the int32 codes 0, ..., cLevels-1 of its levels.  Bit (i % 8) of byte
+// (i / 8) of the NA bitmap is set when row i is NA; the value stored for an
+// NA row is NaN in a float64 column and ignored in the others.  Float64
+// columns are used where they lie in the file; the other types are
+// converted to doubles when read.
+
+class CColumnarFile
+{
+public:
+
+    enum Type
+    {
+        FLOAT64 = 0,
+        INT32 = 1,
+        FACTOR = 2
+    };
+
+    struct Column
+    {
+        Type type;
+        std::string name;
+        std::vector<std::string> vecLevels;
+        int64_t offValues;
+        int64_t offMissing;
+    };
+
+    CColumnarFile();
+    ~CColumnarFile();
+
+    // maps the file, throws GBM::failure if it cannot or the file is not
+    // a valid columnar file
+    void Open(const std::string &file);
+    void Close();
+
+    int64_t Rows() const { return cRows; }
+    int Columns() const { return int(vecColumns.size()); }
+    const Column &GetColumn(int iCol) const { return vecColumns[iCol]; }
+
+    // the index of the column called name, -1 if there is none
+    int Find(const std::string &name) const;
+
+    bool IsMissing(int iCol, int64_t iRow) const;
+    int64_t CountMissing(int iCol) const;
+
+    // The values of column iCol as doubles with NaN for NA, and factors as
+    // their codes.  For a float64 column this points into the mapped file,
+    // for the others into adBuffer, which is filled.
+    const double *Values(int iCol, std::vector<double> &adBuffer) const;
+
+    // the same with a buffer of cRows doubles owned by the caller, which is
+    // not touched for a float64 column
+    const double *Values(int iCol, double *adBuffer) const;
+
+    // true if s starts like a columnar file
+    static bool IsColumnar(const char *s, std::size_t cLength);
+
+private:
+
+    const unsigned char *Bytes(int64_t offset, int64_t cBytes) const;
+
+    void *pMapping;
+    std::size_t cMappedBytes;
+    int64_t cRows;
+    std::vector<Column> vecColumns;
+};
+
+
+// CColumnarWriter writes a columnar file from columns held in memory, as
+// "gbmtool import" does for a csv file.
+
+class CColumnarWriter
+{
+public:
+
+    struct Column
+    {
+        CColumnarFile::Type type;
+        std::string name;
+        std::vector<std::string> vecLevels;
+        std::vector<double> adValues;     // NaN for NA, codes of factors
+    };
+
+    static void Write(const std::string &file,
+                      const std::vector<Column> &vecColumns,
+                      int64_t cRows);
+};
+
+#endif // COLUMNAR_H
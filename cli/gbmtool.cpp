@@ -0,0 +1,964 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       gbmtool.cpp
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   command line trainer and scorer, built without R (see
+//              Makefile)
+//
+//  Usage:      gbmtool import DATA.csv DATA.gbc
+//              gbmtool train DATA.gbc MODEL --response NAME [options]
+//              gbmtool predict MODEL DATA.gbc [--n-trees N]
+//                      [--type link|response] [--out FILE]
+//              gbmtool inspect FILE
+//
+//              train fits a model on a columnar data file (columnar.h) the
+//              way gbm.fit() does, with the engine reading the float64
+//              columns where they are mapped.  With --scratch the order
+//              index, the predictors in its order, the weights and the
+//              scores are kept in a mapped scratch file (scratch.h) rather
+//              than in memory, for data larger than memory; the model is
+//              the same.  With --workers N, N processes train one model
+//              together, each on a data file with its shard of the rows,
+//              meeting at --address (socket.h); worker 0 writes the model.
+//              The model file (model.h) is
+//              loaded in R by gbm.load(), after which predict.gbm() and the
+//              other methods for gbm objects apply.  Run gbmtool without
+//              arguments for the options.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gbm.h"
+#include "columnar.h"
+#include "model.h"
+#include "scratch.h"
+#include "socket.h"
+
+namespace {
+
+  const double dNaN = std::numeric_limits<double>::quiet_NaN();
+
+  // the engine's messages and warnings go to stderr, the output of the
+  // commands to stdout
+  class CStderrLogger : public CLogger {
+  public:
+    void Message(const char *szMessage) {
+      fputs(szMessage, stderr);
+    }
+
+    void Warning(const char *szMessage) {
+      fprintf(stderr, "Warning: %s\n", szMessage);
+    }
+  };
+
+  CStderrLogger stderrLogger;
+
+  void Usage()
+  {
+    fprintf(stderr,
+            "usage: gbmtool import DATA.csv DATA.gbc\n"
+            "       gbmtool train DATA.gbc MODEL --response NAME [options]\n"
+            "       gbmtool predict MODEL DATA.gbc [--n-trees N]\n"
+            "               [--type link|response] [--out FILE]\n"
+            "       gbmtool inspect FILE\n"
+            "\n"
+            "options of train, with the defaults of gbm.fit():\n"
+            "  --distribution NAME   bernoulli, gaussian, poisson, gamma,\n"
+            "                        tweedie, adaboost, laplace, quantile,\n"
+            "                        tdist, huberized or multinomial\n"
+            "                        (bernoulli)\n"
+            "  --alpha A             quantile to estimate for quantile\n"
+            "  --power P             power of tweedie (1.5)\n"
+            "  --df DF               degrees of freedom of tdist (4)\n"
+            "  --x A,B,...           the predictors (all other columns)\n"
+            "  --weights NAME        column of weights\n"
+            "  --offset NAME         column of offsets\n"
+            "  --n-trees N           (100)\n"
+            "  --interaction-depth D (1)\n"
+            "  --n-minobsinnode N    (10)\n"
+            "  --shrinkage S         (0.001)\n"
+            "  --bag-fraction F      (0.5)\n"
+            "  --bag-type T          sequential, philox (rows drawn on\n"
+            "                        threads) or poisson (bootstrap\n"
+            "                        weights on threads) (sequential)\n"
+            "  --random-streams      draw the bag and the predictor order\n"
+            "                        from streams of their own\n"
+            "  --n-train N           training rows, the first N (all)\n"
+            "  --train-fraction F    the same as a fraction of the rows\n"
+            "  --m-features M        predictors tried at each split (all)\n"
+            "  --column-sampling S   draw them per tree, level or node\n"
+            "                        (level)\n"
+            "  --newton              Newton boosting\n"
+            "  --lambda L            its L2 penalty (0)\n"
+            "  --threads T           (the OpenMP default)\n"
+            "  --seed S              of the random number generator (1)\n"
+            "  --scratch FILE        train out of core, keeping the working\n"
+            "                        arrays in FILE, which must not exist\n"
+            "                        and is removed after\n"
+            "  --workers N           train on N shards of the rows, one per\n"
+            "                        process, with histogram splits\n"
+            "  --rank R              the shard of this process, 0 to N-1\n"
+            "  --address A           where the workers meet: a socket path\n"
+            "                        containing a /, or HOST:PORT\n"
+            "  --max-bins B          bins per predictor of the workers (256)\n"
+            "  --verbose             print the progress of the fit\n");
+    std::exit(2);
+  }
+
+  // the options of a command: --name value pairs, --flags and the rest
+  struct Arguments {
+    std::map<std::string, std::string> mapOptions;
+    std::set<std::string> setFlags;
+    std::vector<std::string> vecPositional;
+
+    bool Has(const std::string &name) const {
+      return mapOptions.count(name) > 0;
+    }
+
+    std::string Get(const std::string &name,
+                    const std::string &defaultValue) const {
+      std::map<std::string, std::string>::const_iterator it =
+        mapOptions.find(name);
+      return (it == mapOptions.end()) ? defaultValue : it->second;
+    }
+
+    double GetDouble(const std::string &name, double dDefault) const {
+      if(!Has(name)) return dDefault;
+      const std::string value = Get(name, "");
+      char *pEnd = 0;
+      const double dValue = std::strtod(value.c_str(), &pEnd);
+      if(value.empty() || (*pEnd != '\0'))
+        {
+          throw GBM::invalid_argument("--" + name + " needs a number");
+        }
+      return dValue;
+    }
+
+    int GetInt(const std::string &name, int iDefault) const {
+      const double dValue = GetDouble(name, iDefault);
+      if(dValue != std::floor(dValue))
+        {
+          throw GBM::invalid_argument("--" + name + " needs an integer");
+        }
+      return int(dValue);
+    }
+  };
+
+  Arguments ParseArguments(int argc, char **argv, int iFirst,
+                           const std::set<std::string> &setFlagNames)
+  {
+    Arguments args;
+    int iArg = 0;
+
+    for(iArg=iFirst; iArg<argc; iArg++)
+      {
+        const std::string arg = argv[iArg];
+        if((arg.size() > 2) && (arg.compare(0, 2, "--") == 0))
+          {
+            const std::string name = arg.substr(2);
+            if(setFlagNames.count(name))
+              {
+                args.setFlags.insert(name);
+              }
+            else
+              {
+                if(iArg+1 >= argc) Usage();
+                args.mapOptions[name] = argv[++iArg];
+              }
+          }
+        else
+          {
+            args.vecPositional.push_back(arg);
+          }
+      }
+    return args;
+  }
+
+  std::vector<std::string> SplitList(const std::string &s)
+  {
+    std::vector<std::string> vec;
+    std::string::size_type iStart = 0;
+
+    while(iStart <= s.size())
+      {
+        std::string::size_type iEnd = s.find(',', iStart);
+        if(iEnd == std::string::npos) iEnd = s.size();
+        if(iEnd > iStart) vec.push_back(s.substr(iStart, iEnd - iStart));
+        iStart = iEnd + 1;
+      }
+    return vec;
+  }
+
+  int FindColumn(const CColumnarFile &file, const std::string &name)
+  {
+    const int iCol = file.Find(name);
+    if(iCol < 0)
+      {
+        throw GBM::invalid_argument("the data has no column " + name);
+      }
+    return iCol;
+  }
+
+  // ----- import ------------------------------------------------------------
+
+  // splits a line of a csv file into its fields, with double quotes
+  // around fields that contain commas or quotes
+  void SplitCsvLine(const std::string &line, std::vector<std::string> &vec)
+  {
+    std::string field;
+    bool fQuoted = false;
+    std::size_t i = 0;
+
+    vec.clear();
+    for(i=0; i<line.size(); i++)
+      {
+        const char c = line[i];
+        if(fQuoted)
+          {
+            if((c == '"') && (i+1 < line.size()) && (line[i+1] == '"'))
+              {
+                field += '"';
+                i++;
+              }
+            else if(c == '"')
+              {
+                fQuoted = false;
+              }
+            else
+              {
+                field += c;
+              }
+          }
+        else if(c == '"')
+          {
+            fQuoted = true;
+          }
+        else if(c == ',')
+          {
+            vec.push_back(field);
+            field.clear();
+          }
+        else if(c != '\r')
+          {
+            field += c;
+          }
+      }
+    vec.push_back(field);
+  }
+
+  // A column of numbers becomes float64, any other a factor with its
+  // levels in sorted order.  Empty fields and NA are missing.
+  int Import(const Arguments &args)
+  {
+    std::vector<std::string> vecNames;
+    std::vector<std::vector<std::string> > vecvecFields;
+    std::vector<std::string> vecFields;
+    std::string line;
+    std::size_t iCol = 0;
+    std::size_t iRow = 0;
+
+    if(args.vecPositional.size() != 2) Usage();
+    std::ifstream in(args.vecPositional[0].c_str());
+    if(!in)
+      {
+        throw GBM::failure("cannot open " + args.vecPositional[0]);
+      }
+    if(!std::getline(in, line))
+      {
+        throw GBM::failure(args.vecPositional[0] + " is empty");
+      }
+    SplitCsvLine(line, vecNames);
+    vecvecFields.resize(vecNames.size());
+    while(std::getline(in, line))
+      {
+        if(line.empty() || (line == "\r")) continue;
+        SplitCsvLine(line, vecFields);
+        if(vecFields.size() != vecNames.size())
+          {
+            throw GBM::failure("line " + line + " has the wrong number of fields");
+          }
+        for(iCol=0; iCol<vecNames.size(); iCol++)
+          {
+            vecvecFields[iCol].push_back(vecFields[iCol]);
+          }
+      }
+
+    const std::size_t cRows = vecNames.empty() ? 0 : vecvecFields[0].size();
+    std::vector<CColumnarWriter::Column> vecColumns(vecNames.size());
+    for(iCol=0; iCol<vecNames.size(); iCol++)
+      {
+        const std::vector<std::string> &vecColumnFields = vecvecFields[iCol];
+        CColumnarWriter::Column &column = vecColumns[iCol];
+        bool fNumeric = true;
+
+        column.name = vecNames[iCol];
+        column.adValues.assign(cRows, dNaN);
+        for(iRow=0; iRow<cRows; iRow++)
+          {
+            const std::string &field = vecColumnFields[iRow];
+            if(field.empty() || (field == "NA")) continue;
+            char *pEnd = 0;
+            column.adValues[iRow] = std::strtod(field.c_str(), &pEnd);
+            if(*pEnd != '\0')
+              {
+                fNumeric = false;
+                break;
+              }
+          }
+
+        if(fNumeric)
+          {
+            column.type = CColumnarFile::FLOAT64;
+            continue;
+          }
+
+        std::set<std::string> setLevels;
+        for(iRow=0; iRow<cRows; iRow++)
+          {
+            const std::string &field = vecColumnFields[iRow];
+            if(!field.empty() && (field != "NA")) setLevels.insert(field);
+          }
+        column.type = CColumnarFile::FACTOR;
+        column.vecLevels.assign(setLevels.begin(), setLevels.end());
+        std::map<std::string, int> mapCodes;
+        for(std::size_t iLevel=0; iLevel<column.vecLevels.size(); iLevel++)
+          {
+            mapCodes[column.vecLevels[iLevel]] = int(iLevel);
+          }
+        for(iRow=0; iRow<cRows; iRow++)
+          {
+            const std::string &field = vecColumnFields[iRow];
+            column.adValues[iRow] = (field.empty() || (field == "NA")) ?
+              dNaN : double(mapCodes[field]);
+          }
+      }
+
+    CColumnarWriter::Write(args.vecPositional[1], vecColumns, cRows);
+    printf("wrote %lu rows and %lu columns to %s\n",
+           (unsigned long)cRows, (unsigned long)vecColumns.size(),
+           args.vecPositional[1].c_str());
+    return 0;
+  }
+
+  // ----- train -------------------------------------------------------------
+
+  // the deciles of the training rows of a continuous predictor, which
+  // gbm.fit() keeps in var.levels, from its presorted index
+  std::vector<double> Deciles(const double *adX, const int *aiOrder,
+                              int cTrain)
+  {
+    std::vector<double> adDeciles;
+    int iFirst = 0;
+
+    // missing values come first in the index
+    while((iFirst < cTrain) && is_missing(adX[aiOrder[iFirst]])) iFirst++;
+    const int cValues = cTrain - iFirst;
+    if(cValues == 0)
+      {
+        return std::vector<double>(11, dNaN);
+      }
+    for(int iDecile=0; iDecile<=10; iDecile++)
+      {
+        // type 7 quantiles, as quantile() in R
+        const double dH = (cValues - 1)*iDecile/10.0;
+        const int iLow = int(std::floor(dH));
+        const int iHigh = std::min(iLow + 1, cValues - 1);
+        const double dLow = adX[aiOrder[iFirst + iLow]];
+        const double dHigh = adX[aiOrder[iFirst + iHigh]];
+        adDeciles.push_back(dLow + (dH - iLow)*(dHigh - dLow));
+      }
+    return adDeciles;
+  }
+
+  void CheckResponse(const std::string &distribution, const double *adY,
+                     int cRows)
+  {
+    for(int iRow=0; iRow<cRows; iRow++)
+      {
+        const double dY = adY[iRow];
+        if(is_missing(dY))
+          {
+            throw GBM::invalid_argument("the response has missing values");
+          }
+        if(((distribution == "bernoulli") || (distribution == "huberized") ||
+            (distribution == "adaboost")) && (dY != 0.0) && (dY != 1.0))
+          {
+            throw GBM::invalid_argument(distribution + " requires the response to be in {0,1}");
+          }
+        if(((distribution == "poisson") || (distribution == "gamma") ||
+            (distribution == "tweedie")) && (dY < 0.0))
+          {
+            throw GBM::invalid_argument(distribution + " requires the response to be positive");
+          }
+        if((distribution == "poisson") && (dY != std::floor(dY)))
+          {
+            throw GBM::invalid_argument("poisson requires the response to be a positive integer");
+          }
+      }
+  }
+
+  int Train(const Arguments &args)
+  {
+    CColumnarFile file;
+    CScratchFile scratch;
+    CSocketAllreduce allreduce;
+    CModel model;
+    std::size_t i = 0;
+    int iT = 0;
+
+    if((args.vecPositional.size() != 2) || !args.Has("response")) Usage();
+    file.Open(args.vecPositional[0]);
+    const int cRows = int(file.Rows());
+    const std::string distribution = args.Get("distribution", "bernoulli");
+
+    // the response, weights, offset and predictors
+    const int iResponse = FindColumn(file, args.Get("response", ""));
+    const int iWeights = args.Has("weights") ?
+      FindColumn(file, args.Get("weights", "")) : -1;
+    const int iOffset = args.Has("offset") ?
+      FindColumn(file, args.Get("offset", "")) : -1;
+    std::vector<int> aiPredictors;
+    if(args.Has("x"))
+      {
+        const std::vector<std::string> vecNames = SplitList(args.Get("x", ""));
+        for(i=0; i<vecNames.size(); i++)
+          {
+            aiPredictors.push_back(FindColumn(file, vecNames[i]));
+          }
+      }
+    else
+      {
+        for(int iCol=0; iCol<file.Columns(); iCol++)
+          {
+            if((iCol != iResponse) && (iCol != iWeights) && (iCol != iOffset))
+              {
+                aiPredictors.push_back(iCol);
+              }
+          }
+      }
+    const int cCols = int(aiPredictors.size());
+    if(cCols == 0)
+      {
+        throw GBM::invalid_argument("there are no predictors");
+      }
+
+    // the settings, checked as gbm.fit() does
+    const int cTrees = args.GetInt("n-trees", 100);
+    const int cDepth = args.GetInt("interaction-depth", 1);
+    const int cMinObsInNode = args.GetInt("n-minobsinnode", 10);
+    const double dShrinkage = args.GetDouble("shrinkage", 0.001);
+    const double dBagFraction = args.GetDouble("bag-fraction", 0.5);
+    const int cFeatures = args.GetInt("m-features", cCols);
+    const int cThreads = args.GetInt("threads", 0);
+    const bool fNewton = args.setFlags.count("newton") > 0;
+    const double dL2Penalty = args.GetDouble("lambda", 0.0);
+    const bool fDistributed = args.Has("workers");
+    const int cWorkers = args.GetInt("workers", 1);
+    const int iRank = args.GetInt("rank", 0);
+    const bool fVerbose = (args.setFlags.count("verbose") > 0) && (iRank == 0);
+    if(fDistributed && (cWorkers > 1) && !args.Has("address"))
+      {
+        throw GBM::invalid_argument("--workers needs --address");
+      }
+    if(args.Has("n-train") && args.Has("train-fraction"))
+      {
+        throw GBM::invalid_argument("--n-train and --train-fraction cannot both be given");
+      }
+    const int cTrain = args.Has("n-train") ? args.GetInt("n-train", cRows) :
+      int(std::floor(args.GetDouble("train-fraction", 1.0)*cRows));
+    if((cTrain < 1) || (cTrain > cRows))
+      {
+        throw GBM::invalid_argument("the number of training rows must be between 1 and the number of rows");
+      }
+    if(cTrain*dBagFraction <= 2*cMinObsInNode+1)
+      {
+        throw GBM::invalid_argument("The dataset size is too small or subsampling rate is too large: nTrain*bag.fraction <= n.minobsinnode");
+      }
+    if((cTrees < 1) || (cDepth < 1) || (cFeatures < 1) || (cFeatures > cCols))
+      {
+        throw GBM::invalid_argument("n.trees, interaction.depth and m.features must be positive, and m.features at most the number of predictors");
+      }
+
+    model.distribution = distribution;
+    std::vector<double> adMisc;
+    const CColumnarFile::Column &response = file.GetColumn(iResponse);
+    std::vector<double> adYBuffer;
+    const double *adY = file.Values(iResponse, adYBuffer);
+    if(distribution == "multinomial")
+      {
+        if(response.type != CColumnarFile::FACTOR)
+          {
+            throw GBM::invalid_argument("multinomial requires a factor response");
+          }
+        model.cClasses = int(response.vecLevels.size());
+        model.vecClasses = response.vecLevels;
+        if(model.cClasses < 2)
+          {
+            throw GBM::invalid_argument("Multinomial requires a response with at least two classes");
+          }
+        if(iOffset >= 0)
+          {
+            throw GBM::invalid_argument("Offsets are not supported for the multinomial distribution");
+          }
+        adMisc.assign(1, model.cClasses);
+      }
+    else if(response.type == CColumnarFile::FACTOR)
+      {
+        throw GBM::invalid_argument("the response is a factor, which only multinomial accepts");
+      }
+    else if(distribution == "tweedie")
+      {
+        model.vecParamNames.push_back("power");
+        model.adParams.push_back(args.GetDouble("power", 1.5));
+        adMisc = model.adParams;
+      }
+    else if(distribution == "quantile")
+      {
+        if(!args.Has("alpha"))
+          {
+            throw GBM::invalid_argument("quantile needs --alpha");
+          }
+        model.vecParamNames.push_back("alpha");
+        model.adParams.push_back(args.GetDouble("alpha", 0.5));
+        if((model.adParams[0] < 0.0) || (model.adParams[0] > 1.0))
+          {
+            throw GBM::invalid_argument("alpha must be between 0 and 1.");
+          }
+        adMisc = model.adParams;
+      }
+    else if(distribution == "tdist")
+      {
+        model.vecParamNames.push_back("df");
+        model.adParams.push_back(args.GetDouble("df", 4));
+        adMisc = model.adParams;
+      }
+    else if((distribution != "bernoulli") && (distribution != "gaussian") &&
+            (distribution != "poisson") && (distribution != "gamma") &&
+            (distribution != "adaboost") && (distribution != "laplace") &&
+            (distribution != "huberized"))
+      {
+        throw GBM::invalid_argument("gbmtool does not support distribution " + distribution);
+      }
+    CheckResponse(distribution, adY, cRows);
+
+    // the workers meet before they need each other for the weights
+    if(fDistributed)
+      {
+        allreduce.Connect(args.Get("address", ""), cWorkers, iRank);
+      }
+
+    // out of core, the arrays with a value per row or per training row and
+    // predictor go into the scratch file; only the float64 predictors need
+    // no copy
+    const bool fScratch = args.Has("scratch");
+    std::vector<double> adWBuffer;
+    std::vector<double> adFBuffer;
+    std::vector<int> aiXOrderBuffer;
+    double *adW = 0;
+    double *adF = 0;
+    int *aiXOrder = 0;
+    double *adXSorted = 0;
+    const std::size_t cOrder = std::size_t(cTrain)*cCols;
+    const std::size_t cScores = std::size_t(cRows)*model.cClasses;
+    if(fScratch)
+      {
+        std::size_t cConverted = 0;
+        for(i=0; i<std::size_t(cCols); i++)
+          {
+            if(file.GetColumn(aiPredictors[i]).type != CColumnarFile::FLOAT64)
+              {
+                cConverted++;
+              }
+          }
+        scratch.Create(args.Get("scratch", ""),
+                       CScratchFile::Bytes<double>(cRows) +
+                       CScratchFile::Bytes<double>(cScores) +
+                       CScratchFile::Bytes<int>(cOrder) +
+                       CScratchFile::Bytes<double>(cOrder) +
+                       cConverted*CScratchFile::Bytes<double>(cRows));
+        adW = scratch.Take<double>(cRows);
+        adF = scratch.Take<double>(cScores);
+        aiXOrder = scratch.Take<int>(cOrder);
+        adXSorted = scratch.Take<double>(cOrder);
+      }
+    else
+      {
+        adWBuffer.resize(cRows);
+        adFBuffer.resize(cScores);
+        aiXOrderBuffer.resize(cOrder);
+        adW = &adWBuffer[0];
+        adF = &adFBuffer[0];
+        aiXOrder = &aiXOrderBuffer[0];
+      }
+
+    // weights normalized to sum to the number of rows, as in gbm.fit(),
+    // of all workers
+    std::fill(adW, adW + cRows, 1.0);
+    if(iWeights >= 0)
+      {
+        std::vector<double> adBuffer;
+        const double *adColumn = file.Values(iWeights, adBuffer);
+        double adSums[2] = {0.0, double(cRows)};
+        for(iT=0; iT<cRows; iT++)
+          {
+            if(is_missing(adColumn[iT]) || (adColumn[iT] < 0.0))
+              {
+                throw GBM::invalid_argument("the weights must be non-negative and not missing");
+              }
+            adSums[0] += adColumn[iT];
+          }
+        allreduce.Sum(adSums, 2);
+        for(iT=0; iT<cRows; iT++) adW[iT] = adColumn[iT]*adSums[1]/adSums[0];
+      }
+    std::vector<double> adOffsetBuffer;
+    const double *adOffset = (iOffset >= 0) ?
+      file.Values(iOffset, adOffsetBuffer) : 0;
+
+    // the predictors: float64 columns are used in place, the others are
+    // converted one column at a time
+    std::vector<const double*> vecpXColumns(cCols);
+    std::vector<std::vector<double> > vecadConverted(cCols);
+    std::vector<int> acVarClasses(cCols, 0);
+    std::vector<int> alMonotoneVar(cCols, 0);
+    for(i=0; i<std::size_t(cCols); i++)
+      {
+        const CColumnarFile::Column &column = file.GetColumn(aiPredictors[i]);
+        if(fScratch && (column.type != CColumnarFile::FLOAT64))
+          {
+            vecpXColumns[i] = file.Values(aiPredictors[i],
+                                          scratch.Take<double>(cRows));
+          }
+        else
+          {
+            vecpXColumns[i] = file.Values(aiPredictors[i], vecadConverted[i]);
+          }
+        if(column.type == CColumnarFile::FACTOR)
+          {
+            acVarClasses[i] = int(column.vecLevels.size());
+          }
+        model.vecVarNames.push_back(column.name);
+      }
+
+    // the factor codes of the shards have to mean the same levels, which
+    // are in sorted order, so they need the same number of them
+    if(fDistributed)
+      {
+        std::vector<double> adClasses(acVarClasses.begin(), acVarClasses.end());
+        Broadcast(allreduce, &adClasses[0], cCols);
+        for(i=0; i<std::size_t(cCols); i++)
+          {
+            if(adClasses[i] != acVarClasses[i])
+              {
+                throw GBM::invalid_argument("the levels of " + model.vecVarNames[i] + " differ from those of worker 0");
+              }
+          }
+      }
+
+    PresortColumns(&vecpXColumns[0], cRows, cCols, cTrain, aiXOrder,
+                   cThreads);
+
+    CDataset data(adY, adOffset, &vecpXColumns[0], aiXOrder,
+                  adW, adMisc.empty() ? 0 : &adMisc[0],
+                  &acVarClasses[0], &alMonotoneVar[0], cRows, cCols);
+
+    // out of core the split search reads the predictors in the order of
+    // the index, from the scratch file, one column ahead
+    CScratchPager pager(aiXOrder, adXSorted, cTrain);
+    if(fScratch)
+      {
+        SortedValues(&vecpXColumns[0], cCols, cTrain, aiXOrder, adXSorted,
+                     cThreads);
+        data.SetSortedValues(adXSorted);
+        data.SetPager(&pager);
+      }
+
+    // the loop of gbm() in gbmentry.cpp, with the scores where they were
+    // allocated above
+    CFitSettings settings;
+    settings.family = distribution;
+    settings.cTrees = cTrees;
+    settings.cDepth = cDepth;
+    settings.cMinObsInNode = cMinObsInNode;
+    settings.cFeatures = cFeatures;
+    settings.dShrinkage = dShrinkage;
+    settings.dBagFraction = dBagFraction;
+    settings.fFusedUpdate = true;
+    settings.fVectorMath = true;
+    settings.fNewton = fNewton;
+    settings.dL2Penalty = dL2Penalty;
+    settings.cPairBudget = 0;
+    settings.cPatience = 0;
+    settings.fStopOnValid = false;
+    settings.cValidEvery = 1;
+    settings.bagging = CGBM::BaggingNamed(args.Get("bag-type", "sequential"));
+    settings.fStreams = args.setFlags.count("random-streams") > 0;
+    settings.columnSampling =
+      CColumnSampler::Named(args.Get("column-sampling", "level"));
+
+    CSeededRandom random(args.GetInt("seed", 1) + iRank);
+    CFitOptions options;
+    options.pRandom = &random;
+    options.cThreads = cThreads;
+    if(fDistributed)
+      {
+        options.pAllreduce = &allreduce;
+        options.cMaxBins = args.GetInt("max-bins", 256);
+      }
+    options.adF = adF;
+    options.fVerbose = fVerbose;
+    CFitResult fit;
+    gbm_fit(data, cTrain, settings, options, fit);
+    model.dInitF = fit.dInitF;
+    model.adTrainError.swap(fit.adTrainError);
+    model.adValidError.swap(fit.adValidError);
+    model.adOOBagImprove.swap(fit.adOOBagImprove);
+    model.vecTrees.swap(fit.vecTrees);
+    model.vecSplitCodes.swap(fit.vecSplitCodes);
+
+    model.cTrees = cTrees;
+    model.cDepth = cDepth;
+    model.cMinObsInNode = cMinObsInNode;
+    // the rows of all workers; the deciles are those of worker 0
+    double adRows[2] = {double(cTrain), double(cRows)};
+    allreduce.Sum(adRows, 2);
+    model.cTrain = int(adRows[0]);
+    model.cFeatures = cFeatures;
+    model.dShrinkage = dShrinkage;
+    model.dBagFraction = dBagFraction;
+    model.dTrainFraction = adRows[0]/adRows[1];
+    model.responseName = response.name;
+    model.aiVarType = acVarClasses;
+    model.aiVarMonotone = alMonotoneVar;
+    model.vecadVarDeciles.resize(cCols);
+    model.vecVarLevels.resize(cCols);
+    for(i=0; i<std::size_t(cCols); i++)
+      {
+        if(acVarClasses[i] == 0)
+          {
+            model.vecadVarDeciles[i] =
+              Deciles(vecpXColumns[i], &aiXOrder[i*std::size_t(cTrain)], cTrain);
+          }
+        else
+          {
+            model.vecVarLevels[i] = file.GetColumn(aiPredictors[i]).vecLevels;
+          }
+      }
+
+    if(iRank != 0)
+      {
+        fprintf(stderr, "worker %d of %d finished\n", iRank, cWorkers);
+        return 0;
+      }
+    model.Write(args.vecPositional[1]);
+    fprintf(stderr, "wrote a %s model with %d trees to %s\n",
+            distribution.c_str(), cTrees, args.vecPositional[1].c_str());
+    return 0;
+  }
+
+  // ----- predict -----------------------------------------------------------
+
+  int Predict(const Arguments &args)
+  {
+    CModel model;
+    CColumnarFile file;
+    std::size_t iVar = 0;
+    int iRow = 0;
+    int iClass = 0;
+
+    if(args.vecPositional.size() != 2) Usage();
+    model.Read(args.vecPositional[0]);
+    file.Open(args.vecPositional[1]);
+    const int cRows = int(file.Rows());
+    const int cTrees = args.GetInt("n-trees", model.cTrees);
+    const std::string type = args.Get("type", "link");
+    if((type != "link") && (type != "response"))
+      {
+        throw GBM::invalid_argument("type must be either 'link' or 'response'");
+      }
+
+    // the predictors by name; the levels of factors are recoded to those
+    // of the model, and levels it has not seen go down the missing branch
+    std::vector<const double*> vecpXColumns(model.vecVarNames.size());
+    std::vector<std::vector<double> > vecadColumns(model.vecVarNames.size());
+    for(iVar=0; iVar<model.vecVarNames.size(); iVar++)
+      {
+        const int iCol = FindColumn(file, model.vecVarNames[iVar]);
+        const CColumnarFile::Column &column = file.GetColumn(iCol);
+        vecpXColumns[iVar] = file.Values(iCol, vecadColumns[iVar]);
+        if((column.type == CColumnarFile::FACTOR) &&
+           (model.aiVarType[iVar] > 0) &&
+           (column.vecLevels != model.vecVarLevels[iVar]))
+          {
+            const std::vector<std::string> &vecModelLevels =
+              model.vecVarLevels[iVar];
+            std::vector<double> adCode(column.vecLevels.size(), dNaN);
+            for(std::size_t iLevel=0; iLevel<column.vecLevels.size(); iLevel++)
+              {
+                const std::vector<std::string>::const_iterator it =
+                  std::find(vecModelLevels.begin(), vecModelLevels.end(),
+                            column.vecLevels[iLevel]);
+                if(it != vecModelLevels.end())
+                  {
+                    adCode[iLevel] = double(it - vecModelLevels.begin());
+                  }
+              }
+            std::vector<double> &adRecoded = vecadColumns[iVar];
+            adRecoded.assign(vecpXColumns[iVar], vecpXColumns[iVar] + cRows);
+            for(iRow=0; iRow<cRows; iRow++)
+              {
+                if(!is_missing(adRecoded[iRow]))
+                  {
+                    adRecoded[iRow] = adCode[int(adRecoded[iRow])];
+                  }
+              }
+            vecpXColumns[iVar] = cRows > 0 ? &adRecoded[0] : 0;
+          }
+      }
+
+    std::vector<double> adPred;
+    model.Predict(vecpXColumns.empty() ? 0 : &vecpXColumns[0], cRows,
+                  cTrees, type == "link", adPred);
+
+    FILE *out = stdout;
+    if(args.Has("out"))
+      {
+        out = fopen(args.Get("out", "").c_str(), "w");
+        if(!out)
+          {
+            throw GBM::failure("cannot open " + args.Get("out", ""));
+          }
+      }
+    if(model.cClasses > 1)
+      {
+        for(iClass=0; iClass<model.cClasses; iClass++)
+          {
+            fprintf(out, "%s%s", iClass > 0 ? "\t" : "",
+                    model.vecClasses[iClass].c_str());
+          }
+        fprintf(out, "\n");
+      }
+    for(iRow=0; iRow<cRows; iRow++)
+      {
+        for(iClass=0; iClass<model.cClasses; iClass++)
+          {
+            fprintf(out, "%s%.15g", iClass > 0 ? "\t" : "",
+                    adPred[std::size_t(iClass)*cRows + iRow]);
+          }
+        fprintf(out, "\n");
+      }
+    if(out != stdout)
+      {
+        fclose(out);
+      }
+    return 0;
+  }
+
+  // ----- inspect -----------------------------------------------------------
+
+  int Inspect(const Arguments &args)
+  {
+    char szMagic[8] = {0};
+
+    if(args.vecPositional.size() != 1) Usage();
+    const std::string name = args.vecPositional[0];
+    {
+      std::ifstream in(name.c_str(), std::ios::binary);
+      if(!in)
+        {
+          throw GBM::failure("cannot open " + name);
+        }
+      in.read(szMagic, sizeof(szMagic));
+    }
+
+    if(CColumnarFile::IsColumnar(szMagic, sizeof(szMagic)))
+      {
+        const char *aszTypes[] = {"float64", "int32", "factor"};
+        CColumnarFile file;
+        file.Open(name);
+        printf("columnar data: %lld rows, %d columns\n",
+               (long long)file.Rows(), file.Columns());
+        printf("column\ttype\tlevels\tmissing\n");
+        for(int iCol=0; iCol<file.Columns(); iCol++)
+          {
+            const CColumnarFile::Column &column = file.GetColumn(iCol);
+            printf("%s\t%s\t%lu\t%lld\n", column.name.c_str(),
+                   aszTypes[column.type],
+                   (unsigned long)column.vecLevels.size(),
+                   (long long)file.CountMissing(iCol));
+          }
+      }
+    else if(CModel::IsModel(szMagic, sizeof(szMagic)))
+      {
+        CModel model;
+        model.Read(name);
+        printf("gbm model: %s", model.distribution.c_str());
+        for(std::size_t i=0; i<model.adParams.size(); i++)
+          {
+            printf(" %s=%g", model.vecParamNames[i].c_str(), model.adParams[i]);
+          }
+        printf(", %d trees of depth %d, shrinkage %g, %d classes\n",
+               model.cTrees, model.cDepth, model.dShrinkage, model.cClasses);
+        printf("response %s, %d training rows, initF %g\n",
+               model.responseName.c_str(), model.cTrain, model.dInitF);
+        if(!model.adTrainError.empty())
+          {
+            printf("train deviance %g, valid deviance %g at the last tree\n",
+                   model.adTrainError.back(), model.adValidError.back());
+          }
+        printf("variable\ttype\n");
+        for(std::size_t i=0; i<model.vecVarNames.size(); i++)
+          {
+            printf("%s\t%d\n", model.vecVarNames[i].c_str(), model.aiVarType[i]);
+          }
+      }
+    else
+      {
+        throw GBM::failure(name + " is neither a columnar data file nor a model");
+      }
+    return 0;
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  std::set<std::string> setFlagNames;
+
+  if(argc < 2) Usage();
+  setFlagNames.insert("newton");
+  setFlagNames.insert("random-streams");
+  setFlagNames.insert("verbose");
+  SetLogger(&stderrLogger);
+
+  const std::string command = argv[1];
+  try
+    {
+      const Arguments args = ParseArguments(argc, argv, 2, setFlagNames);
+      if(command == "import") return Import(args);
+      if(command == "train") return Train(args);
+      if(command == "predict") return Predict(args);
+      if(command == "inspect") return Inspect(args);
+      Usage();
+    }
+  catch(const std::exception &e)
+    {
+      fprintf(stderr, "gbmtool %s: %s\n", command.c_str(), e.what());
+      return 1;
+    }
+  return 0;
+}
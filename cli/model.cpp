@@ -0,0 +1,430 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       model.cpp
+//
+//------------------------------------------------------------------------------
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+#include "model.h"
+#include "dataset.h"
+
+namespace {
+
+  const char szMagic[8] = {'G','B','M','M','O','D','E','L'};
+  const int32_t iVersion = 1;
+
+  template <typename T>
+  void WriteValue(std::ofstream &out, const T &value)
+  {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  void WriteVector(std::ofstream &out, const std::vector<T> &vec)
+  {
+    WriteValue(out, int32_t(vec.size()));
+    if(!vec.empty())
+      {
+        out.write(reinterpret_cast<const char*>(&vec[0]),
+                  vec.size()*sizeof(T));
+      }
+  }
+
+  void WriteString(std::ofstream &out, const std::string &s)
+  {
+    WriteValue(out, int32_t(s.size()));
+    out.write(s.data(), s.size());
+  }
+
+  void WriteStrings(std::ofstream &out, const std::vector<std::string> &vec)
+  {
+    WriteValue(out, int32_t(vec.size()));
+    for(std::size_t i=0; i<vec.size(); i++)
+      {
+        WriteString(out, vec[i]);
+      }
+  }
+
+  template <typename T>
+  void ReadValue(std::ifstream &in, T &value)
+  {
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    if(!in)
+      {
+        throw GBM::failure("the model file is truncated");
+      }
+  }
+
+  int32_t ReadLength(std::ifstream &in)
+  {
+    int32_t cLength = 0;
+    ReadValue(in, cLength);
+    if(cLength < 0)
+      {
+        throw GBM::failure("the model file is corrupt");
+      }
+    return cLength;
+  }
+
+  template <typename T>
+  void ReadVector(std::ifstream &in, std::vector<T> &vec)
+  {
+    vec.resize(ReadLength(in));
+    if(!vec.empty())
+      {
+        in.read(reinterpret_cast<char*>(&vec[0]), vec.size()*sizeof(T));
+        if(!in)
+          {
+            throw GBM::failure("the model file is truncated");
+          }
+      }
+  }
+
+  void ReadString(std::ifstream &in, std::string &s)
+  {
+    std::vector<char> vec(ReadLength(in));
+    if(!vec.empty())
+      {
+        in.read(&vec[0], vec.size());
+        if(!in)
+          {
+            throw GBM::failure("the model file is truncated");
+          }
+      }
+    s.assign(vec.begin(), vec.end());
+  }
+
+  void ReadStrings(std::ifstream &in, std::vector<std::string> &vec)
+  {
+    vec.resize(ReadLength(in));
+    for(std::size_t i=0; i<vec.size(); i++)
+      {
+        ReadString(in, vec[i]);
+      }
+  }
+}
+
+
+CModel::CModel()
+{
+  cClasses = 1;
+  cTrees = 0;
+  cDepth = 0;
+  cMinObsInNode = 0;
+  cTrain = 0;
+  cFeatures = 0;
+  dShrinkage = 0.0;
+  dBagFraction = 0.0;
+  dTrainFraction = 0.0;
+  dInitF = 0.0;
+}
+
+
+void CModel::Write
+(
+    const std::string &file
+) const
+{
+  std::size_t i = 0;
+  const std::string tmpFile = file + ".tmp";
+
+  {
+    std::ofstream out(tmpFile.c_str(), std::ios::binary | std::ios::trunc);
+    if(!out)
+      {
+        throw GBM::failure("cannot open " + tmpFile);
+      }
+
+    out.write(szMagic, sizeof(szMagic));
+    WriteValue(out, iVersion);
+
+    WriteString(out, distribution);
+    WriteStrings(out, vecParamNames);
+    WriteVector(out, adParams);
+    WriteValue(out, int32_t(cClasses));
+    WriteStrings(out, vecClasses);
+    WriteValue(out, int32_t(cTrees));
+    WriteValue(out, int32_t(cDepth));
+    WriteValue(out, int32_t(cMinObsInNode));
+    WriteValue(out, int32_t(cTrain));
+    WriteValue(out, int32_t(cFeatures));
+    WriteValue(out, dShrinkage);
+    WriteValue(out, dBagFraction);
+    WriteValue(out, dTrainFraction);
+    WriteValue(out, dInitF);
+    WriteString(out, responseName);
+
+    WriteStrings(out, vecVarNames);
+    WriteVector(out, aiVarType);
+    WriteVector(out, aiVarMonotone);
+    for(i=0; i<vecVarNames.size(); i++)
+      {
+        if(aiVarType[i] == 0)
+          {
+            WriteVector(out, vecadVarDeciles[i]);
+          }
+        else
+          {
+            WriteStrings(out, vecVarLevels[i]);
+          }
+      }
+
+    WriteVector(out, adTrainError);
+    WriteVector(out, adValidError);
+    WriteVector(out, adOOBagImprove);
+
+    WriteValue(out, int32_t(vecTrees.size()));
+    for(i=0; i<vecTrees.size(); i++)
+      {
+        const CCheckpointTree &tree = vecTrees[i];
+        WriteVector(out, tree.aiSplitVar);
+        WriteVector(out, tree.adSplitPoint);
+        WriteVector(out, tree.aiLeftNode);
+        WriteVector(out, tree.aiRightNode);
+        WriteVector(out, tree.aiMissingNode);
+        WriteVector(out, tree.adErrorReduction);
+        WriteVector(out, tree.adWeight);
+        WriteVector(out, tree.adPred);
+      }
+    WriteValue(out, int32_t(vecSplitCodes.size()));
+    for(i=0; i<vecSplitCodes.size(); i++)
+      {
+        WriteVector(out, vecSplitCodes[i]);
+      }
+
+    out.close();
+    if(!out)
+      {
+        throw GBM::failure("cannot write " + tmpFile);
+      }
+  }
+
+  if(std::rename(tmpFile.c_str(), file.c_str()) != 0)
+    {
+      throw GBM::failure("cannot rename " + tmpFile + " to " + file);
+    }
+}
+
+
+void CModel::Read
+(
+    const std::string &file
+)
+{
+  std::size_t i = 0;
+  char szFileMagic[sizeof(szMagic)];
+  int32_t iFileVersion = 0;
+  int32_t iValue = 0;
+
+  std::ifstream in(file.c_str(), std::ios::binary);
+  if(!in)
+    {
+      throw GBM::failure("cannot open model file " + file);
+    }
+
+  in.read(szFileMagic, sizeof(szFileMagic));
+  if(!in || !IsModel(szFileMagic, sizeof(szFileMagic)))
+    {
+      throw GBM::failure(file + " is not a gbm model file");
+    }
+  ReadValue(in, iFileVersion);
+  if(iFileVersion != iVersion)
+    {
+      throw GBM::failure("unsupported model file version");
+    }
+
+  ReadString(in, distribution);
+  ReadStrings(in, vecParamNames);
+  ReadVector(in, adParams);
+  ReadValue(in, iValue); cClasses = iValue;
+  ReadStrings(in, vecClasses);
+  ReadValue(in, iValue); cTrees = iValue;
+  ReadValue(in, iValue); cDepth = iValue;
+  ReadValue(in, iValue); cMinObsInNode = iValue;
+  ReadValue(in, iValue); cTrain = iValue;
+  ReadValue(in, iValue); cFeatures = iValue;
+  ReadValue(in, dShrinkage);
+  ReadValue(in, dBagFraction);
+  ReadValue(in, dTrainFraction);
+  ReadValue(in, dInitF);
+  ReadString(in, responseName);
+
+  ReadStrings(in, vecVarNames);
+  ReadVector(in, aiVarType);
+  ReadVector(in, aiVarMonotone);
+  if((aiVarType.size() != vecVarNames.size()) ||
+     (aiVarMonotone.size() != vecVarNames.size()) ||
+     (adParams.size() != vecParamNames.size()) || (cClasses < 1))
+    {
+      throw GBM::failure("the model file is corrupt");
+    }
+  vecadVarDeciles.assign(vecVarNames.size(), std::vector<double>());
+  vecVarLevels.assign(vecVarNames.size(), std::vector<std::string>());
+  for(i=0; i<vecVarNames.size(); i++)
+    {
+      if(aiVarType[i] == 0)
+        {
+          ReadVector(in, vecadVarDeciles[i]);
+        }
+      else
+        {
+          ReadStrings(in, vecVarLevels[i]);
+        }
+    }
+
+  ReadVector(in, adTrainError);
+  ReadVector(in, adValidError);
+  ReadVector(in, adOOBagImprove);
+
+  vecTrees.resize(ReadLength(in));
+  for(i=0; i<vecTrees.size(); i++)
+    {
+      CCheckpointTree &tree = vecTrees[i];
+      ReadVector(in, tree.aiSplitVar);
+      ReadVector(in, tree.adSplitPoint);
+      ReadVector(in, tree.aiLeftNode);
+      ReadVector(in, tree.aiRightNode);
+      ReadVector(in, tree.aiMissingNode);
+      ReadVector(in, tree.adErrorReduction);
+      ReadVector(in, tree.adWeight);
+      ReadVector(in, tree.adPred);
+    }
+  vecSplitCodes.resize(ReadLength(in));
+  for(i=0; i<vecSplitCodes.size(); i++)
+    {
+      ReadVector(in, vecSplitCodes[i]);
+    }
+
+  if(vecTrees.size() != std::size_t(cTrees)*cClasses)
+    {
+      throw GBM::failure("the model file is corrupt");
+    }
+}
+
+
+void CModel::Predict
+(
+    const double *const *apdXColumns,
+    int cRows,
+    int cTreesUsed,
+    bool fLink,
+    std::vector<double> &adPred
+) const
+{
+  int iTree = 0;
+  int iClass = 0;
+  int iObs = 0;
+
+  if((cTreesUsed < 0) || (cTreesUsed > cTrees))
+    {
+      throw GBM::invalid_argument("the model has fewer trees than requested");
+    }
+
+  adPred.assign(std::size_t(cRows)*cClasses, dInitF);
+  for(iTree=0; iTree<cTreesUsed; iTree++)
+    {
+      for(iClass=0; iClass<cClasses; iClass++)
+        {
+          const CCheckpointTree &tree = vecTrees[iTree*cClasses + iClass];
+          double *adClassPred = &adPred[std::size_t(iClass)*cRows];
+
+          // the same walk as gbm_pred() in gbmentry.cpp
+#pragma omp parallel for schedule(static)
+          for(iObs=0; iObs<cRows; iObs++)
+            {
+              int iCurrentNode = 0;
+              while(tree.aiSplitVar[iCurrentNode] != -1)
+                {
+                  const int iVar = tree.aiSplitVar[iCurrentNode];
+                  const double dX = apdXColumns[iVar][iObs];
+                  const double dSplit = tree.adSplitPoint[iCurrentNode];
+
+                  if(is_missing(dX))
+                    {
+                      iCurrentNode = tree.aiMissingNode[iCurrentNode];
+                    }
+                  else if(aiVarType[iVar] == 0)
+                    {
+                      iCurrentNode = (dX < dSplit) ?
+                        tree.aiLeftNode[iCurrentNode] :
+                        tree.aiRightNode[iCurrentNode];
+                    }
+                  else
+                    {
+                      const VEC_CATEGORIES &splits = vecSplitCodes[int(dSplit)];
+                      const int iIndicator = (int(splits.size()) < int(dX) + 1) ?
+                        0 : splits[int(dX)];
+                      if(iIndicator == -1)
+                        {
+                          iCurrentNode = tree.aiLeftNode[iCurrentNode];
+                        }
+                      else if(iIndicator == 1)
+                        {
+                          iCurrentNode = tree.aiRightNode[iCurrentNode];
+                        }
+                      else
+                        {
+                          iCurrentNode = tree.aiMissingNode[iCurrentNode];
+                        }
+                    }
+                }
+              adClassPred[iObs] += tree.adSplitPoint[iCurrentNode];
+            }
+        }
+    }
+
+  if(fLink) return;
+
+  // the response scale of predict.gbm()
+  if(cClasses > 1)
+    {
+      for(iObs=0; iObs<cRows; iObs++)
+        {
+          double dMax = adPred[iObs];
+          double dSum = 0.0;
+          for(iClass=1; iClass<cClasses; iClass++)
+            {
+              dMax = std::max(dMax, adPred[std::size_t(iClass)*cRows + iObs]);
+            }
+          for(iClass=0; iClass<cClasses; iClass++)
+            {
+              double &dP = adPred[std::size_t(iClass)*cRows + iObs];
+              dP = std::exp(dP - dMax);
+              dSum += dP;
+            }
+          for(iClass=0; iClass<cClasses; iClass++)
+            {
+              adPred[std::size_t(iClass)*cRows + iObs] /= dSum;
+            }
+        }
+    }
+  else if((distribution == "bernoulli") || (distribution == "pairwise"))
+    {
+      for(iObs=0; iObs<cRows; iObs++) adPred[iObs] = 1.0/(1.0 + std::exp(-adPred[iObs]));
+    }
+  else if((distribution == "poisson") || (distribution == "gamma") ||
+          (distribution == "tweedie"))
+    {
+      for(iObs=0; iObs<cRows; iObs++) adPred[iObs] = std::exp(adPred[iObs]);
+    }
+  else if(distribution == "adaboost")
+    {
+      for(iObs=0; iObs<cRows; iObs++) adPred[iObs] = 1.0/(1.0 + std::exp(-2.0*adPred[iObs]));
+    }
+}
+
+
+bool CModel::IsModel
+(
+    const char *s,
+    std::size_t cLength
+)
+{
+  return (cLength >= sizeof(szMagic)) &&
+    (std::memcmp(s, szMagic, sizeof(szMagic)) == 0);
+}
@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       model.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   model files of gbmtool, also read by gbm.load() in R
+//
+//------------------------------------------------------------------------------
+
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+
+// CModel holds what predict.gbm() needs of a fitted model, and is written
+// to and read from a binary file in the byte order of the machine:
+//
+//   char    magic[8]        "GBMMODEL"
+//   int32   version         1
+//   string  distribution    the R name, e.g. "bernoulli"
+//   strings parameter names and doubles parameter values (alpha, df, power)
+//   int32   num.classes, strings classes
+//   int32   n.trees, interaction.depth, n.minobsinnode, nTrain, mFeatures
+//   double  shrinkage, bag.fraction, train.fraction, initF
+//   string  response.name
+//   strings var.names, ints var.type, ints var.monotone
+//   then for each variable its var.levels: doubles (the deciles of a
+//     continuous variable) if its var.type is 0, else strings
+//   doubles train.error, valid.error, oobag.improve
+//   int32   the number of trees, then each tree as ints split variable,
+//     doubles split point, ints left, right and missing node, doubles
+//     error reduction, weight and prediction, as in object$trees
+//   int32   the number of categorical splits, then each as ints
+//
+// A string is an int32 length and its bytes, and ints, doubles and strings
+// are an int32 count followed by the elements.  The layout is read by
+// gbm.load() in R/gbm.load.R, which has to be changed along with it.
+
+class CModel
+{
+public:
+
+    CModel();
+
+    void Write(const std::string &file) const;
+    void Read(const std::string &file);
+
+    // The scores of the cRows x cCols column-major predictors adX (factors
+    // coded as in the model) with the first cTrees trees, class k of row i
+    // at adPred[k*cRows + i].  Without fLink the scores are converted to
+    // the scale of the response, as predict.gbm(type="response") does.
+    void Predict(const double *const *apdXColumns,
+                 int cRows,
+                 int cTrees,
+                 bool fLink,
+                 std::vector<double> &adPred) const;
+
+    // true if s starts like a model file
+    static bool IsModel(const char *s, std::size_t cLength);
+
+    std::string distribution;
+    std::vector<std::string> vecParamNames;
+    std::vector<double> adParams;
+    int cClasses;
+    std::vector<std::string> vecClasses;
+    int cTrees;
+    int cDepth;
+    int cMinObsInNode;
+    int cTrain;
+    int cFeatures;
+    double dShrinkage;
+    double dBagFraction;
+    double dTrainFraction;
+    double dInitF;
+    std::string responseName;
+    std::vector<std::string> vecVarNames;
+    std::vector<int> aiVarType;
+    std::vector<int> aiVarMonotone;
+    std::vector<std::vector<double> > vecadVarDeciles;
+    std::vector<std::vector<std::string> > vecVarLevels;
+    std::vector<double> adTrainError;
+    std::vector<double> adValidError;
+    std::vector<double> adOOBagImprove;
+    std::vector<CCheckpointTree> vecTrees;
+    VEC_VEC_CATEGORIES vecSplitCodes;
+};
+
+#endif // MODEL_H
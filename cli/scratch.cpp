@@ -0,0 +1,177 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       scratch.cpp
+//
+//------------------------------------------------------------------------------
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "scratch.h"
+#include "gbmexcept.h"
+
+namespace {
+
+  // the page-aligned range around [p, p+cBytes), as posix_madvise() wants
+  void PageRange(const void *p, std::size_t cBytes,
+                 void *&pStart, std::size_t &cRangeBytes)
+  {
+    const std::size_t cPage = sysconf(_SC_PAGESIZE);
+    const std::size_t iStart = reinterpret_cast<std::size_t>(p) / cPage * cPage;
+    const std::size_t iEnd = reinterpret_cast<std::size_t>(p) + cBytes;
+    pStart = reinterpret_cast<void*>(iStart);
+    cRangeBytes = iEnd - iStart;
+  }
+}
+
+
+CScratchFile::CScratchFile()
+{
+  pMapping = 0;
+  cMappedBytes = 0;
+  cTaken = 0;
+}
+
+
+CScratchFile::~CScratchFile()
+{
+  Close();
+}
+
+
+void CScratchFile::Create
+(
+    const std::string &file,
+    std::size_t cBytes
+)
+{
+  Close();
+
+  const int fd = open(file.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd < 0)
+    {
+      throw GBM::failure("cannot create the scratch file " + file +
+                         " (it must not exist)");
+    }
+  this->file = file;
+  cMappedBytes = (cBytes > 0) ? cBytes : 1;
+  if(ftruncate(fd, cMappedBytes) != 0)
+    {
+      close(fd);
+      Close();
+      throw GBM::failure("cannot make room in the scratch file " + file);
+    }
+  pMapping = mmap(0, cMappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(pMapping == MAP_FAILED)
+    {
+      pMapping = 0;
+      Close();
+      throw GBM::failure("cannot map the scratch file " + file);
+    }
+}
+
+
+void CScratchFile::Close()
+{
+  if(pMapping)
+    {
+      munmap(pMapping, cMappedBytes);
+    }
+  if(!file.empty())
+    {
+      std::remove(file.c_str());
+    }
+  file.clear();
+  pMapping = 0;
+  cMappedBytes = 0;
+  cTaken = 0;
+}
+
+
+void *CScratchFile::TakeBytes
+(
+    std::size_t cBytes
+)
+{
+  const std::size_t cAligned = (cBytes + 7) / 8 * 8;
+  if(!pMapping || (cAligned > cMappedBytes - cTaken))
+    {
+      throw GBM::failure("the scratch file is too small");
+    }
+  void *p = static_cast<char*>(pMapping) + cTaken;
+  cTaken += cAligned;
+  return p;
+}
+
+
+void CScratchFile::WillNeed
+(
+    const void *p,
+    std::size_t cBytes
+)
+{
+  void *pStart = 0;
+  std::size_t cRangeBytes = 0;
+  PageRange(p, cBytes, pStart, cRangeBytes);
+  posix_madvise(pStart, cRangeBytes, POSIX_MADV_WILLNEED);
+}
+
+
+void CScratchFile::DontNeed
+(
+    const void *p,
+    std::size_t cBytes
+)
+{
+  void *pStart = 0;
+  std::size_t cRangeBytes = 0;
+  PageRange(p, cBytes, pStart, cRangeBytes);
+  // glibc ignores POSIX_MADV_DONTNEED; Linux 5.4 and later move the pages
+  // to the inactive list with MADV_COLD, where they are reclaimed first
+#ifdef MADV_COLD
+  if(madvise(pStart, cRangeBytes, MADV_COLD) == 0)
+    {
+      return;
+    }
+#endif
+  posix_madvise(pStart, cRangeBytes, POSIX_MADV_DONTNEED);
+}
+
+
+CScratchPager::CScratchPager
+(
+    const int *aiXOrder,
+    const double *adXSorted,
+    unsigned long cTrain
+)
+  : aiXOrder(aiXOrder), adXSorted(adXSorted), cTrain(cTrain)
+{
+}
+
+
+void CScratchPager::Fetch
+(
+    int iVar
+)
+{
+  CScratchFile::WillNeed(aiXOrder + std::size_t(iVar)*cTrain,
+                         cTrain*sizeof(int));
+  CScratchFile::WillNeed(adXSorted + std::size_t(iVar)*cTrain,
+                         cTrain*sizeof(double));
+}
+
+
+void CScratchPager::Release
+(
+    int iVar
+)
+{
+  CScratchFile::DontNeed(aiXOrder + std::size_t(iVar)*cTrain,
+                         cTrain*sizeof(int));
+  CScratchFile::DontNeed(adXSorted + std::size_t(iVar)*cTrain,
+                         cTrain*sizeof(double));
+}
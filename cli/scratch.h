@@ -0,0 +1,92 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       scratch.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   memory-mapped scratch file for out-of-core training
+//
+//------------------------------------------------------------------------------
+
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "dataset.h"
+
+// A scratch file holds the working arrays of "gbmtool train --scratch": the
+// order index, the predictor values in its order, the converted predictor
+// columns, the weights and the scores.  It is created at its full size,
+// mapped into memory and removed again when closed, so that the operating
+// system can write the arrays out and read them back as memory runs short
+// instead of the process running out of it.  Take() hands out the arrays
+// one after the other, each aligned to 8 bytes.
+
+class CScratchFile
+{
+public:
+
+    CScratchFile();
+    ~CScratchFile();
+
+    // creates and maps file with room for cBytes, throws GBM::failure if
+    // it cannot or if file already exists, which is left alone
+    void Create(const std::string &file, std::size_t cBytes);
+    void Close();
+
+    // the next cCount elements of type T
+    template <typename T>
+    T *Take(std::size_t cCount)
+    {
+      return static_cast<T*>(TakeBytes(cCount*sizeof(T)));
+    }
+
+    // the bytes Take() needs for cCount elements of type T
+    template <typename T>
+    static std::size_t Bytes(std::size_t cCount)
+    {
+      return (cCount*sizeof(T) + 7) / 8 * 8;
+    }
+
+    // tell the system that [p, p+cBytes) is needed soon, or not for a while
+    static void WillNeed(const void *p, std::size_t cBytes);
+    static void DontNeed(const void *p, std::size_t cBytes);
+
+private:
+
+    void *TakeBytes(std::size_t cBytes);
+
+    std::string file;
+    void *pMapping;
+    std::size_t cMappedBytes;
+    std::size_t cTaken;
+};
+
+
+// The pager of a dataset whose order index and sorted values are in a
+// scratch file: the column the split search needs next is read ahead in
+// the background, and the pages of a finished one are the first to go
+// where the system supports it (MADV_COLD on Linux).
+
+class CScratchPager : public CColumnPager
+{
+public:
+
+    CScratchPager(const int *aiXOrder, const double *adXSorted,
+                  unsigned long cTrain);
+
+    void Fetch(int iVar);
+    void Release(int iVar);
+
+private:
+
+    const int *aiXOrder;
+    const double *adXSorted;
+    unsigned long cTrain;
+};
+
+#endif // SCRATCH_H
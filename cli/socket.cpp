@@ -0,0 +1,289 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       socket.cpp
+//
+//------------------------------------------------------------------------------
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "socket.h"
+#include "gbmexcept.h"
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+  const int fSendFlags = MSG_NOSIGNAL;
+#else
+  const int fSendFlags = 0;
+#endif
+
+  // how long the other workers wait for worker 0 to listen, in seconds
+  const int cConnectSeconds = 60;
+
+  void SendAll(int fd, const void *p, std::size_t cBytes)
+  {
+    const char *pc = static_cast<const char*>(p);
+    while(cBytes > 0)
+      {
+	const ssize_t cSent = send(fd, pc, cBytes, fSendFlags);
+	if(cSent < 0)
+	  {
+	    if(errno == EINTR) continue;
+	    throw GBM::failure(std::string("lost a worker: ") + std::strerror(errno));
+	  }
+	pc += cSent;
+	cBytes -= cSent;
+      }
+  }
+
+  void ReceiveAll(int fd, void *p, std::size_t cBytes)
+  {
+    char *pc = static_cast<char*>(p);
+    while(cBytes > 0)
+      {
+	const ssize_t cReceived = recv(fd, pc, cBytes, 0);
+	if(cReceived < 0)
+	  {
+	    if(errno == EINTR) continue;
+	    throw GBM::failure(std::string("lost a worker: ") + std::strerror(errno));
+	  }
+	if(cReceived == 0)
+	  {
+	    throw GBM::failure("lost a worker: it closed the connection");
+	  }
+	pc += cReceived;
+	cBytes -= cReceived;
+      }
+  }
+
+  // the socket address of a path or HOST:PORT; returns the domain
+  int Resolve(const std::string &address, sockaddr_storage &addr,
+	      socklen_t &cAddr)
+  {
+    std::memset(&addr, 0, sizeof(addr));
+    if(address.find('/') != std::string::npos)
+      {
+	sockaddr_un *pUnix = reinterpret_cast<sockaddr_un*>(&addr);
+	if(address.size() >= sizeof(pUnix->sun_path))
+	  {
+	    throw GBM::invalid_argument("the socket path " + address + " is too long");
+	  }
+	pUnix->sun_family = AF_UNIX;
+	std::strcpy(pUnix->sun_path, address.c_str());
+	cAddr = sizeof(sockaddr_un);
+	return AF_UNIX;
+      }
+
+    const std::string::size_type iColon = address.rfind(':');
+    if(iColon == std::string::npos)
+      {
+	throw GBM::invalid_argument("the address " + address + " is neither a path nor HOST:PORT");
+      }
+    const std::string host = address.substr(0, iColon);
+    const std::string port = address.substr(iColon + 1);
+    addrinfo hints;
+    addrinfo *pResult = 0;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if(getaddrinfo(host.empty() ? 0 : host.c_str(), port.c_str(),
+		   &hints, &pResult) != 0)
+      {
+	throw GBM::invalid_argument("cannot resolve " + address);
+      }
+    std::memcpy(&addr, pResult->ai_addr, pResult->ai_addrlen);
+    cAddr = pResult->ai_addrlen;
+    const int iDomain = pResult->ai_family;
+    freeaddrinfo(pResult);
+    return iDomain;
+  }
+
+  // small messages go out at once
+  void NoDelay(int fd, int iDomain)
+  {
+    if(iDomain != AF_UNIX)
+      {
+	int iOne = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &iOne, sizeof(iOne));
+      }
+  }
+}
+
+
+CSocketAllreduce::CSocketAllreduce()
+{
+  iRank = 0;
+  cWorkers = 1;
+}
+
+
+CSocketAllreduce::~CSocketAllreduce()
+{
+  Close();
+}
+
+
+void CSocketAllreduce::Connect
+(
+    const std::string &address,
+    int cWorkers,
+    int iRank
+)
+{
+  sockaddr_storage addr;
+  socklen_t cAddr = 0;
+  int i = 0;
+
+  Close();
+  if((cWorkers < 1) || (iRank < 0) || (iRank >= cWorkers))
+    {
+      throw GBM::invalid_argument("the rank must be between 0 and the number of workers - 1");
+    }
+  this->cWorkers = cWorkers;
+  this->iRank = iRank;
+  if(cWorkers == 1)
+    {
+      return;
+    }
+  const int iDomain = Resolve(address, addr, cAddr);
+
+  if(iRank == 0)
+    {
+      // listen and take the others in the order they come, each telling
+      // its rank
+      const int fdListen = socket(iDomain, SOCK_STREAM, 0);
+      if(fdListen < 0)
+	{
+	  throw GBM::failure("cannot open a socket");
+	}
+      int iOne = 1;
+      setsockopt(fdListen, SOL_SOCKET, SO_REUSEADDR, &iOne, sizeof(iOne));
+      if(iDomain == AF_UNIX)
+	{
+	  unlink(address.c_str());
+	  unixPath = address;
+	}
+      if((bind(fdListen, reinterpret_cast<sockaddr*>(&addr), cAddr) != 0) ||
+	 (listen(fdListen, cWorkers) != 0))
+	{
+	  close(fdListen);
+	  throw GBM::failure("cannot listen at " + address + ": " +
+			     std::strerror(errno));
+	}
+      aiPeer.assign(cWorkers, -1);
+      for(i=1; i<cWorkers; i++)
+	{
+	  const int fd = accept(fdListen, 0, 0);
+	  if(fd < 0)
+	    {
+	      close(fdListen);
+	      throw GBM::failure("cannot accept a worker");
+	    }
+	  int iPeerRank = 0;
+	  ReceiveAll(fd, &iPeerRank, sizeof(iPeerRank));
+	  if((iPeerRank <= 0) || (iPeerRank >= cWorkers) ||
+	     (aiPeer[iPeerRank] >= 0))
+	    {
+	      close(fd);
+	      close(fdListen);
+	      throw GBM::failure("a worker connected with a wrong or duplicate rank");
+	    }
+	  NoDelay(fd, iDomain);
+	  aiPeer[iPeerRank] = fd;
+	}
+      close(fdListen);
+    }
+  else
+    {
+      int fd = -1;
+      for(i=0; i<10*cConnectSeconds; i++)
+	{
+	  fd = socket(iDomain, SOCK_STREAM, 0);
+	  if(fd < 0)
+	    {
+	      throw GBM::failure("cannot open a socket");
+	    }
+	  if(connect(fd, reinterpret_cast<sockaddr*>(&addr), cAddr) == 0)
+	    {
+	      break;
+	    }
+	  close(fd);
+	  fd = -1;
+	  usleep(100000);
+	}
+      if(fd < 0)
+	{
+	  throw GBM::failure("cannot reach worker 0 at " + address);
+	}
+      NoDelay(fd, iDomain);
+      aiPeer.assign(1, fd);
+      SendAll(fd, &iRank, sizeof(iRank));
+    }
+}
+
+
+void CSocketAllreduce::Close()
+{
+  for(std::size_t i=0; i<aiPeer.size(); i++)
+    {
+      if(aiPeer[i] >= 0)
+	{
+	  close(aiPeer[i]);
+	}
+    }
+  aiPeer.clear();
+  if(!unixPath.empty())
+    {
+      unlink(unixPath.c_str());
+      unixPath.clear();
+    }
+}
+
+
+void CSocketAllreduce::Sum
+(
+    double *adValues,
+    std::size_t cValues
+)
+{
+  const std::size_t cBytes = cValues*sizeof(double);
+  std::size_t i = 0;
+  int iWorker = 0;
+
+  if((cWorkers == 1) || (cValues == 0))
+    {
+      return;
+    }
+
+  if(iRank != 0)
+    {
+      SendAll(aiPeer[0], adValues, cBytes);
+      ReceiveAll(aiPeer[0], adValues, cBytes);
+      return;
+    }
+
+  adReceived.resize(cValues);
+  for(iWorker=1; iWorker<cWorkers; iWorker++)
+    {
+      ReceiveAll(aiPeer[iWorker], &adReceived[0], cBytes);
+      for(i=0; i<cValues; i++)
+	{
+	  adValues[i] += adReceived[i];
+	}
+    }
+  for(iWorker=1; iWorker<cWorkers; iWorker++)
+    {
+      SendAll(aiPeer[iWorker], adValues, cBytes);
+    }
+}
@@ -0,0 +1,55 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       socket.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   allreduce over sockets for data-parallel training
+//
+//------------------------------------------------------------------------------
+
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <string>
+#include <vector>
+
+#include "allreduce.h"
+
+// The workers of "gbmtool train --workers N" meet at an address: a path,
+// which is a Unix socket for workers on one machine, or HOST:PORT for TCP.
+// Worker 0 listens there and the others connect to it, so it is a star:
+// in Sum() the others send their values to worker 0, which adds them in
+// the order of the ranks and sends the sum back.  Every worker so gets the
+// same bits, whatever the order the values arrive in.
+//
+// The others retry for a while if worker 0 is not listening yet.  A worker
+// that fails or goes away makes the others throw GBM::failure.
+
+class CSocketAllreduce : public CAllreduce
+{
+public:
+
+    CSocketAllreduce();
+    ~CSocketAllreduce();
+
+    // joins the cWorkers workers at address as worker iRank, which returns
+    // when all have
+    void Connect(const std::string &address, int cWorkers, int iRank);
+    void Close();
+
+    int Rank() const { return iRank; }
+    int Size() const { return cWorkers; }
+    void Sum(double *adValues, std::size_t cValues);
+
+private:
+
+    int iRank;
+    int cWorkers;
+    std::string unixPath;       // the Unix socket worker 0 removes
+    std::vector<int> aiPeer;    // worker 0: the socket of each other worker
+    std::vector<double> adReceived;
+};
+
+#endif // SOCKET_H
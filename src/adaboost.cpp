@@ -1,5 +1,7 @@
 // GBM by Greg Ridgeway  Copyright (C) 2003
 
+#include <algorithm>
+
 #include "adaboost.h"
 
 CAdaBoost::CAdaBoost()
@@ -13,36 +15,61 @@ CAdaBoost::~CAdaBoost()
 
 void CAdaBoost::ComputeWorkingResponse
 (
- const double *adY,
- const double *adMisc,
- const double *adOffset,
- const double *adF,
- double *adZ,
- const double *adWeight,
- const bag& afInBag,
- unsigned long nTrain
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    double *adZ,
+    const double *adWeight,
+    const bag& afInBag,
+    unsigned long nTrain
 )
 {
-  unsigned long i = 0;
-  
-  if(adOffset == NULL)
+    double adExpF[cVecBlock];
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
+
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
     {
-      for(i=0; i<nTrain; i++)
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+        AddOffset(adF, adOffset, iStart, cBlock, adExpF);
+        for(i=0; i<cBlock; i++)
         {
-	  adZ[i] = -(2*adY[i]-1) * std::exp(-(2*adY[i]-1)*adF[i]);
+            adExpF[i] = -(2*adY[iStart+i]-1)*adExpF[i];
         }
-    }
-  else
-    {
-      for(i=0; i<nTrain; i++)
+        vecmath.Exp(adExpF, cBlock);
+
+        for(i=0; i<cBlock; i++)
         {
-	  adZ[i] = -(2*adY[i]-1) * std::exp(-(2*adY[i]-1)*(adOffset[i]+adF[i]));
+            adZ[iStart+i] = (2*adY[iStart+i]-1) * adExpF[i];
         }
     }
 }
 
 
 
+void CAdaBoost::ComputeHessian
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    const double *adZ,
+    double *adH,
+    unsigned long nTrain
+)
+{
+    unsigned long i = 0;
+
+    // adZ = (2y-1)*exp(-(2y-1)F), the hessian is exp(-(2y-1)F)
+    for(i=0; i<nTrain; i++)
+    {
+        adH[i] = (2*adY[i]-1) * adZ[i];
+    }
+}
+
+
 void CAdaBoost::InitF
 (
  const double *adY,
@@ -88,7 +115,9 @@ void CAdaBoost::InitF
         }
       }
     
-    dInitF = 0.5*std::log(dNum/dDen);
+    double adSums[2] = {dNum, dDen};
+    Reduce(adSums, 2);
+    dInitF = 0.5*std::log(adSums[0]/adSums[1]);
 }
 
 
@@ -99,30 +128,24 @@ double CAdaBoost::Deviance
     const double *adOffset,
     const double *adWeight,
     const double *adF,
-    unsigned long cLength)
+    unsigned long cLength
+)
 {
-    unsigned long i=0;
     double dL = 0.0;
     double dW = 0.0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
 
-    if(adOffset == NULL)
-    {
-        for(i=0; i!=cLength; i++)
-        {
-            dL += adWeight[i] * std::exp(-(2*adY[i]-1)*adF[i]);
-            dW += adWeight[i];
-        }
-    }
-    else
+    for(iStart=0; iStart<cLength; iStart+=cBlock)
     {
-        for(i=0; i!=cLength; i++)
-        {
-            dL += adWeight[i] * std::exp(-(2*adY[i]-1)*(adOffset[i]+adF[i]));
-            dW += adWeight[i];
-       }
+        cBlock = std::min(cVecBlock, cLength-iStart);
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, NULL);
     }
 
-    return dL/dW;
+    double adSums[2] = {dL, dW};
+    Reduce(adSums, 2);
+    return adSums[0]/adSums[1];
 }
 
 
@@ -134,7 +157,7 @@ void CAdaBoost::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long>& aiNodeAssign,
+    const CNodeAssign& aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -164,6 +187,10 @@ void CAdaBoost::FitBestConstant
         }
     }
   
+  // the sums of the nodes over the rows of all workers
+  Reduce(&vecdNum[0], cTermNodes);
+  Reduce(&vecdDen[0], cTermNodes);
+
   for(iNode=0; iNode<cTermNodes; iNode++)
     {
       if(vecpTermNodes[iNode]!=NULL)
@@ -196,22 +223,155 @@ double CAdaBoost::BagImprovement
 )
 {
     double dReturnValue = 0.0;
+    double dW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+
+    while((cRows = NextOutOfBag(afInBag, nTrain, iNext, aiRow)) > 0)
+    {
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dReturnValue, dW);
+    }
+
+    double adSums[2] = {dReturnValue, dW};
+    Reduce(adSums, 2);
+    return adSums[0]/adSums[1];
+}
+
+
+void CAdaBoost::BagImprovementBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    const double *adFadj,
+    double dStepSize,
+    const unsigned long *aiRow,
+    unsigned long cRows,
+    double &dReturnValue,
+    double &dW
+) const
+{
+    double adExpF[cVecBlock];
+    double adExpFNew[cVecBlock];
     double dF = 0.0;
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
+        adExpF[k] = -(2*adY[i]-1)*dF;
+        adExpFNew[k] = -(2*adY[i]-1)*(dF+dStepSize*adFadj[i]);
+    }
+    vecmath.Exp(adExpF, cRows);
+    vecmath.Exp(adExpFNew, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        dReturnValue += adWeight[i]*(adExpF[k] - adExpFNew[k]);
+        dW += adWeight[i];
+    }
+}
+
+
+bool CAdaBoost::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
     double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
     unsigned long i = 0;
 
-    for(i=0; i<nTrain; i++)
+    // one sweep in blocks: out-of-bag improvement at the old scores, the
+    // step, then the deviance and the next working response at the new
+    // scores
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
     {
-        if(!afInBag[i])
-        {
-            dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
+        cBlock = std::min(cVecBlock, nTrain-iStart);
 
-            dReturnValue += adWeight[i]*
-                (std::exp(-(2*adY[i]-1)*dF) -
-                 std::exp(-(2*adY[i]-1)*(dF+dStepSize*adFadj[i])));
-            dW += adWeight[i];
+        iNext = iStart;
+        cRows = NextOutOfBag(afInBag, iStart+cBlock, iNext, aiRow);
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dOOBag, dOOBagW);
+
+        for(i=iStart; i<iStart+cBlock; i++)
+        {
+            adF[i] += dStepSize * adFadj[i];
         }
+
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, adZ);
     }
 
-    return dReturnValue/dW;
+    double adSums[4] = {dOOBag, dOOBagW, dL, dW};
+    Reduce(adSums, 4);
+    dOOBagImprove = adSums[0]/adSums[1];
+    dTrainError = adSums[2]/adSums[3];
+
+    return true;
+}
+
+
+void CAdaBoost::DevianceBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    unsigned long iStart,
+    unsigned long cRows,
+    double &dL,
+    double &dW,
+    double *adZ
+) const
+{
+    double adExpF[cVecBlock];
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    AddOffset(adF, adOffset, iStart, cRows, adExpF);
+    for(k=0; k<cRows; k++)
+    {
+        adExpF[k] = -(2*adY[iStart+k]-1)*adExpF[k];
+    }
+    vecmath.Exp(adExpF, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = iStart + k;
+        dL += adWeight[i] * adExpF[k];
+        dW += adWeight[i];
+    }
+
+    if(adZ != NULL)
+    {
+        for(k=0; k<cRows; k++)
+        {
+            adZ[iStart+k] = (2*adY[iStart+k]-1) * adExpF[k];
+        }
+    }
 }
@@ -0,0 +1,52 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       allreduce.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   the transport of data-parallel training
+//
+//------------------------------------------------------------------------------
+
+#ifndef ALLREDUCE_H
+#define ALLREDUCE_H
+
+#include <algorithm>
+#include <cstddef>
+
+// In data-parallel training each of Size() workers holds a shard of the
+// rows and runs a CGBM of its own (CGBM::SetAllreduce()).  Whatever the
+// fit sums over rows (the split histograms, the terminal node sums of
+// FitBestConstant(), InitF() and the deviances) is summed over the workers
+// with Sum(), so that every worker grows the same trees.  A transport
+// implements Sum(); gbmtool has one over sockets (cli/socket.h).
+//
+// Sum() replaces adValues on every worker with the sum of those of all
+// workers, and has to return the same sum, to the bit, on all of them.
+// The workers call it in the same order with the same cValues; failures
+// are thrown as GBM::failure.
+
+class CAllreduce
+{
+public:
+
+    virtual ~CAllreduce() {}
+
+    virtual int Rank() const = 0;
+    virtual int Size() const = 0;
+    virtual void Sum(double *adValues, std::size_t cValues) = 0;
+};
+
+// Sends the cValues of adValues of worker iRoot to all workers.
+inline void Broadcast(CAllreduce &allreduce, double *adValues,
+                      std::size_t cValues, int iRoot = 0)
+{
+  if(allreduce.Rank() != iRoot)
+    {
+      std::fill(adValues, adValues + cValues, 0.0);
+    }
+  allreduce.Sum(adValues, cValues);
+}
+
+#endif // ALLREDUCE_H
@@ -1,5 +1,7 @@
 // GBM by Greg Ridgeway  Copyright (C) 2003
 
+#include <algorithm>
+
 #include "bernoulli.h"
 
 CBernoulli::CBernoulli()
@@ -25,22 +27,49 @@ void CBernoulli::ComputeWorkingResponse
     unsigned long nTrain
 )
 {
-  unsigned long i = 0;
-  double dProb = 0.0;
-  double dF = 0.0;
+    double adExpF[cVecBlock];
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
 
-  for(i=0; i<nTrain; i++)
-  {
-    dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-    dProb = 1.0/(1.0+std::exp(-dF));
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
+    {
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+        AddOffset(adF, adOffset, iStart, cBlock, adExpF);
+        for(i=0; i<cBlock; i++)
+        {
+            adExpF[i] = -adExpF[i];
+        }
+        vecmath.Exp(adExpF, cBlock);
 
-    adZ[i] = adY[i] - dProb;
-#ifdef NOISY_DEBUG
-//  Rprintf("dF=%f, dProb=%f, adZ=%f, adY=%f\n", dF, dProb, adZ[i], adY[i]);
-    if(dProb<  0.0001) Rprintf("Small prob(i=%d)=%f Z=%f\n",i,dProb,adZ[i]);
-    if(dProb>1-0.0001) Rprintf("Large prob(i=%d)=%f Z=%f\n",i,dProb,adZ[i]);
-#endif
-  }
+        // adExpF holds exp(-F), 1/(1+exp(-F)) is the probability
+        for(i=0; i<cBlock; i++)
+        {
+            adZ[iStart+i] = adY[iStart+i] - 1.0/(1.0+adExpF[i]);
+        }
+    }
+}
+
+
+void CBernoulli::ComputeHessian
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    const double *adZ,
+    double *adH,
+    unsigned long nTrain
+)
+{
+    unsigned long i = 0;
+
+    // adZ = y - p
+    for(i=0; i<nTrain; i++)
+    {
+        const double dP = adY[i] - adZ[i];
+        adH[i] = dP*(1.0-dP);
+    }
 }
 
 
@@ -65,7 +94,9 @@ void CBernoulli::InitF
             dSum += adWeight[i]*adY[i];
             dTemp += adWeight[i];
         }
-        dInitF = std::log(dSum/(dTemp-dSum));
+        double adSums[2] = {dSum, dTemp};
+        Reduce(adSums, 2);
+        dInitF = std::log(adSums[0]/(adSums[1]-adSums[0]));
     }
     else
     {
@@ -85,7 +116,9 @@ void CBernoulli::InitF
                 dNum += adWeight[i]*(adY[i]-dTemp);
                 dDen += adWeight[i]*dTemp*(1.0-dTemp);
             }
-            dNewtonStep = dNum/dDen;
+            double adSums[2] = {dNum, dDen};
+            Reduce(adSums, 2);
+            dNewtonStep = adSums[0]/adSums[1];
             dInitF += dNewtonStep;
         }
     }
@@ -103,30 +136,21 @@ double CBernoulli::Deviance
     unsigned long cLength
 )
 {
-   unsigned long i=0;
-   double dL = 0.0;
-   double dF = 0.0;
-   double dW = 0.0;
-
-   if(adOffset==NULL)
-   {
-      for(i=0; i!=cLength; i++)
-      {
-         dL += adWeight[i]*(adY[i]*adF[i] - std::log(1.0+std::exp(adF[i])));
-         dW += adWeight[i];
-      }
-   }
-   else
-   {
-      for(i=0; i!=cLength; i++)
-      {
-         dF = adF[i] + adOffset[i];
-         dL += adWeight[i]*(adY[i]*dF - std::log(1.0+std::exp(dF)));
-         dW += adWeight[i];
-      }
-   }
+    double dL = 0.0;
+    double dW = 0.0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+
+    for(iStart=0; iStart<cLength; iStart+=cBlock)
+    {
+        cBlock = std::min(cVecBlock, cLength-iStart);
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, NULL);
+    }
 
-   return -2*dL/dW;
+    double adSums[2] = {dL, dW};
+    Reduce(adSums, 2);
+    return -2*adSums[0]/adSums[1];
 }
 
 
@@ -138,7 +162,7 @@ void CBernoulli::FitBestConstant
   const double *adW,
   const double *adF,
   double *adZ,
-  const std::vector<unsigned long>& aiNodeAssign,
+  const CNodeAssign& aiNodeAssign,
   unsigned long nTrain,
   VEC_P_NODETERMINAL vecpTermNodes,
   unsigned long cTermNodes,
@@ -165,7 +189,7 @@ void CBernoulli::FitBestConstant
           adW[iObs]*(adY[iObs]-adZ[iObs])*(1-adY[iObs]+adZ[iObs]);
 #ifdef NOISY_DEBUG
 /*
-      Rprintf("iNode=%d, dNum(%d)=%f, dDen(%d)=%f\n",
+      LogMessage("iNode=%d, dNum(%d)=%f, dDen(%d)=%f\n",
               aiNodeAssign[iObs],
               iObs,vecdNum[aiNodeAssign[iObs]],
               iObs,vecdDen[aiNodeAssign[iObs]]);
@@ -174,6 +198,10 @@ void CBernoulli::FitBestConstant
     }
   }
 
+  // the sums of the nodes over the rows of all workers
+  Reduce(&vecdNum[0], cTermNodes);
+  Reduce(&vecdDen[0], cTermNodes);
+
   for(iNode=0; iNode<cTermNodes; iNode++)
   {
     if(vecpTermNodes[iNode]!=NULL)
@@ -192,7 +220,7 @@ void CBernoulli::FitBestConstant
           {
             // set fCappedPred=true so that warning only issued once
             fCappedPred = true;  
-            Rcpp::warning("Some terminal node predictions were excessively large for Bernoulli and have been capped at 1.0. Likely due to a feature that separates the 0/1 outcomes. Consider reducing shrinkage parameter.");
+            LogWarning("Some terminal node predictions were excessively large for Bernoulli and have been capped at 1.0. Likely due to a feature that separates the 0/1 outcomes. Consider reducing shrinkage parameter.");
           }
           if(dTemp>1.0) dTemp = 1.0;
           else if(dTemp<-1.0) dTemp = -1.0;
@@ -218,26 +246,180 @@ double CBernoulli::BagImprovement
 )
 {
     double dReturnValue = 0.0;
-    double dF = 0.0;
     double dW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+
+    while((cRows = NextOutOfBag(afInBag, nTrain, iNext, aiRow)) > 0)
+    {
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dReturnValue, dW);
+    }
+
+    double adSums[2] = {dReturnValue, dW};
+    Reduce(adSums, 2);
+    return adSums[0]/adSums[1];
+}
+
+
+void CBernoulli::BagImprovementBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    const double *adFadj,
+    double dStepSize,
+    const unsigned long *aiRow,
+    unsigned long cRows,
+    double &dReturnValue,
+    double &dW
+) const
+{
+    double adLog[cVecBlock];
+    double adLogNew[cVecBlock];
     unsigned long i = 0;
+    unsigned long k = 0;
 
-    for(i=0; i<nTrain; i++)
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        adLog[k] = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
+        adLogNew[k] = adLog[k] + dStepSize*adFadj[i];
+    }
+
+    // log(1+exp(F)) before and after the step
+    vecmath.Exp(adLog, cRows);
+    vecmath.Exp(adLogNew, cRows);
+    for(k=0; k<cRows; k++)
     {
-        if(!afInBag[i])
+        adLog[k] = 1.0+adLog[k];
+        adLogNew[k] = 1.0+adLogNew[k];
+    }
+    vecmath.Log(adLog, cRows);
+    vecmath.Log(adLogNew, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        if(adY[i]==1.0)
         {
-            dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
+            dReturnValue += adWeight[i]*dStepSize*adFadj[i];
+        }
+        dReturnValue += adWeight[i]*(adLog[k] - adLogNew[k]);
+        dW += adWeight[i];
+    }
+}
 
-            if(adY[i]==1.0)
-            {
-                dReturnValue += adWeight[i]*dStepSize*adFadj[i];
-            }
-            dReturnValue += adWeight[i]*
-                            (std::log(1.0+std::exp(dF)) -
-                             std::log(1.0+std::exp(dF+dStepSize*adFadj[i])));
-            dW += adWeight[i];
+
+bool CBernoulli::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
+    double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
+
+    // one sweep in blocks: out-of-bag improvement at the old scores, the
+    // step, then the deviance and the next working response at the new
+    // scores
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
+    {
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+
+        iNext = iStart;
+        cRows = NextOutOfBag(afInBag, iStart+cBlock, iNext, aiRow);
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dOOBag, dOOBagW);
+
+        for(i=iStart; i<iStart+cBlock; i++)
+        {
+            adF[i] += dStepSize * adFadj[i];
         }
+
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, adZ);
     }
 
-    return dReturnValue/dW;
+    double adSums[4] = {dOOBag, dOOBagW, dL, dW};
+    Reduce(adSums, 4);
+    dOOBagImprove = adSums[0]/adSums[1];
+    dTrainError = -2*adSums[2]/adSums[3];
+
+    return true;
+}
+
+
+void CBernoulli::DevianceBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    unsigned long iStart,
+    unsigned long cRows,
+    double &dL,
+    double &dW,
+    double *adZ
+) const
+{
+    double adFB[cVecBlock];
+    double adLog[cVecBlock];
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    AddOffset(adF, adOffset, iStart, cRows, adFB);
+
+    // log(1+exp(F))
+    for(k=0; k<cRows; k++)
+    {
+        adLog[k] = adFB[k];
+    }
+    vecmath.Exp(adLog, cRows);
+    for(k=0; k<cRows; k++)
+    {
+        adLog[k] = 1.0+adLog[k];
+    }
+    vecmath.Log(adLog, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = iStart + k;
+        dL += adWeight[i]*(adY[i]*adFB[k] - adLog[k]);
+        dW += adWeight[i];
+    }
+
+    if(adZ != NULL)
+    {
+        for(k=0; k<cRows; k++)
+        {
+            adFB[k] = -adFB[k];
+        }
+        vecmath.Exp(adFB, cRows);
+
+        for(k=0; k<cRows; k++)
+        {
+            adZ[iStart+k] = adY[iStart+k] - 1.0/(1.0+adFB[k]);
+        }
+    }
 }
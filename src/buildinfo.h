@@ -4,7 +4,13 @@
 #ifndef BUILDINFO_H
 #define BUILDINFO_H
 
-#include <Rcpp.h>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#include "logger.h"
 
     typedef unsigned long ULONG;
     typedef char *PCHAR;
@@ -0,0 +1,357 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       checkpoint.cpp
+//
+//------------------------------------------------------------------------------
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+#include "checkpoint.h"
+
+namespace {
+
+  const char szMagic[8] = {'G','B','M','C','K','P','T','\0'};
+  const int iVersion = 6;
+
+  template <typename T>
+  void WriteValue(std::ofstream &out, const T &value)
+  {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  void WriteVector(std::ofstream &out, const std::vector<T> &vec)
+  {
+    const int64_t cLength = vec.size();
+    WriteValue(out, cLength);
+    if(cLength > 0)
+      {
+	out.write(reinterpret_cast<const char*>(&vec[0]), cLength*sizeof(T));
+      }
+  }
+
+  void WriteString(std::ofstream &out, const std::string &s)
+  {
+    WriteVector(out, std::vector<char>(s.begin(), s.end()));
+  }
+
+  template <typename T>
+  void ReadValue(std::ifstream &in, T &value)
+  {
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    if(!in)
+      {
+	throw GBM::failure("the checkpoint file is truncated");
+      }
+  }
+
+  template <typename T>
+  void ReadVector(std::ifstream &in, std::vector<T> &vec)
+  {
+    int64_t cLength = 0;
+    ReadValue(in, cLength);
+    if(cLength < 0)
+      {
+	throw GBM::failure("the checkpoint file is corrupt");
+      }
+    vec.resize(cLength);
+    if(cLength > 0)
+      {
+	in.read(reinterpret_cast<char*>(&vec[0]), cLength*sizeof(T));
+	if(!in)
+	  {
+	    throw GBM::failure("the checkpoint file is truncated");
+	  }
+      }
+  }
+
+  void ReadString(std::ifstream &in, std::string &s)
+  {
+    std::vector<char> vec;
+    ReadVector(in, vec);
+    s.assign(vec.begin(), vec.end());
+  }
+}
+
+
+CCheckpoint::CCheckpoint()
+{
+    cRows = 0;
+    cCols = 0;
+    cTrain = 0;
+    cClasses = 1;
+    cDepth = 0;
+    cMinObsInNode = 0;
+    cFeatures = 0;
+    dShrinkage = 0.0;
+    dBagFraction = 0.0;
+    fVectorMath = true;
+    cPairBudget = 0;
+    fNewton = false;
+    dL2Penalty = 0.0;
+    fStreams = false;
+    dDataSum = 0.0;
+    iXHash = 0;
+
+    cIterations = 0;
+    dInitF = 0.0;
+
+    iBest = -1;
+    dBestCriterion = HUGE_VAL;
+    dOOBagSum = 0.0;
+    cCatSplitsBest = 0;
+}
+
+
+CCheckpoint::~CCheckpoint()
+{
+}
+
+
+void CCheckpoint::Write
+(
+    const std::string &file
+) const
+{
+  unsigned long i = 0;
+  const std::string tmpFile = file + ".tmp";
+
+  {
+    std::ofstream out(tmpFile.c_str(), std::ios::binary | std::ios::trunc);
+    if(!out)
+      {
+	throw GBM::failure("cannot open checkpoint file " + tmpFile);
+      }
+
+    out.write(szMagic, sizeof(szMagic));
+    WriteValue(out, iVersion);
+
+    WriteString(out, family);
+    WriteValue(out, cRows);
+    WriteValue(out, cCols);
+    WriteValue(out, cTrain);
+    WriteValue(out, cClasses);
+    WriteValue(out, cDepth);
+    WriteValue(out, cMinObsInNode);
+    WriteValue(out, cFeatures);
+    WriteValue(out, dShrinkage);
+    WriteValue(out, dBagFraction);
+    WriteValue(out, int(fVectorMath));
+    WriteValue(out, cPairBudget);
+    WriteValue(out, int(fNewton));
+    WriteValue(out, dL2Penalty);
+    WriteString(out, bagType);
+    WriteValue(out, int(fStreams));
+    WriteString(out, columnSampling);
+    WriteValue(out, dDataSum);
+    WriteValue(out, iXHash);
+
+    WriteValue(out, cIterations);
+    WriteValue(out, dInitF);
+    WriteVector(out, adF);
+    WriteVector(out, adTrainError);
+    WriteVector(out, adValidError);
+    WriteVector(out, adOOBagImprove);
+
+    WriteValue(out, int64_t(vecTrees.size()));
+    for(i=0; i<vecTrees.size(); i++)
+      {
+	const CCheckpointTree &tree = vecTrees[i];
+	WriteVector(out, tree.aiSplitVar);
+	WriteVector(out, tree.adSplitPoint);
+	WriteVector(out, tree.aiLeftNode);
+	WriteVector(out, tree.aiRightNode);
+	WriteVector(out, tree.aiMissingNode);
+	WriteVector(out, tree.adErrorReduction);
+	WriteVector(out, tree.adWeight);
+	WriteVector(out, tree.adPred);
+      }
+    WriteValue(out, int64_t(vecSplitCodes.size()));
+    for(i=0; i<vecSplitCodes.size(); i++)
+      {
+	WriteVector(out, vecSplitCodes[i]);
+      }
+
+    WriteValue(out, iBest);
+    WriteValue(out, dBestCriterion);
+    WriteValue(out, dOOBagSum);
+    WriteVector(out, adFBest);
+    WriteValue(out, cCatSplitsBest);
+
+    WriteVector(out, aiXOrder);
+    WriteVector(out, aiRNGState);
+
+    out.close();
+    if(!out)
+      {
+	throw GBM::failure("cannot write checkpoint file " + tmpFile);
+      }
+  }
+
+  if(std::rename(tmpFile.c_str(), file.c_str()) != 0)
+    {
+      throw GBM::failure("cannot rename " + tmpFile + " to " + file);
+    }
+}
+
+
+void CCheckpoint::Read
+(
+    const std::string &file
+)
+{
+  unsigned long i = 0;
+  int64_t cLength = 0;
+  char szFileMagic[sizeof(szMagic)];
+  int iFileVersion = 0;
+
+  std::ifstream in(file.c_str(), std::ios::binary);
+  if(!in)
+    {
+      throw GBM::failure("cannot open checkpoint file " + file);
+    }
+
+  in.read(szFileMagic, sizeof(szFileMagic));
+  if(!in || (std::memcmp(szFileMagic, szMagic, sizeof(szMagic)) != 0))
+    {
+      throw GBM::failure(file + " is not a gbm checkpoint file");
+    }
+  ReadValue(in, iFileVersion);
+  if(iFileVersion != iVersion)
+    {
+      throw GBM::failure("unsupported checkpoint file version");
+    }
+
+  ReadString(in, family);
+  ReadValue(in, cRows);
+  ReadValue(in, cCols);
+  ReadValue(in, cTrain);
+  ReadValue(in, cClasses);
+  ReadValue(in, cDepth);
+  ReadValue(in, cMinObsInNode);
+  ReadValue(in, cFeatures);
+  ReadValue(in, dShrinkage);
+  ReadValue(in, dBagFraction);
+  int iVectorMath = 0;
+  ReadValue(in, iVectorMath);
+  fVectorMath = (iVectorMath != 0);
+  ReadValue(in, cPairBudget);
+  int iNewton = 0;
+  ReadValue(in, iNewton);
+  fNewton = (iNewton != 0);
+  ReadValue(in, dL2Penalty);
+  ReadString(in, bagType);
+  int iStreams = 0;
+  ReadValue(in, iStreams);
+  fStreams = (iStreams != 0);
+  ReadString(in, columnSampling);
+  ReadValue(in, dDataSum);
+  ReadValue(in, iXHash);
+
+  ReadValue(in, cIterations);
+  ReadValue(in, dInitF);
+  ReadVector(in, adF);
+  ReadVector(in, adTrainError);
+  ReadVector(in, adValidError);
+  ReadVector(in, adOOBagImprove);
+
+  ReadValue(in, cLength);
+  if(cLength < 0)
+    {
+      throw GBM::failure("the checkpoint file is corrupt");
+    }
+  vecTrees.resize(cLength);
+  for(i=0; i<vecTrees.size(); i++)
+    {
+      CCheckpointTree &tree = vecTrees[i];
+      ReadVector(in, tree.aiSplitVar);
+      ReadVector(in, tree.adSplitPoint);
+      ReadVector(in, tree.aiLeftNode);
+      ReadVector(in, tree.aiRightNode);
+      ReadVector(in, tree.aiMissingNode);
+      ReadVector(in, tree.adErrorReduction);
+      ReadVector(in, tree.adWeight);
+      ReadVector(in, tree.adPred);
+    }
+  ReadValue(in, cLength);
+  if(cLength < 0)
+    {
+      throw GBM::failure("the checkpoint file is corrupt");
+    }
+  vecSplitCodes.resize(cLength);
+  for(i=0; i<vecSplitCodes.size(); i++)
+    {
+      ReadVector(in, vecSplitCodes[i]);
+    }
+
+  ReadValue(in, iBest);
+  ReadValue(in, dBestCriterion);
+  ReadValue(in, dOOBagSum);
+  ReadVector(in, adFBest);
+  ReadValue(in, cCatSplitsBest);
+
+  ReadVector(in, aiXOrder);
+  ReadVector(in, aiRNGState);
+
+  if((vecTrees.size() != (unsigned long)(cIterations*cClasses)) ||
+     (adF.size() != (unsigned long)(cRows*cClasses)) ||
+     (aiXOrder.size() != (unsigned long)(cTrain*cCols)))
+    {
+      throw GBM::failure("the checkpoint file is corrupt");
+    }
+}
+
+
+void CCheckpoint::CheckMatches
+(
+    const CCheckpoint &current
+) const
+{
+  if((family != current.family) ||
+     (cRows != current.cRows) ||
+     (cCols != current.cCols) ||
+     (cTrain != current.cTrain) ||
+     (cClasses != current.cClasses) ||
+     (cDepth != current.cDepth) ||
+     (cMinObsInNode != current.cMinObsInNode) ||
+     (cFeatures != current.cFeatures) ||
+     (dShrinkage != current.dShrinkage) ||
+     (dBagFraction != current.dBagFraction) ||
+     (fVectorMath != current.fVectorMath) ||
+     (cPairBudget != current.cPairBudget) ||
+     (fNewton != current.fNewton) ||
+     (dL2Penalty != current.dL2Penalty) ||
+     (bagType != current.bagType) ||
+     (fStreams != current.fStreams) ||
+     (columnSampling != current.columnSampling))
+    {
+      throw GBM::invalid_argument("the checkpoint was written with different settings");
+    }
+  if((dDataSum != current.dDataSum) || (iXHash != current.iXHash))
+    {
+      throw GBM::invalid_argument("the checkpoint was written for different data");
+    }
+}
+
+
+uint32_t CCheckpoint::Hash
+(
+    const double *adValues,
+    std::size_t cValues
+)
+{
+  const unsigned char *ab = reinterpret_cast<const unsigned char*>(adValues);
+  const std::size_t cBytes = cValues*sizeof(double);
+  uint32_t iHash = 2166136261u;
+  std::size_t i = 0;
+
+  for(i=0; i<cBytes; i++)
+    {
+      iHash = (iHash ^ ab[i]) * 16777619u;
+    }
+  return iHash;
+}
@@ -0,0 +1,107 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       checkpoint.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   binary snapshot of a training run, for resuming it
+//
+//------------------------------------------------------------------------------
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "node.h"
+#include "gbmexcept.h"
+
+// One tree as returned to R by gbm_transfer_to_R().
+struct CCheckpointTree
+{
+    std::vector<int> aiSplitVar;
+    std::vector<double> adSplitPoint;
+    std::vector<int> aiLeftNode;
+    std::vector<int> aiRightNode;
+    std::vector<int> aiMissingNode;
+    std::vector<double> adErrorReduction;
+    std::vector<double> adWeight;
+    std::vector<double> adPred;
+};
+
+// CCheckpoint holds everything the training loop of gbm() needs to carry on
+// where it stopped: the scores adF, the trees and categorical splits so far,
+// the error histories, the early stopping state, the presorted index of
+// the data and the state of R's random number generator.  The settings and
+// a fingerprint of the data are kept so that a checkpoint is only resumed
+// with the call that wrote it.
+//
+// The file is a fixed sequence of native-endian integers, doubles, and
+// vectors written as their 64 bit length followed by the elements.  It
+// starts with a magic string and a format version.  Write() goes through a
+// temporary file that is renamed at the end, so an interrupted write
+// leaves the previous checkpoint intact.
+
+class CCheckpoint
+{
+public:
+
+    CCheckpoint();
+    ~CCheckpoint();
+
+    void Write(const std::string &file) const;
+    void Read(const std::string &file);
+
+    // throws GBM::invalid_argument if the settings or data differ
+    void CheckMatches(const CCheckpoint &current) const;
+
+    // FNV-1a hash of the bytes of cValues doubles, for iXHash
+    static uint32_t Hash(const double *adValues, std::size_t cValues);
+
+    // settings of the run
+    std::string family;
+    int cRows;
+    int cCols;
+    int cTrain;
+    int cClasses;
+    int cDepth;
+    int cMinObsInNode;
+    int cFeatures;
+    double dShrinkage;
+    double dBagFraction;
+    bool fVectorMath;
+    int cPairBudget;
+    bool fNewton;
+    double dL2Penalty;
+    std::string bagType;        // the name of its CGBM::Bagging
+    bool fStreams;              // CGBM::SetStreams()
+    std::string columnSampling; // the name of its CColumnSampler::Mode
+    double dDataSum;            // sum of y, w, offset and misc
+    uint32_t iXHash;            // Hash() of the predictors
+
+    // state after cIterations iterations
+    int cIterations;
+    double dInitF;
+    std::vector<double> adF;
+    std::vector<double> adTrainError;
+    std::vector<double> adValidError;
+    std::vector<double> adOOBagImprove;
+    std::vector<CCheckpointTree> vecTrees;
+    VEC_VEC_CATEGORIES vecSplitCodes;
+
+    // early stopping
+    int iBest;
+    double dBestCriterion;
+    double dOOBagSum;
+    std::vector<double> adFBest;
+    int cCatSplitsBest;
+
+    std::vector<int> aiXOrder;
+    std::vector<int> aiRNGState;    // .Random.seed
+};
+
+#endif // CHECKPOINT_H
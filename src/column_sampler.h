@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       column_sampler.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   draws the predictors tried by the split search
+//
+//------------------------------------------------------------------------------
+
+#ifndef COLUMN_SAMPLER_H
+#define COLUMN_SAMPLER_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gbmexcept.h"
+#include "random.h"
+
+// Draw() puts a uniform sample of cDraw of the column numbers 0 to
+// cColumns-1, in random order, at the front of a buffer kept from one draw
+// to the next.  It is a partial Fisher-Yates shuffle: cDraw uniforms and
+// cDraw swaps, which the next draw swaps back first, so that every draw
+// starts from 0, 1, ..., cColumns-1 without refilling the buffer or
+// allocating.  Drawing all the columns shuffles them as std::random_shuffle()
+// of libstdc++ does, which is how gbm has always ordered them.
+//
+// The Mode says how often a tree draws (CCARTTree::SetColumnSampling()):
+// TREE once for the whole tree, LEVEL once for each split (the nodes made
+// by a split are searched with the same columns) and NODE once for each
+// node.
+
+class CColumnSampler
+{
+public:
+
+    enum Mode { TREE, LEVEL, NODE };
+
+    // the Mode named "tree", "level" or "node"
+    static Mode Named(const std::string &name)
+    {
+      if(name == "tree") return TREE;
+      if(name == "level") return LEVEL;
+      if(name == "node") return NODE;
+      throw GBM::invalid_argument("the column sampling must be tree, level or node");
+    }
+
+    // the first cDraw of Columns() are the sample
+    void Draw(CRandom &random, int cColumns, int cDraw)
+    {
+      CShuffler shuffler(random);
+      int i = 0;
+
+      Restore(cColumns);
+      if(cDraw >= cColumns)
+        {
+          for(i=1; i<cColumns; i++)
+            {
+              Swap(i, int(shuffler(i+1)));
+            }
+        }
+      else
+        {
+          for(i=0; i<cDraw; i++)
+            {
+              Swap(i, i + int(shuffler(cColumns-i)));
+            }
+        }
+    }
+
+    const int *Columns() const { return &aiColumns[0]; }
+
+private:
+
+    // undoes the swaps of the last draw, or fills a new buffer
+    void Restore(int cColumns)
+    {
+      if(int(aiColumns.size()) != cColumns)
+        {
+          aiColumns.resize(cColumns);
+          for(int i=0; i<cColumns; i++)
+            {
+              aiColumns[i] = i;
+            }
+          aiSwaps.clear();
+        }
+      while(!aiSwaps.empty())
+        {
+          const int j = aiSwaps.back();
+          aiSwaps.pop_back();
+          const int i = aiSwaps.back();
+          aiSwaps.pop_back();
+          std::swap(aiColumns[i], aiColumns[j]);
+        }
+    }
+
+    void Swap(int i, int j)
+    {
+      std::swap(aiColumns[i], aiColumns[j]);
+      aiSwaps.push_back(i);
+      aiSwaps.push_back(j);
+    }
+
+    std::vector<int> aiColumns;
+    std::vector<int> aiSwaps;   // the pairs swapped by the last draw
+};
+
+#endif // COLUMN_SAMPLER_H
@@ -1,5 +1,8 @@
 //  GBM by Greg Ridgeway  Copyright (C) 2003
 
+#include <cfloat>
+#include <cmath>
+
 #include "coxph.h"
 
 CCoxPH::CCoxPH()
@@ -112,7 +115,7 @@ void CCoxPH::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long>& aiNodeAssign,
+    const CNodeAssign& aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -123,18 +126,20 @@ void CCoxPH::FitBestConstant
 {
     double dF = 0.0;
     double dRiskTot = 0.0;
+    double dExpF = 0.0;
+    double dSumC = 0.0;
+    double dSumD = 0.0;
     unsigned long i = 0;
     unsigned long k = 0;
     unsigned long m = 0;
-
-    double dTemp = 0.0;
-    bool fTemp = false;
     unsigned long K = 0;
+    unsigned long cDim = 0;
     veciK2Node.resize(cTermNodes);
     veciNode2K.resize(cTermNodes);
 
     for(i=0; i<cTermNodes; i++)
     {
+        vecpTermNodes[i]->dPrediction = 0.0;
         veciNode2K[i] = 0;
         if(vecpTermNodes[i]->cN >= cMinObsInNode)
         {
@@ -143,94 +148,200 @@ void CCoxPH::FitBestConstant
             K++;
         }
     }
+    if(K < 2)
+    {
+        return;
+    }
 
-    vecdP.resize(K);
+    // Newton step for the partial likelihood, Ridgeway (1999) pp. 100-101,
+    // with terminal node K-1 fixed at 0.0 for identifiability.  At the
+    // event of row i with risk set total R_i and per-node risk sums P(i)
+    //
+    //   g = sum_i w_i (e_node(i) - P(i)/R_i)
+    //   -H = sum_i w_i/R_i diag(P(i)) - sum_i w_i/R_i^2 P(i) P(i)'
+    //
+    // P(i) changes in one element per row, so the rank-one sum is
+    // accumulated one row of H per observation: row j in node k adds
+    // e_j U_j P(j) to row k, where e_j = w_j exp(f_j) and U_j is the sum of
+    // w_i/R_i^2 over the events at or after j.  That makes the cost
+    // O(nTrain K) instead of O(events K^2).
+    cDim = K-1;
+    vecdRiskTot.resize(nTrain);
+    vecdU.resize(nTrain);
+    vecdV.resize(nTrain);
 
-    matH.setactualsize(K-1);
-    vecdG.resize(K-1);
-    vecdG.assign(K-1,0.0);
+    // risk sets and the terms of each event
+    dRiskTot = 0.0;
+    for(i=0; i<nTrain; i++)
+    {
+        if(afInBag[i] && (vecpTermNodes[aiNodeAssign[i]]->cN >= cMinObsInNode))
+        {
+            dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
+            dExpF = adW[i]*std::exp(dF);
+            dRiskTot += dExpF;
+            vecdRiskTot[i] = dExpF;
+            vecdU[i] = 0.0;
+            vecdV[i] = 0.0;
+            if(adDelta[i]==1.0)
+            {
+                vecdU[i] = adW[i]/(dRiskTot*dRiskTot);
+                vecdV[i] = adW[i]/dRiskTot;
+            }
+        }
+    }
 
-    // zero the Hessian
-    for(k=0; k<K-1; k++)
+    // sums over the later events, smallest terms first
+    dSumC = 0.0;
+    dSumD = 0.0;
+    for(i=nTrain-1; i!=ULONG_MAX; i--) // i is unsigned so wraps to ULONG_MAX
     {
-        for(m=0; m<K-1; m++)
+        if(afInBag[i] && (vecpTermNodes[aiNodeAssign[i]]->cN >= cMinObsInNode))
         {
-            matH.setvalue(k,m,0.0);
+            dSumC += vecdU[i];
+            dSumD += vecdV[i];
+            vecdU[i] = dSumC;
+            vecdV[i] = dSumD;
         }
     }
 
-    // get the gradient & Hessian, Ridgeway (1999) pp. 100-101
-    // correction from Ridgeway (1999): fix terminal node K-1 prediction to 0.0
-    //      for identifiability
-    dRiskTot = 0.0;
-    vecdP.assign(K,0.0);
+    // gradient and packed lower triangle of the rank-one part
+    vecdP.assign(cDim,0.0);
+    vecdG.assign(cDim,0.0);
+    vecdQ.assign(cDim,0.0);
+    vecdH.assign(cDim*(cDim+1)/2,0.0);
     for(i=0; i<nTrain; i++)
     {
         if(afInBag[i] && (vecpTermNodes[aiNodeAssign[i]]->cN >= cMinObsInNode))
         {
-            dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-            vecdP[veciNode2K[aiNodeAssign[i]]] += adW[i]*std::exp(dF);
-            dRiskTot += adW[i]*std::exp(dF);
-
+            k = veciNode2K[aiNodeAssign[i]];
+            if(k == cDim)
+            {
+                continue;
+            }
+            dExpF = vecdRiskTot[i];
+            const double dScale = dExpF*vecdU[i];
+            double *adRow = &vecdH[k*(k+1)/2];
+            for(m=0; m<k; m++)
+            {
+                adRow[m] += dScale*vecdP[m];
+            }
+            adRow[k] += dScale*(2.0*vecdP[k] + dExpF);
+            for(m=k+1; m<cDim; m++)
+            {
+                vecdH[m*(m+1)/2 + k] += dScale*vecdP[m];
+            }
+            vecdQ[k] += dExpF*vecdV[i];
+            vecdP[k] += dExpF;
             if(adDelta[i]==1.0)
             {
-                // compute g and H
-                for(k=0; k<K-1; k++)
-                {
-                    vecdG[k] +=
-                        adW[i]*((aiNodeAssign[i]==veciK2Node[k]) - vecdP[k]/dRiskTot);
-
-                    matH.getvalue(k,k,dTemp,fTemp);
-                    matH.setvalue(k,k,dTemp -
-                        adW[i]*vecdP[k]/dRiskTot*(1-vecdP[k]/dRiskTot));
-                    for(m=0; m<k; m++)
-                    {
-                        matH.getvalue(k,m,dTemp,fTemp);
-                        dTemp += adW[i]*vecdP[k]/dRiskTot*vecdP[m]/dRiskTot;
-                        matH.setvalue(k,m,dTemp);
-                        matH.setvalue(m,k,dTemp);
-                    }
-                }
+                vecdG[k] += adW[i];
             }
         }
     }
 
-    /*
-    for(k=0; k<K-1; k++)
+    // -H = diag(Q) - S, g = G - Q
+    for(k=0; k<cDim; k++)
     {
-        for(m=0; m<K-1; m++)
+        double *adRow = &vecdH[k*(k+1)/2];
+        for(m=0; m<k; m++)
         {
-            matH.getvalue(k,m,dTemp,fTemp);
-            Rprintf("%f ",dTemp);
+            adRow[m] = -adRow[m];
         }
-        Rprintf("\n");
+        adRow[k] = vecdQ[k] - adRow[k];
+        vecdG[k] -= vecdQ[k];
     }
-    */
 
     // one step to get leaf predictions
-    matH.invert();
+    CholeskySolve(&vecdH[0], &vecdG[0], cDim);
 
-    for(k=0; k<cTermNodes; k++)
+    for(k=0; k<cDim; k++)
     {
-        vecpTermNodes[k]->dPrediction = 0.0;
+        if(std::abs(vecdG[k]) <= DBL_MAX)
+        {
+            vecpTermNodes[veciK2Node[k]]->dPrediction = vecdG[k];
+        }
     }
-    for(m=0; m<K-1; m++)
+    // vecpTermNodes[veciK2Node[K-1]]->dPrediction = 0.0; // already set to 0.0
+}
+
+
+// Solves A x = b in place for a symmetric positive semi-definite A given as
+// its packed lower triangle, row by row.  adA is overwritten by the Cholesky
+// factor and adB by x.  Directions in which A is singular (a pivot that
+// vanishes relative to its diagonal element) get x = 0 and the remaining
+// system is solved as if they were absent.
+void CCoxPH::CholeskySolve
+(
+    double *adA,
+    double *adB,
+    unsigned long cDim
+)
+{
+    unsigned long i = 0;
+    unsigned long j = 0;
+    unsigned long k = 0;
+    double dSum = 0.0;
+
+    for(i=0; i<cDim; i++)
     {
-        for(k=0; k<K-1; k++)
+        double *adRowI = &adA[i*(i+1)/2];
+        for(j=0; j<i; j++)
         {
-            matH.getvalue(k,m,dTemp,fTemp);
-            if(!R_FINITE(dTemp)) // occurs if matH was not invertible
+            const double *adRowJ = &adA[j*(j+1)/2];
+            if(adRowJ[j] == 0.0)
             {
-                vecpTermNodes[veciK2Node[k]]->dPrediction = 0.0;
-                break;
+                adRowI[j] = 0.0;
+                continue;
             }
-            else
+            dSum = adRowI[j];
+            for(k=0; k<j; k++)
             {
-                vecpTermNodes[veciK2Node[k]]->dPrediction -= dTemp*vecdG[m];
+                dSum -= adRowI[k]*adRowJ[k];
             }
-          }
+            adRowI[j] = dSum/adRowJ[j];
+        }
+        dSum = adRowI[i];
+        for(k=0; k<i; k++)
+        {
+            dSum -= adRowI[k]*adRowI[k];
+        }
+        // also catches NaN
+        adRowI[i] = ((dSum > 0.0) && (dSum > 1e-12*adRowI[i])) ?
+            std::sqrt(dSum) : 0.0;
+    }
+
+    // L y = b
+    for(i=0; i<cDim; i++)
+    {
+        const double *adRowI = &adA[i*(i+1)/2];
+        if(adRowI[i] == 0.0)
+        {
+            adB[i] = 0.0;
+            continue;
+        }
+        dSum = adB[i];
+        for(k=0; k<i; k++)
+        {
+            dSum -= adRowI[k]*adB[k];
+        }
+        adB[i] = dSum/adRowI[i];
+    }
+
+    // L' x = y
+    for(i=cDim-1; i!=ULONG_MAX; i--)
+    {
+        if(adA[i*(i+1)/2 + i] == 0.0)
+        {
+            adB[i] = 0.0;
+            continue;
+        }
+        dSum = adB[i];
+        for(k=i+1; k<cDim; k++)
+        {
+            dSum -= adA[k*(k+1)/2 + i]*adB[k];
+        }
+        adB[i] = dSum/adA[i*(i+1)/2 + i];
     }
-    // vecpTermNodes[veciK2Node[K-1]]->dPrediction = 0.0; // already set to 0.0
 }
 
 
@@ -19,7 +19,6 @@
 #define COXPH_H
 
 #include "distribution.h"
-#include "matrix.h"
 
 class CCoxPH : public CDistribution
 {
@@ -52,7 +51,7 @@ public:
 			 const double *adW,
 			 const double *adF,
 			 double *adZ,
-			 const std::vector<unsigned long>& aiNodeAssign,
+			 const CNodeAssign& aiNodeAssign,
 			 unsigned long nTrain,
 			 VEC_P_NODETERMINAL vecpTermNodes,
 			 unsigned long cTermNodes,
@@ -79,14 +78,17 @@ public:
 
 
 private:
+    static void CholeskySolve(double *adA, double *adB, unsigned long cDim);
+
     vector<double> vecdP;
     vector<double> vecdRiskTot;
+    vector<double> vecdU;
+    vector<double> vecdV;
     vector<double> vecdG;
+    vector<double> vecdQ;
+    vector<double> vecdH;  // packed lower triangle of -H
     vector<unsigned long> veciK2Node;
     vector<unsigned long> veciNode2K;
-
-    matrix<double> matH;
-    matrix<double> matHinv;
 };
 
 #endif // COXPH_H
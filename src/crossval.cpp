@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       crossval.cpp
+//
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+#include "gbm.h"
+#include "threads.h"
+
+namespace {
+
+  // fits the model of fold iFold
+  void FitFold
+  (
+   const CDataset &data,
+   int cTrain,
+   const int *aiFold,
+   int iFold,
+   const CFitSettings &settings,
+   CRandom &random,
+   CFitResult &fold
+  )
+  {
+    int i = 0;
+
+    // the weights of the fit are 0 on the held-out rows, those of the
+    // validation 0 on the others
+    const double *adWeight = data.weight_ptr();
+    bag afHeldOut(cTrain, false);
+    std::vector<double> adFitWeight(cTrain, 0.0);
+    std::vector<double> adHeldOutWeight(cTrain, 0.0);
+    int cHeldOut = 0;
+    for(i=0; i<cTrain; i++)
+      {
+        if(aiFold[i] == iFold)
+          {
+            afHeldOut[i] = true;
+            adHeldOutWeight[i] = adWeight[i];
+            cHeldOut++;
+          }
+        else
+          {
+            adFitWeight[i] = adWeight[i];
+          }
+      }
+    if((cHeldOut == 0) || (cHeldOut == cTrain))
+      {
+        char szMessage[64];
+        std::sprintf(szMessage, "fold %d holds out no rows or all of them", iFold);
+        throw GBM::invalid_argument(szMessage);
+      }
+    const CDataset foldData(data, &adFitWeight[0], cTrain);
+
+    CFitOptions options;
+    options.pRandom = &random;
+    options.pafHeldOut = &afHeldOut;
+    options.adHeldOutWeight = &adHeldOutWeight[0];
+    gbm_fit(foldData, cTrain, settings, options, fold);
+  }
+
+  // an exception may not leave a parallel region, so the models keep
+  // their errors until all have finished
+  void ThrowFirstError(const std::vector<std::string> &vecErrors)
+  {
+    for(std::size_t i=0; i<vecErrors.size(); i++)
+      {
+        if(!vecErrors[i].empty())
+          {
+            throw GBM::failure(vecErrors[i]);
+          }
+      }
+  }
+
+  void KeepError(const std::exception &e, std::string &error)
+  {
+    error = e.what();
+    if(error.empty())
+      {
+        error = "the fit failed";
+      }
+  }
+}
+
+
+void gbm_cross_validate
+(
+ const CDataset &data,
+ int cTrain,
+ const int *aiFold,
+ int cFolds,
+ const CFitSettings &settings,
+ CRandom *const *apRandom,
+ int cThreads,
+ std::vector<CFitResult> &vecFolds
+)
+{
+  int iFold = 0;
+
+  if((cTrain <= 0) || (cTrain > data.nrow()))
+    {
+      throw GBM::invalid_argument("nTrain does not match the data");
+    }
+  if((settings.family == "coxph") ||
+     (settings.family.compare(0, 8, "pairwise") == 0))
+    {
+      throw GBM::invalid_argument("threaded cross-validation does not support " +
+                                  settings.family);
+    }
+
+  vecFolds.assign(cFolds, CFitResult());
+  std::vector<std::string> vecErrors(cFolds);
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(ThreadCount(cThreads))
+  for(iFold=0; iFold<cFolds; iFold++)
+    {
+      try
+        {
+          FitFold(data, cTrain, aiFold, iFold+1, settings, *apRandom[iFold],
+                  vecFolds[iFold]);
+        }
+      catch(const std::exception &e)
+        {
+          KeepError(e, vecErrors[iFold]);
+        }
+    }
+
+  ThrowFirstError(vecErrors);
+}
+
+
+double GridCost(const CFitSettings &settings, int cTrain)
+{
+  return double(settings.cTrees) * cTrain *
+    (1.0 + settings.cDepth * settings.cFeatures * (1.0 + settings.dBagFraction));
+}
+
+
+void gbm_fit_grid
+(
+ const CDataset &data,
+ int cTrain,
+ const std::vector<CFitSettings> &vecSettings,
+ CRandom *const *apRandom,
+ int cThreads,
+ std::vector<CFitResult> &vecModels
+)
+{
+  const int cModels = int(vecSettings.size());
+  int i = 0;
+
+  if((cTrain <= 0) || (cTrain > data.nrow()))
+    {
+      throw GBM::invalid_argument("nTrain does not match the data");
+    }
+
+  // the models in decreasing order of cost, so that a thread that
+  // finishes early is left with the cheap ones
+  std::vector<std::pair<double, int> > vecOrder(cModels);
+  for(i=0; i<cModels; i++)
+    {
+      vecOrder[i] = std::make_pair(-GridCost(vecSettings[i], cTrain), i);
+    }
+  std::sort(vecOrder.begin(), vecOrder.end());
+
+  vecModels.assign(cModels, CFitResult());
+  std::vector<std::string> vecErrors(cModels);
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(ThreadCount(cThreads))
+  for(i=0; i<cModels; i++)
+    {
+      const int iModel = vecOrder[i].second;
+      try
+        {
+          CFitOptions options;
+          options.pRandom = apRandom[iModel];
+          gbm_fit(data, cTrain, vecSettings[iModel], options,
+                  vecModels[iModel]);
+        }
+      catch(const std::exception &e)
+        {
+          KeepError(e, vecErrors[iModel]);
+        }
+    }
+
+  ThrowFirstError(vecErrors);
+}
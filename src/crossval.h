@@ -0,0 +1,61 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       crossval.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   cross-validation folds and grids of settings fitted on
+//              threads over shared data
+//
+//------------------------------------------------------------------------------
+
+#ifndef CROSSVAL_H
+#define CROSSVAL_H
+
+#include <string>
+#include <vector>
+
+#include "dataset.h"
+#include "fit.h"
+#include "random.h"
+
+// Fits the models of a cFolds-fold cross-validation on the first cTrain
+// rows of data, which have to be its training rows with their presorted
+// index.  aiFold gives the fold (1 to cFolds) of each row; the model of
+// fold k is fitted on the rows of the other folds and validated on those
+// of fold k.  The folds run on cThreads threads (see ThreadCount()), all
+// of them reading data and its index: a fold is a mask of held-out rows
+// and its own weights, zero on those rows, and not a copy of the data.
+// apRandom holds the generator of each fold.  Folds with no rows, or all
+// of them, are an error; coxph and pairwise are not supported, since
+// coxph reorders and pairwise groups its rows.
+void gbm_cross_validate(const CDataset &data,
+                        int cTrain,
+                        const int *aiFold,
+                        int cFolds,
+                        const CFitSettings &settings,
+                        CRandom *const *apRandom,
+                        int cThreads,
+                        std::vector<CFitResult> &vecFolds);
+
+// Fits a model for each of vecSettings on data, whose first cTrain rows
+// are the training rows with their presorted index and the others the
+// validation rows, as gbm() does.  The models share data and its index,
+// and run on cThreads threads with the generators in apRandom, one per
+// model, so that they do not depend on the number of threads.  The most
+// expensive models by GridCost() are started first, which keeps the
+// threads busy to the end when the costs differ.
+void gbm_fit_grid(const CDataset &data,
+                  int cTrain,
+                  const std::vector<CFitSettings> &vecSettings,
+                  CRandom *const *apRandom,
+                  int cThreads,
+                  std::vector<CFitResult> &vecModels);
+
+// The expected time of fitting a model with settings on cTrain rows, in
+// arbitrary units: each split of a tree passes over the presorted index of
+// each predictor searched, and works on the rows in the bag.
+double GridCost(const CFitSettings &settings, int cTrain);
+
+#endif // CROSSVAL_H
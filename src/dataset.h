@@ -17,84 +17,124 @@
 #ifndef DATASET_H
 #define DATASET_H
 
+#include <algorithm>
 #include <vector>
 
-#include <Rcpp.h>
-
-typedef std::vector<int> bag;
+// in-bag flags for the training observations, one bit per row
+typedef std::vector<bool> bag;
 
 #include "buildinfo.h"
 #include "gbmexcept.h"
+#include "random.h"
 
-namespace {
-  inline bool has_value(const Rcpp::NumericVector& x) {
-    return !( (x.size() == 1) && (ISNA(x[0])));
-  }
-
-  std::ptrdiff_t shuffler(std::ptrdiff_t n) {
-    return n * unif_rand();
-  }
+// missing values of the predictors are NaN (R's NA is one)
+inline bool is_missing(double dX) {
+  return dX != dX;
 }
-  
+
+// CDataset is a read-only view of the data in buffers owned by the caller,
+// which have to outlive it: the response, weights and offset of each row,
+// the family specific misc (a value per row for coxph and pairwise, the
+// parameter of tweedie, quantile, tdist and multinomial), the cRows x cCols
+// predictors in column-major order, the class (0 for continuous, else the
+// number of levels) and monotone constraint of each predictor, and the
+// presorted index of the training rows (see presort.h).  adOffset and
+// adMisc are NULL when there are none.  The predictors can also be given
+// as one pointer per column, so that the columns need not be adjacent
+// (gbmtool maps them from a file).  The R package builds it from the
+// arguments of gbm() in gbmentry.cpp.  The folds of a cross-validation
+// see the first rows of the shared data with weights of their own.
+//
+// For data larger than memory (gbmtool train --scratch) the index and the
+// values in its order (SetSortedValues()) can live in a mapped file, and a
+// CColumnPager set with SetPager() is told which column the split search
+// reads next, so that it can be read ahead, and which it has finished.
+
+// Reads the columns of the split search ahead of it.  Fetch() is called
+// for the next column before the search reads the current one and should
+// not block; Release() when the search is done with a column.
+class CColumnPager
+{
+public:
+
+    virtual ~CColumnPager() {}
+
+    virtual void Fetch(int iVar) = 0;
+    virtual void Release(int iVar) = 0;
+};
 
 class CDataset
 {
 public:
-  CDataset(SEXP radY, SEXP radOffset, SEXP radX, SEXP raiXOrder,
-           SEXP radWeight, SEXP radMisc,
-           SEXP racVarClasses, SEXP ralMonotoneVar) :
-  adY(radY), adOffset(radOffset), adWeight(radWeight), adMisc(radMisc),
-    adX(radX),
-    acVarClasses(racVarClasses), alMonotoneVar(ralMonotoneVar),
-    aiXOrder(raiXOrder),
-    fHasMisc(has_value(adMisc)), fHasOffset(has_value(adOffset)) {
-
-    if (adX.ncol() != alMonotoneVar.size()) {
-      throw GBM::invalid_argument("shape mismatch (monotone does not match data)");
-    }
-    
-    if (adX.ncol() != acVarClasses.size()) {
-      throw GBM::invalid_argument("shape mismatch (var classes does not match daa)");
+  CDataset(const double *adY, const double *adOffset, const double *adX,
+           const int *aiXOrder, const double *adWeight, const double *adMisc,
+           const int *acVarClasses, const int *alMonotoneVar,
+           int cRows, int cCols) :
+  adY(adY), adOffset(adOffset), adWeight(adWeight), adMisc(adMisc),
+    vecpXColumns(cCols),
+    acVarClasses(acVarClasses), alMonotoneVar(alMonotoneVar),
+    aiXOrder(aiXOrder), adXSorted(0), pPager(0),
+    cRows(cRows), cCols(cCols) {
+
+    for (int iCol=0; iCol<cCols; iCol++) {
+      vecpXColumns[iCol] = adX + std::size_t(iCol)*cRows;
     }
+  };
 
+  CDataset(const double *adY, const double *adOffset,
+           const double *const *apdXColumns,
+           const int *aiXOrder, const double *adWeight, const double *adMisc,
+           const int *acVarClasses, const int *alMonotoneVar,
+           int cRows, int cCols) :
+  adY(adY), adOffset(adOffset), adWeight(adWeight), adMisc(adMisc),
+    vecpXColumns(apdXColumns, apdXColumns + cCols),
+    acVarClasses(acVarClasses), alMonotoneVar(alMonotoneVar),
+    aiXOrder(aiXOrder), adXSorted(0), pPager(0),
+    cRows(cRows), cCols(cCols) {};
+
+  // the first cRows rows of data with the weights adWeight
+  CDataset(const CDataset &data, const double *adWeight, int cRows) :
+  adY(data.adY), adOffset(data.adOffset), adWeight(adWeight),
+    adMisc(data.adMisc),
+    vecpXColumns(data.vecpXColumns),
+    acVarClasses(data.acVarClasses), alMonotoneVar(data.alMonotoneVar),
+    aiXOrder(data.aiXOrder), adXSorted(data.adXSorted), pPager(data.pPager),
+    cRows(cRows), cCols(data.cCols) {
+
+    if (cRows > data.cRows) {
+      throw GBM::invalid_argument("more rows than in the data");
+    }
   };
 
   virtual ~CDataset()  {};
 
+  // the values of the training rows in the order of the index, as
+  // SortedValues() (presort.h) computes them, or NULL
+  void SetSortedValues(const double *adXSorted) {
+    this->adXSorted = adXSorted;
+  }
+
+  void SetPager(CColumnPager *pPager) {
+    this->pPager = pPager;
+  }
+
   typedef std::vector<int> index_vector;
   
   int nrow() const {
-    return adX.nrow();
+    return cRows;
   }
 
   int ncol() const {
-    return adX.ncol();
-  }
-
-  double* y_ptr() {
-    return adY.begin();
+    return cCols;
   }
 
   const double* y_ptr() const {
-    return adY.begin();
+    return adY;
   }
 
-  
-  double* offset_ptr(bool require=true) {
-    if (has_offset()) {
-      return adOffset.begin();
-    } else {
-      if (require) {
-        throw GBM::failure("You require a genuine offset, and don't have one.");
-      } else {
-        return 0;
-      }
-    }
-  }    
-
   const double* offset_ptr(bool require=true) const {
     if (has_offset()) {
-      return adOffset.begin();
+      return adOffset;
     } else {
       if (require) {
         throw GBM::failure("You require a genuine offset, and don't have one.");
@@ -104,29 +144,13 @@ public:
     }
   }    
 
-  double* weight_ptr() {
-    return adWeight.begin();
-  }
-
   const double* weight_ptr() const {
-    return adWeight.begin();
-  }
-
-  double* misc_ptr(bool require=true) {
-    if (has_misc()) {
-      return adMisc.begin();
-    } else {
-      if (require) {
-        throw GBM::failure("You require genuine misc, and don't have it.");
-      } else {
-        return 0;
-      }
-    }
+    return adWeight;
   }
 
   const double* misc_ptr(bool require=true) const {
     if (has_misc()) {
-      return adMisc.begin();
+      return adMisc;
     } else {
       if (require) {
         throw GBM::failure("You require genuine misc, and don't have it.");
@@ -144,49 +168,41 @@ public:
     return alMonotoneVar[ind];
   }
   
-  int* order_ptr() {
-    return aiXOrder.begin();
+  const int* order_ptr() const {
+    return aiXOrder;
   }
 
-  const int* order_ptr() const {
-    return aiXOrder.begin();
+  const double* sorted_x_ptr() const {
+    return adXSorted;
+  }
+
+  CColumnPager* pager() const {
+    return pPager;
   }
 
   bool has_misc() const {
-    return fHasMisc;
+    return adMisc != 0;
   }
 
   bool has_offset() const {
-    return fHasOffset;
+    return adOffset != 0;
   }
 
   double x_value(const int row, const int col) const {
-    return adX(row, col);
+    return vecpXColumns[col][row];
   }
 
-  index_vector random_order() const {
-    index_vector result(ncol());
-    // fill the vector
-    for (index_vector::size_type ind=0; ind!=result.size(); ++ind) {
-      result[ind] = ind;
-    }
-    // and now shuffle
-    std::random_shuffle(result.begin(), result.end(), shuffler);
-    // and return
-    return result;
-  }
-  
  private:
     
-  Rcpp::NumericVector adY, adOffset, adWeight, adMisc;
-  Rcpp::NumericMatrix adX;
-  Rcpp::IntegerVector acVarClasses, alMonotoneVar, aiXOrder;
-
-  bool fHasMisc;
-  bool fHasOffset;
+  const double *adY, *adOffset, *adWeight, *adMisc;
+  std::vector<const double*> vecpXColumns;
+  const int *acVarClasses, *alMonotoneVar, *aiXOrder;
+  const double *adXSorted;
+  CColumnPager *pPager;
+
+  int cRows;
+  int cCols;
   
 };
 
 #endif // DATASET_H
-
-
@@ -4,7 +4,9 @@
 
 CDistribution::CDistribution()
 {
-
+    cThreads = 1;
+    pRandom = NULL;
+    pAllreduce = NULL;
 }
 
 CDistribution::~CDistribution()
@@ -12,5 +14,33 @@ CDistribution::~CDistribution()
 }
 
 
+bool CDistribution::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long cLength,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    unsigned long i = 0;
+
+    dOOBagImprove = BagImprovement(adY, adMisc, adOffset, adWeight,
+                                   adF, adFadj, afInBag, dStepSize, cLength);
 
+    for(i=0; i < cLength; i++)
+    {
+        adF[i] += dStepSize * adFadj[i];
+    }
 
+    dTrainError = Deviance(adY, adMisc, adOffset, adWeight, adF, cLength);
+
+    return false;
+}
@@ -19,7 +19,12 @@
 
 #include <vector>
 
+#include "allreduce.h"
 #include "node_terminal.h"
+#include "node_assign.h"
+#include "vecmath.h"
+#include "random.h"
+#include "gbmexcept.h"
 
 class CDistribution
 {
@@ -29,6 +34,38 @@ public:
     CDistribution();
     virtual ~CDistribution();
 
+// SetVectorMath() chooses between the vectorized exp() and log() of
+// CVecMath (the default) and the scalar libm functions.
+
+    void SetVectorMath(bool fVector) { vecmath.SetVector(fVector); }
+
+// SetThreadCount() sets the number of threads a distribution may use in
+// its own loops (cThreads < 1 means the OpenMP default).  It has to be
+// called before Initialize().
+
+    void SetThreadCount(int cThreads) { this->cThreads = cThreads; }
+
+// SetRandom() sets the generator of the distributions that draw random
+// numbers (pairwise); CGBM passes on its own.
+
+    void SetRandom(CRandom *pRandom) { this->pRandom = pRandom; }
+
+// SetAllreduce() makes the distribution sum whatever it sums over rows in
+// InitF(), FitBestConstant(), Deviance(), BagImprovement() and
+// UpdateScores() over the workers of data-parallel training (allreduce.h)
+// before it uses the sums; CGBM passes on its own.  Only distributions
+// with CanDistribute() do.
+
+    void SetAllreduce(CAllreduce *pAllreduce) { this->pAllreduce = pAllreduce; }
+    virtual bool CanDistribute() const { return false; }
+
+// NumClasses() is the number of scores per instance.  A distribution with
+// K > 1 classes keeps K scores per instance in adF, adZ and adFadj, class k
+// of instance i at [k*cLength + i] where cLength is the number of instances
+// passed to Initialize(); CGBM grows one tree per class in each iteration.
+
+    virtual unsigned long NumClasses() const { return 1; }
+
 // In the subsequent functions, parameters have the following meaning:
 // * adY      - The target
 // * adMisc   - Optional auxiliary data (the precise meaning is specific to the
@@ -72,6 +109,23 @@ public:
 					const bag& afInBag,
 					unsigned long cLength) = 0;
 
+// HasHessian() tells whether the distribution implements ComputeHessian().
+// ComputeHessian() stores in adH the second derivative of the loss with
+// respect to the score for each instance, given adZ from
+// ComputeWorkingResponse() for the same adF.  CGBM uses it for Newton
+// boosting, where splits and terminal node predictions are based on the
+// sums of the gradients and hessians instead of FitBestConstant().
+
+    virtual bool HasHessian() const { return false; }
+
+    virtual void ComputeHessian(const double *adY,
+				const double *adMisc,
+				const double *adOffset,
+				const double *adF,
+				const double *adZ,
+				double *adH,
+				unsigned long cLength) { }
+
 // InitF() computes the best constant prediction for all instances, and
 // stores it in dInitF.
 
@@ -107,7 +161,7 @@ public:
 				      const double *adWeight,
 				      const double *adF,
 				      double *adZ,
-				      const std::vector<unsigned long>& aiNodeAssign,
+				      const CNodeAssign& aiNodeAssign,
 				      unsigned long cLength,
 				      VEC_P_NODETERMINAL vecpTermNodes,
 				      unsigned long cTermNodes,
@@ -129,6 +183,76 @@ public:
                                   const bag& afInBag,
                                   double dStepSize,
                                   unsigned long cLength) = 0;
+
+// UpdateScores() applies the step adF += dStepSize * adFadj to the training
+// instances. It returns in dOOBagImprove what BagImprovement() returns for the
+// step, and in dTrainError the Deviance() of the updated scores.
+// The default implementation does this in separate passes and returns false.
+// Distributions whose working response depends on nothing but the scores (no
+// afInBag, no random numbers, no state set in UpdateParams()) override it with
+// a single sweep that also fills adZ with the working response for the next
+// iteration, and return true; the caller then skips ComputeWorkingResponse().
+// The default is kept as the reference the fused versions are tested against.
+
+    virtual bool UpdateScores(const double *adY,
+                              const double *adMisc,
+                              const double *adOffset,
+                              const double *adWeight,
+                              double *adF,
+                              const double *adFadj,
+                              const bag& afInBag,
+                              double dStepSize,
+                              unsigned long cLength,
+                              double *adZ,
+                              double &dTrainError,
+                              double &dOOBagImprove);
+
+protected:
+
+// NextOutOfBag() stores in aiRow the next (at most cVecBlock) instances
+// below cLength that are not in the bag, starting the search at iNext, and
+// returns how many it found.  iNext is advanced past the last one examined.
+
+    static unsigned long NextOutOfBag(const bag& afInBag,
+                                      unsigned long cLength,
+                                      unsigned long &iNext,
+                                      unsigned long *aiRow)
+    {
+        unsigned long cRows = 0;
+
+        for(; (iNext < cLength) && (cRows < cVecBlock); iNext++)
+        {
+            if(!afInBag[iNext])
+            {
+                aiRow[cRows++] = iNext;
+            }
+        }
+        return cRows;
+    }
+
+// Reduce() sums the cSums values of adSums over the workers, if there are.
+
+    void Reduce(double *adSums, unsigned long cSums) const
+    {
+        if(pAllreduce)
+        {
+            pAllreduce->Sum(adSums, cSums);
+        }
+    }
+
+    CRandom &Random() const
+    {
+        if(!pRandom)
+        {
+            throw GBM::failure("no random number generator was set");
+        }
+        return *pRandom;
+    }
+
+    CVecMath vecmath;
+    int cThreads;
+    CRandom *pRandom;
+    CAllreduce *pAllreduce;
 };
 
 typedef CDistribution *PCDistribution;
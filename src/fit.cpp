@@ -0,0 +1,253 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       fit.cpp
+//
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+#include "gbm.h"
+
+CFitResult::CFitResult()
+{
+  dInitF = 0.0;
+  cIterations = 0;
+  stopReason = "n.trees";
+  iBest = -1;
+  dBestCriterion = HUGE_VAL;
+  dOOBagSum = 0.0;
+  cCatSplitsBest = 0;
+}
+
+
+CFitOptions::CFitOptions()
+{
+  pRandom = NULL;
+  cThreads = 1;
+  pafHeldOut = NULL;
+  adHeldOutWeight = NULL;
+  pAllreduce = NULL;
+  cMaxBins = 256;
+  adF = NULL;
+  cTreesOld = 0;
+  cCatSplitsOld = 0;
+  fVerbose = false;
+  fTiming = false;
+  pObserver = NULL;
+}
+
+
+void gbm_fit
+(
+ const CDataset &data,
+ int cTrain,
+ const CFitSettings &settings,
+ const CFitOptions &options,
+ CFitResult &model
+)
+{
+  int iT = 0;
+  unsigned long iClass = 0;
+  const int cTreesOld = options.cTreesOld;
+
+  int cGroups = -1;
+  std::auto_ptr<CDistribution> pDist(gbm_setup(data, settings.family,
+                                               settings.cTrees,
+                                               settings.cDepth,
+                                               settings.cMinObsInNode,
+                                               settings.dShrinkage,
+                                               settings.dBagFraction,
+                                               cTrain,
+                                               settings.cFeatures,
+                                               settings.cPairBudget,
+                                               cGroups));
+  pDist->SetVectorMath(settings.fVectorMath);
+  pDist->SetThreadCount(options.cThreads);
+
+  CGBM gbm;
+  gbm.SetRandom(options.pRandom);
+  gbm.SetHeldOut(options.pafHeldOut);
+  gbm.SetBagging(settings.bagging, options.cThreads);
+  gbm.SetStreams(settings.fStreams);
+  gbm.SetColumnSampling(settings.columnSampling);
+  if(options.pAllreduce)
+    {
+      gbm.SetAllreduce(options.pAllreduce, options.cMaxBins);
+    }
+  gbm.Initialize(data, pDist.get(), settings.dShrinkage, cTrain,
+                 settings.cFeatures, settings.dBagFraction,
+                 settings.cDepth, settings.cMinObsInNode, cGroups,
+                 settings.fFusedUpdate, settings.fNewton,
+                 settings.dL2Penalty);
+
+  // a multi-class model has one score per class for every row, and grows
+  // one tree per class in each iteration
+  const unsigned long cClasses = gbm.NumClasses();
+  const std::size_t cScores = std::size_t(data.nrow())*cClasses;
+
+  CPhaseTimer &timer = gbm.Timer();
+  timer.SetEnabled(options.fTiming);
+
+  pDist->Initialize(data.y_ptr(), data.misc_ptr(false),
+                    data.offset_ptr(false), data.weight_ptr(),
+                    data.nrow());
+
+  double *adF = options.adF;
+  if(adF || model.adF.empty())
+    {
+      pDist->InitF(data.y_ptr(), data.misc_ptr(false),
+                   data.offset_ptr(false), data.weight_ptr(),
+                   model.dInitF, cTrain);
+      if(!adF)
+        {
+          model.adF.resize(cScores);
+          adF = &model.adF[0];
+        }
+      std::fill(adF, adF + cScores, model.dInitF);
+    }
+  else if(model.adF.size() != cScores)
+    {
+      throw GBM::invalid_argument("old predictions are the wrong shape");
+    }
+  else
+    {
+      adF = &model.adF[0];
+    }
+
+  if(options.fVerbose)
+    {
+      LogMessage("Iter   TrainDeviance   ValidDeviance   StepSize   Improve\n");
+    }
+  for(iT=model.cIterations; iT<settings.cTrees; iT++)
+    {
+      timer.Clear();
+      timer.Start(CPhaseTimer::RESPONSE);
+      pDist->UpdateParams(adF, data.offset_ptr(false), data.weight_ptr(),
+                          cTrain);
+      timer.Stop(CPhaseTimer::RESPONSE);
+
+      const bool fValidDeviance =
+        IsValidIteration(iT+cTreesOld, settings.cTrees+cTreesOld,
+                         settings.cValidEvery);
+      double dTrainError = 0.0;
+      double dValidError = 0.0;
+      double dOOBagImprove = 0.0;
+      int cNodes = 0;
+
+      gbm.iterate(adF, dTrainError, dValidError, dOOBagImprove, cNodes,
+                  fValidDeviance && !options.pafHeldOut);
+
+      // the held-out rows were scored with the training rows
+      if(options.pafHeldOut && fValidDeviance)
+        {
+          dValidError = pDist->Deviance(data.y_ptr(),
+                                        data.misc_ptr(false),
+                                        data.offset_ptr(false),
+                                        options.adHeldOutWeight,
+                                        adF,
+                                        cTrain);
+        }
+      if(!fValidDeviance)
+        {
+          dValidError = std::numeric_limits<double>::quiet_NaN();
+        }
+      model.adTrainError.push_back(dTrainError);
+      model.adValidError.push_back(dValidError);
+      model.adOOBagImprove.push_back(dOOBagImprove);
+      model.dOOBagSum += dOOBagImprove;
+
+      timer.Start(CPhaseTimer::TRANSFER);
+      for(iClass=0; iClass<cClasses; iClass++)
+        {
+          CCheckpointTree tree;
+          tree.aiSplitVar.resize(cNodes);
+          tree.adSplitPoint.resize(cNodes);
+          tree.aiLeftNode.resize(cNodes);
+          tree.aiRightNode.resize(cNodes);
+          tree.aiMissingNode.resize(cNodes);
+          tree.adErrorReduction.resize(cNodes);
+          tree.adWeight.resize(cNodes);
+          tree.adPred.resize(cNodes);
+          gbm_transfer_to_R(&gbm, model.vecSplitCodes,
+                            &tree.aiSplitVar[0], &tree.adSplitPoint[0],
+                            &tree.aiLeftNode[0], &tree.aiRightNode[0],
+                            &tree.aiMissingNode[0],
+                            &tree.adErrorReduction[0], &tree.adWeight[0],
+                            &tree.adPred[0], options.cCatSplitsOld, iClass);
+          model.vecTrees.push_back(tree);
+        }
+      timer.Stop(CPhaseTimer::TRANSFER, 0, cNodes*cClasses);
+      model.cIterations = iT+1;
+
+      if(options.fVerbose && ((iT <= 9) ||
+                              (0 == (iT+1+cTreesOld) % 20) ||
+                              (iT == settings.cTrees-1)))
+        {
+          LogMessage("%6d %13.4f %15.4f %10.4f %9.4f\n",
+                     iT+1+cTreesOld, dTrainError, dValidError,
+                     settings.dShrinkage, dOOBagImprove);
+        }
+
+      // early stopping: after cPatience iterations without a lower
+      // validation deviance (or a higher cumulative out-of-bag
+      // improvement) training stops.  Only the iterations with a
+      // validation deviance count when stopping on it.
+      bool fStop = false;
+      if((settings.cPatience > 0) &&
+         (fValidDeviance || !settings.fStopOnValid))
+        {
+          const double dCriterion =
+            settings.fStopOnValid ? dValidError : -model.dOOBagSum;
+          if(dCriterion < model.dBestCriterion)
+            {
+              model.dBestCriterion = dCriterion;
+              model.iBest = iT;
+              model.adFBest.assign(adF, adF + cScores);
+              model.cCatSplitsBest = model.vecSplitCodes.size();
+            }
+          else if(iT - model.iBest >= settings.cPatience)
+            {
+              model.stopReason = "patience";
+              fStop = true;
+            }
+        }
+
+      if(options.pObserver)
+        {
+          options.pObserver->Iterated(gbm, model, adF);
+        }
+      if(fStop) break;
+    }
+
+  if(options.pObserver)
+    {
+      options.pObserver->Finished(model, adF);
+    }
+
+  // cut the model back to its best iteration
+  const int cIterations = model.cIterations;
+  const int iBest = model.iBest;
+  if((settings.cPatience > 0) && (iBest >= 0) && (iBest+1 < cIterations))
+    {
+      model.adTrainError.resize(iBest+1);
+      model.adValidError.resize(iBest+1);
+      model.adOOBagImprove.resize(iBest+1);
+      model.vecTrees.resize((iBest+1)*cClasses);
+      model.vecSplitCodes.resize(model.cCatSplitsBest);
+      std::copy(model.adFBest.begin(), model.adFBest.end(), adF);
+    }
+
+  if(options.fVerbose)
+    {
+      if(model.stopReason == "patience")
+        {
+          LogMessage("Stopped after %d iterations, keeping %d\n",
+                     cIterations+cTreesOld,
+                     int(model.adTrainError.size())+cTreesOld);
+        }
+      LogMessage("\n");
+    }
+}
@@ -0,0 +1,124 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       fit.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   the training loop of a model, shared by gbm(), the folds
+//              and grids fitted on threads and gbmtool
+//
+//------------------------------------------------------------------------------
+
+#ifndef FIT_H
+#define FIT_H
+
+#include <string>
+#include <vector>
+
+#include "allreduce.h"
+#include "checkpoint.h"
+#include "dataset.h"
+#include "gbm_engine.h"
+#include "random.h"
+
+// The settings of a model, as passed to gbm().
+struct CFitSettings
+{
+    std::string family;
+    int cTrees;
+    int cDepth;
+    int cMinObsInNode;
+    int cFeatures;
+    double dShrinkage;
+    double dBagFraction;
+    bool fFusedUpdate;
+    bool fVectorMath;
+    bool fNewton;
+    double dL2Penalty;
+    int cPairBudget;        // pairs per group for pairwise, 0 for all
+    int cPatience;          // early stopping, 0 for none
+    bool fStopOnValid;      // stop on the held-out deviance, else out-of-bag
+    int cValidEvery;        // iterations between validation deviances
+    CGBM::Bagging bagging;
+    bool fStreams;          // CGBM::SetStreams()
+    CColumnSampler::Mode columnSampling;
+};
+
+// A fitted model: what gbm() returns, and the early stopping state that a
+// checkpoint keeps to carry on from.  The validation error is NaN at the
+// iterations that do not compute it (IsValidIteration()).
+struct CFitResult
+{
+    CFitResult();
+
+    double dInitF;
+    std::vector<double> adF;                // scores of the rows, by class
+    std::vector<double> adTrainError;
+    std::vector<double> adValidError;
+    std::vector<double> adOOBagImprove;
+    std::vector<CCheckpointTree> vecTrees;  // cClasses per iteration
+    VEC_VEC_CATEGORIES vecSplitCodes;
+    int cIterations;                        // run, before early stopping
+    std::string stopReason;                 // "patience" or "n.trees"
+
+    // early stopping: the best iteration so far, its criterion, and the
+    // scores and number of categorical splits of the model at that
+    // iteration
+    int iBest;
+    double dBestCriterion;
+    double dOOBagSum;
+    std::vector<double> adFBest;
+    std::size_t cCatSplitsBest;
+};
+
+// Hooks into the loop of gbm_fit().  Iterated() is called after each
+// iteration, with the trees and errors of model up to date and adF the
+// scores; Finished() once the loop ends, before the model is cut back to
+// its best iteration.  Either may throw to stop the fit.
+class CFitObserver
+{
+public:
+    virtual ~CFitObserver() {}
+    virtual void Iterated(CGBM &gbm, const CFitResult &model,
+                          const double *adF) {}
+    virtual void Finished(const CFitResult &model, const double *adF) {}
+};
+
+// How gbm_fit() runs a model, apart from its settings.
+struct CFitOptions
+{
+    CFitOptions();
+
+    CRandom *pRandom;
+    int cThreads;                   // of the distribution and the bag
+    // the training rows in pafHeldOut, if not NULL, are left out of the
+    // fit, and the validation error is their deviance with the weights
+    // adHeldOutWeight instead of that of the rows after cTrain
+    const bag *pafHeldOut;
+    const double *adHeldOutWeight;
+    CAllreduce *pAllreduce;         // CGBM::SetAllreduce(), or NULL
+    int cMaxBins;
+    double *adF;                    // the scores, if not in model.adF
+    int cTreesOld;                  // trees of the model being extended
+    int cCatSplitsOld;
+    bool fVerbose;                  // print the errors as gbm() does
+    bool fTiming;                   // CPhaseTimer of the CGBM
+    CFitObserver *pObserver;
+};
+
+// Fits a model with settings on the first cTrain rows of data, which have
+// to be its training rows with their presorted index; the rows after them
+// are the validation rows.  If model.adF holds scores, the fit carries on
+// from them and from the cIterations iterations and early stopping state
+// of model, as when gbm.more() extends a model or a checkpoint is resumed.
+// Otherwise, or if options.adF is given, the scores start at the initial
+// value of the distribution.  With early stopping (settings.cPatience) the
+// model is cut back to its best iteration at the end.
+void gbm_fit(const CDataset &data,
+             int cTrain,
+             const CFitSettings &settings,
+             const CFitOptions &options,
+             CFitResult &model);
+
+#endif // FIT_H
@@ -1,6 +1,8 @@
 // Gamma distribution with natural log link function ( mean = std::exp(prediction) )
 // -19 <= prediction <= +19
 
+#include <algorithm>
+
 #include "gamma.h"
 #include <math.h>
 #include <iostream>
@@ -19,26 +21,58 @@ void CGamma::ComputeWorkingResponse
     const double *adY,
     const double *adMisc,
     const double *adOffset,
-    const double *adF, 
-    double *adZ, 
+    const double *adF,
+    double *adZ,
     const double *adWeight,
     const bag& afInBag,
     unsigned long nTrain
 )
 {
-  unsigned long i = 0;
-  double dF = 0.0;
-  
-  if (!(adY && adF && adZ && adWeight)) {
-    throw GBM::invalid_argument();
-  }
+    double adExpF[cVecBlock];
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
 
-  for(i=0; i<nTrain; i++)
+    if (!(adY && adF && adZ && adWeight)) {
+      throw GBM::invalid_argument();
+    }
+
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
     {
-      dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-      adZ[i] = adY[i]*std::exp(-dF)-1.0;
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+        AddOffset(adF, adOffset, iStart, cBlock, adExpF);
+        for(i=0; i<cBlock; i++)
+        {
+            adExpF[i] = -adExpF[i];
+        }
+        vecmath.Exp(adExpF, cBlock);
+
+        for(i=0; i<cBlock; i++)
+        {
+            adZ[iStart+i] = adY[iStart+i]*adExpF[i]-1.0;
+        }
+    }
+}
+
+
+void CGamma::ComputeHessian
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    const double *adZ,
+    double *adH,
+    unsigned long nTrain
+)
+{
+    unsigned long i = 0;
+
+    // adZ = y*exp(-F) - 1, the hessian is y*exp(-F)
+    for(i=0; i<nTrain; i++)
+    {
+        adH[i] = adZ[i] + 1.0;
     }
-  
 }
 
 
@@ -87,25 +121,25 @@ double CGamma::Deviance
 (
     const double *adY,
     const double *adMisc,
-    const double *adOffset, 
+    const double *adOffset,
     const double *adWeight,
     const double *adF,
     unsigned long cLength
 )
 {
-  unsigned long i=0;
-  double dL = 0.0;
-  double dW = 0.0;
-  double dF = 0.0;
-  
-  for(i=0; i!=cLength; i++)
+    double dL = 0.0;
+    double dW = 0.0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+
+    for(iStart=0; iStart<cLength; iStart+=cBlock)
     {
-      dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-      dL += adWeight[i]*(adY[i]*std::exp(-dF) + dF);
-      dW += adWeight[i];
+        cBlock = std::min(cVecBlock, cLength-iStart);
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, NULL);
     }
-  
-  return 2*dL/dW;
+
+    return 2*dL/dW;
 }
 
 
@@ -117,7 +151,7 @@ void CGamma::FitBestConstant
  const double *adW,
  const double *adF,
  double *adZ,
- const std::vector<unsigned long>& aiNodeAssign,
+ const CNodeAssign& aiNodeAssign,
  unsigned long nTrain,
  VEC_P_NODETERMINAL vecpTermNodes,
  unsigned long cTermNodes,
@@ -152,8 +186,8 @@ void CGamma::FitBestConstant
 	  vecdDen[aiNodeAssign[iObs]] += adW[iObs];
 	  
 	  // Keep track of largest and smallest prediction in each node
-	  vecdMax[aiNodeAssign[iObs]] = R::fmax2(dF,vecdMax[aiNodeAssign[iObs]]);
-	  vecdMin[aiNodeAssign[iObs]] = R::fmin2(dF,vecdMin[aiNodeAssign[iObs]]);
+	  vecdMax[aiNodeAssign[iObs]] = std::max(dF,vecdMax[aiNodeAssign[iObs]]);
+	  vecdMin[aiNodeAssign[iObs]] = std::min(dF,vecdMin[aiNodeAssign[iObs]]);
 	}
     }
   
@@ -187,31 +221,163 @@ void CGamma::FitBestConstant
 
 double CGamma::BagImprovement
 (
-	const double *adY,
-	const double *adMisc,
-	const double *adOffset,
-	const double *adWeight,
-	const double *adF,
-	const double *adFadj,
-	const bag& afInBag,
-	double dStepSize,
-	unsigned long nTrain
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain
 )
 {
-	double dReturnValue = 0.0;
-	double dF = 0.0;
-	double dW = 0.0;
-	unsigned long i = 0;
+    double dReturnValue = 0.0;
+    double dW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
 
-	for(i=0; i<nTrain; i++)
-	{
-		if(!afInBag[i])
-		{
-			dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-			dReturnValue += adWeight[i]*(adY[i]*std::exp(-dF)*(1.0-exp(-dStepSize*adFadj[i])) - dStepSize*adFadj[i]);
-			dW += adWeight[i];
-		}
-	}
+    while((cRows = NextOutOfBag(afInBag, nTrain, iNext, aiRow)) > 0)
+    {
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dReturnValue, dW);
+    }
+
+    return 2*dReturnValue/dW;
+}
+
+
+void CGamma::BagImprovementBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    const double *adFadj,
+    double dStepSize,
+    const unsigned long *aiRow,
+    unsigned long cRows,
+    double &dReturnValue,
+    double &dW
+) const
+{
+    double adExpF[cVecBlock];
+    double adExpStep[cVecBlock];
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        adExpF[k] = -(adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]));
+        adExpStep[k] = -dStepSize*adFadj[i];
+    }
+    vecmath.Exp(adExpF, cRows);
+    vecmath.Exp(adExpStep, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        dReturnValue += adWeight[i]*(adY[i]*adExpF[k]*(1.0-adExpStep[k]) -
+                                     dStepSize*adFadj[i]);
+        dW += adWeight[i];
+    }
+}
+
+
+bool CGamma::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
+    double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
+
+    // one sweep in blocks: out-of-bag improvement at the old scores, the
+    // step, then the deviance and the next working response at the new
+    // scores
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
+    {
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+
+        iNext = iStart;
+        cRows = NextOutOfBag(afInBag, iStart+cBlock, iNext, aiRow);
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dOOBag, dOOBagW);
+
+        for(i=iStart; i<iStart+cBlock; i++)
+        {
+            adF[i] += dStepSize * adFadj[i];
+        }
+
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, adZ);
+    }
+
+    dOOBagImprove = 2*dOOBag/dOOBagW;
+    dTrainError = 2*dL/dW;
+
+    return true;
+}
 
-	return 2*dReturnValue/dW;
+
+void CGamma::DevianceBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    unsigned long iStart,
+    unsigned long cRows,
+    double &dL,
+    double &dW,
+    double *adZ
+) const
+{
+    double adFB[cVecBlock];
+    double adExpF[cVecBlock];
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    AddOffset(adF, adOffset, iStart, cRows, adFB);
+    for(k=0; k<cRows; k++)
+    {
+        adExpF[k] = -adFB[k];
+    }
+    vecmath.Exp(adExpF, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = iStart + k;
+        dL += adWeight[i]*(adY[i]*adExpF[k] + adFB[k]);
+        dW += adWeight[i];
+    }
+
+    if(adZ != NULL)
+    {
+        for(k=0; k<cRows; k++)
+        {
+            adZ[iStart+k] = adY[iStart+k]*adExpF[k]-1.0;
+        }
+    }
 }
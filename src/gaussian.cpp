@@ -1,5 +1,7 @@
 //  GBM by Greg Ridgeway  Copyright (C) 2003
 
+#include <algorithm>
+
 #include "gaussian.h"
 
 CGaussian::CGaussian()
@@ -45,6 +47,21 @@ void CGaussian::ComputeWorkingResponse
     }
 }
 
+void CGaussian::ComputeHessian
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    const double *adZ,
+    double *adH,
+    unsigned long nTrain
+)
+{
+    std::fill(adH, adH + nTrain, 1.0);
+}
+
+
 void CGaussian::InitF
 (
     const double *adY,
@@ -76,7 +93,9 @@ void CGaussian::InitF
             dTotalWeight += adWeight[i];
         }
     }
-    dInitF = dSum/dTotalWeight;
+    double adSums[2] = {dSum, dTotalWeight};
+    Reduce(adSums, 2);
+    dInitF = adSums[0]/adSums[1];
 }
 
 
@@ -112,7 +131,9 @@ double CGaussian::Deviance
        }
     }
 
-    return dL/dW;
+    double adSums[2] = {dL, dW};
+    Reduce(adSums, 2);
+    return adSums[0]/adSums[1];
 }
 
 
@@ -124,7 +145,7 @@ void CGaussian::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long>& aiNodeAssign,
+    const CNodeAssign& aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -167,8 +188,61 @@ double CGaussian::BagImprovement
         }
     }
 
-    return dReturnValue/dW;
+    double adSums[2] = {dReturnValue, dW};
+    Reduce(adSums, 2);
+    return adSums[0]/adSums[1];
 }
 
 
+bool CGaussian::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
+    double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    double dOffset = 0.0;
+    double dU = 0.0;
+    unsigned long i = 0;
+
+    // one sweep: out-of-bag improvement at the old scores, the step, then
+    // the deviance and the next working response at the new scores
+    for(i=0; i<nTrain; i++)
+    {
+        dOffset = (adOffset==NULL) ? 0.0 : adOffset[i];
+        if(!afInBag[i])
+        {
+            dU = adY[i] - (adF[i] + dOffset);
+            dOOBag += adWeight[i]*dStepSize*adFadj[i]*
+                      (2.0*dU - dStepSize*adFadj[i]);
+            dOOBagW += adWeight[i];
+        }
+
+        adF[i] += dStepSize * adFadj[i];
 
+        dU = adY[i] - dOffset - adF[i];
+        dL += adWeight[i]*dU*dU;
+        adZ[i] = dU;
+        dW += adWeight[i];
+    }
+
+    double adSums[4] = {dOOBag, dOOBagW, dL, dW};
+    Reduce(adSums, 4);
+    dOOBagImprove = adSums[0]/adSums[1];
+    dTrainError = adSums[2]/adSums[3];
+
+    return true;
+}
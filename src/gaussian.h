@@ -38,6 +38,17 @@ public:
 				const bag& afInBag,
 				unsigned long nTrain);
 
+    bool HasHessian() const { return true; }
+    bool CanDistribute() const { return true; }
+
+    void ComputeHessian(const double *adY,
+			const double *adMisc,
+			const double *adOffset,
+			const double *adF,
+			const double *adZ,
+			double *adH,
+			unsigned long nTrain);
+
     void InitF(const double *adY,
 	       const double *adMisc,
 	       const double *adOffset,
@@ -51,7 +62,7 @@ public:
 			 const double *adW,
 			 const double *adF,
 			 double *adZ,
-			 const std::vector<unsigned long>& aiNodeAssign,
+			 const CNodeAssign& aiNodeAssign,
 			 unsigned long nTrain,
 			 VEC_P_NODETERMINAL vecpTermNodes,
 			 unsigned long cTermNodes,
@@ -75,6 +86,19 @@ public:
                           const bag& afInBag,
                           double dStepSize,
                           unsigned long nTrain);
+
+    bool UpdateScores(const double *adY,
+                      const double *adMisc,
+                      const double *adOffset,
+                      const double *adWeight,
+                      double *adF,
+                      const double *adFadj,
+                      const bag& afInBag,
+                      double dStepSize,
+                      unsigned long nTrain,
+                      double *adZ,
+                      double &dTrainError,
+                      double &dOOBagImprove);
 };
 
 #endif // GAUSSIAN_H
@@ -42,6 +42,7 @@ std::auto_ptr<CDistribution> gbm_setup
  double dBagFraction,
  int cTrain,
  int cFeatures,
+ unsigned long cPairBudget,
  int& cGroups
  )
 {
@@ -59,6 +60,11 @@ std::auto_ptr<CDistribution> gbm_setup
     {
       pDist.reset(new CBernoulli());
     }
+  else if (family == "multinomial")
+    {
+      // the number of classes is passed in Misc
+      pDist.reset(new CMultinomial((unsigned long)data.misc_ptr()[0]));
+    }
   else if (family == "gaussian") 
     {
       pDist.reset(new CGaussian());
@@ -93,19 +99,19 @@ std::auto_ptr<CDistribution> gbm_setup
     }
   else if (family == "pairwise_conc")
     {
-      pDist.reset(new CPairwise("conc"));
+      pDist.reset(new CPairwise("conc", cPairBudget));
     }
   else if (family == "pairwise_ndcg")
     {
-      pDist.reset(new CPairwise("ndcg"));
+      pDist.reset(new CPairwise("ndcg", cPairBudget));
     }
   else if (family == "pairwise_map")
     {
-      pDist.reset(new CPairwise("map"));
+      pDist.reset(new CPairwise("map", cPairBudget));
     }
   else if (family == "pairwise_mrr")
     {
-      pDist.reset(new CPairwise("mrr"));
+      pDist.reset(new CPairwise("mrr", cPairBudget));
     }
   else
     {
@@ -133,7 +139,8 @@ void gbm_transfer_to_R
  double *adErrorReduction,
  double *adWeight,
  double *adPred,
- int cCatSplitsOld
+ int cCatSplitsOld,
+ unsigned long iClass
  )
 {
     pGBM->TransferTreeToRList(aiSplitVar,
@@ -145,7 +152,8 @@ void gbm_transfer_to_R
 			      adWeight,
 			      adPred,
 			      vecSplitCodes,
-			      cCatSplitsOld);
+			      cCatSplitsOld,
+			      iClass);
 }
 
 
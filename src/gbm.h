@@ -21,6 +21,7 @@
 #include "dataset.h"
 #include "distribution.h"
 #include "bernoulli.h"
+#include "multinomial.h"
 #include "adaboost.h"
 #include "poisson.h"
 #include "gaussian.h"
@@ -34,6 +35,9 @@
 #include "huberized.h"
 #include "gamma.h"
 #include "tweedie.h"
+#include "presort.h"
+#include "fit.h"
+#include "crossval.h"
 
 std::auto_ptr<CDistribution> gbm_setup
 (
@@ -46,6 +50,7 @@ std::auto_ptr<CDistribution> gbm_setup
     double dBagFraction,
     int cTrain,
     int cFeatures,
+    unsigned long cPairBudget,
     int& cGroups
 );
 
@@ -62,7 +67,8 @@ void gbm_transfer_to_R
  double *adErrorReduction,
  double *adWeight,
  double *adPred,
- int cCatSplitsOld
+ int cCatSplitsOld,
+ unsigned long iClass = 0
 );
 
 
@@ -1,8 +1,10 @@
 //  GBM by Greg Ridgeway  Copyright (C) 2003
 //#define NOISY_DEBUG
 #include <algorithm>
+#include <cmath>
 
 #include "gbm_engine.h"
+#include "threads.h"
 
 namespace {
   template <typename T> 
@@ -21,11 +23,26 @@ CGBM::CGBM()
     fInitialized = false;
     cTotalInBag = 0;
     cTrain = 0;
+    cFit = 0;
     cFeatures = 0;
     cValid = 0;
+    cGroups = -1;
+    cClasses = 1;
+    fFusedUpdate = true;
+    fZCurrent = false;
+    fNewton = false;
+    dL2Penalty = 0.0;
 
     pDist = NULL;
     pData = NULL;
+    pRandom = NULL;
+    pafHeldOut = NULL;
+    pAllreduce = NULL;
+    cMaxBins = 256;
+    bagging = SEQUENTIAL;
+    cBagThreads = 1;
+    fStreams = false;
+    columnSampling = CColumnSampler::LEVEL;
 }
 
 
@@ -34,6 +51,62 @@ CGBM::~CGBM()
 }
 
 
+void CGBM::SetRandom
+(
+    CRandom *pRandom
+)
+{
+  this->pRandom = pRandom;
+  if(pDist)
+  {
+    pDist->SetRandom(pRandom);
+  }
+}
+
+
+void CGBM::SetHeldOut
+(
+    const bag *pafHeldOut
+)
+{
+  this->pafHeldOut = pafHeldOut;
+}
+
+
+void CGBM::SetAllreduce
+(
+    CAllreduce *pAllreduce,
+    int cMaxBins
+)
+{
+  this->pAllreduce = pAllreduce;
+  this->cMaxBins = cMaxBins;
+}
+
+
+void CGBM::SetBagging
+(
+    Bagging bagging,
+    int cThreads
+)
+{
+  this->bagging = bagging;
+  this->cBagThreads = cThreads;
+}
+
+
+CGBM::Bagging CGBM::BaggingNamed
+(
+    const std::string &name
+)
+{
+  if(name == "sequential") return SEQUENTIAL;
+  if(name == "philox") return PHILOX;
+  if(name == "poisson") return POISSON;
+  throw GBM::invalid_argument("the bag type must be sequential, philox or poisson");
+}
+
+
 void CGBM::Initialize
 (
     const CDataset& data,
@@ -44,7 +117,10 @@ void CGBM::Initialize
     double dBagFraction,
     unsigned long cDepth,
     unsigned long cMinObsInNode,
-    int cGroups
+    int cGroups,
+    bool fFusedUpdate,
+    bool fNewton,
+    double dL2Penalty
 )
 {
   unsigned long i=0;
@@ -55,6 +131,7 @@ void CGBM::Initialize
   
   this->pData = &data;
   this->pDist = pDist;
+  pDist->SetRandom(pRandom);
   this->dLambda = dLambda;
   this->cTrain = cTrain;
   this->cFeatures = cFeatures;
@@ -62,6 +139,18 @@ void CGBM::Initialize
   this->cDepth = cDepth;
   this->cMinObsInNode = cMinObsInNode;
   this->cGroups = cGroups;
+  this->fFusedUpdate = fFusedUpdate;
+  this->fZCurrent = false;
+  this->cClasses = pDist->NumClasses();
+  // Newton boosting needs the hessian, and is not used for multi-class
+  // distributions
+  this->fNewton = fNewton && pDist->HasHessian() && (cClasses == 1);
+  this->dL2Penalty = this->fNewton ? dL2Penalty : 0.0;
+
+  if(dL2Penalty < 0.0)
+  {
+    throw GBM::invalid_argument("the L2 penalty must be non-negative");
+  }
 
   // allocate the tree structure
   ptreeTemp.reset(new CCARTTree);
@@ -72,32 +161,71 @@ void CGBM::Initialize
     throw GBM::invalid_argument("your training instances don't make sense");
   }
   
-  cTotalInBag = (unsigned long)(dBagFraction*cTrain);
+  cFit = cTrain;
+  if (pafHeldOut) {
+    if ((pafHeldOut->size() != cTrain) || (cGroups >= 0)) {
+      throw GBM::invalid_argument("the held out rows do not match the training rows");
+    }
+    cFit = cTrain - std::count(pafHeldOut->begin(), pafHeldOut->end(), true);
+  }
+
+  cTotalInBag = (unsigned long)(dBagFraction*cFit);
 
   if (cTotalInBag <= 0) {
     throw GBM::invalid_argument("you have an empty bag!");
   }
   
-  adZ.assign(data.nrow(), 0);
-  adFadj.assign(data.nrow(), 0);
+  adZ.assign(data.nrow()*cClasses, 0);
+  adFadj.assign(data.nrow()*cClasses, 0);
   
   pNodeFactory.reset(new CNodeFactory());
   pNodeFactory->Initialize(cDepth);
   ptreeTemp->Initialize(pNodeFactory.get());
+
+  // the workers of data-parallel training agree on the bins of the split
+  // search, and the distribution sums over all of them
+  if (pAllreduce) {
+    if (!pDist->CanDistribute() || (cClasses > 1) || (cGroups >= 0) ||
+        pafHeldOut) {
+      throw GBM::invalid_argument("data-parallel training supports the gaussian, bernoulli, poisson and adaboost distributions, without held out rows");
+    }
+    histogram.Build(data, cTrain, cMaxBins, *pAllreduce);
+  }
+  ptreeTemp->SetHistogram(pAllreduce ? &histogram : NULL, pAllreduce);
+  ptreeTemp->SetColumnSampling(columnSampling);
+  pDist->SetAllreduce(pAllreduce);
   
   // array for flagging those observations in the bag
   afInBag.resize(cTrain);
+  if(bagging == POISSON)
+    {
+      vecdBagW.assign(cTrain, 0.0);
+    }
   
-  // aiNodeAssign tracks to which node each training obs belongs
-  aiNodeAssign.resize(cTrain);
+  // aiNodeAssign tracks to which node each obs belongs, the validation
+  // rows included, so that their predictions are gathered as those of
+  // the training rows; a tree never has more than 2*cDepth+1 terminal
+  // nodes
+  aiNodeAssign.Initialize(data.nrow(), 2 * cDepth + 1);
   // NodeSearch objects help decide which nodes to split
   aNodeSearch.resize(2 * cDepth + 1);
   
   for(i=0; i<2*cDepth+1; i++)
     {
-      aNodeSearch[i].Initialize(cMinObsInNode);
+      aNodeSearch[i].Initialize(cMinObsInNode, cClasses, this->dL2Penalty);
     }
   vecpTermNodes.resize(2*cDepth+1, NULL);
+  if(cClasses > 1)
+    {
+      vecdClassPred.assign(cClasses*(2*cDepth+1), 0.0);
+    }
+  if(this->fNewton)
+    {
+      vecdWH.assign(cTrain, 0.0);
+      vecdNodeG.assign(2*cDepth+1, 0.0);
+      vecdNodeH.assign(2*cDepth+1, 0.0);
+      vecdNodeW.assign(2*cDepth+1, 0.0);
+    }
   
   fInitialized = true;
 }
@@ -109,16 +237,22 @@ void CGBM::iterate
   double &dTrainError,
   double &dValidError,
   double &dOOBagImprove,
-  int &cNodes
+  int &cNodes,
+  bool fValidDeviance
 )
 {
   unsigned long i = 0;
   unsigned long cBagged = 0;
+  unsigned long cSeen = 0;
 
   if(!fInitialized)
   {
     throw GBM::failure();
   }
+  if(!pRandom)
+  {
+    throw GBM::failure("no random number generator was set");
+  }
 
   dTrainError = 0.0;
   dValidError = 0.0;
@@ -126,13 +260,41 @@ void CGBM::iterate
 
   vecpTermNodes.assign(2*cDepth+1,NULL);
 
+  // the key of the streams of this iteration comes first, so that the
+  // counter bags draw it at the same place with or without fStreams
+  const bool fCounterBag = !IsPairwise() && (bagging != SEQUENTIAL);
+  if(fStreams || fCounterBag)
+    {
+      streams.Rekey(*pRandom);
+    }
+  CPhiloxStream randomBag = streams.Stream(CRandomStreams::BAG, 0);
+  CPhiloxStream randomColumns = streams.Stream(CRandomStreams::COLUMNS, 0);
+  CRandom &random = fStreams ? static_cast<CRandom&>(randomBag) : *pRandom;
+  if(fStreams)
+    {
+      randomGroups = streams.Stream(CRandomStreams::GROUPS, 0);
+      pDist->SetRandom(&randomGroups);
+    }
+
   // randomly assign observations to the Bag
-  if (!IsPairwise())
+  timer.Start(CPhaseTimer::BAG);
+  if (fCounterBag)
     {
-      // regular instance based training
+      cBagged = DrawCounterBag(streams.Philox());
+      i = cTrain;
+    }
+  else if (!IsPairwise())
+    {
+      // regular instance based training; held out rows are skipped, so
+      // that a fold draws the bag its rows would as a separate data set
       for(i=0; i<cTrain && (cBagged < cTotalInBag); i++)
       {
-        if(unif_rand() * (cTrain-i) < cTotalInBag - cBagged)
+        if(pafHeldOut && (*pafHeldOut)[i])
+        {
+          afInBag[i] = false;
+          continue;
+        }
+        if(random.Uniform() * (cFit-cSeen) < cTotalInBag - cBagged)
         {
           afInBag[i] = true;
           cBagged++;
@@ -141,6 +303,7 @@ void CGBM::iterate
         {
           afInBag[i] = false;
         }
+        cSeen++;
       }
       std::fill(afInBag.begin() + i, afInBag.end(), false);
     }
@@ -168,7 +331,7 @@ void CGBM::iterate
           }
                   
           // Group changed, make a new decision
-          fChosen = (unif_rand()*(cGroups - cSeenGroups) < 
+          fChosen = (random.Uniform()*(cGroups - cSeenGroups) < 
                    cTotalGroupsInBag - cBaggedGroups);
           if(fChosen)
           {
@@ -190,43 +353,85 @@ void CGBM::iterate
       // the remainder is not in the bag
       std::fill(afInBag.begin() + i, afInBag.end(), false);
     }
+  timer.Stop(CPhaseTimer::BAG, i);
+
+  // the weights of the tree and its terminal node fit: those of a POISSON
+  // bag count its draws; the deviances keep the weights of the data
+  const double *adFitW = (fCounterBag && (bagging == POISSON)) ?
+    &vecdBagW[0] : pData->weight_ptr();
 
 
 #ifdef NOISY_DEBUG
-  Rprintf("Compute working response\n");
+  LogMessage("Compute working response\n");
 #endif
 
-  pDist->ComputeWorkingResponse(pData->y_ptr(),
-                                pData->misc_ptr(false),
-                                pData->offset_ptr(false),
-                                adF,
-                                &adZ[0],
-                                pData->weight_ptr(),
-                                afInBag,
-                                cTrain);
+  // the fused update of the previous iteration may have computed it already
+  timer.Start(CPhaseTimer::RESPONSE);
+  if(!fZCurrent)
+  {
+    pDist->ComputeWorkingResponse(pData->y_ptr(),
+                                  pData->misc_ptr(false),
+                                  pData->offset_ptr(false),
+                                  adF,
+                                  &adZ[0],
+                                  pData->weight_ptr(),
+                                  afInBag,
+                                  cTrain);
+  }
+  timer.Stop(CPhaseTimer::RESPONSE, fZCurrent ? 0 : cTrain);
+  fZCurrent = false;
+
+  if(fNewton)
+  {
+    timer.Start(CPhaseTimer::RESPONSE);
+    pDist->ComputeHessian(pData->y_ptr(),
+                          pData->misc_ptr(false),
+                          pData->offset_ptr(false),
+                          adF,
+                          &adZ[0],
+                          &vecdWH[0],
+                          cTrain);
+    for(i=0; i<cTrain; i++)
+    {
+      vecdWH[i] *= adFitW[i];
+    }
+    timer.Stop(CPhaseTimer::RESPONSE, cTrain);
+  }
 
 #ifdef NOISY_DEBUG
-  Rprintf("Reset tree\n");
+  LogMessage("Reset tree\n");
 #endif
+  timer.Start(CPhaseTimer::GROW);
   ptreeTemp->Reset();
 #ifdef NOISY_DEBUG
-  Rprintf("grow tree\n");
+  LogMessage("grow tree\n");
 #endif
 
   ptreeTemp->grow(&(adZ[0]), 
                   *pData, 
-                  pData->weight_ptr() ,
+                  adFitW,
                   &(adFadj[0]), 
                   cTrain, 
                   cFeatures, 
-                  cTotalInBag, 
+                  fCounterBag ? cBagged : cTotalInBag, 
                   dLambda, 
                   cDepth,
                   cMinObsInNode, 
                   afInBag, 
                   aiNodeAssign, 
                   &aNodeSearch[0],
-                  vecpTermNodes);
+                  vecpTermNodes,
+                  fStreams ? static_cast<CRandom&>(randomColumns) : *pRandom,
+                  cClasses,
+                  pData->nrow(),
+                  fNewton ? &vecdWH[0] : NULL);
+  if(timer.IsEnabled())
+  {
+    double cRowsScanned = 0.0;
+    double cNodesSearched = 0.0;
+    ptreeTemp->GetSearchCounts(cRowsScanned, cNodesSearched);
+    timer.Stop(CPhaseTimer::GROW, cRowsScanned, cNodesSearched);
+  }
 
 #ifdef NOISY_DEBUG
   ptreeTemp->Print();
@@ -234,79 +439,323 @@ void CGBM::iterate
 
   ptreeTemp->GetNodeCount(cNodes);
 #ifdef NOISY_DEBUG
-  Rprintf("get node count=%d\n",cNodes);
+  LogMessage("get node count=%d\n",cNodes);
 #endif
 
+  if(cClasses > 1)
+  {
+    FitClassTrees(adF, adFitW, cNodes, dTrainError, dValidError,
+                  dOOBagImprove, fValidDeviance);
+    return;
+  }
+
   // Now I have adF, adZ, and vecpTermNodes (new node assignments)
   // Fit the best constant within each terminal node
 #ifdef NOISY_DEBUG
-  Rprintf("fit best constant\n");
+  LogMessage("fit best constant\n");
 #endif
 
-  pDist->FitBestConstant(pData->y_ptr(),
-                         pData->misc_ptr(false),
-                         pData->offset_ptr(false),
-                         pData->weight_ptr(),
-                         &adF[0],
-                         &adZ[0],
-                         aiNodeAssign,
-                         cTrain,
-                         vecpTermNodes,
-                         (2*cNodes+1)/3, // number of terminal nodes
-                         cMinObsInNode,
-                         afInBag,
-                         &adFadj[0]);
-
-  // update training predictions
+  timer.Start(CPhaseTimer::FIT);
+  if(fNewton)
+  {
+    FitNewtonLeaves(cNodes, adFitW);
+  }
+  else
+  {
+    pDist->FitBestConstant(pData->y_ptr(),
+                           pData->misc_ptr(false),
+                           pData->offset_ptr(false),
+                           adFitW,
+                           &adF[0],
+                           &adZ[0],
+                           aiNodeAssign,
+                           cTrain,
+                           vecpTermNodes,
+                           (2*cNodes+1)/3, // number of terminal nodes
+                           cMinObsInNode,
+                           afInBag,
+                           &adFadj[0]);
+  }
+
+  // update training and validation predictions
   // fill in missing nodes where N < cMinObsInNode
   ptreeTemp->Adjust(aiNodeAssign,
                     &(adFadj[0]),
-                    cTrain,
+                    cTrain+cValid,
                     vecpTermNodes,
                     cMinObsInNode);
+  if(fNewton)
+  {
+    // the saved trees hold the observation weights, which partial
+    // dependence averages over, rather than the hessian sums
+    ptreeTemp->SetNodeWeights(&vecdNodeW[0], vecpTermNodes, (2*cNodes+1)/3);
+  }
   ptreeTemp->SetShrinkage(dLambda);
+  timer.Stop(CPhaseTimer::FIT, cTrain+cValid, (2*cNodes+1)/3);
 #ifdef NOISY_DEBUG
   ptreeTemp->Print();
 #endif
 
-  dOOBagImprove = pDist->BagImprovement(pData->y_ptr(),
-                                        pData->misc_ptr(false),
-                                        pData->offset_ptr(false),
-                                        pData->weight_ptr(),
-                                        &adF[0],
-                                        &adFadj[0],
-                                        afInBag,
-                                        dLambda,
-                                        cTrain);
-    
-  // update the training predictions
-  for(i=0; i < cTrain; i++)
+  // update the training predictions, the training deviance and the
+  // out-of-bag improvement
+  timer.Start(CPhaseTimer::UPDATE);
+  if(fFusedUpdate)
   {
-    adF[i] += dLambda * adFadj[i];
+    fZCurrent = pDist->UpdateScores(pData->y_ptr(),
+                                    pData->misc_ptr(false),
+                                    pData->offset_ptr(false),
+                                    pData->weight_ptr(),
+                                    adF,
+                                    &adFadj[0],
+                                    afInBag,
+                                    dLambda,
+                                    cTrain,
+                                    &adZ[0],
+                                    dTrainError,
+                                    dOOBagImprove);
   }
-  
-  dTrainError = pDist->Deviance(pData->y_ptr(),
-                                pData->misc_ptr(false),
-                                pData->offset_ptr(false),
-                                pData->weight_ptr(),
-                                adF,
-                                cTrain);
-
-  // update the validation predictions
-  ptreeTemp->PredictValid(*pData,cValid,&(adFadj[0]));
+  else
+  {
+    // separate passes, kept as the reference for the fused updates
+    pDist->CDistribution::UpdateScores(pData->y_ptr(),
+                                       pData->misc_ptr(false),
+                                       pData->offset_ptr(false),
+                                       pData->weight_ptr(),
+                                       adF,
+                                       &adFadj[0],
+                                       afInBag,
+                                       dLambda,
+                                       cTrain,
+                                       &adZ[0],
+                                       dTrainError,
+                                       dOOBagImprove);
+  }
+  timer.Stop(CPhaseTimer::UPDATE, cTrain);
 
+  // update the validation predictions, which Adjust() gathered from the
+  // terminal nodes grow() routed the rows to
+  timer.Start(CPhaseTimer::VALID);
   for(i=cTrain; i < cTrain+cValid; i++)
   {
-    adF[i] += adFadj[i];
+    adF[i] += dLambda*adFadj[i];
   }
     
-  dValidError =
-    pDist->Deviance(pData->y_ptr() + cTrain,
-                    shift_ptr(pData->misc_ptr(false), cTrain),
-                    shift_ptr(pData->offset_ptr(false), cTrain),
-                    pData->weight_ptr() + cTrain,
-                    adF + cTrain,
-                    cValid);
+  if(fValidDeviance)
+  {
+    dValidError =
+      pDist->Deviance(pData->y_ptr() + cTrain,
+                      shift_ptr(pData->misc_ptr(false), cTrain),
+                      shift_ptr(pData->offset_ptr(false), cTrain),
+                      pData->weight_ptr() + cTrain,
+                      adF + cTrain,
+                      cValid);
+  }
+  timer.Stop(CPhaseTimer::VALID, cValid);
+}
+
+
+// Draws a PHILOX or POISSON bag and returns the number of rows in it.  The
+// uniform of row i is word i%4 of the counter i/4 of the BAG stream of
+// the iteration, so the bag does not depend on how the rows are split over
+// the threads.  The threads fill blocks of rows that are whole words of
+// afInBag.
+unsigned long CGBM::DrawCounterBag
+(
+    const CPhilox &philox
+)
+{
+  const double *adW = pData->weight_ptr();
+  const double dP0 = std::exp(-dBagFraction);
+  const long cBlockRows = 4096;
+  const long cBlocks = long((cTrain + cBlockRows - 1)/cBlockRows);
+  unsigned long cBagged = 0;
+  long iBlock = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:cBagged) num_threads(ThreadCount(cBagThreads))
+  for(iBlock=0; iBlock<cBlocks; iBlock++)
+    {
+      const unsigned long iFirst = iBlock*cBlockRows;
+      const unsigned long iLast = std::min(iFirst + cBlockRows, cTrain);
+      unsigned int aiWords[4];
+
+      for(unsigned long i=iFirst; i<iLast; i++)
+        {
+          if((i & 3) == 0)
+            {
+              const unsigned long long iCounter = i >> 2;
+              philox.Block((unsigned int)iCounter,
+                           (unsigned int)(iCounter >> 32), 0, 0, aiWords);
+            }
+          const double dU = CPhilox::Uniform(aiWords[i & 3]);
+          unsigned long cCount = 0;
+
+          if(pafHeldOut && (*pafHeldOut)[i])
+            {
+              cCount = 0;
+            }
+          else if(bagging == PHILOX)
+            {
+              cCount = (dU < dBagFraction) ? 1 : 0;
+            }
+          else
+            {
+              // the inverse of the Poisson(dBagFraction) distribution
+              double dP = dP0;
+              double dCDF = dP0;
+              while((dU > dCDF) && (dP > 0.0))
+                {
+                  cCount++;
+                  dP *= dBagFraction/cCount;
+                  dCDF += dP;
+                }
+              vecdBagW[i] = adW[i]*cCount;
+            }
+          afInBag[i] = (cCount > 0);
+          cBagged += (cCount > 0) ? 1 : 0;
+        }
+    }
+
+  if(cBagged == 0)
+    {
+      throw GBM::failure("the bag of an iteration is empty; increase bag.fraction");
+    }
+  return cBagged;
+}
+
+
+// Sets the terminal node predictions to the Newton step G/(H + dL2Penalty),
+// where G and H are the sums of the weighted gradients and hessians of the
+// rows of the bag in the node.  The split search saw the hessian sums as the
+// node weights; the weights of the bag are kept in vecdNodeW for the tree.
+void CGBM::FitNewtonLeaves(int cNodes, const double *adW)
+{
+  const unsigned long cTermNodes = (2*cNodes+1)/3;
+  unsigned long i = 0;
+  unsigned long iNode = 0;
+
+  std::fill(vecdNodeG.begin(), vecdNodeG.begin() + cTermNodes, 0.0);
+  std::fill(vecdNodeH.begin(), vecdNodeH.begin() + cTermNodes, 0.0);
+  std::fill(vecdNodeW.begin(), vecdNodeW.begin() + cTermNodes, 0.0);
+
+  for(i=0; i<cTrain; i++)
+  {
+    if(afInBag[i])
+    {
+      vecdNodeG[aiNodeAssign[i]] += adW[i]*adZ[i];
+      vecdNodeH[aiNodeAssign[i]] += vecdWH[i];
+      vecdNodeW[aiNodeAssign[i]] += adW[i];
+    }
+  }
+  if(pAllreduce)
+  {
+    pAllreduce->Sum(&vecdNodeG[0], cTermNodes);
+    pAllreduce->Sum(&vecdNodeH[0], cTermNodes);
+    pAllreduce->Sum(&vecdNodeW[0], cTermNodes);
+  }
+
+  for(iNode=0; iNode<cTermNodes; iNode++)
+  {
+    if(vecpTermNodes[iNode] != NULL)
+    {
+      const double dH = vecdNodeH[iNode] + dL2Penalty;
+      vecpTermNodes[iNode]->dPrediction =
+        (dH > 0.0) ? vecdNodeG[iNode]/dH : 0.0;
+    }
+  }
+}
+
+
+// Fits the terminal nodes of the shared tree structure for each class of a
+// multi-class model and updates the K scores of every row.  The predictions
+// of each class are kept in vecdClassPred for TransferTreeToRList().
+void CGBM::FitClassTrees
+(
+  double *adF,
+  const double *adFitW,
+  int cNodes,
+  double &dTrainError,
+  double &dValidError,
+  double &dOOBagImprove,
+  bool fValidDeviance
+)
+{
+  const unsigned long cRows = pData->nrow();
+  const unsigned long cMaxTermNodes = 2*cDepth+1;
+  unsigned long i = 0;
+  unsigned long k = 0;
+  unsigned long iNode = 0;
+
+  ptreeTemp->SetShrinkage(dLambda);
+
+  for(k=0; k<cClasses; k++)
+  {
+    timer.Start(CPhaseTimer::FIT);
+    pDist->FitBestConstant(pData->y_ptr(),
+                           pData->misc_ptr(false),
+                           pData->offset_ptr(false),
+                           adFitW,
+                           &adF[0],
+                           &adZ[k*cRows],
+                           aiNodeAssign,
+                           cTrain,
+                           vecpTermNodes,
+                           (2*cNodes+1)/3, // number of terminal nodes
+                           cMinObsInNode,
+                           afInBag,
+                           &adFadj[k*cRows]);
+
+    for(iNode=0; iNode<cMaxTermNodes; iNode++)
+    {
+      if(vecpTermNodes[iNode] != NULL)
+      {
+        vecdClassPred[k*cMaxTermNodes + iNode] =
+          vecpTermNodes[iNode]->dPrediction;
+      }
+    }
+
+    ptreeTemp->Adjust(aiNodeAssign,
+                      &adFadj[k*cRows],
+                      cTrain+cValid,
+                      vecpTermNodes,
+                      cMinObsInNode);
+    timer.Stop(CPhaseTimer::FIT, cTrain+cValid, (2*cNodes+1)/3);
+  }
+
+  timer.Start(CPhaseTimer::UPDATE);
+  fZCurrent = pDist->UpdateScores(pData->y_ptr(),
+                                  pData->misc_ptr(false),
+                                  pData->offset_ptr(false),
+                                  pData->weight_ptr(),
+                                  adF,
+                                  &adFadj[0],
+                                  afInBag,
+                                  dLambda,
+                                  cTrain,
+                                  &adZ[0],
+                                  dTrainError,
+                                  dOOBagImprove);
+  timer.Stop(CPhaseTimer::UPDATE, cTrain);
+
+  timer.Start(CPhaseTimer::VALID);
+  for(k=0; k<cClasses; k++)
+  {
+    for(i=cTrain; i < cTrain+cValid; i++)
+    {
+      adF[k*cRows + i] += dLambda*adFadj[k*cRows + i];
+    }
+  }
+
+  if(fValidDeviance)
+  {
+    dValidError =
+      pDist->Deviance(pData->y_ptr() + cTrain,
+                      shift_ptr(pData->misc_ptr(false), cTrain),
+                      shift_ptr(pData->offset_ptr(false), cTrain),
+                      pData->weight_ptr() + cTrain,
+                      adF + cTrain,
+                      cValid);
+  }
+  timer.Stop(CPhaseTimer::VALID);
 }
 
 
@@ -321,9 +770,28 @@ void CGBM::TransferTreeToRList
  double *adWeight,
  double *adPred,
  VEC_VEC_CATEGORIES &vecSplitCodes,
- int cCatSplitsOld
+ int cCatSplitsOld,
+ unsigned long iClass
  )
 {
+  const unsigned long cMaxTermNodes = 2*cDepth+1;
+  unsigned long iNode = 0;
+  int cNodes = 0;
+
+  if(cClasses > 1)
+  {
+    // put the predictions of the class into the shared tree
+    for(iNode=0; iNode<cMaxTermNodes; iNode++)
+    {
+      if(vecpTermNodes[iNode] != NULL)
+      {
+        vecpTermNodes[iNode]->dPrediction =
+          vecdClassPred[iClass*cMaxTermNodes + iNode];
+      }
+    }
+    ptreeTemp->AdjustNodes(cMinObsInNode);
+  }
+
   ptreeTemp->TransferTreeToRList(*pData,
 				 aiSplitVar,
 				 adSplitPoint,
@@ -336,6 +804,17 @@ void CGBM::TransferTreeToRList
 				 vecSplitCodes,
 				 cCatSplitsOld,
 				 dLambda);
+
+  if(cClasses > 1)
+  {
+    // each class tree gets an equal share of the improvement of the
+    // shared splits, so that relative influence adds up over the classes
+    ptreeTemp->GetNodeCount(cNodes);
+    for(iNode=0; iNode<(unsigned long)cNodes; iNode++)
+    {
+      adErrorReduction[iNode] /= cClasses;
+    }
+  }
 }
 
 
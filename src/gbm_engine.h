@@ -19,11 +19,17 @@
 
 #include <vector>
 #include <memory>
+#include <string>
+#include "allreduce.h"
 #include "buildinfo.h"
 #include "distribution.h"
 #include "tree.h"
 #include "dataset.h"
+#include "histogram.h"
 #include "node_factory.h"
+#include "philox.h"
+#include "timer.h"
+#include "random.h"
 
 using namespace std;
 
@@ -34,6 +40,63 @@ public:
 
     CGBM();
     ~CGBM();
+
+    // the generator of the bag draws, the split variables and the
+    // distribution; it has to be set before iterate() and outlive the CGBM
+    void SetRandom(CRandom *pRandom);
+
+    // Rows of the training set held out of the fit, as the folds of a
+    // cross-validation do (crossval.h): they are never in the bag, but
+    // their scores are updated with those of the other training rows.
+    // Their weights are expected to be 0, so that they do not count in
+    // the training deviance and the out-of-bag improvement.  It has to be
+    // set before Initialize() and outlive the CGBM; NULL holds none out.
+    void SetHeldOut(const bag *pafHeldOut);
+
+    // Data-parallel training: this CGBM fits the shard of the rows in its
+    // data, and pAllreduce sums what the fit sums over rows over all the
+    // workers (allreduce.h), so that they grow the same trees.  The splits
+    // are searched in histograms of at most cMaxBins bins per predictor
+    // (histogram.h).  The data needs its presorted index and the
+    // distribution CanDistribute(); multi-class, pairwise and held-out
+    // rows are not supported.  It has to be set before Initialize(), which
+    // agrees the bins with the other workers, and outlive the CGBM; NULL
+    // trains alone.
+    void SetAllreduce(CAllreduce *pAllreduce, int cMaxBins = 256);
+
+    // How the rows of the bag are drawn.  SEQUENTIAL draws exactly
+    // dBagFraction of the training rows, a uniform of the generator per
+    // row, as gbm always has.  PHILOX puts each row in the bag with
+    // probability dBagFraction, and POISSON gives each row a
+    // Poisson(dBagFraction) count that multiplies its weight in the tree
+    // and the terminal node fit (a Poisson bootstrap), the rows with
+    // counts of 0 being out of the bag.  These two draw the rows from a
+    // counter-based stream (philox.h) keyed by two uniforms of the
+    // generator per iteration (the CRandomStreams::BAG stream), on
+    // cThreads threads, and draw the same bag on any number of threads.
+    // The groups of pairwise are always drawn sequentially.
+    enum Bagging { SEQUENTIAL, PHILOX, POISSON };
+    void SetBagging(Bagging bagging, int cThreads = 1);
+    // the Bagging named "sequential", "philox" or "poisson"
+    static Bagging BaggingNamed(const std::string &name);
+
+    // Random streams: with fStreams each iteration keys a CRandomStreams
+    // (philox.h) with two uniforms of the generator, and the bag, the
+    // order of the candidate variables and the seeds of the pairwise
+    // groups draw from streams of their own instead of from the generator
+    // in turn.  What one of them draws then does not move the numbers of
+    // the others, and none depends on the number of threads.  The models
+    // differ from those without it.
+    void SetStreams(bool fStreams) { this->fStreams = fStreams; }
+
+    // How often a tree draws the cFeatures variables its split search
+    // tries: once per tree, once per split (LEVEL, the default) or once
+    // per node (column_sampler.h).  It has to be set before Initialize().
+    void SetColumnSampling(CColumnSampler::Mode columnSampling)
+    {
+      this->columnSampling = columnSampling;
+    }
+
     void Initialize(const CDataset &pData,
 		    CDistribution *pDist,
 		    double dLambda,
@@ -42,13 +105,20 @@ public:
 		    double dBagFraction,
 		    unsigned long cLeaves,
 		    unsigned long cMinObsInNode,
-		    int cGroups);
+		    int cGroups,
+		    bool fFusedUpdate = true,
+		    bool fNewton = false,
+		    double dL2Penalty = 0.0);
 
+    // Grows the next tree and updates the scores adF of all rows.  The
+    // validation rows are scored every iteration, but their deviance is
+    // only computed if fValidDeviance; dValidError is 0 otherwise.
     void iterate(double *adF,
 		 double &dTrainError,
 		 double &dValidError,
 		 double &dOOBagImprove,
-		 int &cNodes);
+		 int &cNodes,
+		 bool fValidDeviance = true);
     
     void TransferTreeToRList(int *aiSplitVar,
 			     double *adSplitPoint,
@@ -59,28 +129,63 @@ public:
 			     double *adWeight,
 			     double *adPred,
 			     VEC_VEC_CATEGORIES &vecSplitCodes,
-			     int cCatSplitsOld);
+			     int cCatSplitsOld,
+			     unsigned long iClass = 0);
 
     bool IsPairwise() const { return (cGroups >= 0); }
+    unsigned long NumClasses() const { return cClasses; }
+    CPhaseTimer &Timer() { return timer; }
  private:
 
+    void FitClassTrees(double *adF,
+		       const double *adFitW,
+		       int cNodes,
+		       double &dTrainError,
+		       double &dValidError,
+		       double &dOOBagImprove,
+		       bool fValidDeviance);
+    void FitNewtonLeaves(int cNodes, const double *adW);
+    unsigned long DrawCounterBag(const CPhilox &philox);
+
     const CDataset *pData;            // the data
     CDistribution *pDist;       // the distribution
+    CRandom *pRandom;           // the random number generator
+    const bag *pafHeldOut;      // training rows held out of the fit, or NULL
+    CAllreduce *pAllreduce;     // the other workers, or NULL
+    int cMaxBins;               // bins per predictor of their split search
+    CHistogramIndex histogram;
+    Bagging bagging;
+    int cBagThreads;            // threads drawing a PHILOX or POISSON bag
+    bool fStreams;              // draw from the streams of the iteration
+    CRandomStreams streams;     // the streams of the current iteration
+    CPhiloxStream randomGroups; // the pairwise group seeds of fStreams
+    CColumnSampler::Mode columnSampling;
     bool fInitialized;          // indicates whether the GBM has been initialized
     std::auto_ptr<CNodeFactory> pNodeFactory;
 
     // these objects are for the tree growing
     // allocate them once here for all trees to use
     bag afInBag;
-    std::vector<unsigned long> aiNodeAssign;
+    // the weights of the rows times their POISSON counts
+    std::vector<double> vecdBagW;
+    CNodeAssign aiNodeAssign;
     std::vector<CNodeSearch> aNodeSearch;
     std::auto_ptr<CCARTTree> ptreeTemp;
     VEC_P_NODETERMINAL vecpTermNodes;
     std::vector<double> adZ;
     std::vector<double> adFadj;
+    // terminal node predictions of each class of a multi-class model
+    std::vector<double> vecdClassPred;
+    // weighted hessians of the training rows and the gradient, hessian
+    // and weight sums of the terminal nodes for Newton boosting
+    std::vector<double> vecdWH;
+    std::vector<double> vecdNodeG;
+    std::vector<double> vecdNodeH;
+    std::vector<double> vecdNodeW;
 
     double dLambda;
     unsigned long cTrain;
+    unsigned long cFit;         // training rows not held out
     unsigned long cValid;
     unsigned long cFeatures;
     unsigned long cTotalInBag;
@@ -88,8 +193,22 @@ public:
     unsigned long cDepth;
     unsigned long cMinObsInNode;
     int  cGroups;
+    unsigned long cClasses;     // trees per iteration, pDist->NumClasses()
+    bool fFusedUpdate;          // use the distribution's one-pass UpdateScores()
+    bool fZCurrent;             // adZ already holds the working response for adF
+    bool fNewton;               // second-order splits and terminal nodes
+    double dL2Penalty;          // L2 penalty on the Newton node predictions
+    CPhaseTimer timer;          // time and work of the phases of iterate()
 };
 
+// Whether iteration iT (from 0) of cTrees computes the validation deviance
+// when it is wanted every cEvery iterations: at the multiples of cEvery and
+// at the last iteration.
+inline bool IsValidIteration(int iT, int cTrees, int cEvery)
+{
+  return (cEvery <= 1) || ((iT+1) % cEvery == 0) || (iT+1 == cTrees);
+}
+
 #endif // GBM_ENGINGBM_H
 
 
@@ -1,11 +1,114 @@
 // GBM by Greg Ridgeway  Copyright (C) 2003
 
 #include "gbm.h"
+#include "checkpoint.h"
+#include <fstream>
 #include <memory>
+#include <set>
 #include <utility>
 #include <Rcpp.h>
 
 namespace {
+  // the engine's random numbers come from R's generator, so that set.seed()
+  // makes a fit reproducible
+  class CRRandom : public CRandom {
+  public:
+    double Uniform() {
+      return unif_rand();
+    }
+  };
+
+  // the engine's messages go to the R console and its warnings to R
+  class CRLogger : public CLogger {
+  public:
+    void Message(const char *szMessage) {
+      Rprintf("%s", szMessage);
+    }
+
+    void Warning(const char *szMessage) {
+      Rcpp::warning(szMessage);
+    }
+  };
+
+  CRLogger rLogger;
+
+  // collects the messages and warnings of the folds of a cross-validation,
+  // which run on other threads, and passes them on to R afterwards; a
+  // warning repeated by the folds is passed on once
+  class CCollectingLogger : public CLogger {
+  public:
+    void Message(const char *szMessage) {
+      Add(false, szMessage);
+    }
+
+    void Warning(const char *szMessage) {
+      Add(true, szMessage);
+    }
+
+    void Replay(CLogger &logger) const {
+      std::set<std::string> setWarnings;
+      for(std::size_t i=0; i<vecMessages.size(); i++) {
+        const std::string &message = vecMessages[i].second;
+        if(!vecMessages[i].first) {
+          logger.Message(message.c_str());
+        }
+        else if(setWarnings.insert(message).second) {
+          logger.Warning(message.c_str());
+        }
+      }
+    }
+
+  private:
+    void Add(bool fWarning, const char *szMessage) {
+#pragma omp critical(gbm_collecting_logger)
+      vecMessages.push_back(std::make_pair(fWarning, std::string(szMessage)));
+    }
+
+    std::vector<std::pair<bool, std::string> > vecMessages;
+  };
+
+  inline bool has_value(const Rcpp::NumericVector& x) {
+    return !( (x.size() == 1) && (ISNA(x[0])));
+  }
+
+  // The arguments of gbm() as a CDataset.  The R vectors are kept here so
+  // that the buffers the dataset points into stay alive with it; an offset
+  // or misc that is a single NA stands for none.
+  class CRDataset {
+  public:
+    CRDataset(SEXP radY, SEXP radOffset, SEXP radX, SEXP raiXOrder,
+              SEXP radWeight, SEXP radMisc,
+              SEXP racVarClasses, SEXP ralMonotoneVar) :
+      adY(radY), adOffset(radOffset), adWeight(radWeight), adMisc(radMisc),
+      adX(radX),
+      acVarClasses(racVarClasses), alMonotoneVar(ralMonotoneVar),
+      aiXOrder(raiXOrder),
+      data(adY.begin(), has_value(adOffset) ? adOffset.begin() : 0,
+           adX.begin(), aiXOrder.begin(), adWeight.begin(),
+           has_value(adMisc) ? adMisc.begin() : 0,
+           acVarClasses.begin(), alMonotoneVar.begin(),
+           adX.nrow(), adX.ncol()) {
+
+      if (adX.ncol() != alMonotoneVar.size()) {
+        throw GBM::invalid_argument("shape mismatch (monotone does not match data)");
+      }
+
+      if (adX.ncol() != acVarClasses.size()) {
+        throw GBM::invalid_argument("shape mismatch (var classes does not match daa)");
+      }
+    }
+
+    const CDataset& get() const {
+      return data;
+    }
+
+  private:
+    Rcpp::NumericVector adY, adOffset, adWeight, adMisc;
+    Rcpp::NumericMatrix adX;
+    Rcpp::IntegerVector acVarClasses, alMonotoneVar, aiXOrder;
+    CDataset data;
+  };
+
   class nodeStack {
   public:
     bool empty() const {
@@ -25,6 +128,203 @@ namespace {
   private:
     std::vector< std::pair< int, double > > stack;
   };
+
+  // a tree in the form of the elements of object$trees
+  Rcpp::List TreeToR(const CCheckpointTree &tree) {
+    return Rcpp::List::create(Rcpp::IntegerVector(tree.aiSplitVar.begin(), tree.aiSplitVar.end()),
+                              Rcpp::NumericVector(tree.adSplitPoint.begin(), tree.adSplitPoint.end()),
+                              Rcpp::IntegerVector(tree.aiLeftNode.begin(), tree.aiLeftNode.end()),
+                              Rcpp::IntegerVector(tree.aiRightNode.begin(), tree.aiRightNode.end()),
+                              Rcpp::IntegerVector(tree.aiMissingNode.begin(), tree.aiMissingNode.end()),
+                              Rcpp::NumericVector(tree.adErrorReduction.begin(), tree.adErrorReduction.end()),
+                              Rcpp::NumericVector(tree.adWeight.begin(), tree.adWeight.end()),
+                              Rcpp::NumericVector(tree.adPred.begin(), tree.adPred.end()));
+  }
+
+  Rcpp::GenericVector TreesToR(const std::vector<CCheckpointTree> &vecTrees) {
+    Rcpp::GenericVector setOfTrees(vecTrees.size());
+    for(std::size_t iTree=0; iTree<vecTrees.size(); iTree++) {
+      setOfTrees[iTree] = TreeToR(vecTrees[iTree]);
+    }
+    return setOfTrees;
+  }
+
+  // the validation errors of a model fitted on threads, with NA for the
+  // NaN of the iterations that did not compute them
+  Rcpp::NumericVector ValidErrorToR(const std::vector<double> &adValidError) {
+    Rcpp::NumericVector result(adValidError.begin(), adValidError.end());
+    for(int i=0; i<result.size(); i++) {
+      if(is_missing(result[i])) result[i] = NA_REAL;
+    }
+    return result;
+  }
+
+  // the settings of gbm_cv() and gbm_grid() that are common to their
+  // models; the tree settings are filled in by the caller
+  CFitSettings FitSettings(SEXP rszFamily, SEXP rcTrees, SEXP rcFeatures,
+                           const Rcpp::List &control) {
+    CFitSettings settings;
+    settings.family = Rcpp::as<std::string>(rszFamily);
+    settings.cTrees = Rcpp::as<int>(rcTrees);
+    settings.cDepth = 0;
+    settings.cMinObsInNode = 0;
+    settings.cFeatures = Rcpp::as<int>(rcFeatures);
+    settings.dShrinkage = 0.0;
+    settings.dBagFraction = 0.0;
+    settings.fFusedUpdate = Rcpp::as<bool>(control["fused.update"]);
+    settings.fVectorMath = Rcpp::as<bool>(control["simd"]);
+    settings.fNewton = Rcpp::as<bool>(control["newton"]);
+    settings.dL2Penalty = Rcpp::as<double>(control["lambda"]);
+    settings.cPairBudget = Rcpp::as<int>(control["pair.budget"]);
+    settings.cPatience = Rcpp::as<int>(control["patience"]);
+    settings.fStopOnValid = false;
+    settings.cValidEvery = Rcpp::as<int>(control["valid.every"]);
+    settings.bagging =
+      CGBM::BaggingNamed(Rcpp::as<std::string>(control["bag.type"]));
+    settings.fStreams = Rcpp::as<bool>(control["random.streams"]);
+    settings.columnSampling = CColumnSampler::Named(
+      Rcpp::as<std::string>(control["column.sampling"]));
+    return settings;
+  }
+
+  // a generator for each of the models fitted on threads, seeded with the
+  // seeds drawn in R
+  class CSeededRandoms {
+  public:
+    explicit CSeededRandoms(const Rcpp::IntegerVector &aiSeed) {
+      for(int i=0; i<aiSeed.size(); i++) {
+        vecRandom.push_back(CSeededRandom((unsigned int)aiSeed[i]));
+      }
+      for(std::size_t i=0; i<vecRandom.size(); i++) {
+        vecpRandom.push_back(&vecRandom[i]);
+      }
+    }
+
+    CRandom *const *get() const {
+      return vecpRandom.empty() ? 0 : &vecpRandom[0];
+    }
+
+  private:
+    CSeededRandoms(const CSeededRandoms &);
+    CSeededRandoms &operator=(const CSeededRandoms &);
+
+    std::vector<CSeededRandom> vecRandom;
+    std::vector<CRandom*> vecpRandom;
+  };
+
+  // sum of the non-missing values of a numeric vector, used to tell whether
+  // a checkpoint was written for the same data
+  double SumNotNA(SEXP rad) {
+    const Rcpp::NumericVector ad(rad);
+    double dSum = 0.0;
+    for(int i=0; i<ad.size(); i++) {
+      if(!ISNA(ad[i])) dSum += ad[i];
+    }
+    return dSum;
+  }
+
+  // bring a checkpoint up to date with a model and write it
+  void gbm_write_checkpoint(CCheckpoint &checkpoint,
+                            const std::string &file,
+                            const CFitResult &model,
+                            SEXP raiXOrder) {
+    checkpoint.cIterations = model.cIterations;
+    checkpoint.dInitF = model.dInitF;
+    checkpoint.adF = model.adF;
+    checkpoint.adTrainError = model.adTrainError;
+    checkpoint.adValidError = model.adValidError;
+    checkpoint.adOOBagImprove = model.adOOBagImprove;
+
+    // only the trees grown since the last write are copied
+    checkpoint.vecTrees.insert(checkpoint.vecTrees.end(),
+                               model.vecTrees.begin() + checkpoint.vecTrees.size(),
+                               model.vecTrees.end());
+    checkpoint.vecSplitCodes = model.vecSplitCodes;
+
+    checkpoint.iBest = model.iBest;
+    checkpoint.dBestCriterion = model.dBestCriterion;
+    checkpoint.dOOBagSum = model.dOOBagSum;
+    checkpoint.adFBest = model.adFBest;
+    checkpoint.cCatSplitsBest = model.cCatSplitsBest;
+
+    if(checkpoint.aiXOrder.empty()) {
+      const Rcpp::IntegerVector aiXOrder(raiXOrder);
+      checkpoint.aiXOrder.assign(aiXOrder.begin(), aiXOrder.end());
+    }
+
+    // save the generator as it stands after this iteration
+    PutRNGstate();
+    const Rcpp::IntegerVector aiSeed(Rcpp::Environment::global_env()[".Random.seed"]);
+    checkpoint.aiRNGState.assign(aiSeed.begin(), aiSeed.end());
+
+    checkpoint.Write(file);
+  }
+
+  // what gbm() adds to the loop of gbm_fit(): a check for an interrupt
+  // after each iteration, the timing rows, and the checkpoints every
+  // cCheckpointEvery iterations and at the end
+  class CRFitObserver : public CFitObserver {
+  public:
+    CRFitObserver(CCheckpoint &checkpoint, const std::string &file,
+                  int cCheckpointEvery, int cTreesOld, SEXP raiXOrder) :
+      checkpoint(checkpoint), file(file),
+      cCheckpointEvery(cCheckpointEvery), cTreesOld(cTreesOld),
+      raiXOrder(raiXOrder) {
+    }
+
+    void Iterated(CGBM &gbm, const CFitResult &model, const double *adF) {
+      const CPhaseTimer &timer = gbm.Timer();
+      if(timer.IsEnabled()) {
+        for(int iPhase=0; iPhase<CPhaseTimer::PHASES; iPhase++) {
+          const CPhaseTimer::Phase phase = CPhaseTimer::Phase(iPhase);
+          aiTimingIter.push_back(model.cIterations+cTreesOld);
+          vecTimingPhase.push_back(CPhaseTimer::Name(phase));
+          adTimingSeconds.push_back(timer.Seconds(phase));
+          adTimingRows.push_back(timer.Rows(phase));
+          adTimingNodes.push_back(timer.Nodes(phase));
+        }
+      }
+
+      if((cCheckpointEvery > 0) && !file.empty() &&
+         (model.cIterations % cCheckpointEvery == 0)) {
+        gbm_write_checkpoint(checkpoint, file, model, raiXOrder);
+      }
+
+      Rcpp::checkUserInterrupt();
+    }
+
+    void Finished(const CFitResult &model, const double *adF) {
+      if(!file.empty() && (checkpoint.cIterations < model.cIterations)) {
+        gbm_write_checkpoint(checkpoint, file, model, raiXOrder);
+      }
+    }
+
+    // one row per iteration and phase, or NULL when not timing
+    SEXP Timing() const {
+      using Rcpp::_;
+      if(aiTimingIter.empty()) {
+        return R_NilValue;
+      }
+      return Rcpp::List::create(_["iteration"]=aiTimingIter,
+                                _["phase"]=vecTimingPhase,
+                                _["seconds"]=adTimingSeconds,
+                                _["rows"]=adTimingRows,
+                                _["nodes"]=adTimingNodes);
+    }
+
+  private:
+    CCheckpoint &checkpoint;
+    const std::string file;
+    const int cCheckpointEvery;
+    const int cTreesOld;
+    SEXP raiXOrder;
+
+    std::vector<int> aiTimingIter;
+    std::vector<std::string> vecTimingPhase;
+    std::vector<double> adTimingSeconds;
+    std::vector<double> adTimingRows;
+    std::vector<double> adTimingNodes;
+  };
 }
 
 extern "C" {
@@ -50,181 +350,374 @@ SEXP gbm
     SEXP radFOld,
     SEXP rcCatSplitsOld,
     SEXP rcTreesOld,
-    SEXP rfVerbose
+    SEXP rfVerbose,
+    SEXP rlControl      // computational settings from gbm.control()
 )
 {
   BEGIN_RCPP
-    
-    VEC_VEC_CATEGORIES vecSplitCodes;
+    using Rcpp::_;
 
-    int iT = 0;
-    const int cTrees = Rcpp::as<int>(rcTrees);
     const int cTrain = Rcpp::as<int>(rcTrain);
-    const int cFeatures = Rcpp::as<int>(rcFeatures);
-    const int cDepth = Rcpp::as<int>(rcDepth);
-    const int cMinObsInNode = Rcpp::as<int>(rcMinObsInNode);
-    const int cCatSplitsOld = Rcpp::as<int>(rcCatSplitsOld);
     const int cTreesOld = Rcpp::as<int>(rcTreesOld);
-    const double dShrinkage = Rcpp::as<double>(rdShrinkage);
-    const double dBagFraction = Rcpp::as<double>(rdBagFraction);
-    const bool verbose = Rcpp::as<bool>(rfVerbose);
     const Rcpp::NumericVector adFold(radFOld);
-    const std::string family = Rcpp::as<std::string>(rszFamily);
+    const Rcpp::List control(rlControl);
+    const std::string stopMetric = Rcpp::as<std::string>(control["stop.metric"]);
+    const std::string checkpointFile = Rcpp::as<std::string>(control["checkpoint.file"]);
+    const bool fResume = Rcpp::as<bool>(control["resume"]) &&
+      !checkpointFile.empty() && ISNA(adFold[0]) &&
+      std::ifstream(checkpointFile.c_str()).good();
 
-    int cNodes = 0;
-
-    int cGroups = -1;
+    CFitSettings settings = FitSettings(rszFamily, rcTrees, rcFeatures,
+                                        control);
+    settings.cDepth = Rcpp::as<int>(rcDepth);
+    settings.cMinObsInNode = Rcpp::as<int>(rcMinObsInNode);
+    settings.dShrinkage = Rcpp::as<double>(rdShrinkage);
+    settings.dBagFraction = Rcpp::as<double>(rdBagFraction);
 
     Rcpp::RNGScope scope;
+    CRRandom random;
+    SetLogger(&rLogger);
 
-    // set up the dataset
-    const CDataset data(radY, radOffset, radX, raiXOrder,
-                        radWeight, radMisc, racVarClasses,
-                        ralMonotoneVar);
-    
-    // initialize some things
-    std::auto_ptr<CDistribution> pDist(gbm_setup(data, family,
-						 cTrees,
-						 cDepth,
-						 cMinObsInNode,
-						 dShrinkage,
-						 dBagFraction,
-						 cTrain,
-						 cFeatures,
-						 cGroups));
-    
-    std::auto_ptr<CGBM> pGBM(new CGBM());
-    
-    // initialize the GBM
-    pGBM->Initialize(data,
-		     pDist.get(),
-		     dShrinkage,
-		     cTrain,
-		     cFeatures,
-		     dBagFraction,
-		     cDepth,
-		     cMinObsInNode,
-		     cGroups);
-
-    double dInitF;
-    Rcpp::NumericVector adF(data.nrow());
-
-    pDist->Initialize(data.y_ptr(),
-		      data.misc_ptr(false),
-		      data.offset_ptr(false),
-		      data.weight_ptr(),
-		      data.nrow());
-    
-    if(ISNA(adFold[0])) // check for old predictions
-    {
-      // set the initial value of F as a constant
-      pDist->InitF(data.y_ptr(),
-                   data.misc_ptr(false),
-                   data.offset_ptr(false),
-                   data.weight_ptr(),
-		   dInitF,
-		   cTrain);
-
-      adF.fill(dInitF);
-    }
-    else
+    // a resumed fit carries on from the state in the checkpoint file, and
+    // uses the presorted index stored there instead of raiXOrder
+    CCheckpoint resumed;
+    SEXP raiXOrderUsed = raiXOrder;
+    if(fResume)
       {
-	if (adFold.size() != adF.size()) {
-	  throw GBM::invalid_argument("old predictions are the wrong shape");
-	}
+	resumed.Read(checkpointFile);
+	raiXOrderUsed = Rcpp::IntegerVector(resumed.aiXOrder.begin(),
+					    resumed.aiXOrder.end());
+      }
+
+    // set up the dataset
+    const CRDataset rdata(radY, radOffset, radX, raiXOrderUsed,
+                          radWeight, radMisc, racVarClasses,
+                          ralMonotoneVar);
+    const CDataset &data = rdata.get();
 
-	std::copy(adFold.begin(), adFold.end(), adF.begin());
+    // early stopping is on the validation deviance if there is one,
+    // unless stop.metric says otherwise
+    settings.fStopOnValid = (stopMetric == "valid") ||
+      ((stopMetric == "auto") && (data.nrow() > cTrain));
+    if(settings.fStopOnValid && (settings.cPatience > 0) &&
+       (data.nrow() <= cTrain))
+      {
+	throw GBM::invalid_argument("early stopping on the validation deviance needs validation data");
       }
 
-    Rcpp::NumericVector adTrainError(cTrees, 0.0);
-    Rcpp::NumericVector adValidError(cTrees, 0.0);
-    Rcpp::NumericVector adOOBagImprove(cTrees, 0.0);
-    Rcpp::GenericVector setOfTrees(cTrees);
+    // the settings and data of this call, compared with those of the
+    // checkpoint when resuming.  The classes of a multinomial model are
+    // its misc.
+    CCheckpoint checkpoint;
+    checkpoint.family = settings.family;
+    checkpoint.cRows = data.nrow();
+    checkpoint.cCols = data.ncol();
+    checkpoint.cTrain = cTrain;
+    checkpoint.cClasses = (settings.family == "multinomial") ?
+      int(Rcpp::NumericVector(radMisc)[0]) : 1;
+    checkpoint.cDepth = settings.cDepth;
+    checkpoint.cMinObsInNode = settings.cMinObsInNode;
+    checkpoint.cFeatures = settings.cFeatures;
+    checkpoint.dShrinkage = settings.dShrinkage;
+    checkpoint.dBagFraction = settings.dBagFraction;
+    checkpoint.fVectorMath = settings.fVectorMath;
+    checkpoint.cPairBudget = settings.cPairBudget;
+    checkpoint.fNewton = settings.fNewton;
+    checkpoint.dL2Penalty = settings.dL2Penalty;
+    checkpoint.bagType = Rcpp::as<std::string>(control["bag.type"]);
+    checkpoint.fStreams = settings.fStreams;
+    checkpoint.columnSampling =
+      Rcpp::as<std::string>(control["column.sampling"]);
+    checkpoint.dDataSum = SumNotNA(radY) + SumNotNA(radWeight) +
+      SumNotNA(radOffset) + SumNotNA(radMisc);
+    const Rcpp::NumericVector adX(radX);
+    checkpoint.iXHash = CCheckpoint::Hash(adX.begin(), adX.size());
 
-    if(verbose)
-    {
-       Rprintf("Iter   TrainDeviance   ValidDeviance   StepSize   Improve\n");
-    }
-    for(iT=0; iT<cTrees; iT++)
+    // the model starts from the checkpoint, from the old predictions of
+    // gbm.more(), or from the initial value
+    CFitResult model;
+    if(fResume)
       {
-	Rcpp::checkUserInterrupt();
-        // Update the parameters
-        pDist->UpdateParams(adF.begin(),
-			    data.offset_ptr(false),
-			    data.weight_ptr(),
-			    cTrain);
-
-        double dTrainError = 0;
-        double dValidError = 0;
-        double dOOBagImprove = 0;
-        pGBM->iterate(adF.begin(),
-                      dTrainError,dValidError,dOOBagImprove,
-                      cNodes);
-          
-        // store the performance measures
-        adTrainError[iT] += dTrainError;
-        adValidError[iT] += dValidError;
-        adOOBagImprove[iT] += dOOBagImprove;
-
-        Rcpp::IntegerVector iSplitVar(cNodes);
-        Rcpp::NumericVector dSplitPoint(cNodes);
-        Rcpp::IntegerVector iLeftNode(cNodes);
-        Rcpp::IntegerVector iRightNode(cNodes);
-        Rcpp::IntegerVector iMissingNode(cNodes);
-        Rcpp::NumericVector dErrorReduction(cNodes);
-        Rcpp::NumericVector dWeight(cNodes);
-        Rcpp::NumericVector dPred(cNodes);
-
-        gbm_transfer_to_R(pGBM.get(),
-                          vecSplitCodes,
-                          iSplitVar.begin(),
-                          dSplitPoint.begin(),
-                          iLeftNode.begin(),
-                          iRightNode.begin(),
-                          iMissingNode.begin(),
-                          dErrorReduction.begin(),
-                          dWeight.begin(),
-                          dPred.begin(),
-                          cCatSplitsOld);
-        
-        setOfTrees[iT] = 
-          Rcpp::List::create(iSplitVar,
-                             dSplitPoint,
-                             iLeftNode, iRightNode, iMissingNode,
-                             dErrorReduction, dWeight, dPred);
-
-        // print the information
-        if((verbose) && ((iT <= 9) ||
-			 (0 == (iT+1+cTreesOld) % 20) ||
-			 (iT==cTrees-1))) {
-	  Rprintf("%6d %13.4f %15.4f %10.4f %9.4f\n",
-		  iT+1+cTreesOld,
-		  adTrainError[iT],
-		  adValidError[iT],
-		  dShrinkage,
-		  adOOBagImprove[iT]);
-        }
+	resumed.CheckMatches(checkpoint);
+	if(resumed.cIterations > settings.cTrees)
+	  {
+	    throw GBM::invalid_argument("the checkpoint has more iterations than n.trees");
+	  }
+
+	model.cIterations = resumed.cIterations;
+	model.dInitF = resumed.dInitF;
+	model.adF = resumed.adF;
+	model.adTrainError = resumed.adTrainError;
+	model.adValidError = resumed.adValidError;
+	model.adOOBagImprove = resumed.adOOBagImprove;
+	model.vecTrees = resumed.vecTrees;
+	model.vecSplitCodes = resumed.vecSplitCodes;
+	model.iBest = resumed.iBest;
+	model.dBestCriterion = resumed.dBestCriterion;
+	model.dOOBagSum = resumed.dOOBagSum;
+	model.adFBest = resumed.adFBest;
+	model.cCatSplitsBest = resumed.cCatSplitsBest;
+
+	Rcpp::Environment::global_env().assign(".Random.seed",
+					       Rcpp::IntegerVector(resumed.aiRNGState.begin(),
+								   resumed.aiRNGState.end()));
+	GetRNGstate();
+
+	checkpoint = resumed;
+      }
+    else if(!ISNA(adFold[0]))
+      {
+	model.adF.assign(adFold.begin(), adFold.end());
       }
 
-    if(verbose) Rprintf("\n");
+    CRFitObserver observer(checkpoint, checkpointFile,
+                           Rcpp::as<int>(control["checkpoint.every"]),
+                           cTreesOld, raiXOrderUsed);
+    CFitOptions options;
+    options.pRandom = &random;
+    options.cThreads = Rcpp::as<int>(control["n.threads"]);
+    options.cTreesOld = cTreesOld;
+    options.cCatSplitsOld = Rcpp::as<int>(rcCatSplitsOld);
+    options.fVerbose = Rcpp::as<bool>(rfVerbose);
+    options.fTiming = Rcpp::as<bool>(control["timing"]);
+    options.pObserver = &observer;
+    gbm_fit(data, cTrain, settings, options, model);
 
-    using Rcpp::_;
+    // a multi-class model has one score per class for every row
+    const int cClasses = model.adF.size() / data.nrow();
+    Rcpp::NumericVector adF(model.adF.begin(), model.adF.end());
+    if(cClasses > 1)
+      {
+	adF.attr("dim") = Rcpp::Dimension(data.nrow(), cClasses);
+      }
 
-    return Rcpp::List::create(_["initF"]=dInitF,
+    return Rcpp::List::create(_["initF"]=model.dInitF,
                               _["fit"]=adF,
-                              _["train.error"]=adTrainError,
-                              _["valid.error"]=adValidError,
-                              _["oobag.improve"]=adOOBagImprove,
-                              _["trees"]=setOfTrees,
-                              _["c.splits"]=vecSplitCodes);
+                              _["train.error"]=model.adTrainError,
+                              _["valid.error"]=ValidErrorToR(model.adValidError),
+                              _["oobag.improve"]=model.adOOBagImprove,
+                              _["trees"]=TreesToR(model.vecTrees),
+                              _["c.splits"]=model.vecSplitCodes,
+                              _["n.iter"]=model.cIterations,
+                              _["stop.reason"]=model.stopReason,
+                              _["timing"]=observer.Timing());
    END_RCPP
 }
 
+SEXP gbm_cv
+(
+    SEXP radY,       // the arguments of gbm(), for the training rows
+    SEXP radOffset,
+    SEXP radX,
+    SEXP raiXOrder,
+    SEXP radWeight,
+    SEXP radMisc,
+    SEXP racVarClasses,
+    SEXP ralMonotoneVar,
+    SEXP rszFamily,
+    SEXP rcTrees,
+    SEXP rcDepth,
+    SEXP rcMinObsInNode,
+    SEXP rdShrinkage,
+    SEXP rdBagFraction,
+    SEXP rcTrain,
+    SEXP rcFeatures,
+    SEXP raiFold,       // fold of each training row, from 1
+    SEXP raiSeed,       // seed of the random numbers of each fold
+    SEXP rcThreads,     // number of threads fitting the folds
+    SEXP rlControl      // computational settings from gbm.control()
+)
+{
+  BEGIN_RCPP
+    using Rcpp::_;
+
+    const Rcpp::IntegerVector aiFold(raiFold);
+    const Rcpp::IntegerVector aiSeed(raiSeed);
+    const Rcpp::List control(rlControl);
+    const int cTrain = Rcpp::as<int>(rcTrain);
+    const int cFolds = aiSeed.size();
+    int iFold = 0;
+
+    CFitSettings settings = FitSettings(rszFamily, rcTrees, rcFeatures,
+                                        control);
+    settings.cDepth = Rcpp::as<int>(rcDepth);
+    settings.cMinObsInNode = Rcpp::as<int>(rcMinObsInNode);
+    settings.dShrinkage = Rcpp::as<double>(rdShrinkage);
+    settings.dBagFraction = Rcpp::as<double>(rdBagFraction);
+    // every fold has held-out rows to stop on, and the cross-validation
+    // error needs their deviance at every iteration
+    settings.fStopOnValid =
+      (Rcpp::as<std::string>(control["stop.metric"]) != "oobag");
+    settings.cValidEvery = 1;
+
+    if(aiFold.size() != cTrain)
+      {
+        throw GBM::invalid_argument("the folds do not match the training rows");
+      }
+
+    const CRDataset rdata(radY, radOffset, radX, raiXOrder,
+                          radWeight, radMisc, racVarClasses,
+                          ralMonotoneVar);
+
+    // each fold draws from its own generator
+    CSeededRandoms randoms(aiSeed);
+
+    // R is not called while the folds run
+    CCollectingLogger logger;
+    std::vector<CFitResult> vecFolds;
+    SetLogger(&logger);
+    try
+      {
+        gbm_cross_validate(rdata.get(), cTrain, aiFold.begin(), cFolds,
+                           settings, randoms.get(),
+                           Rcpp::as<int>(rcThreads), vecFolds);
+      }
+    catch(...)
+      {
+        SetLogger(&rLogger);
+        logger.Replay(rLogger);
+        throw;
+      }
+    SetLogger(&rLogger);
+    logger.Replay(rLogger);
+
+    Rcpp::List result(cFolds);
+    for(iFold=0; iFold<cFolds; iFold++)
+      {
+        const CFitResult &fold = vecFolds[iFold];
+        result[iFold] =
+          Rcpp::List::create(_["initF"]=fold.dInitF,
+                             _["train.error"]=fold.adTrainError,
+                             _["valid.error"]=fold.adValidError,
+                             _["oobag.improve"]=fold.adOOBagImprove,
+                             _["trees"]=TreesToR(fold.vecTrees),
+                             _["c.splits"]=fold.vecSplitCodes,
+                             _["n.iter"]=fold.cIterations,
+                             _["stop.reason"]=fold.stopReason);
+      }
+    return result;
+  END_RCPP
+}
+
+SEXP gbm_grid
+(
+    SEXP radY,       // the arguments of gbm()
+    SEXP radOffset,
+    SEXP radX,
+    SEXP raiXOrder,
+    SEXP radWeight,
+    SEXP radMisc,
+    SEXP racVarClasses,
+    SEXP ralMonotoneVar,
+    SEXP rszFamily,
+    SEXP rcTrees,
+    SEXP raiDepth,          // the settings of each model
+    SEXP raiMinObsInNode,
+    SEXP radShrinkage,
+    SEXP radBagFraction,
+    SEXP rcTrain,
+    SEXP rcFeatures,
+    SEXP raiSeed,           // seed of the random numbers of each model
+    SEXP rcThreads,         // number of threads fitting the models
+    SEXP rlControl          // computational settings from gbm.control()
+)
+{
+  BEGIN_RCPP
+    using Rcpp::_;
+
+    const Rcpp::IntegerVector aiDepth(raiDepth);
+    const Rcpp::IntegerVector aiMinObsInNode(raiMinObsInNode);
+    const Rcpp::NumericVector adShrinkage(radShrinkage);
+    const Rcpp::NumericVector adBagFraction(radBagFraction);
+    const Rcpp::IntegerVector aiSeed(raiSeed);
+    const Rcpp::List control(rlControl);
+    const std::string stopMetric = Rcpp::as<std::string>(control["stop.metric"]);
+    const int cTrain = Rcpp::as<int>(rcTrain);
+    const int cModels = aiSeed.size();
+    int iModel = 0;
+
+    if((aiDepth.size() != cModels) || (aiMinObsInNode.size() != cModels) ||
+       (adShrinkage.size() != cModels) || (adBagFraction.size() != cModels))
+      {
+        throw GBM::invalid_argument("the settings of the grid differ in length");
+      }
+
+    const CRDataset rdata(radY, radOffset, radX, raiXOrder,
+                          radWeight, radMisc, racVarClasses,
+                          ralMonotoneVar);
+    const CDataset &data = rdata.get();
+
+    CFitSettings settings = FitSettings(rszFamily, rcTrees, rcFeatures,
+                                        control);
+    settings.fStopOnValid = (stopMetric == "valid") ||
+      ((stopMetric == "auto") && (data.nrow() > cTrain));
+    if(settings.fStopOnValid && (settings.cPatience > 0) &&
+       (data.nrow() <= cTrain))
+      {
+        throw GBM::invalid_argument("early stopping on the validation deviance needs validation data");
+      }
+
+    std::vector<CFitSettings> vecSettings(cModels, settings);
+    for(iModel=0; iModel<cModels; iModel++)
+      {
+        vecSettings[iModel].cDepth = aiDepth[iModel];
+        vecSettings[iModel].cMinObsInNode = aiMinObsInNode[iModel];
+        vecSettings[iModel].dShrinkage = adShrinkage[iModel];
+        vecSettings[iModel].dBagFraction = adBagFraction[iModel];
+      }
+
+    // each model draws from its own generator
+    CSeededRandoms randoms(aiSeed);
+
+    // R is not called while the models run
+    CCollectingLogger logger;
+    std::vector<CFitResult> vecModels;
+    SetLogger(&logger);
+    try
+      {
+        gbm_fit_grid(data, cTrain, vecSettings, randoms.get(),
+                     Rcpp::as<int>(rcThreads), vecModels);
+      }
+    catch(...)
+      {
+        SetLogger(&rLogger);
+        logger.Replay(rLogger);
+        throw;
+      }
+    SetLogger(&rLogger);
+    logger.Replay(rLogger);
+
+    Rcpp::List result(cModels);
+    for(iModel=0; iModel<cModels; iModel++)
+      {
+        const CFitResult &model = vecModels[iModel];
+        const int cClasses = model.adF.size() / data.nrow();
+        Rcpp::NumericVector adF(model.adF.begin(), model.adF.end());
+        if(cClasses > 1)
+          {
+            adF.attr("dim") = Rcpp::Dimension(data.nrow(), cClasses);
+          }
+        result[iModel] =
+          Rcpp::List::create(_["initF"]=model.dInitF,
+                             _["fit"]=adF,
+                             _["train.error"]=model.adTrainError,
+                             _["valid.error"]=ValidErrorToR(model.adValidError),
+                             _["oobag.improve"]=model.adOOBagImprove,
+                             _["trees"]=TreesToR(model.vecTrees),
+                             _["c.splits"]=model.vecSplitCodes,
+                             _["n.iter"]=model.cIterations,
+                             _["stop.reason"]=model.stopReason);
+      }
+    return result;
+  END_RCPP
+}
+
 SEXP gbm_pred
 (
    SEXP radX,         // the data matrix
    SEXP rcTrees,      // number of trees, may be a vector
    SEXP rdInitF,      // the initial value
+   SEXP rcNumClasses, // number of classes, trees are interleaved by class
    SEXP rTrees,       // the list of trees
    SEXP rCSplits,     // the list of categorical splits
    SEXP raiVarType,   // indicator of continuous/nominal
@@ -241,6 +734,7 @@ SEXP gbm_pred
    const Rcpp::IntegerVector aiVarType(raiVarType);
    const Rcpp::GenericVector cSplits(rCSplits);
    const bool fSingleTree = Rcpp::as<bool>(riSingleTree);
+   const int cNumClasses = Rcpp::as<int>(rcNumClasses);
    const int cPredIterations = cTrees.size();
    int iPredIteration = 0;
    int iClass = 0;
@@ -249,13 +743,19 @@ SEXP gbm_pred
      throw GBM::invalid_argument("shape mismatch");
    }
      
-   Rcpp::NumericVector adPredF(cRows * cPredIterations);
+   if ((cNumClasses < 1) || (trees.size() % cNumClasses != 0)) {
+     throw GBM::invalid_argument("number of trees does not match the classes");
+   }
+
+   // the scores of iteration j and class k are at
+   // adPredF[cRows*cNumClasses*j + cRows*k + iObs]
+   Rcpp::NumericVector adPredF(cRows * cNumClasses * cPredIterations);
 
    // initialize the predicted values
    if(!fSingleTree)
    {
      std::fill(adPredF.begin(),
-               adPredF.begin() + cRows,
+               adPredF.begin() + cRows * cNumClasses,
                Rcpp::as<double>(rdInitF));
    }
    else
@@ -270,66 +770,69 @@ SEXP gbm_pred
      if(!fSingleTree && (iPredIteration>0))
        {
          // copy over from the last rcTrees
-         std::copy(adPredF.begin() + cRows * (iPredIteration -1),
-                   adPredF.begin() + cRows * iPredIteration,
-                   adPredF.begin() + cRows * iPredIteration);
+         std::copy(adPredF.begin() + cRows * cNumClasses * (iPredIteration -1),
+                   adPredF.begin() + cRows * cNumClasses * iPredIteration,
+                   adPredF.begin() + cRows * cNumClasses * iPredIteration);
        }
      while(iTree<mycTrees)
        {
-         const Rcpp::GenericVector thisTree = trees[iTree];
-         const Rcpp::IntegerVector iSplitVar = thisTree[0];
-         const Rcpp::NumericVector dSplitCode = thisTree[1];
-         const Rcpp::IntegerVector iLeftNode = thisTree[2];
-         const Rcpp::IntegerVector iRightNode = thisTree[3];
-         const Rcpp::IntegerVector iMissingNode = thisTree[4];
-         
-         for(iObs=0; iObs<cRows; iObs++)
+         for(iClass=0; iClass<cNumClasses; iClass++)
            {
-             int iCurrentNode = 0;
-             while(iSplitVar[iCurrentNode] != -1)
+             const Rcpp::GenericVector thisTree = trees[iTree*cNumClasses + iClass];
+             const Rcpp::IntegerVector iSplitVar = thisTree[0];
+             const Rcpp::NumericVector dSplitCode = thisTree[1];
+             const Rcpp::IntegerVector iLeftNode = thisTree[2];
+             const Rcpp::IntegerVector iRightNode = thisTree[3];
+             const Rcpp::IntegerVector iMissingNode = thisTree[4];
+         
+             for(iObs=0; iObs<cRows; iObs++)
                {
-                 const double dX = adX[iSplitVar[iCurrentNode]*cRows + iObs];
-                 // missing?
-                 if(ISNA(dX))
-                   {
-                     iCurrentNode = iMissingNode[iCurrentNode];
-                   }
-                 // continuous?
-                 else if (aiVarType[iSplitVar[iCurrentNode]] == 0)
+                 int iCurrentNode = 0;
+                 while(iSplitVar[iCurrentNode] != -1)
                    {
-                     if(dX < dSplitCode[iCurrentNode])
+                     const double dX = adX[iSplitVar[iCurrentNode]*cRows + iObs];
+                     // missing?
+                     if(ISNA(dX))
                        {
-                         iCurrentNode = iLeftNode[iCurrentNode];
+                         iCurrentNode = iMissingNode[iCurrentNode];
                        }
-                     else
+                     // continuous?
+                     else if (aiVarType[iSplitVar[iCurrentNode]] == 0)
                        {
-                         iCurrentNode = iRightNode[iCurrentNode];
+                         if(dX < dSplitCode[iCurrentNode])
+                           {
+                             iCurrentNode = iLeftNode[iCurrentNode];
+                           }
+                         else
+                           {
+                             iCurrentNode = iRightNode[iCurrentNode];
+                           }
                        }
-                   }
-                 else // categorical
-                   {
-                     const Rcpp::IntegerVector mySplits = cSplits[dSplitCode[iCurrentNode]];
-                     if (mySplits.size() < (int)dX + 1) {
-                       iCurrentNode = iMissingNode[iCurrentNode];
-                     } else {
-                       const int iCatSplitIndicator = mySplits[(int)dX];
-                       if(iCatSplitIndicator==-1)
-                         {
-                           iCurrentNode = iLeftNode[iCurrentNode];
-                         }
-                       else if (iCatSplitIndicator==1)
-                         {
-                           iCurrentNode = iRightNode[iCurrentNode];
-                         }
-                       else // categorical level not present in training
-                         {
+                     else // categorical
+                       {
+                         const Rcpp::IntegerVector mySplits = cSplits[dSplitCode[iCurrentNode]];
+                         if (mySplits.size() < (int)dX + 1) {
                            iCurrentNode = iMissingNode[iCurrentNode];
+                         } else {
+                           const int iCatSplitIndicator = mySplits[(int)dX];
+                           if(iCatSplitIndicator==-1)
+                             {
+                               iCurrentNode = iLeftNode[iCurrentNode];
+                             }
+                           else if (iCatSplitIndicator==1)
+                             {
+                               iCurrentNode = iRightNode[iCurrentNode];
+                             }
+                           else // categorical level not present in training
+                             {
+                               iCurrentNode = iMissingNode[iCurrentNode];
+                             }
                          }
-                     }
+                       }
                    }
-               }
-             adPredF[cRows*iPredIteration+cRows*iClass+iObs] += dSplitCode[iCurrentNode]; // add the prediction
-           } // iObs
+                 adPredF[cRows*cNumClasses*iPredIteration+cRows*iClass+iObs] += dSplitCode[iCurrentNode]; // add the prediction
+               } // iObs
+           } // iClass
          iTree++;
        } // iTree
    }  // iPredIteration
@@ -463,5 +966,72 @@ SEXP gbm_plot
     END_RCPP
 } // gbm_plot
 
+
+SEXP gbm_presort
+(
+    SEXP radX,          // the data matrix
+    SEXP rcTrain,       // number of training rows to sort
+    SEXP rcThreads      // number of threads, < 1 for the OpenMP default
+)
+{
+    BEGIN_RCPP
+    const Rcpp::NumericMatrix adX(radX);
+    const int cTrain = Rcpp::as<int>(rcTrain);
+    const int cThreads = Rcpp::as<int>(rcThreads);
+
+    if ((cTrain < 0) || (cTrain > adX.nrow()))
+      {
+	throw GBM::invalid_argument("nTrain does not match the data");
+      }
+
+    Rcpp::IntegerMatrix aiXOrder(cTrain, adX.ncol());
+    PresortColumns(adX.begin(),
+		   adX.nrow(),
+		   adX.ncol(),
+		   cTrain,
+		   aiXOrder.begin(),
+		   cThreads);
+
+    return Rcpp::wrap(aiXOrder);
+    END_RCPP
+} // gbm_presort
+
+
+SEXP gbm_order_subset
+(
+    SEXP raiXOrder,     // order index of the full data, as from gbm_presort
+    SEXP raiNewRow,     // 0-based row in the subset of each full-data row
+    SEXP rcSubTrain,    // number of training rows in the subset
+    SEXP rcThreads      // number of threads, < 1 for the OpenMP default
+)
+{
+    BEGIN_RCPP
+    const Rcpp::IntegerMatrix aiXOrder(raiXOrder);
+    const Rcpp::IntegerVector aiNewRow(raiNewRow);
+    const int cSubTrain = Rcpp::as<int>(rcSubTrain);
+    const int cThreads = Rcpp::as<int>(rcThreads);
+
+    if (aiNewRow.size() != aiXOrder.nrow())
+      {
+	throw GBM::invalid_argument("row map does not match the order index");
+      }
+    if (cSubTrain < 0)
+      {
+	throw GBM::invalid_argument("negative number of training rows");
+      }
+
+    Rcpp::IntegerMatrix aiSubOrder(cSubTrain, aiXOrder.ncol());
+    SubsetOrder(aiXOrder.begin(),
+		aiXOrder.nrow(),
+		aiXOrder.ncol(),
+		aiNewRow.begin(),
+		cSubTrain,
+		aiSubOrder.begin(),
+		cThreads);
+
+    return Rcpp::wrap(aiSubOrder);
+    END_RCPP
+} // gbm_order_subset
+
 } // end extern "C"
 
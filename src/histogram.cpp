@@ -0,0 +1,152 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       histogram.cpp
+//
+//------------------------------------------------------------------------------
+#include <algorithm>
+
+#include "histogram.h"
+
+namespace {
+
+  // keeps cKeep of the values in adValues, which are sorted, evenly spaced
+  // by rank, and drops the duplicates
+  void Thin(std::vector<double> &adValues, std::size_t cKeep)
+  {
+    std::size_t k = 0;
+
+    if(adValues.size() > cKeep)
+      {
+	std::vector<double> adKept(cKeep);
+	for(k=0; k<cKeep; k++)
+	  {
+	    adKept[k] = adValues[(k+1)*adValues.size()/(cKeep+1)];
+	  }
+	adValues.swap(adKept);
+      }
+    adValues.erase(std::unique(adValues.begin(), adValues.end()),
+		   adValues.end());
+  }
+
+  // the edges predictor iVar of this worker proposes: the distinct values
+  // of its training rows if there are at most cCandidates, else as many of
+  // their quantiles
+  void Propose(const CDataset &data, int iVar, unsigned long cTrain,
+	       std::size_t cCandidates, std::vector<double> &adValues)
+  {
+    const int *aiOrder = data.order_ptr() + std::size_t(iVar)*cTrain;
+    std::size_t cDistinct = 0;
+    unsigned long i = 0;
+
+    adValues.clear();
+    for(i=0; i<cTrain; i++)
+      {
+	const double dX = data.x_value(aiOrder[i], iVar);
+	if(!is_missing(dX))
+	  {
+	    if(adValues.empty() || (dX != adValues.back())) cDistinct++;
+	    adValues.push_back(dX);
+	  }
+      }
+    if(cDistinct <= cCandidates)
+      {
+	adValues.erase(std::unique(adValues.begin(), adValues.end()),
+		       adValues.end());
+      }
+    Thin(adValues, cCandidates);
+  }
+}
+
+
+CHistogramIndex::CHistogramIndex()
+{
+  cTrain = 0;
+}
+
+
+void CHistogramIndex::Build
+(
+ const CDataset &data,
+ unsigned long cTrain,
+ int cMaxBins,
+ CAllreduce &allreduce
+)
+{
+  const int cCols = data.ncol();
+  const int cWorkers = allreduce.Size();
+  const std::size_t cCandidates = cMaxBins - 1;
+  std::vector<double> adValues;
+  std::vector<double> adProposals;
+  unsigned long i = 0;
+  int iVar = 0;
+  int iWorker = 0;
+
+  if((cMaxBins < 2) || (cMaxBins > 65535))
+    {
+      throw GBM::invalid_argument("the number of bins must be between 2 and 65535");
+    }
+
+  this->cTrain = cTrain;
+  acBins.assign(cCols, 0);
+  vecadEdges.assign(cCols, std::vector<double>());
+  vecCodes.resize(std::size_t(cCols)*cTrain);
+
+  for(iVar=0; iVar<cCols; iVar++)
+    {
+      const int cVarClasses = data.varclass(iVar);
+      std::vector<double> &adEdges = vecadEdges[iVar];
+      unsigned short *aiCode = &vecCodes[std::size_t(iVar)*cTrain];
+
+      if(cVarClasses != 0)
+	{
+	  if(cVarClasses >= 65535)
+	    {
+	      throw GBM::invalid_argument("a factor has too many levels for the histogram search");
+	    }
+	  acBins[iVar] = cVarClasses;
+	  for(i=0; i<cTrain; i++)
+	    {
+	      const double dX = data.x_value(i, iVar);
+	      aiCode[i] = is_missing(dX) ? cVarClasses : (unsigned short)(dX);
+	    }
+	  continue;
+	}
+
+      // each worker fills its slot of cCandidates, the unused values with
+      // HUGE_VAL, and the sum gathers the proposals of all
+      Propose(data, iVar, cTrain, cCandidates, adValues);
+      adProposals.assign(cWorkers*cCandidates, 0.0);
+      std::copy(adValues.begin(), adValues.end(),
+		adProposals.begin() + allreduce.Rank()*cCandidates);
+      std::fill(adProposals.begin() + allreduce.Rank()*cCandidates +
+		adValues.size(),
+		adProposals.begin() + (allreduce.Rank()+1)*cCandidates,
+		HUGE_VAL);
+      allreduce.Sum(&adProposals[0], adProposals.size());
+
+      adEdges.clear();
+      for(iWorker=0; iWorker<cWorkers; iWorker++)
+	{
+	  for(i=0; i<cCandidates; i++)
+	    {
+	      const double dX = adProposals[iWorker*cCandidates + i];
+	      if(dX != HUGE_VAL) adEdges.push_back(dX);
+	    }
+	}
+      std::sort(adEdges.begin(), adEdges.end());
+      adEdges.erase(std::unique(adEdges.begin(), adEdges.end()),
+		    adEdges.end());
+      Thin(adEdges, cCandidates);
+
+      // the bin of a value is the number of edges at or below it
+      acBins[iVar] = int(adEdges.size()) + 1;
+      for(i=0; i<cTrain; i++)
+	{
+	  const double dX = data.x_value(i, iVar);
+	  aiCode[i] = is_missing(dX) ? acBins[iVar] :
+	    (unsigned short)(std::upper_bound(adEdges.begin(), adEdges.end(),
+					      dX) - adEdges.begin());
+	}
+    }
+}
@@ -0,0 +1,72 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       histogram.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   binned predictors of data-parallel training
+//
+//------------------------------------------------------------------------------
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cmath>
+#include <vector>
+
+#include "allreduce.h"
+#include "dataset.h"
+
+// The presorted split search needs all rows of a node in the order of a
+// predictor, which the shards of data-parallel training do not have.  They
+// search the splits of histograms instead: each continuous predictor is
+// cut into at most cMaxBins bins at edges all workers agree on, each row
+// of the shard is given the code of its bin, and the split search sums the
+// gradients of a node over the bins on every worker, sums the histograms
+// over the workers (allreduce.h) and splits at an edge.  A factor has a
+// bin per level.  The last code of every predictor is that of missing
+// values.
+//
+// The edges are observed values: each worker proposes the distinct values
+// of its training rows, or cMaxBins-1 of their quantiles when there are
+// more, and the edges are the proposals of all workers, thinned to
+// cMaxBins-1 in the same way.  A predictor with fewer distinct values than
+// that is split as the presorted search splits it, at the lower of two
+// values instead of half way.
+
+class CHistogramIndex
+{
+public:
+
+    CHistogramIndex();
+
+    // the edges and codes of the first cTrain rows of data, which has to
+    // have its presorted index
+    void Build(const CDataset &data, unsigned long cTrain, int cMaxBins,
+               CAllreduce &allreduce);
+
+    // the number of bins of predictor iVar; Bins(iVar) is its missing code
+    int Bins(int iVar) const { return acBins[iVar]; }
+
+    // the lowest value of bin iBin of continuous predictor iVar
+    double LowerEdge(int iVar, int iBin) const
+    {
+      return (iBin == 0) ? -HUGE_VAL : vecadEdges[iVar][iBin-1];
+    }
+
+    // the codes of the training rows of predictor iVar
+    const unsigned short *Codes(int iVar) const
+    {
+      return &vecCodes[std::size_t(iVar)*cTrain];
+    }
+
+private:
+
+    unsigned long cTrain;
+    std::vector<int> acBins;
+    std::vector<std::vector<double> > vecadEdges;
+    std::vector<unsigned short> vecCodes;
+};
+
+#endif // HISTOGRAM_H
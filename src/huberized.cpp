@@ -117,7 +117,7 @@ double CHuberized::Deviance
       for(i=0; i<cLength; i++)
       {
          dF = adOffset[i]+adF[i];
-         if ( (2*adY[i]-1)*adF[i] < -1 )
+         if ( (2*adY[i]-1)*dF < -1 )
          {
             dL += -adWeight[i]*4*(2*adY[i]-1)*dF;
             dW += adWeight[i];
@@ -148,7 +148,7 @@ void CHuberized::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long>& aiNodeAssign,
+    const CNodeAssign& aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -250,3 +250,84 @@ double CHuberized::BagImprovement
 
     return dReturnValue/dW;
 }
+
+
+bool CHuberized::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
+    double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    double dOffset = 0.0;
+    double dF = 0.0;
+    unsigned long i = 0;
+
+    // one sweep: out-of-bag improvement at the old scores, the step, then
+    // the deviance and the next working response at the new scores
+    for(i=0; i<nTrain; i++)
+    {
+        dOffset = (adOffset==NULL) ? 0.0 : adOffset[i];
+        // the out-of-bag weight leaves out the quadratic part, as in
+        // BagImprovement()
+        if(!afInBag[i])
+        {
+            dF = adF[i] + dOffset;
+            if( (2*adY[i]-1)*dF < -1 )
+            {
+                dOOBag += adWeight[i]*
+                    (-4*(2*adY[i]-1)*dF -
+                     -4*(2*adY[i]-1)*(dF+dStepSize*adFadj[i]));
+                dOOBagW += adWeight[i];
+            }
+            else if ( 1 - (2*adY[i]-1)*dF < 0 )
+            {
+                dOOBagW += adWeight[i];
+            }
+            else
+            {
+                dOOBag += adWeight[i] *
+                    ( ( 1 - (2*adY[i]-1)*dF )*( 1 - (2*adY[i]-1)*dF ) -
+                      ( 1 - (2*adY[i]-1)*(dF+dStepSize*adFadj[i]) )*( 1 - (2*adY[i]-1)*(dF+dStepSize*adFadj[i]) )
+                    );
+            }
+        }
+
+        adF[i] += dStepSize * adFadj[i];
+
+        dF = adF[i] + dOffset;
+        if( (2*adY[i]-1)*dF < -1 )
+        {
+            dL += -adWeight[i]*4*(2*adY[i]-1)*dF;
+            adZ[i] = -4 * (2*adY[i]-1);
+        }
+        else if ( 1 - (2*adY[i]-1)*dF < 0 )
+        {
+            adZ[i] = 0;
+        }
+        else
+        {
+            dL += adWeight[i]*( 1 - (2*adY[i]-1)*dF )*( 1 - (2*adY[i]-1)*dF );
+            adZ[i] = -2 * (2*adY[i]-1) * ( 1 - (2*adY[i]-1)*dF );
+        }
+        dW += adWeight[i];
+    }
+
+    dOOBagImprove = dOOBag/dOOBagW;
+    dTrainError = dL/dW;
+
+    return true;
+}
@@ -58,7 +58,7 @@ public:
 			 const double *adW,
 			 const double *adF,
 			 double *adZ,
-			 const std::vector<unsigned long>& aiNodeAssign,
+			 const CNodeAssign& aiNodeAssign,
 			 unsigned long nTrain,
 			 VEC_P_NODETERMINAL vecpTermNodes,
 			 unsigned long cTermNodes,
@@ -76,6 +76,19 @@ public:
                           double dStepSize,
                           unsigned long nTrain);
 
+    bool UpdateScores(const double *adY,
+                      const double *adMisc,
+                      const double *adOffset,
+                      const double *adWeight,
+                      double *adF,
+                      const double *adFadj,
+                      const bag& afInBag,
+                      double dStepSize,
+                      unsigned long nTrain,
+                      double *adZ,
+                      double &dTrainError,
+                      double &dOOBagImprove);
+
 private:
     vector<double> vecdNum;
     vector<double> vecdDen;
@@ -9,11 +9,11 @@
 #ifndef LOCMCGBM_H
 #define LOCMCGBM_H
 
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
 #include <algorithm>
-#include <R.h>
 
 using namespace std;
 
@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       logger.cpp
+//
+//------------------------------------------------------------------------------
+#include <cstdarg>
+#include <cstdio>
+#include <vector>
+
+#include "logger.h"
+
+namespace {
+
+  CLogger *pCurrentLogger = 0;
+
+  // formats the message into a buffer that grows as needed
+  void Format(std::vector<char> &buffer, const char *szFormat, va_list args)
+  {
+    va_list argsCopy;
+
+    buffer.resize(256);
+    va_copy(argsCopy, args);
+    const int cChars = vsnprintf(&buffer[0], buffer.size(), szFormat, argsCopy);
+    va_end(argsCopy);
+    if(cChars < 0)
+      {
+	buffer[0] = '\0';
+      }
+    else if(static_cast<std::size_t>(cChars) >= buffer.size())
+      {
+	buffer.resize(cChars + 1);
+	vsnprintf(&buffer[0], buffer.size(), szFormat, args);
+      }
+  }
+}
+
+
+CLogger *SetLogger
+(
+    CLogger *pLogger
+)
+{
+  CLogger *pPrevious = pCurrentLogger;
+  pCurrentLogger = pLogger;
+  return pPrevious;
+}
+
+
+void LogMessage
+(
+    const char *szFormat,
+    ...
+)
+{
+  std::vector<char> buffer;
+  va_list args;
+
+  if(pCurrentLogger == 0) return;
+
+  va_start(args, szFormat);
+  Format(buffer, szFormat, args);
+  va_end(args);
+  pCurrentLogger->Message(&buffer[0]);
+}
+
+
+void LogWarning
+(
+    const char *szFormat,
+    ...
+)
+{
+  std::vector<char> buffer;
+  va_list args;
+
+  if(pCurrentLogger == 0) return;
+
+  va_start(args, szFormat);
+  Format(buffer, szFormat, args);
+  va_end(args);
+  pCurrentLogger->Warning(&buffer[0]);
+}
@@ -0,0 +1,41 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       logger.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   messages and warnings of the engine
+//
+//------------------------------------------------------------------------------
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+// The engine writes its messages and warnings (and the debugging output of
+// NOISY_DEBUG and the Print() functions) through LogMessage() and
+// LogWarning(), which format them printf-style and pass them to the
+// CLogger installed with SetLogger().  Without one they are discarded.  The
+// R package installs CRLogger (gbmentry.cpp), which uses Rprintf() and
+// Rcpp::warning().  They are called from parallel regions only by the
+// models fitted on threads (crossval.h), during which gbm_cv() and
+// gbm_grid() install a logger that collects the messages and passes them
+// on afterwards.
+
+class CLogger
+{
+public:
+
+    virtual ~CLogger() {}
+
+    virtual void Message(const char *szMessage) = 0;
+    virtual void Warning(const char *szMessage) = 0;
+};
+
+// installs pLogger (NULL to discard) and returns the one it replaces
+CLogger *SetLogger(CLogger *pLogger);
+
+void LogMessage(const char *szFormat, ...);
+void LogWarning(const char *szFormat, ...);
+
+#endif // LOGGER_H
@@ -0,0 +1,288 @@
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+
+#include <algorithm>
+#include <cmath>
+
+#include "multinomial.h"
+
+CMultinomial::CMultinomial(unsigned long cNumClasses)
+{
+    if(cNumClasses < 2)
+    {
+        throw GBM::invalid_argument("multinomial needs at least two classes");
+    }
+    this->cNumClasses = cNumClasses;
+    cRows = 0;
+}
+
+CMultinomial::~CMultinomial()
+{
+}
+
+
+void CMultinomial::Initialize
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    unsigned long cLength
+)
+{
+    cRows = cLength;
+    vecdProb.assign(cNumClasses*cLength, 0.0);
+}
+
+
+void CMultinomial::UpdateParams
+(
+    const double *adF,
+    const double *adOffset,
+    const double *adWeight,
+    unsigned long cLength
+)
+{
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    // normalize the scores of each row to class probabilities
+    for(i=0; i<cLength; i++)
+    {
+        double dMax = adF[i];
+        for(k=1; k<cNumClasses; k++)
+        {
+            dMax = std::max(dMax, adF[k*cRows + i]);
+        }
+
+        double dSum = 0.0;
+        for(k=0; k<cNumClasses; k++)
+        {
+            vecdProb[k*cRows + i] = std::exp(adF[k*cRows + i] - dMax);
+            dSum += vecdProb[k*cRows + i];
+        }
+        for(k=0; k<cNumClasses; k++)
+        {
+            vecdProb[k*cRows + i] /= dSum;
+        }
+    }
+}
+
+
+void CMultinomial::ComputeWorkingResponse
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    double *adZ,
+    const double *adWeight,
+    const bag& afInBag,
+    unsigned long nTrain
+)
+{
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    for(k=0; k<cNumClasses; k++)
+    {
+        for(i=0; i<nTrain; i++)
+        {
+            adZ[k*cRows + i] = ((adY[i] == k) ? 1.0 : 0.0) -
+                vecdProb[k*cRows + i];
+        }
+    }
+}
+
+
+void CMultinomial::InitF
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double &dInitF,
+    unsigned long cLength
+)
+{
+    // all classes start with the same score; the scores of a row only
+    // matter up to a common constant
+    dInitF = 0.0;
+}
+
+
+double CMultinomial::LogProb
+(
+    const double *adF,
+    const double *adFadj,
+    double dStepSize,
+    unsigned long i,
+    unsigned long iClass
+) const
+{
+    unsigned long k = 0;
+    double dMax = -HUGE_VAL;
+    double dSum = 0.0;
+
+    for(k=0; k<cNumClasses; k++)
+    {
+        const double dF = adF[k*cRows + i] +
+            ((adFadj == NULL) ? 0.0 : dStepSize*adFadj[k*cRows + i]);
+        dMax = std::max(dMax, dF);
+    }
+    for(k=0; k<cNumClasses; k++)
+    {
+        const double dF = adF[k*cRows + i] +
+            ((adFadj == NULL) ? 0.0 : dStepSize*adFadj[k*cRows + i]);
+        dSum += std::exp(dF - dMax);
+    }
+
+    return adF[iClass*cRows + i] +
+        ((adFadj == NULL) ? 0.0 : dStepSize*adFadj[iClass*cRows + i]) -
+        dMax - std::log(dSum);
+}
+
+
+double CMultinomial::Deviance
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    unsigned long cLength
+)
+{
+    unsigned long i = 0;
+    double dL = 0.0;
+    double dW = 0.0;
+
+    for(i=0; i<cLength; i++)
+    {
+        dL += adWeight[i]*LogProb(adF, NULL, 0.0, i, (unsigned long)adY[i]);
+        dW += adWeight[i];
+    }
+
+    return -2*dL/dW;
+}
+
+
+void CMultinomial::FitBestConstant
+(
+  const double *adY,
+  const double *adMisc,
+  const double *adOffset,
+  const double *adW,
+  const double *adF,
+  double *adZ,
+  const CNodeAssign& aiNodeAssign,
+  unsigned long nTrain,
+  VEC_P_NODETERMINAL vecpTermNodes,
+  unsigned long cTermNodes,
+  unsigned long cMinObsInNode,
+  const bag& afInBag,
+  const double *adFadj
+)
+{
+  unsigned long iObs = 0;
+  unsigned long iNode = 0;
+
+  vecdNum.assign(cTermNodes, 0.0);
+  vecdDen.assign(cTermNodes, 0.0);
+
+  // one Newton step for the class, scaled by (K-1)/K as in Friedman (2001)
+  // since the K scores of a row sum to a constant; |z|(1-|z|) is p(1-p)
+  for(iObs=0; iObs<nTrain; iObs++)
+  {
+    if(afInBag[iObs])
+    {
+      const double dAbsZ = std::abs(adZ[iObs]);
+      vecdNum[aiNodeAssign[iObs]] += adW[iObs]*adZ[iObs];
+      vecdDen[aiNodeAssign[iObs]] += adW[iObs]*dAbsZ*(1.0-dAbsZ);
+    }
+  }
+
+  for(iNode=0; iNode<cTermNodes; iNode++)
+  {
+    if(vecpTermNodes[iNode]!=NULL)
+    {
+      if(vecdDen[iNode] == 0)
+      {
+        vecpTermNodes[iNode]->dPrediction = 0.0;
+      }
+      else
+      {
+        vecpTermNodes[iNode]->dPrediction =
+          (cNumClasses-1.0)/cNumClasses * vecdNum[iNode]/vecdDen[iNode];
+      }
+    }
+  }
+}
+
+
+double CMultinomial::BagImprovement
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain
+)
+{
+    unsigned long i = 0;
+    double dReturnValue = 0.0;
+    double dW = 0.0;
+
+    for(i=0; i<nTrain; i++)
+    {
+        if(!afInBag[i])
+        {
+            const unsigned long iClass = (unsigned long)adY[i];
+            dReturnValue += adWeight[i]*
+                (LogProb(adF, adFadj, dStepSize, i, iClass) -
+                 LogProb(adF, NULL, 0.0, i, iClass));
+            dW += adWeight[i];
+        }
+    }
+
+    return dReturnValue/dW;
+}
+
+
+bool CMultinomial::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    dOOBagImprove = BagImprovement(adY, adMisc, adOffset, adWeight,
+                                   adF, adFadj, afInBag, dStepSize, nTrain);
+
+    for(k=0; k<cNumClasses; k++)
+    {
+        for(i=0; i<nTrain; i++)
+        {
+            adF[k*cRows + i] += dStepSize * adFadj[k*cRows + i];
+        }
+    }
+
+    dTrainError = Deviance(adY, adMisc, adOffset, adWeight, adF, nTrain);
+
+    return false;
+}
@@ -0,0 +1,127 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       multinomial.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   multinomial object
+//
+//------------------------------------------------------------------------------
+
+#ifndef MULTINOMIAL_H
+#define MULTINOMIAL_H
+
+#include "distribution.h"
+#include "buildinfo.h"
+
+// K-class logistic loss.  adY holds the class 0, ..., K-1 of each instance
+// and adF its K scores (see CDistribution::NumClasses()); the probability
+// of class k is exp(F_k) / sum_j exp(F_j).  Offsets are not supported.
+
+class CMultinomial : public CDistribution
+{
+
+public:
+
+    CMultinomial(unsigned long cNumClasses);
+
+    virtual ~CMultinomial();
+
+    unsigned long NumClasses() const { return cNumClasses; }
+
+    void Initialize(const double *adY,
+                    const double *adMisc,
+                    const double *adOffset,
+                    const double *adWeight,
+                    unsigned long cLength);
+
+    void UpdateParams(const double *adF,
+                      const double *adOffset,
+                      const double *adWeight,
+                      unsigned long cLength);
+
+    void ComputeWorkingResponse(const double *adY,
+				const double *adMisc,
+				const double *adOffset,
+				const double *adF,
+				double *adZ,
+				const double *adWeight,
+				const bag& afInBag,
+				unsigned long nTrain);
+
+    double Deviance(const double *adY,
+                    const double *adMisc,
+                    const double *adOffset,
+                    const double *adWeight,
+                    const double *adF,
+                    unsigned long cLength);
+
+    void InitF(const double *adY,
+	       const double *adMisc,
+	       const double *adOffset,
+	       const double *adWeight,
+	       double &dInitF,
+	       unsigned long cLength);
+
+    // called once per class, with adZ pointing at the working response
+    // of that class
+    void FitBestConstant(const double *adY,
+			 const double *adMisc,
+			 const double *adOffset,
+			 const double *adW,
+			 const double *adF,
+			 double *adZ,
+			 const CNodeAssign& aiNodeAssign,
+			 unsigned long nTrain,
+			 VEC_P_NODETERMINAL vecpTermNodes,
+			 unsigned long cTermNodes,
+			 unsigned long cMinObsInNode,
+			 const bag& afInBag,
+			 const double *adFadj);
+
+    double BagImprovement(const double *adY,
+                          const double *adMisc,
+                          const double *adOffset,
+                          const double *adWeight,
+                          const double *adF,
+                          const double *adFadj,
+                          const bag& afInBag,
+                          double dStepSize,
+                          unsigned long nTrain);
+
+    // steps all K scores; the working response depends on the
+    // probabilities of UpdateParams(), so this is not fused and returns
+    // false
+    bool UpdateScores(const double *adY,
+                      const double *adMisc,
+                      const double *adOffset,
+                      const double *adWeight,
+                      double *adF,
+                      const double *adFadj,
+                      const bag& afInBag,
+                      double dStepSize,
+                      unsigned long nTrain,
+                      double *adZ,
+                      double &dTrainError,
+                      double &dOOBagImprove);
+
+private:
+
+    // log of the probability of class iClass for the scores
+    // adF[k*cRows + i] (+ dStepSize*adFadj[k*cRows + i] if adFadj is not
+    // NULL)
+    double LogProb(const double *adF,
+                   const double *adFadj,
+                   double dStepSize,
+                   unsigned long i,
+                   unsigned long iClass) const;
+
+    unsigned long cNumClasses;
+    unsigned long cRows;          // stride between the scores of two classes
+    vector<double> vecdProb;      // class probabilities of the training rows
+    vector<double> vecdNum;
+    vector<double> vecdDen;
+};
+
+#endif // MULTINOMIAL_H
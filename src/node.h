@@ -37,6 +37,9 @@ public:
     CNode();
     virtual ~CNode();
     virtual void Adjust(unsigned long cMinObsInNode) = 0;
+    // sets the weight of each nonterminal node of the subtree to the sum
+    // of the weights of its children
+    virtual void AddUpTrainW() = 0;
     virtual void Predict(const CDataset &data,
 			 unsigned long iRow,
 			 double &dFadj) = 0;
@@ -77,6 +80,35 @@ public:
         return dResult;
     }
 
+    // The gain of a split in the second-order (Newton) approximation of
+    // the loss, for gradient sums dLeftG, ... and hessian sums dLeftH, ...
+    // of the children, with an L2 penalty dL2 on the node predictions.
+    // With dL2 = 0 this is Improvement() with the hessian sums as weights.
+    static double NewtonImprovement
+    (
+        double dLeftH,
+        double dRightH,
+        double dMissingH,
+        double dLeftG,
+        double dRightG,
+        double dMissingG,
+        double dL2
+    )
+    {
+        const double dG = dLeftG + dRightG + dMissingG;
+        double dResult = 0.0;
+
+        dResult += dLeftG*dLeftG/(dLeftH + dL2);
+        dResult += dRightG*dRightG/(dRightH + dL2);
+        if(dMissingH + dL2 > 0.0)
+        {
+            dResult += dMissingG*dMissingG/(dMissingH + dL2);
+        }
+        dResult -= dG*dG/(dLeftH + dRightH + dMissingH + dL2);
+
+        return dResult;
+    }
+
 
     virtual void PrintSubtree(unsigned long cIndent) = 0;
     virtual void TransferTreeToRList(int &iNodeID,
@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       node_assign.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   compact map from observation to terminal node
+//
+//------------------------------------------------------------------------------
+
+#ifndef NODE_ASSIGN_H
+#define NODE_ASSIGN_H
+
+#include <vector>
+#include "gbmexcept.h"
+
+// A tree of depth d never has more than 2*d+1 terminal nodes (left, right
+// and missing for every split), so the terminal node of an observation
+// fits in a byte for any depth the R interface accepts.  The width is
+// chosen from the node count passed to Initialize() so that the array
+// walked by GetBestSplit, Adjust and FitBestConstant is as small as
+// possible.
+
+class CNodeAssign
+{
+public:
+  CNodeAssign() : cLength(0), fWide(false) {}
+
+  void Initialize(unsigned long cLength, unsigned long cMaxNodes)
+  {
+    if (cMaxNodes > 65536UL)
+      {
+	throw GBM::invalid_argument("too many terminal nodes for node assignment");
+      }
+
+    this->cLength = cLength;
+    fWide = (cMaxNodes > 256UL);
+
+    if (fWide)
+      {
+	aiNarrow.clear();
+	aiWide.assign(cLength, 0);
+      }
+    else
+      {
+	aiWide.clear();
+	aiNarrow.assign(cLength, 0);
+      }
+  }
+
+  unsigned long size() const { return cLength; }
+
+  unsigned long operator[](unsigned long iObs) const
+  {
+    return fWide ? aiWide[iObs] : aiNarrow[iObs];
+  }
+
+  void set(unsigned long iObs, unsigned long iNode)
+  {
+    if (fWide)
+      {
+	aiWide[iObs] = static_cast<unsigned short>(iNode);
+      }
+    else
+      {
+	aiNarrow[iObs] = static_cast<unsigned char>(iNode);
+      }
+  }
+
+private:
+  unsigned long cLength;
+  bool fWide;
+  std::vector<unsigned char> aiNarrow;
+  std::vector<unsigned short> aiWide;
+};
+
+#endif // NODE_ASSIGN_H
@@ -7,7 +7,7 @@
 CNodeCategorical::~CNodeCategorical()
 {
     #ifdef NOISY_DEBUG
-    Rprintf("categorical destructor\n");
+    LogMessage("categorical destructor\n");
     #endif
 }
 
@@ -20,35 +20,35 @@ void CNodeCategorical::PrintSubtree
   unsigned long i = 0;
   const std::size_t cLeftCategory = aiLeftCategory.size();
   
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("N=%f, Improvement=%f, Prediction=%f, NA pred=%f\n",
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("N=%f, Improvement=%f, Prediction=%f, NA pred=%f\n",
 	  dTrainW,
 	  dImprovement,
 	  dPrediction,
 	  (pMissingNode == NULL ? 0.0 : pMissingNode->dPrediction));
 
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("V%d in ",iSplitVar);
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("V%d in ",iSplitVar);
   for(i=0; i<cLeftCategory; i++)
     {
-      Rprintf("%d",aiLeftCategory[i]);
-      if(i<cLeftCategory-1) Rprintf(",");
+      LogMessage("%d",aiLeftCategory[i]);
+      if(i<cLeftCategory-1) LogMessage(",");
     }
-  Rprintf("\n");
+  LogMessage("\n");
   pLeftNode->PrintSubtree(cIndent+1);
 
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("V%d not in ",iSplitVar);
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("V%d not in ",iSplitVar);
   for(i=0; i<cLeftCategory; i++)
     {
-      Rprintf("%d",aiLeftCategory[i]);
-      if(i<cLeftCategory-1) Rprintf(",");
+      LogMessage("%d",aiLeftCategory[i]);
+      if(i<cLeftCategory-1) LogMessage(",");
     }
-  Rprintf("\n");
+  LogMessage("\n");
   pRightNode->PrintSubtree(cIndent+1);
   
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("missing\n");
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("missing\n");
   pMissingNode->PrintSubtree(cIndent+1);
 }
 
@@ -62,7 +62,7 @@ signed char CNodeCategorical::WhichNode
     signed char ReturnValue = 0;
     double dX = data.x_value(iObs, iSplitVar);
 
-    if(!ISNA(dX))
+    if(!is_missing(dX))
     {
       if(std::find(aiLeftCategory.begin(),
 		   aiLeftCategory.end(),
@@ -92,7 +92,7 @@ signed char CNodeCategorical::WhichNode
     signed char ReturnValue = 0;
     double dX = adX[iSplitVar*cRow + iRow];
 
-    if(!ISNA(dX))
+    if(!is_missing(dX))
     {
       if(std::find(aiLeftCategory.begin(),
 		   aiLeftCategory.end(),
@@ -12,7 +12,7 @@ CNodeContinuous::CNodeContinuous()
 CNodeContinuous::~CNodeContinuous()
 {
     #ifdef NOISY_DEBUG
-    Rprintf("continuous destructor\n");
+    LogMessage("continuous destructor\n");
     #endif
 }
 
@@ -25,27 +25,27 @@ void CNodeContinuous::PrintSubtree
 {
   unsigned long i = 0;
   
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("N=%f, Improvement=%f, Prediction=%f, NA pred=%f\n",
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("N=%f, Improvement=%f, Prediction=%f, NA pred=%f\n",
 	  dTrainW,
 	  dImprovement,
 	  dPrediction,
 	  (pMissingNode == NULL ? 0.0 : pMissingNode->dPrediction));
 
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("V%d < %f\n",
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("V%d < %f\n",
 	  iSplitVar,
 	  dSplitValue);
   pLeftNode->PrintSubtree(cIndent+1);
   
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("V%d > %f\n",
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("V%d > %f\n",
 	  iSplitVar,
 	  dSplitValue);
   pRightNode->PrintSubtree(cIndent+1);
 
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("missing\n");
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("missing\n");
   pMissingNode->PrintSubtree(cIndent+1);
 }
 
@@ -60,7 +60,7 @@ signed char CNodeContinuous::WhichNode
     signed char ReturnValue = 0;
     double dX = data.x_value(iObs, iSplitVar);
 
-    if(!ISNA(dX))
+    if(!is_missing(dX))
     {
         if(dX < dSplitValue)
         {
@@ -88,7 +88,7 @@ signed char CNodeContinuous::WhichNode
     signed char ReturnValue = 0;
     double dX = adX[iSplitVar*cRow + iRow];
 
-    if(!ISNA(dX))
+    if(!is_missing(dX))
     {
         if(dX < dSplitValue)
         {
@@ -11,7 +11,7 @@ CNodeFactory::CNodeFactory()
 CNodeFactory::~CNodeFactory()
 {
     #ifdef NOISY_DEBUG
-    Rprintf("destructing node factory\n");
+    LogMessage("destructing node factory\n");
     #endif
 }
 
@@ -46,6 +46,16 @@ void CNodeNonterminal::Adjust
 
 
 
+void CNodeNonterminal::AddUpTrainW()
+{
+  pLeftNode->AddUpTrainW();
+  pRightNode->AddUpTrainW();
+  pMissingNode->AddUpTrainW();
+
+  dTrainW = pLeftNode->dTrainW + pRightNode->dTrainW + pMissingNode->dTrainW;
+}
+
+
 void CNodeNonterminal::Predict
 (
     const CDataset &data,
@@ -27,6 +27,7 @@ public:
     CNodeNonterminal();
     virtual ~CNodeNonterminal();
     virtual void Adjust(unsigned long cMinObsInNode);
+    virtual void AddUpTrainW();
 
     virtual signed char WhichNode(const CDataset &data,
                                   unsigned long iObs) = 0;
@@ -6,6 +6,54 @@
 //------------------------------------------------------------------------------
 #include "node_search.h"
 
+namespace {
+
+  // three way comparison with NaN last
+  int CompareNaNLast(double dX, double dY)
+  {
+    const bool fMissingX = is_missing(dX);
+    const bool fMissingY = is_missing(dY);
+
+    if(fMissingX && fMissingY) return 0;
+    if(fMissingX) return 1;
+    if(fMissingY) return -1;
+    if(dX < dY) return -1;
+    if(dX > dY) return 1;
+    return 0;
+  }
+
+  // Sorts adX into increasing order, NaN last, and permutes aiIndex along
+  // with it.  This is the Shell sort of R's rsort_with_index(), so that
+  // ties between categories are broken as they always were.
+  void SortWithIndex(double *adX, int *aiIndex, int n)
+  {
+    double dV = 0.0;
+    int iV = 0;
+    int i = 0;
+    int j = 0;
+    int h = 0;
+
+    for(h=1; h<=n/9; h=3*h+1);
+    for(; h>0; h/=3)
+      {
+	for(i=h; i<n; i++)
+	  {
+	    dV = adX[i];
+	    iV = aiIndex[i];
+	    j = i;
+	    while((j >= h) && (CompareNaNLast(adX[j-h], dV) > 0))
+	      {
+		adX[j] = adX[j-h];
+		aiIndex[j] = aiIndex[j-h];
+		j -= h;
+	      }
+	    adX[j] = dV;
+	    aiIndex[j] = iV;
+	  }
+      }
+  }
+}
+
 CNodeSearch::CNodeSearch()
 {
     iBestSplitVar = 0;
@@ -26,6 +74,8 @@ CNodeSearch::CNodeSearch()
     aiBestCategory.resize(1024);
 
     iRank = UINT_MAX;
+    cClasses = 1;
+    dL2Penalty = 0.0;
 }
 
 
@@ -36,28 +86,73 @@ CNodeSearch::~CNodeSearch()
 
 void CNodeSearch::Initialize
 (
-    unsigned long cMinObsInNode
+    unsigned long cMinObsInNode,
+    unsigned long cClasses,
+    double dL2Penalty
 )
 {
     this->cMinObsInNode = cMinObsInNode;
+    this->cClasses = cClasses;
+    this->dL2Penalty = dL2Penalty;
+
+    if(cClasses > 1)
+    {
+        vecdBestLeftSumZ.assign(cClasses, 0.0);
+        vecdBestRightSumZ.assign(cClasses, 0.0);
+        vecdBestMissingSumZ.assign(cClasses, 0.0);
+        vecdInitSumZ.assign(cClasses, 0.0);
+        vecdCurrentLeftSumZ.assign(cClasses, 0.0);
+        vecdCurrentRightSumZ.assign(cClasses, 0.0);
+        vecdCurrentMissingSumZ.assign(cClasses, 0.0);
+        vecdRightSumZ.assign(cClasses, 0.0);
+        vecdGroupSumZ.assign(adGroupSumZ.size()*cClasses, 0.0);
+    }
 }
 
 
-void CNodeSearch::IncorporateObs
+// Keeps the split at dCurrentSplitValue of a continuous variable if it is
+// the best so far.
+inline void CNodeSearch::EvaluateContinuousSplit
+(
+    long lMonotone
+)
+{
+    if((cCurrentLeftN >= cMinObsInNode) &&
+        (cCurrentRightN >= cMinObsInNode) &&
+        ((lMonotone==0) ||
+        (lMonotone*(dCurrentRightSumZ*dCurrentLeftTotalW -
+                    dCurrentLeftSumZ*dCurrentRightTotalW) > 0)))
+    {
+        dCurrentImprovement = CurrentImprovement();
+        if(dCurrentImprovement > dBestImprovement)
+        {
+            iBestSplitVar = iCurrentSplitVar;
+            dBestSplitValue = dCurrentSplitValue;
+            cBestVarClasses = 0;
+
+            dBestLeftSumZ    = dCurrentLeftSumZ;
+            dBestLeftTotalW  = dCurrentLeftTotalW;
+            cBestLeftN       = cCurrentLeftN;
+            dBestRightSumZ   = dCurrentRightSumZ;
+            dBestRightTotalW = dCurrentRightTotalW;
+            cBestRightN      = cCurrentRightN;
+            dBestImprovement = dCurrentImprovement;
+        }
+    }
+}
+
+
+void CNodeSearch::IncorporateSums
 (
     double dX,
-    double dZ,
+    double dWZ,
     double dW,
     long lMonotone
 )
 {
-    static double dWZ = 0.0;
-
     if(fIsSplit) return;
 
-    dWZ = dW*dZ;
-
-    if(ISNA(dX))
+    if(is_missing(dX))
     {
         dCurrentMissingSumZ += dWZ;
         dCurrentMissingTotalW += dW;
@@ -76,28 +171,129 @@ void CNodeSearch::IncorporateObs
         // Evaluate the current split
         // the newest observation is still in the right child
         dCurrentSplitValue = 0.5*(dLastXValue + dX);
+        if(dLastXValue != dX)
+        {
+            EvaluateContinuousSplit(lMonotone);
+        }
+
+        // now move the new observation to the left
+        // if another observation arrives we will evaluate this
+        dCurrentLeftSumZ += dWZ;
+        dCurrentLeftTotalW += dW;
+        cCurrentLeftN++;
+        dCurrentRightSumZ -= dWZ;
+        dCurrentRightTotalW -= dW;
+        cCurrentRightN--;
+
+        dLastXValue = dX;
+    }
+    else // variable is categorical, evaluates later
+    {
+        adGroupSumZ[(unsigned long)dX] += dWZ;
+        adGroupW[(unsigned long)dX] += dW;
+        acGroupN[(unsigned long)dX] ++;
+    }
+}
+
+
+
+void CNodeSearch::IncorporateBin
+(
+    double dX,
+    double dWZ,
+    double dW,
+    unsigned long cN,
+    long lMonotone
+)
+{
+    if(fIsSplit || (cN == 0)) return;
+
+    if(is_missing(dX))
+    {
+        dCurrentMissingSumZ += dWZ;
+        dCurrentMissingTotalW += dW;
+        cCurrentMissingN += cN;
+        dCurrentRightSumZ -= dWZ;
+        dCurrentRightTotalW -= dW;
+        cCurrentRightN -= cN;
+    }
+    else if(cCurrentVarClasses == 0)
+    {
+        // the split in front of the bin, at its lowest value
+        dCurrentSplitValue = dX;
+        if(cCurrentLeftN > 0)
+        {
+            EvaluateContinuousSplit(lMonotone);
+        }
+
+        dCurrentLeftSumZ += dWZ;
+        dCurrentLeftTotalW += dW;
+        cCurrentLeftN += cN;
+        dCurrentRightSumZ -= dWZ;
+        dCurrentRightTotalW -= dW;
+        cCurrentRightN -= cN;
+    }
+    else
+    {
+        adGroupSumZ[(unsigned long)dX] += dWZ;
+        adGroupW[(unsigned long)dX] += dW;
+        acGroupN[(unsigned long)dX] += cN;
+    }
+}
+
+
+
+void CNodeSearch::IncorporateObs
+(
+    double dX,
+    const double *adZ,
+    double dW
+)
+{
+    unsigned long k = 0;
+
+    if(fIsSplit) return;
+
+    if(is_missing(dX))
+    {
+        for(k=0; k<cClasses; k++)
+        {
+            vecdCurrentMissingSumZ[k] += dW*adZ[k];
+            vecdCurrentRightSumZ[k] -= dW*adZ[k];
+        }
+        dCurrentMissingTotalW += dW;
+        cCurrentMissingN++;
+        dCurrentRightTotalW -= dW;
+        cCurrentRightN--;
+    }
+    else if(cCurrentVarClasses == 0)   // variable is continuous
+    {
+        if(dLastXValue > dX)
+        {
+	  throw GBM::failure("Observations are not in order. gbm() was unable to build an index for the design matrix. Could be a bug in gbm or an unusual data type in data.");
+	}
+
+        // evaluate the split in front of the new observation
+        dCurrentSplitValue = 0.5*(dLastXValue + dX);
         if((dLastXValue != dX) &&
             (cCurrentLeftN >= cMinObsInNode) &&
-            (cCurrentRightN >= cMinObsInNode) &&
-            ((lMonotone==0) ||
-            (lMonotone*(dCurrentRightSumZ*dCurrentLeftTotalW -
-                        dCurrentLeftSumZ*dCurrentRightTotalW) > 0)))
+            (cCurrentRightN >= cMinObsInNode))
         {
-            dCurrentImprovement =
-                CNode::Improvement(dCurrentLeftTotalW,dCurrentRightTotalW,
-                                    dCurrentMissingTotalW,
-                                    dCurrentLeftSumZ,dCurrentRightSumZ,
-                                    dCurrentMissingSumZ);
+            dCurrentImprovement = ClassImprovement();
             if(dCurrentImprovement > dBestImprovement)
             {
                 iBestSplitVar = iCurrentSplitVar;
                 dBestSplitValue = dCurrentSplitValue;
                 cBestVarClasses = 0;
 
-                dBestLeftSumZ    = dCurrentLeftSumZ;
+                std::copy(vecdCurrentLeftSumZ.begin(),
+                          vecdCurrentLeftSumZ.end(),
+                          vecdBestLeftSumZ.begin());
+                std::copy(vecdCurrentRightSumZ.begin(),
+                          vecdCurrentRightSumZ.end(),
+                          vecdBestRightSumZ.begin());
                 dBestLeftTotalW  = dCurrentLeftTotalW;
                 cBestLeftN       = cCurrentLeftN;
-                dBestRightSumZ   = dCurrentRightSumZ;
                 dBestRightTotalW = dCurrentRightTotalW;
                 cBestRightN      = cCurrentRightN;
                 dBestImprovement = dCurrentImprovement;
@@ -105,11 +301,13 @@ void CNodeSearch::IncorporateObs
         }
 
         // now move the new observation to the left
-        // if another observation arrives we will evaluate this
-        dCurrentLeftSumZ += dWZ;
+        for(k=0; k<cClasses; k++)
+        {
+            vecdCurrentLeftSumZ[k] += dW*adZ[k];
+            vecdCurrentRightSumZ[k] -= dW*adZ[k];
+        }
         dCurrentLeftTotalW += dW;
         cCurrentLeftN++;
-        dCurrentRightSumZ -= dWZ;
         dCurrentRightTotalW -= dW;
         cCurrentRightN--;
 
@@ -117,10 +315,31 @@ void CNodeSearch::IncorporateObs
     }
     else // variable is categorical, evaluates later
     {
-        adGroupSumZ[(unsigned long)dX] += dWZ;
-        adGroupW[(unsigned long)dX] += dW;
-        acGroupN[(unsigned long)dX] ++;
+        const unsigned long iCat = (unsigned long)dX;
+        for(k=0; k<cClasses; k++)
+        {
+            vecdGroupSumZ[iCat*cClasses + k] += dW*adZ[k];
+        }
+        adGroupW[iCat] += dW;
+        acGroupN[iCat] ++;
+    }
+}
+
+
+double CNodeSearch::ClassImprovement() const
+{
+    unsigned long k = 0;
+    double dImprovement = 0.0;
+
+    for(k=0; k<cClasses; k++)
+    {
+        dImprovement +=
+            CNode::Improvement(dCurrentLeftTotalW,dCurrentRightTotalW,
+                               dCurrentMissingTotalW,
+                               vecdCurrentLeftSumZ[k],vecdCurrentRightSumZ[k],
+                               vecdCurrentMissingSumZ[k]);
     }
+    return dImprovement;
 }
 
 
@@ -175,6 +394,30 @@ void CNodeSearch::Set
 }
 
 
+void CNodeSearch::Set
+(
+    const double *adSumZ,
+    double dTotalW,
+    unsigned long cTotalN,
+    CNodeTerminal *pThisNode,
+    CNode **ppParentPointerToThisNode,
+    CNodeFactory *pNodeFactory
+)
+{
+    // adSumZ may be one of the vecdBest...SumZ of this node search, so it
+    // is copied before those are reset
+    std::copy(adSumZ, adSumZ + cClasses, vecdInitSumZ.begin());
+
+    Set(vecdInitSumZ[0], dTotalW, cTotalN,
+        pThisNode, ppParentPointerToThisNode, pNodeFactory);
+
+    std::fill(vecdBestLeftSumZ.begin(), vecdBestLeftSumZ.end(), 0.0);
+    std::copy(vecdInitSumZ.begin(), vecdInitSumZ.end(),
+              vecdBestRightSumZ.begin());
+    std::fill(vecdBestMissingSumZ.begin(), vecdBestMissingSumZ.end(), 0.0);
+}
+
+
 void CNodeSearch::ResetForNewVar
 (
     unsigned long iWhichVar,
@@ -207,6 +450,17 @@ void CNodeSearch::ResetForNewVar
   dCurrentImprovement = 0.0;
   
   dLastXValue = -HUGE_VAL;
+
+  if(cClasses > 1)
+    {
+      std::fill(vecdGroupSumZ.begin(),
+		vecdGroupSumZ.begin() + cCurrentVarClasses*cClasses, 0);
+      std::fill(vecdCurrentLeftSumZ.begin(), vecdCurrentLeftSumZ.end(), 0);
+      std::copy(vecdInitSumZ.begin(), vecdInitSumZ.end(),
+		vecdCurrentRightSumZ.begin());
+      std::fill(vecdCurrentMissingSumZ.begin(),
+		vecdCurrentMissingSumZ.end(), 0);
+    }
 }
 
 
@@ -220,12 +474,18 @@ void CNodeSearch::WrapUpCurrentVariable()
 	  dBestMissingSumZ   = dCurrentMissingSumZ;
 	  dBestMissingTotalW = dCurrentMissingTotalW;
 	  cBestMissingN      = cCurrentMissingN;
+	  std::copy(vecdCurrentMissingSumZ.begin(),
+		    vecdCurrentMissingSumZ.end(),
+		    vecdBestMissingSumZ.begin());
         }
       else // DEBUG: consider a weighted average with parent node?
         {
 	  dBestMissingSumZ   = dInitSumZ;
 	  dBestMissingTotalW = dInitTotalW;
 	  cBestMissingN      = 0;
+	  std::copy(vecdInitSumZ.begin(),
+		    vecdInitSumZ.end(),
+		    vecdBestMissingSumZ.begin());
         }
     }
 }
@@ -244,6 +504,12 @@ void CNodeSearch::EvaluateCategoricalSplit()
       throw GBM::invalid_argument();
     }
 
+  if(cClasses > 1)
+    {
+      EvaluateCategoricalClassSplit();
+      return;
+    }
+
   cFiniteMeans = 0;
   for(i=0; i<cCurrentVarClasses; i++)
     {
@@ -259,7 +525,7 @@ void CNodeSearch::EvaluateCategoricalSplit()
         }
     }
   
-  rsort_with_index(&adGroupMean[0],&aiCurrentCategory[0],cCurrentVarClasses);
+  SortWithIndex(&adGroupMean[0],&aiCurrentCategory[0],cCurrentVarClasses);
     
   // if only one group has a finite mean it will not consider
   // might be all are missing so no categories enter here
@@ -274,11 +540,7 @@ void CNodeSearch::EvaluateCategoricalSplit()
       dCurrentRightTotalW -= adGroupW[aiCurrentCategory[i]];
       cCurrentRightN      -= acGroupN[aiCurrentCategory[i]];
       
-      dCurrentImprovement =
-	CNode::Improvement(dCurrentLeftTotalW,dCurrentRightTotalW,
-			   dCurrentMissingTotalW,
-			   dCurrentLeftSumZ,dCurrentRightSumZ,
-			   dCurrentMissingSumZ);
+      dCurrentImprovement = CurrentImprovement();
       if((cCurrentLeftN >= cMinObsInNode) &&
 	 (cCurrentRightN >= cMinObsInNode) &&
 	 (dCurrentImprovement > dBestImprovement))
@@ -307,6 +569,96 @@ void CNodeSearch::EvaluateCategoricalSplit()
 
 
 
+// The categories of a multi-class split cannot be put in one order that
+// contains the best split for all classes.  Each class orders them by its
+// mean working response, and the splits along each of these orders are
+// evaluated by their improvement summed over the classes.
+void CNodeSearch::EvaluateCategoricalClassSplit()
+{
+  long i = 0;
+  unsigned long k = 0;
+  unsigned long iOrderClass = 0;
+  unsigned long cFiniteMeans = 0;
+
+  std::copy(vecdCurrentRightSumZ.begin(), vecdCurrentRightSumZ.end(),
+	    vecdRightSumZ.begin());
+  const double dRightTotalW = dCurrentRightTotalW;
+  const unsigned long cRightN = cCurrentRightN;
+
+  for(iOrderClass=0; iOrderClass<cClasses; iOrderClass++)
+    {
+      cFiniteMeans = 0;
+      for(i=0; i<cCurrentVarClasses; i++)
+	{
+	  aiCurrentCategory[i] = i;
+	  if(adGroupW[i] != 0.0)
+	    {
+	      adGroupMean[i] = vecdGroupSumZ[i*cClasses + iOrderClass]/adGroupW[i];
+	      cFiniteMeans++;
+	    }
+	  else
+	    {
+	      adGroupMean[i] = HUGE_VAL;
+	    }
+	}
+
+      SortWithIndex(&adGroupMean[0],&aiCurrentCategory[0],cCurrentVarClasses);
+
+      std::fill(vecdCurrentLeftSumZ.begin(), vecdCurrentLeftSumZ.end(), 0.0);
+      std::copy(vecdRightSumZ.begin(), vecdRightSumZ.end(),
+		vecdCurrentRightSumZ.begin());
+      dCurrentLeftTotalW  = 0.0;
+      cCurrentLeftN       = 0;
+      dCurrentRightTotalW = dRightTotalW;
+      cCurrentRightN      = cRightN;
+
+      for(i=0; (cFiniteMeans>1) && ((ULONG)i<cFiniteMeans-1); i++)
+	{
+	  const unsigned long iCat = aiCurrentCategory[i];
+
+	  dCurrentSplitValue = (double)i;
+	  for(k=0; k<cClasses; k++)
+	    {
+	      vecdCurrentLeftSumZ[k]  += vecdGroupSumZ[iCat*cClasses + k];
+	      vecdCurrentRightSumZ[k] -= vecdGroupSumZ[iCat*cClasses + k];
+	    }
+	  dCurrentLeftTotalW  += adGroupW[iCat];
+	  cCurrentLeftN       += acGroupN[iCat];
+	  dCurrentRightTotalW -= adGroupW[iCat];
+	  cCurrentRightN      -= acGroupN[iCat];
+
+	  dCurrentImprovement = ClassImprovement();
+	  if((cCurrentLeftN >= cMinObsInNode) &&
+	     (cCurrentRightN >= cMinObsInNode) &&
+	     (dCurrentImprovement > dBestImprovement))
+	    {
+	      dBestSplitValue = dCurrentSplitValue;
+	      iBestSplitVar = iCurrentSplitVar;
+	      cBestVarClasses = cCurrentVarClasses;
+	      // the order differs between the classes, so copy it every time
+	      std::copy(aiCurrentCategory.begin(),
+			aiCurrentCategory.begin() + cCurrentVarClasses,
+			aiBestCategory.begin());
+
+	      std::copy(vecdCurrentLeftSumZ.begin(),
+			vecdCurrentLeftSumZ.end(),
+			vecdBestLeftSumZ.begin());
+	      std::copy(vecdCurrentRightSumZ.begin(),
+			vecdCurrentRightSumZ.end(),
+			vecdBestRightSumZ.begin());
+	      dBestLeftTotalW    = dCurrentLeftTotalW;
+	      cBestLeftN         = cCurrentLeftN;
+	      dBestRightTotalW   = dCurrentRightTotalW;
+	      cBestRightN        = cCurrentRightN;
+	      dBestImprovement   = dCurrentImprovement;
+	    }
+	}
+    }
+}
+
+
+
+
 void CNodeSearch::SetupNewNodes
 (
     PCNodeNonterminal &pNewSplitNode,
@@ -356,6 +708,15 @@ void CNodeSearch::SetupNewNodes
     pNewSplitNode->pRightNode   = pNewRightNode;
     pNewSplitNode->pMissingNode = pNewMissingNode;
 
+    // a multi-class distribution sets the predictions of each class in
+    // FitBestConstant(); the first class stands in until then
+    if(cClasses > 1)
+    {
+        dBestLeftSumZ    = vecdBestLeftSumZ[0];
+        dBestRightSumZ   = vecdBestRightSumZ[0];
+        dBestMissingSumZ = vecdBestMissingSumZ[0];
+    }
+
     pNewLeftNode->dPrediction    = dBestLeftSumZ/dBestLeftTotalW;
     pNewLeftNode->dTrainW        = dBestLeftTotalW;
     pNewLeftNode->cN             = cBestLeftN;
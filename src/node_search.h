@@ -30,19 +30,57 @@ public:
 
     CNodeSearch();
     ~CNodeSearch();
-    void Initialize(unsigned long cMinObsInNode);
+    void Initialize(unsigned long cMinObsInNode,
+		    unsigned long cClasses = 1,
+		    double dL2Penalty = 0.0);
 
     void IncorporateObs(double dX,
 			double dZ,
 			double dW,
+			long lMonotone)
+    {
+        IncorporateSums(dX, dW*dZ, dW, lMonotone);
+    }
+
+    // Newton version: dWG is the weighted gradient of the observation and
+    // dWH its weighted hessian, which takes the place of the weight in all
+    // the sums of this node search
+    void IncorporateNewtonObs(double dX,
+			      double dWG,
+			      double dWH,
+			      long lMonotone)
+    {
+        IncorporateSums(dX, dWG, dWH, lMonotone);
+    }
+
+    // histogram version (histogram.h): the cN rows of a bin, with the sums
+    // dWZ and dW.  dX is the lowest value of a bin of a continuous
+    // variable, which the bins have to be given in the order of, the
+    // level of a categorical one, or missing.
+    void IncorporateBin(double dX,
+			double dWZ,
+			double dW,
+			unsigned long cN,
 			long lMonotone);
 
+    // multi-class version: adZ holds the working response of the
+    // observation for each of the cClasses classes
+    void IncorporateObs(double dX,
+			const double *adZ,
+			double dW);
+
     void Set(double dSumZ,
 	     double dTotalW,
 	     unsigned long cTotalN,
 	     CNodeTerminal *pThisNode,
 	     CNode **ppParentPointerToThisNode,
 	     CNodeFactory *pNodeFactory);
+    void Set(const double *adSumZ,
+	     double dTotalW,
+	     unsigned long cTotalN,
+	     CNodeTerminal *pThisNode,
+	     CNode **ppParentPointerToThisNode,
+	     CNodeFactory *pNodeFactory);
     void ResetForNewVar(unsigned long iWhichVar,
 			long cVarClasses);
     
@@ -88,8 +126,40 @@ public:
     unsigned long cInitN;
     double dBestImprovement;
 
+    // per-class sums of the best split when the trees of a multi-class
+    // model share their splits (cClasses > 1); the improvement of a split
+    // is the sum of its improvements for the classes
+    std::vector<double> vecdBestLeftSumZ;
+    std::vector<double> vecdBestRightSumZ;
+    std::vector<double> vecdBestMissingSumZ;
+
 private:
+    void IncorporateSums(double dX,
+			 double dWZ,
+			 double dW,
+			 long lMonotone);
+    void EvaluateContinuousSplit(long lMonotone);
+    void EvaluateCategoricalClassSplit();
+    double ClassImprovement() const;
+    double CurrentImprovement() const
+    {
+        if(dL2Penalty == 0.0)
+        {
+            return CNode::Improvement(dCurrentLeftTotalW,dCurrentRightTotalW,
+                                      dCurrentMissingTotalW,
+                                      dCurrentLeftSumZ,dCurrentRightSumZ,
+                                      dCurrentMissingSumZ);
+        }
+        return CNode::NewtonImprovement(dCurrentLeftTotalW,dCurrentRightTotalW,
+                                        dCurrentMissingTotalW,
+                                        dCurrentLeftSumZ,dCurrentRightSumZ,
+                                        dCurrentMissingSumZ,
+                                        dL2Penalty);
+    }
+
     bool fIsSplit;
+    unsigned long cClasses;
+    double dL2Penalty;          // L2 penalty on the node predictions
 
     unsigned long cMinObsInNode;
 
@@ -116,6 +186,13 @@ private:
     std::vector<int> aiCurrentCategory;
     std::vector<unsigned long> aiBestCategory;
 
+    std::vector<double> vecdInitSumZ;
+    std::vector<double> vecdCurrentLeftSumZ;
+    std::vector<double> vecdCurrentRightSumZ;
+    std::vector<double> vecdCurrentMissingSumZ;
+    std::vector<double> vecdRightSumZ;  // right sums before a category ordering
+    std::vector<double> vecdGroupSumZ;  // cClasses sums per category
+
     CNodeTerminal *pThisNode;
     CNode **ppParentPointerToThisNode;
     CNodeFactory *pNodeFactory;
@@ -17,7 +17,7 @@ CNodeTerminal::CNodeTerminal()
 CNodeTerminal::~CNodeTerminal()
 {
     #ifdef NOISY_DEBUG
-    Rprintf("terminal destructor\n");
+    LogMessage("terminal destructor\n");
     #endif
 }
 
@@ -28,6 +28,10 @@ void CNodeTerminal::Adjust
 {
 }
 
+void CNodeTerminal::AddUpTrainW()
+{
+}
+
 void CNodeTerminal::ApplyShrinkage
 (
     double dLambda
@@ -72,8 +76,8 @@ void CNodeTerminal::PrintSubtree
 {
   unsigned long i = 0;
   
-  for(i=0; i< cIndent; i++) Rprintf("  ");
-  Rprintf("N=%f, Prediction=%f *\n",
+  for(i=0; i< cIndent; i++) LogMessage("  ");
+  LogMessage("N=%f, Prediction=%f *\n",
 	  dTrainW,
 	  dPrediction);
 }
@@ -30,6 +30,7 @@ public:
     CNodeTerminal();
     ~CNodeTerminal();
     void Adjust(unsigned long cMinObsInNode);
+    void AddUpTrainW();
 
     void PrintSubtree(unsigned long cIndent);
     void TransferTreeToRList(int &iNodeID,
@@ -3,6 +3,7 @@
 // Author: Stefan Schroedl (schroedl@a9.com)
 
 #include "pairwise.h"
+#include "threads.h"
 
 #include <iostream>
 #include <vector>
@@ -19,7 +20,7 @@ void CRanker::Init(unsigned int cMaxItemsPerGroup)
     vecpdipScoreRank.resize(cMaxItemsPerGroup);
 }
 
-bool CRanker::SetGroupScores(const double* const adScores, const unsigned int cNumItems)
+bool CRanker::SetGroupScores(const double* const adScores, const unsigned int cNumItems, CGroupRandom& rng)
 {
     const double dEPS = 1e-10;
 
@@ -37,7 +38,7 @@ bool CRanker::SetGroupScores(const double* const adScores, const unsigned int cN
     for(unsigned int i = 0; i < cNumItems; i++)
     {
         // Add small random number to break possible ties
-        vecdipScoreRank[i].first = adScores[i] + dEPS * (unif_rand() - 0.5);
+        vecdipScoreRank[i].first = adScores[i] + dEPS * (rng.Uniform() - 0.5);
 
         vecpdipScoreRank[i] = &(vecdipScoreRank[i]);
     }
@@ -55,13 +56,115 @@ struct CDoubleUintPairPtrComparison
     }
 };
 
-bool CRanker::Rank()
+void CRanker::SetOrder(const unsigned int* const aiOrder)
+{
+    for (unsigned int i = 0; i < cNumItems; i++)
+    {
+        vecpdipScoreRank[i] = &(vecdipScoreRank[aiOrder[i]]);
+    }
+}
+
+void CRanker::GetOrder(unsigned int* aiOrder) const
+{
+    for (unsigned int i = 0; i < cNumItems; i++)
+    {
+        aiOrder[i] = vecpdipScoreRank[i] - &(vecdipScoreRank[0]);
+    }
+}
+
+// Insertion sort of the pointers in [apBegin, apEnd) by decreasing score.
+// Gives up and returns false once more than cMaxMoves shifts were needed,
+// leaving a permutation of the input.
+static bool InsertionSort(CRanker::CDoubleUintPair** apBegin, CRanker::CDoubleUintPair** apEnd, unsigned long cMaxMoves)
+{
+    unsigned long cMoves = 0;
+
+    for (CRanker::CDoubleUintPair** ap = apBegin + 1; ap < apEnd; ap++)
+    {
+        CRanker::CDoubleUintPair* const pItem = *ap;
+        CRanker::CDoubleUintPair** apTo = ap;
+
+        while (apTo > apBegin && (*(apTo - 1))->first < pItem->first)
+        {
+            *apTo = *(apTo - 1);
+            apTo--;
+        }
+        *apTo = pItem;
+
+        cMoves += ap - apTo;
+        if (cMoves > cMaxMoves)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Moves the highest scores to [apBegin, apTop), sorted, by insertion into
+// the first (apTop - apBegin) items.  Gives up like InsertionSort().
+static bool SelectTop(CRanker::CDoubleUintPair** apBegin, CRanker::CDoubleUintPair** apTop, CRanker::CDoubleUintPair** apEnd, unsigned long cMaxMoves)
+{
+    if (!InsertionSort(apBegin, apTop, cMaxMoves))
+    {
+        return false;
+    }
+
+    unsigned long cMoves = 0;
+
+    for (CRanker::CDoubleUintPair** ap = apTop; ap < apEnd; ap++)
+    {
+        if ((*ap)->first > (*(apTop - 1))->first)
+        {
+            // Replaces the last of the top items
+            CRanker::CDoubleUintPair* const pItem = *ap;
+            CRanker::CDoubleUintPair** apTo = apTop - 1;
+            *ap = *apTo;
+
+            while (apTo > apBegin && (*(apTo - 1))->first < pItem->first)
+            {
+                *apTo = *(apTo - 1);
+                apTo--;
+            }
+            *apTo = pItem;
+
+            cMoves += apTop - apTo;
+            if (cMoves > cMaxMoves)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool CRanker::Rank(unsigned int cTopRanks)
 {
     // Sort the pointer array, based on decreasing score
 
     CDoubleUintPairPtrComparison comp;
 
-    sort(vecpdipScoreRank.begin(), vecpdipScoreRank.begin() + cNumItems, comp);
+    CDoubleUintPair** const apBegin = &(vecpdipScoreRank[0]);
+    CDoubleUintPair** const apEnd   = apBegin + cNumItems;
+
+    // The starting order (see SetOrder()) is usually nearly sorted, so
+    // insertion is tried first; beyond this many moves a general sort is
+    // faster
+    const unsigned long cMaxMoves = 8 * (unsigned long)cNumItems;
+
+    unsigned int cRanked = cNumItems;
+
+    if (cTopRanks > 0 && cTopRanks < cNumItems)
+    {
+        cRanked = cTopRanks;
+        if (!SelectTop(apBegin, apBegin + cRanked, apEnd, cMaxMoves))
+        {
+            partial_sort(apBegin, apBegin + cRanked, apEnd, comp);
+        }
+    }
+    else if (!InsertionSort(apBegin, apEnd, cMaxMoves))
+    {
+        sort(apBegin, apEnd, comp);
+    }
 
     bool bChanged = false;
 
@@ -69,8 +172,8 @@ bool CRanker::Rank()
 
     for(unsigned int i = 0; i < cNumItems; i++)
     {
-        // Note: ranks are 1-based
-        const unsigned int cNewRank = i + 1;
+        // Note: ranks are 1-based, items beyond the top share one rank
+        const unsigned int cNewRank = (i < cRanked) ? i + 1 : cRanked + 1;
         if (!bChanged)
         {
             bChanged = (cNewRank != vecpdipScoreRank[i]->second);
@@ -308,7 +411,7 @@ double CNDCG::MaxMeasure(unsigned int iGroup, const double* const adY, unsigned
 #ifdef NOISY_DEBUG
             if (vecdMaxDCG[iGroup] == 0)
             {
-                Rprintf("max score is 0: iGroup = %d, maxScore = %f\n", 
+                LogMessage("max score is 0: iGroup = %d, maxScore = %f\n", 
                         iGroup,  vecdMaxDCG[iGroup]);
                 throw GBM::failure();
             }
@@ -524,8 +627,10 @@ double CMAP::Measure(const double* const adY, const CRanker& ranker)
 }
 
 
-CPairwise::CPairwise(const char* szIRMeasure)
+CPairwise::CPairwise(const char* szIRMeasure, unsigned long cPairBudget)
 {
+    this->cPairBudget = cPairBudget;
+
     // Construct the IR Measure
     if (!strcmp(szIRMeasure, "conc"))
     {
@@ -543,7 +648,7 @@ CPairwise::CPairwise(const char* szIRMeasure)
       {
         if (strcmp(szIRMeasure, "ndcg"))
 	  {
-            Rprintf("Unknown IR measure '%s' in initialization, using 'ndcg' instead\n", szIRMeasure);
+            LogMessage("Unknown IR measure '%s' in initialization, using 'ndcg' instead\n", szIRMeasure);
         }
         pirm.reset(new CNDCG());
       }
@@ -551,6 +656,73 @@ CPairwise::CPairwise(const char* szIRMeasure)
 
 CPairwise::~CPairwise()
 {
+    for (unsigned int i = 0; i < vecState.size(); i++)
+    {
+        delete vecState[i].pirm;
+    }
+}
+
+
+// Auxiliary struct to order groups by decreasing size
+struct CGroupSizeComparison
+{
+    CGroupSizeComparison(const vector<unsigned int>& veciGroupStart) : veciGroupStart(veciGroupStart) {}
+
+    bool operator() (unsigned int iLhs, unsigned int iRhs) const
+    {
+        return (veciGroupStart[iLhs+1] - veciGroupStart[iLhs] > veciGroupStart[iRhs+1] - veciGroupStart[iRhs]);
+    }
+
+    const vector<unsigned int>& veciGroupStart;
+};
+
+void CPairwise::FindGroups(const double* const adGroup, unsigned long cLength)
+{
+    veciGroupStart.clear();
+    for (unsigned int i = 0; i < cLength; i++)
+    {
+        if (i == 0 || adGroup[i] != adGroup[i-1])
+        {
+            veciGroupStart.push_back(i);
+        }
+    }
+    const unsigned int cGroups = veciGroupStart.size();
+    veciGroupStart.push_back(cLength);
+
+    // Scheduling the largest groups first keeps a few very large groups
+    // from finishing last on a single thread
+    veciGroupOrder.resize(cGroups);
+    for (unsigned int iGroup = 0; iGroup < cGroups; iGroup++)
+    {
+        veciGroupOrder[iGroup] = iGroup;
+    }
+    stable_sort(veciGroupOrder.begin(), veciGroupOrder.end(), CGroupSizeComparison(veciGroupStart));
+}
+
+void CPairwise::RankGroup(CGroupState& state, CGroupRandom& rng, int iGroup, const double* const adScores, unsigned int cNumItems)
+{
+    state.ranker.SetGroupScores(adScores, cNumItems, rng);
+
+    // Order of the last ranking of this group, if stored
+    unsigned int* aiOrder = NULL;
+    if (iGroup >= 0 && (unsigned int)iGroup < veciOrderSize.size() && veciOrderSize[iGroup] == cNumItems)
+    {
+        aiOrder = &veciOrder[veciOrderStart[iGroup]];
+        state.ranker.SetOrder(aiOrder);
+    }
+
+    state.ranker.Rank(state.pirm->TopRanksNeeded());
+
+    if (aiOrder != NULL)
+    {
+        state.ranker.GetOrder(aiOrder);
+    }
+}
+
+// Seed for the CGroupRandom streams of one pass over the groups
+inline uint64_t GroupSeed(CRandom& random)
+{
+    return (uint64_t)(random.Uniform() * 4294967296.0);
 }
 
 
@@ -585,40 +757,43 @@ void CPairwise::ComputeWorkingResponse
 )
 {
 #ifdef NOISY_DEBUG
-    Rprintf("compute working response, nTrain = %u\n", nTrain);
+    LogMessage("compute working response, nTrain = %u\n", nTrain);
 #endif
     
     if (nTrain <= 0) return;
     
+    FindGroups(adGroup, nTrain);
+
+#ifdef NOISY_DEBUG
+    // Check sorting
+    for (unsigned int i = 0; i < nTrain-1; i++) {
+      if (adGroup[i] == adGroup[i+1] && adY[i] < adY[i+1]) {
+        throw GBM::failure("sorting failed in pairwise?");
+      }
+    }
+#endif
+
     // Iterate through all groups, compute gradients
-    
-    unsigned int iItemStart = 0;
-    unsigned int iItemEnd   = 0;
-    
-    while (iItemStart < nTrain)
+
+    const uint64_t ulSeed = GroupSeed(Random());
+    const int cGroups = veciGroupOrder.size();
+    int iOrder = 0;
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(vecState.size())
+    for (iOrder = 0; iOrder < cGroups; iOrder++)
       {
-	adZ[iItemEnd]           = 0;
-	vecdHessian[iItemEnd]   = 0;
-	
-	const double dGroup = adGroup[iItemStart];
-	
-	// Find end of current group, initialize working response
-	for (iItemEnd = iItemStart + 1; iItemEnd < nTrain && adGroup[iItemEnd] == dGroup; iItemEnd++)
+	CGroupState& state = vecState[ThreadNum()];
+	const unsigned int iGroup     = veciGroupOrder[iOrder];
+	const unsigned int iItemStart = veciGroupStart[iGroup];
+	const unsigned int iItemEnd   = veciGroupStart[iGroup + 1];
+
+	// Clear gradients from last iteration
+	for (unsigned int i = iItemStart; i < iItemEnd; i++)
 	  {
-	    // Clear gradients from last iteration
-	    adZ[iItemEnd]         = 0;
-	    vecdHessian[iItemEnd] = 0;
+	    adZ[i]         = 0;
+	    vecdHessian[i] = 0;
 	  }
 	
-#ifdef NOISY_DEBUG
-	// Check sorting
-	for (unsigned int i = iItemStart; i < iItemEnd-1; i++) {
-	  if (adY[i] < adY[i+1]) {
-	    throw GBM::failure("sorting failed in pairwise?");
-	  }
-	}  
-#endif
-
 	if (afInBag[iItemStart])
 	  {
 	    // Group is part of the training set
@@ -626,14 +801,12 @@ void CPairwise::ComputeWorkingResponse
 	    const int cNumItems = iItemEnd - iItemStart;
 	    
 	    // If offset given, add up current scores
-	    const double* adFPlusOffset = OffsetVector(adF, adOffset, iItemStart, iItemEnd, vecdFPlusOffset);
+	    const double* adFPlusOffset = OffsetVector(adF, adOffset, iItemStart, iItemEnd, state.vecdFPlusOffset);
 	    
 	    // Accumulate gradients
-	    ComputeLambdas((int)dGroup, cNumItems, adY + iItemStart, adFPlusOffset, adWeight + iItemStart, adZ + iItemStart, &vecdHessian[iItemStart]);
+	    CGroupRandom rng(ulSeed, iItemStart);
+	    ComputeLambdas(state, rng, (int)adGroup[iItemStart], cNumItems, adY + iItemStart, adFPlusOffset, adWeight + iItemStart, adZ + iItemStart, &vecdHessian[iItemStart]);
 	  }
-	
-	// Next group
-	iItemStart = iItemEnd;
       }
 }
 
@@ -677,8 +850,84 @@ void CPairwise::ComputeWorkingResponse
 // (resp. d^2C/d^2s_i = gamma_i) over all instances falling into this leaf. This
 // summation is calculated later in CPairwise::FitBestConstant().
 
-void CPairwise::ComputeLambdas(int iGroup, unsigned int cNumItems, const double* const adY, const double* const adF, const double* const adWeight, double* adZ, double* adDeriv)
+// Adds the contribution of the pair (i,j), where i is the better item, to the
+// gradients and Hessians; counts the pair if it has a positive swap cost.
+inline void CPairwise::AddPair(CGroupState& state, unsigned int i, unsigned int j, const double* const adY, const double* const adF, double* adZ, double* adDeriv, unsigned int& cPairs)
+{
+    CRanker& ranker = state.ranker;
+    const double dSwapCost = fabs(state.pirm->SwapCost(i, j, adY, ranker));
+
+#ifdef NOISY_DEBUG
+    const double dMeasureBefore = state.pirm->Measure(adY, ranker);
+    const int cRanki = ranker.GetRank(i);
+    const int cRankj = ranker.GetRank(j);
+    ranker.SetRank(i, cRankj);
+    ranker.SetRank(j, cRanki);
+    const double dMeasureAfter = state.pirm->Measure(adY, ranker);
+
+    if (fabs(dMeasureBefore-dMeasureAfter) - dSwapCost > 1e-5)
+    {
+        LogMessage("%f %f %f %f %d %d\n", dMeasureBefore, dMeasureAfter, dMeasureBefore - dMeasureAfter, dSwapCost, i, j);
+        for (unsigned int k = 0; k < ranker.GetNumItems(); k++)
+        {
+            LogMessage("%d\t%d\t%f\t%f\n", k, ranker.GetRank(k), adY[k], adF[k]);
+        }
+        throw GBM::failure("the impossible happened");
+    }
+    ranker.SetRank(j, cRankj);
+    ranker.SetRank(i, cRanki);
+
+    if (!isfinite(dSwapCost)) {
+      throw GBM::failure("infinite swap cost");
+    }
+#endif
+
+    if (dSwapCost > 0.0)
+    {
+        cPairs++;
+        const double dRhoij    = 1.0 / (1.0 + std::exp(adF[i]- adF[j])) ;
+#ifdef NOISY_DEBUG
+        if (!isfinite(dRhoij)) {
+          throw GBM::failure("unanticipated infinity");
+        };
+#endif
+
+        const double dLambdaij = dSwapCost * dRhoij;
+        adZ[i] += dLambdaij;
+        adZ[j] -= dLambdaij;
+        const double dDerivij  = dLambdaij * (1.0 - dRhoij);
+#ifdef NOISY_DEBUG
+        if (dDerivij < 0) {
+          throw GBM::failure("negative derivative!");
+        }
+#endif
+        adDeriv[i] += dDerivij;
+        adDeriv[j] += dDerivij;
+    }
+}
+
+// Pairs visited:
+//
+// For NDCG and MRR the swap cost is zero if both items are ranked below the
+// cutoff, so each item j only needs to be paired with the better items that
+// are ranked within the cutoff, unless j itself is.  This reduces the work
+// per group from O(n^2) to O(n * cutoff) without changing the result.
+//
+// If the number of such candidate pairs exceeds cPairBudget, cPairBudget of
+// them are drawn uniformly with replacement instead.  The sums of lambda_ij
+// and of the Hessian terms over the draws, scaled by (candidates / draws),
+// are unbiased estimates of the sums over all candidates; since the
+// normalization below divides by the number of pairs with positive swap
+// cost in the draws rather than among all candidates, the normalized
+// gradient is a ratio estimate whose bias vanishes as the budget grows.
+
+void CPairwise::ComputeLambdas(CGroupState& state, CGroupRandom& rng, int iGroup, unsigned int cNumItems, const double* const adY, const double* const adF, const double* const adWeight, double* adZ, double* adDeriv)
 {
+    CIRMeasure* const pirm = state.pirm;
+    CRanker& ranker = state.ranker;
+    vector<unsigned int>& veciTop = state.veciTop;
+    vector<double>& vecdPairCum = state.vecdPairCum;
+
     // Assumption: Weights are constant within group
     if (adWeight[0] <= 0)
     {
@@ -695,8 +944,24 @@ void CPairwise::ComputeLambdas(int iGroup, unsigned int cNumItems, const double*
     }
 
     // Rank items by current score
-    ranker.SetGroupScores(adF, cNumItems);
-    ranker.Rank();
+    RankGroup(state, rng, iGroup, adF, cNumItems);
+
+    // Only pairs with at least one item within the cutoff matter?
+    const unsigned int cRankCutoff = pirm->GetCutoffRank();
+    const bool fCutoff = pirm->SkipsPairsBelowCutoff() && (cRankCutoff < cNumItems);
+
+    // Items within the cutoff, in item order
+    unsigned int cTop = 0;
+    if (fCutoff)
+    {
+        for (unsigned int i = 0; i < cNumItems; i++)
+        {
+            if (ranker.GetRank(i) <= cRankCutoff)
+            {
+                veciTop[cTop++] = i;
+            }
+        }
+    }
 
     double dLabelCurrent    = adY[0];
 
@@ -704,76 +969,90 @@ void CPairwise::ComputeLambdas(int iGroup, unsigned int cNumItems, const double*
     // (i.e., each smaller index corresponds to better item)
     unsigned int iLabelCurrentStart  = 0;
 
-    // Number of pairs with unequal labels
-    unsigned int cPairs   = 0;
+    // Number of items in veciTop that are better than the current item
+    unsigned int cTopBetter = 0;
 
-#ifdef NOISY_DEBUG
-    double dMeasureBefore = pirm->Measure(adY, ranker);
-#endif
+    // Cumulative number of candidate pairs (i,j), over j
+    double dCandidates = 0.0;
+    vecdPairCum[0] = 0.0;
 
     for (unsigned int j = 1; j < cNumItems; j++)
     {
-        const double dYj     = adY[j];
-
-        if (dYj != dLabelCurrent)
+        if (adY[j] != dLabelCurrent)
         {
             iLabelCurrentStart = j;
-            dLabelCurrent      = dYj;
+            dLabelCurrent      = adY[j];
+            while (cTopBetter < cTop && veciTop[cTopBetter] < iLabelCurrentStart)
+            {
+                cTopBetter++;
+            }
         }
-
-        for (unsigned int i = 0; i < iLabelCurrentStart; i++)
+        if (!fCutoff || ranker.GetRank(j) <= cRankCutoff)
         {
-            // Instance i is better than j
+            dCandidates += iLabelCurrentStart;
+        }
+        else
+        {
+            dCandidates += cTopBetter;
+        }
+        vecdPairCum[j] = dCandidates;
+    }
 
-            const double dSwapCost = fabs(pirm->SwapCost(i, j, adY, ranker));
+    // Number of pairs with unequal labels
+    unsigned int cPairs   = 0;
 
-#ifdef NOISY_DEBUG
-            double dDelta    = fabs(pirm->SwapCost(i, j, adY, ranker));
-            const int cRanki = ranker.GetRank(i);
-            const int cRankj = ranker.GetRank(j);
-            ranker.SetRank(i, cRankj);
-            ranker.SetRank(j, cRanki);
-            double dMeasureAfter = pirm->Measure(adY, ranker);
-
-            if (fabs(dMeasureBefore-dMeasureAfter) - dDelta > 1e-5)
+    if (cPairBudget == 0 || dCandidates <= cPairBudget)
+    {
+        // Visit all candidate pairs
+        for (unsigned int j = 1; j < cNumItems; j++)
+        {
+            const double cCandidates = vecdPairCum[j] - vecdPairCum[j-1];
+            if (cCandidates == 0.0)
+            {
+                continue;
+            }
+            if (!fCutoff || ranker.GetRank(j) <= cRankCutoff)
             {
-                Rprintf("%f %f %f %f %f %d %d\n", pirm->SwapCost(i, j, adY, ranker), dMeasureBefore, dMeasureAfter, dMeasureBefore - dMeasureAfter, dDelta , i, j);
-                for (unsigned int k = 0; k < cNumItems; k++)
+                // Instance i is better than j
+                for (unsigned int i = 0; i < (unsigned int)cCandidates; i++)
                 {
-                    Rprintf("%d\t%d\t%f\t%f\n", k, ranker.GetRank(k), adY[k], adF[k]);
+                    AddPair(state, i, j, adY, adF, adZ, adDeriv, cPairs);
                 }
-		throw GBM::failure("the impossible happened");
             }
-	    if (fabs(dMeasureBefore - dMeasureAfter) - fabs(dDelta) >= 1e-5) {
-	      throw GBM::failure("the impossible happened");
-	    }
-            ranker.SetRank(j, cRankj);
-            ranker.SetRank(i, cRanki);
-	    
-	    if (!isfinite(dSwapCost)) {
-	      throw GBM::failure("infinite swap cost");
-	    }
-#endif
+            else
+            {
+                for (unsigned int t = 0; t < (unsigned int)cCandidates; t++)
+                {
+                    AddPair(state, veciTop[t], j, adY, adF, adZ, adDeriv, cPairs);
+                }
+            }
+        }
+    }
+    else
+    {
+        // Sample cPairBudget candidate pairs
+        for (unsigned long iDraw = 0; iDraw < cPairBudget; iDraw++)
+        {
+            const double dU = rng.Uniform() * dCandidates;
 
-            if (dSwapCost > 0.0)
+            // The worse item j is the first with vecdPairCum[j] > dU
+            const unsigned int j = (unsigned int)
+                (upper_bound(vecdPairCum.begin() + 1, vecdPairCum.begin() + cNumItems, dU) - vecdPairCum.begin());
+            if (j >= cNumItems)
             {
-#ifdef NOISY_DEBUG
-                cPairs++;
-                const double dRhoij    = 1.0 / (1.0 + std::exp(adF[i]- adF[j])) ;
-                if (!isfinite(dRhoij)) {
-		  throw GBM::failure("unanticipated infinity");
-		};
-
-                const double dLambdaij = dSwapCost * dRhoij;
-                adZ[i] += dLambdaij;
-                adZ[j] -= dLambdaij;
-                const double dDerivij  = dLambdaij * (1.0 - dRhoij);
-		if (dDerivij < 0) {
-		  throw GBM::failure("negative derivative!");
-		}
-                adDeriv[i] += dDerivij;
-                adDeriv[j] += dDerivij;
-#endif
+                continue;
+            }
+
+            const unsigned int cCandidates = (unsigned int)(vecdPairCum[j] - vecdPairCum[j-1]);
+            const unsigned int iPick = std::min((unsigned int)(dU - vecdPairCum[j-1]), cCandidates - 1);
+
+            if (!fCutoff || ranker.GetRank(j) <= cRankCutoff)
+            {
+                AddPair(state, iPick, j, adY, adF, adZ, adDeriv, cPairs);
+            }
+            else
+            {
+                AddPair(state, veciTop[iPick], j, adY, adF, adZ, adDeriv, cPairs);
             }
         }
     }
@@ -834,12 +1113,33 @@ void CPairwise::Initialize
       iItemStart = iItemEnd;
     }
   
-  // Allocate buffer for offset addition
-  vecdFPlusOffset.resize(cMaxItemsPerGroup);
-  
-  // Allocate ranker memory
-  ranker.Init(cMaxItemsPerGroup);
-  
+  // Store the order of each group, initially the item order; a group
+  // number that occurs in more than one range is not stored
+  veciOrder.resize(cLength);
+  veciOrderStart.assign((unsigned long)dMaxGroup + 1, UINT_MAX);
+  veciOrderSize.assign((unsigned long)dMaxGroup + 1, 0);
+
+  for (iItemStart = 0; iItemStart < cLength; iItemStart = iItemEnd)
+    {
+      const unsigned int iGroup = (unsigned int)adGroup[iItemStart];
+      for (iItemEnd = iItemStart + 1; iItemEnd < cLength && adGroup[iItemEnd] == adGroup[iItemStart]; iItemEnd++)
+	{
+	  veciOrder[iItemEnd] = iItemEnd - iItemStart;
+	}
+      veciOrder[iItemStart] = 0;
+
+      if (veciOrderStart[iGroup] == UINT_MAX)
+	{
+	  veciOrderStart[iGroup] = iItemStart;
+	  veciOrderSize[iGroup]  = iItemEnd - iItemStart;
+	}
+      else
+	{
+	  veciOrderStart[iGroup] = 0;
+	  veciOrderSize[iGroup]  = 0;
+	}
+    }
+
   // Allocate IR measure memory
   
   // The last element of adGroup specifies the cutoff
@@ -850,8 +1150,29 @@ void CPairwise::Initialize
       cRankCutoff = (unsigned int)adGroup[cLength];
     }
   pirm->Init((unsigned long)dMaxGroup, cMaxItemsPerGroup, cRankCutoff);
+
+  // Allocate the state of each thread
+  for (unsigned int i = 0; i < vecState.size(); i++)
+    {
+      delete vecState[i].pirm;
+      vecState[i].pirm = NULL;
+    }
+#ifdef NOISY_DEBUG
+  // The consistency checks throw, which a parallel region must not do
+  vecState.resize(1);
+#else
+  vecState.resize(ThreadCount(cThreads));
+#endif
+  for (unsigned int i = 0; i < vecState.size(); i++)
+    {
+      vecState[i].ranker.Init(cMaxItemsPerGroup);
+      vecState[i].pirm = pirm->Clone();
+      vecState[i].vecdFPlusOffset.resize(cMaxItemsPerGroup);
+      vecState[i].veciTop.resize(cMaxItemsPerGroup);
+      vecState[i].vecdPairCum.resize(cMaxItemsPerGroup);
+    }
 #ifdef NOISY_DEBUG
-  Rprintf("Initialization: instances=%ld, groups=%u, max items per group=%u, rank cutoff=%u, offset specified: %d\n", cLength, (unsigned long)dMaxGroup, cMaxItemsPerGroup, cRankCutoff, (adOffset != NULL));
+  LogMessage("Initialization: instances=%ld, groups=%u, max items per group=%u, rank cutoff=%u, offset specified: %d\n", cLength, (unsigned long)dMaxGroup, cMaxItemsPerGroup, cRankCutoff, (adOffset != NULL));
 #endif
 }
 
@@ -885,40 +1206,53 @@ double CPairwise::Deviance
         return 0;
     }
 
-    double dL = 0.0;
-    double dW = 0.0;
+    FindGroups(adGroup, cLength);
+
+    const uint64_t ulSeed = GroupSeed(Random());
+    const int cGroups = veciGroupOrder.size();
+    int iOrder = 0;
 
-    unsigned int iItemStart  = 0;
-    unsigned int iItemEnd    = iItemStart;
-    const unsigned int cEnd = cLength;
+    vecdGroupLoss.assign(cGroups, 0.0);
+    vecdGroupWeight.assign(cGroups, 0.0);
 
-    while (iItemStart < cEnd)
+#pragma omp parallel for schedule(dynamic, 1) num_threads(vecState.size())
+    for (iOrder = 0; iOrder < cGroups; iOrder++)
     {
+        CGroupState& state = vecState[ThreadNum()];
+        const unsigned int iGroup     = veciGroupOrder[iOrder];
+        const unsigned int iItemStart = veciGroupStart[iGroup];
+        const unsigned int iItemEnd   = veciGroupStart[iGroup + 1];
+
         const double dGroup = adGroup[iItemStart];
         const double dWi    = adWeight[iItemStart];
 
-        // Find end of current group
-        for (iItemEnd = iItemStart + 1; iItemEnd < cEnd && adGroup[iItemEnd] == dGroup; iItemEnd++) ;
-
         const int cNumItems = iItemEnd - iItemStart;
 
-        const double dMaxScore = pirm->MaxMeasure((int)dGroup, adY + iItemStart, cNumItems);
+        const double dMaxScore = state.pirm->MaxMeasure((int)dGroup, adY + iItemStart, cNumItems);
 
         if (dMaxScore > 0.0)
         {
             // Rank items by current score
 
             // If offset given, add up current scores
-            const double* adFPlusOffset = OffsetVector(adF, adOffset, iItemStart, iItemEnd, vecdFPlusOffset);
+            const double* adFPlusOffset = OffsetVector(adF, adOffset, iItemStart, iItemEnd, state.vecdFPlusOffset);
 
-            ranker.SetGroupScores(adFPlusOffset, cNumItems);
-            ranker.Rank();
+            CGroupRandom rng(ulSeed, iItemStart);
+            RankGroup(state, rng, (int)dGroup, adFPlusOffset, cNumItems);
 
-            dL += dWi * pirm->Measure(adY + iItemStart, ranker) / dMaxScore;
-            dW += dWi;
+            vecdGroupLoss[iGroup]   = dWi * state.pirm->Measure(adY + iItemStart, state.ranker) / dMaxScore;
+            vecdGroupWeight[iGroup] = dWi;
         }
-        // Next group
-        iItemStart = iItemEnd;
+    }
+
+    // Add up in group order, independent of the number of threads
+    double dL = 0.0;
+    double dW = 0.0;
+
+    for (int iGroup = 0; iGroup < cGroups; iGroup++)
+    {
+        dL += vecdGroupLoss[iGroup];
+        dW += vecdGroupWeight[iGroup];
     }
 
    // Loss = 1 - utility
@@ -934,7 +1268,7 @@ void CPairwise::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long> &aiNodeAssign,
+    const CNodeAssign &aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -945,7 +1279,7 @@ void CPairwise::FitBestConstant
 {
 
 #ifdef NOISY_DEBUG
-    Rprintf("FitBestConstant, nTrain = %u,  cTermNodes = %d, \n", nTrain, cTermNodes);
+    LogMessage("FitBestConstant, nTrain = %u,  cTermNodes = %d, \n", nTrain, cTermNodes);
 #endif
 
     // Assumption: ComputeWorkingResponse() has been executed before with
@@ -1012,7 +1346,7 @@ double CPairwise::BagImprovement
 {
 
 #ifdef NOISY_DEBUG
-    Rprintf("BagImprovement, nTrain = %u\n", nTrain);
+    LogMessage("BagImprovement, nTrain = %u\n", nTrain);
 #endif
 
     if (nTrain <= 0)
@@ -1020,19 +1354,22 @@ double CPairwise::BagImprovement
         return 0;
     }
 
-    double dL = 0.0;
-    double dW = 0.0;
+    FindGroups(adGroup, nTrain);
 
-    unsigned int iItemStart = 0;
-    unsigned int iItemEnd   = 0;
+    const uint64_t ulSeed = GroupSeed(Random());
+    const int cGroups = veciGroupOrder.size();
+    int iOrder = 0;
 
+    vecdGroupLoss.assign(cGroups, 0.0);
+    vecdGroupWeight.assign(cGroups, 0.0);
 
-    while (iItemStart < nTrain)
+#pragma omp parallel for schedule(dynamic, 1) num_threads(vecState.size())
+    for (iOrder = 0; iOrder < cGroups; iOrder++)
     {
-        const double dGroup = adGroup[iItemStart];
-
-        // Find end of current group
-        for (iItemEnd = iItemStart + 1; iItemEnd < nTrain && adGroup[iItemEnd] == dGroup; iItemEnd++) ;
+        CGroupState& state = vecState[ThreadNum()];
+        const unsigned int iGroup     = veciGroupOrder[iOrder];
+        const unsigned int iItemStart = veciGroupStart[iGroup];
+        const unsigned int iItemEnd   = veciGroupStart[iGroup + 1];
 
         if (!afInBag[iItemStart])
         {
@@ -1040,39 +1377,45 @@ double CPairwise::BagImprovement
 
             const unsigned int cNumItems = iItemEnd - iItemStart;
 
-            const double dMaxScore = pirm->MaxMeasure((int)dGroup, adY + iItemStart, cNumItems);
+            const double dMaxScore = state.pirm->MaxMeasure((int)adGroup[iItemStart], adY + iItemStart, cNumItems);
 
             if (dMaxScore > 0.0)
             {
                 // If offset given, add up current scores
-                const double* adFPlusOffset = OffsetVector(adF, adOffset, iItemStart, iItemEnd, vecdFPlusOffset);
+                const double* adFPlusOffset = OffsetVector(adF, adOffset, iItemStart, iItemEnd, state.vecdFPlusOffset);
 
                 // Compute score according to old score, adF
-                ranker.SetGroupScores(adFPlusOffset, cNumItems);
-                ranker.Rank();
-                const double dOldScore = pirm->Measure(adY + iItemStart, ranker);
+                CGroupRandom rng(ulSeed, iItemStart);
+                RankGroup(state, rng, (int)adGroup[iItemStart], adFPlusOffset, cNumItems);
+                const double dOldScore = state.pirm->Measure(adY + iItemStart, state.ranker);
 
                 // Compute score according to new score: adF' =  adF + dStepSize * adFadj
                 for (unsigned int i = 0; i < cNumItems; i++)
                 {
-                    ranker.AddToScore(i, adFadj[i+iItemStart] * dStepSize);
+                    state.ranker.AddToScore(i, adFadj[i+iItemStart] * dStepSize);
                 }
 
                 const double dWi = adWeight[iItemStart];
 
-                if (ranker.Rank())
+                if (state.ranker.Rank(state.pirm->TopRanksNeeded()))
                 {
                     // Ranking changed
-                    const double dNewScore = pirm->Measure(adY + iItemStart, ranker);
-                    dL                    += dWi * (dNewScore - dOldScore) / dMaxScore;
+                    const double dNewScore = state.pirm->Measure(adY + iItemStart, state.ranker);
+                    vecdGroupLoss[iGroup] = dWi * (dNewScore - dOldScore) / dMaxScore;
                 }
-                dW += dWi;
+                vecdGroupWeight[iGroup] = dWi;
             }
         }
+    }
 
-        // Next group
-        iItemStart = iItemEnd;
+    // Add up in group order, independent of the number of threads
+    double dL = 0.0;
+    double dW = 0.0;
 
+    for (int iGroup = 0; iGroup < cGroups; iGroup++)
+    {
+        dL += vecdGroupLoss[iGroup];
+        dW += vecdGroupWeight[iGroup];
     }
 
     return dL / dW;
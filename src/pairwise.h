@@ -56,9 +56,37 @@
 #define PAIRWISE_H
 
 #include <memory>
+#include <stdint.h>
 #include "distribution.h"
 #include "buildinfo.h"
 
+// Counter-based random numbers for one group (the SplitMix64 generator).
+// The stream only depends on the seed and the stream number, so groups can
+// be processed in any order and by any thread with the same result.
+
+class CGroupRandom
+{
+public:
+    CGroupRandom(uint64_t ulSeed, uint64_t ulStream) : ulState(Mix(ulSeed + Mix(ulStream))) {}
+
+    // Uniform random number in [0,1)
+    double Uniform()
+    {
+        ulState += 0x9E3779B97F4A7C15ULL;
+        return (Mix(ulState) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    static uint64_t Mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t ulState;
+};
+
 // A class to rerank groups based on (intermediate) scores
 // Note: Smaller ranks are better, the top rank is 1
 
@@ -73,11 +101,22 @@ public:
 
     // Initialize ranker with scores of items belonging to the same group
     // - adScores is a score array, (at least) cNumItems long
-    bool SetGroupScores(const double* const adScores, unsigned int cNumItems);
+    // - rng supplies the random jitter that breaks ties
+    bool SetGroupScores(const double* const adScores, unsigned int cNumItems, CGroupRandom& rng);
+
+    // Start the next Rank() from the order aiOrder (item indices by rank), e.g.
+    // the order of the previous iteration; a nearly sorted order is ranked in
+    // close to linear time
+    void SetOrder(const unsigned int* const aiOrder);
+
+    // Store the item indices in rank order in aiOrder
+    void GetOrder(unsigned int* aiOrder) const;
 
     // Perform the ranking
+    // - Only the top cTopRanks ranks are determined; all other items get
+    //   rank cTopRanks + 1
     // - Return true if any item changed its rank
-    bool Rank();
+    bool Rank(unsigned int cTopRanks = UINT_MAX);
 
     // Getter / setter
     unsigned int GetNumItems() const               { return cNumItems; }
@@ -111,6 +150,9 @@ public:
     // Destructor
     virtual ~CIRMeasure() { }
 
+    // Copy, including all caches and buffers
+    virtual CIRMeasure* Clone() const = 0;
+
     // Getter / Setter
     unsigned int GetCutoffRank() const { return cRankCutoff; }
     void SetCutoffRank(unsigned int cRankCutoff) { this->cRankCutoff = cRankCutoff; }
@@ -146,6 +188,14 @@ public:
     // * ranker.setGroup() has been called.
     virtual double SwapCost(int iItemBetter, int iItemWorse, const double* const adY, const CRanker& ranker) const = 0;
 
+    // True if SwapCost() is zero whenever both items are ranked below the cutoff,
+    // so that such pairs need not be visited
+    virtual bool SkipsPairsBelowCutoff() const { return false; }
+
+    // The number of top ranks Measure() and SwapCost() need; the order of the
+    // items below them does not matter, as long as they all share one rank
+    virtual unsigned int TopRanksNeeded() const { return UINT_MAX; }
+
 protected:
     // Cut-off rank below which items are ignored for measure
     unsigned int cRankCutoff;
@@ -159,6 +209,8 @@ class CConc : public CIRMeasure
 public:
     virtual ~CConc() { }
 
+    CIRMeasure* Clone() const { return new CConc(*this); }
+
     void Init(unsigned long cMaxGroup, unsigned long cNumItems, unsigned int cRankCutoff = UINT_MAX);
 
     double Measure(const double* const adY, const CRanker& ranker);
@@ -189,6 +241,8 @@ class CNDCG : public CIRMeasure
 {
 public:
 
+    CIRMeasure* Clone() const { return new CNDCG(*this); }
+
     void Init(unsigned long cMaxGroup, unsigned long cNumItems, unsigned int cRankCutoff = UINT_MAX);
 
     // Compute DCG
@@ -199,6 +253,10 @@ public:
 
     double SwapCost(int iItemBetter, int iItemWorse, const double* const adY, const CRanker& ranker) const;
 
+    // Rank weights are zero below the cutoff
+    bool SkipsPairsBelowCutoff() const { return true; }
+    unsigned int TopRanksNeeded() const { return cRankCutoff; }
+
 protected:
      // Lookup table for rank weight (w(rank) = 1/log2(1+rank))
     vector<double> vecdRankWeight;
@@ -213,10 +271,15 @@ protected:
 class CMRR : public CIRMeasure
 {
 public:
+    CIRMeasure* Clone() const { return new CMRR(*this); }
+
     double Measure(const double* const adY, const CRanker& ranker);
 
     double SwapCost(int iItemPos, int iItemNeg, const double* const adY, const CRanker& ranker) const;
 
+    // Only a positive item within the cutoff contributes
+    bool SkipsPairsBelowCutoff() const { return true; }
+    unsigned int TopRanksNeeded() const { return cRankCutoff; }
 };
 
 
@@ -227,6 +290,8 @@ class CMAP : public CIRMeasure
 {
 public:
 
+    CIRMeasure* Clone() const { return new CMAP(*this); }
+
     void Init(unsigned long cMaxGroup, unsigned long cNumItems, unsigned int cRankCutoff = UINT_MAX);
 
     double Measure(const double* const adY, const CRanker& ranker);
@@ -256,13 +321,30 @@ protected:
 //   functions, with same values for adY, adGroup, adWeight, and
 //   nTrain. Certain values have to be precomputed for
 //   efficiency.
+//
+// Groups are processed in parallel, each thread with its own ranker, copy
+// of the IR measure and buffers (CGroupState).  The tie-breaking jitter and
+// the pair sampling draw from a CGroupRandom stream per group, seeded by a
+// single draw from Random() per call, so the result does not depend on the
+// number of threads.
+
+// Per-thread state for processing one group at a time
+struct CGroupState
+{
+    CRanker ranker;                   // The ranker
+    CIRMeasure* pirm;                 // Copy of the IR measure, owned by CPairwise
+    vector<double> vecdFPlusOffset;   // Buffer for (adF + adOffset), if the latter is not null
+    vector<unsigned int> veciTop;     // Buffer for the items ranked within the cutoff
+    vector<double> vecdPairCum;       // Buffer for the cumulative number of candidate pairs
+};
 
 class CPairwise : public CDistribution
 {
 public:
 
-    // Constructor: determine IR measure as either "conc", "map", "mrr", or "ndcg"
-    CPairwise(const char* szIRMeasure);
+    // Constructor: determine IR measure as either "conc", "map", "mrr", or "ndcg";
+    // cPairBudget > 0 limits the number of pairs per group (see ComputeLambdas())
+    CPairwise(const char* szIRMeasure, unsigned long cPairBudget = 0);
 
     virtual ~CPairwise();
 
@@ -301,7 +383,7 @@ public:
 			 const double *adW,
 			 const double *adF,
 			 double *adZ,
-			 const std::vector<unsigned long>& aiNodeAssign,
+			 const CNodeAssign& aiNodeAssign,
 			 unsigned long nTrain,
 			 VEC_P_NODETERMINAL vecpTermNodes,
 			 unsigned long cTermNodes,
@@ -322,17 +404,36 @@ public:
 protected:
 
     // Calculate and accumulate up the gradients and Hessians from all training pairs
-    void ComputeLambdas(int iGroup, unsigned int cNumItems, const double* const adY, const double* const adF, const double* const adWeight, double* adZ, double* adDeriv);
+    void ComputeLambdas(CGroupState& state, CGroupRandom& rng, int iGroup, unsigned int cNumItems, const double* const adY, const double* const adF, const double* const adWeight, double* adZ, double* adDeriv);
+
+    // Add the gradient and Hessian of one pair
+    void AddPair(CGroupState& state, unsigned int i, unsigned int j, const double* const adY, const double* const adF, double* adZ, double* adDeriv, unsigned int& cPairs);
+
+    // Find the groups in adGroup[0..cLength-1] and order them by decreasing size
+    void FindGroups(const double* const adGroup, unsigned long cLength);
+
+    // Rank the items of group iGroup by adScores, starting from the order of the
+    // previous call for this group, and store the new order
+    void RankGroup(CGroupState& state, CGroupRandom& rng, int iGroup, const double* const adScores, unsigned int cNumItems);
 
     std::auto_ptr<CIRMeasure> pirm;                 // The IR measure to use
-    CRanker ranker;                   // The ranker
+    vector<CGroupState> vecState;     // Ranker, measure and buffers, for each thread
 
     vector<double> vecdHessian;       // Second derivative of loss function, for each training instance; used for Newton step
 
     vector<double> vecdNum;           // Buffer used for numerator   in FitBestConstant(), for each node
     vector<double> vecdDenom;         // Buffer used for denominator in FitBestConstant(), for each node
 
-    vector<double> vecdFPlusOffset;   // Temporary buffer for (adF + adOffset), if the latter is not null
+    unsigned long cPairBudget;        // Maximum number of pairs per group, 0 for all pairs
+
+    vector<unsigned int> veciOrder;       // Items of each group in the order of the last ranking
+    vector<unsigned int> veciOrderStart;  // Start of each group in veciOrder, by group number
+    vector<unsigned int> veciOrderSize;   // Size of each group in veciOrder (0 if not stored)
+
+    vector<unsigned int> veciGroupStart;  // First item of each group, and the end of the last one
+    vector<unsigned int> veciGroupOrder;  // Groups by decreasing size
+    vector<double> vecdGroupLoss;     // Buffer for the weighted measure, for each group
+    vector<double> vecdGroupWeight;   // Buffer for the weight, for each group
 };
 
 #endif // PAIRWISE_H
@@ -0,0 +1,154 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       philox.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   counter-based random numbers
+//
+//------------------------------------------------------------------------------
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include "random.h"
+
+// Philox4x32-10 (Salmon, Moraes, Dror and Shaw, "Parallel random numbers:
+// as easy as 1, 2, 3", SC 2011) turns a 128 bit counter and a 64 bit key
+// into four 32 bit random words.  There is no state: the words of a
+// counter are the same whichever thread asks and in whatever order, so
+// parallel loops can draw the numbers of row i from the counter i and get
+// the same results on any number of threads.  A different key gives an
+// independent stream.  unsigned int is taken to be 32 bits.
+
+class CPhilox
+{
+public:
+
+    CPhilox(unsigned int iKey0, unsigned int iKey1)
+    {
+      aiKey[0] = iKey0;
+      aiKey[1] = iKey1;
+    }
+
+    // the four words of the counter (c0, c1, c2, c3)
+    void Block(unsigned int c0, unsigned int c1, unsigned int c2,
+               unsigned int c3, unsigned int aiOut[4]) const
+    {
+      unsigned int k0 = aiKey[0];
+      unsigned int k1 = aiKey[1];
+      unsigned int x0 = c0, x1 = c1, x2 = c2, x3 = c3;
+
+      for(int iRound=0; iRound<10; iRound++)
+        {
+          const unsigned long long p0 = 0xD2511F53ULL*x0;
+          const unsigned long long p1 = 0xCD9E8D57ULL*x2;
+          const unsigned int y0 = (unsigned int)(p1 >> 32) ^ x1 ^ k0;
+          const unsigned int y2 = (unsigned int)(p0 >> 32) ^ x3 ^ k1;
+          x1 = (unsigned int)p1;
+          x3 = (unsigned int)p0;
+          x0 = y0;
+          x2 = y2;
+          k0 += 0x9E3779B9U;
+          k1 += 0xBB67AE85U;
+        }
+      aiOut[0] = x0;
+      aiOut[1] = x1;
+      aiOut[2] = x2;
+      aiOut[3] = x3;
+    }
+
+    // a uniform draw from (0, 1) with the 32 bits of a word
+    static double Uniform(unsigned int iWord)
+    {
+      return (iWord + 0.5)*(1.0/4294967296.0);
+    }
+
+    // a uniform draw from (0, 1) with 53 bits of two words
+    static double Uniform(unsigned int iHigh, unsigned int iLow)
+    {
+      const unsigned long long ull =
+        ((unsigned long long)(iHigh) << 21) | (iLow >> 11);
+      return (ull + 0.5)*(1.0/9007199254740992.0);
+    }
+
+private:
+
+    unsigned int aiKey[2];
+};
+
+// The stream of a CPhilox whose counters are (position, position >> 32,
+// iStream, iTask): Uniform() reads the positions in order, two words per
+// number.  Streams that differ in iStream or iTask are independent.
+class CPhiloxStream : public CRandom
+{
+public:
+
+    CPhiloxStream() : philox(0, 0), iStream(0), iTask(0), ullPosition(0),
+                      iWord(4) {}
+    CPhiloxStream(const CPhilox &philox, unsigned int iStream,
+                  unsigned int iTask)
+      : philox(philox), iStream(iStream), iTask(iTask), ullPosition(0),
+        iWord(4) {}
+
+    double Uniform()
+    {
+      if(iWord == 4)
+        {
+          philox.Block((unsigned int)ullPosition,
+                       (unsigned int)(ullPosition >> 32),
+                       iStream, iTask, aiWords);
+          ullPosition++;
+          iWord = 0;
+        }
+      iWord += 2;
+      return CPhilox::Uniform(aiWords[iWord-2], aiWords[iWord-1]);
+    }
+
+private:
+
+    CPhilox philox;
+    unsigned int iStream;
+    unsigned int iTask;
+    unsigned long long ullPosition;
+    int iWord;
+    unsigned int aiWords[4];
+};
+
+// The random numbers of one iteration of a model, split by who uses them.
+// Rekey() takes the key of the iteration from two uniforms of the model's
+// generator; Stream(consumer, iTask) is then the stream of task iTask (a
+// block of rows, a group, a node) of the consumer.  A stream only depends
+// on the key, the consumer and the task, and not on the thread that reads
+// it or on what the other streams drew, which is what makes parallel fits
+// the same on any number of threads.  The bags of CGBM::PHILOX and
+// CGBM::POISSON read the positions of Stream(BAG, 0) by row.
+class CRandomStreams
+{
+public:
+
+    enum Consumer { BAG, COLUMNS, GROUPS };
+
+    CRandomStreams() : philox(0, 0) {}
+
+    void Rekey(CRandom &random)
+    {
+      const unsigned int iKey0 = (unsigned int)(random.Uniform()*4294967296.0);
+      const unsigned int iKey1 = (unsigned int)(random.Uniform()*4294967296.0);
+      philox = CPhilox(iKey0, iKey1);
+    }
+
+    const CPhilox &Philox() const { return philox; }
+
+    CPhiloxStream Stream(Consumer consumer, unsigned int iTask) const
+    {
+      return CPhiloxStream(philox, consumer, iTask);
+    }
+
+private:
+
+    CPhilox philox;
+};
+
+#endif // PHILOX_H
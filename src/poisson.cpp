@@ -1,5 +1,7 @@
 //  GBM by Greg Ridgeway  Copyright (C) 2003
 
+#include <algorithm>
+
 #include "poisson.h"
 
 CPoisson::CPoisson()
@@ -23,19 +25,48 @@ void CPoisson::ComputeWorkingResponse
     unsigned long nTrain
 )
 {
+    double adExpF[cVecBlock];
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
     unsigned long i = 0;
-    double dF = 0.0;
 
     // compute working response
-    for(i=0; i < nTrain; i++)
+    for(iStart=0; iStart < nTrain; iStart+=cBlock)
     {
-        dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-        adZ[i] = adY[i] - std::exp(dF);
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+        AddOffset(adF, adOffset, iStart, cBlock, adExpF);
+        vecmath.Exp(adExpF, cBlock);
+
+        for(i=0; i<cBlock; i++)
+        {
+            adZ[iStart+i] = adY[iStart+i] - adExpF[i];
+        }
     }
 }
 
 
 
+void CPoisson::ComputeHessian
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    const double *adZ,
+    double *adH,
+    unsigned long nTrain
+)
+{
+    unsigned long i = 0;
+
+    // adZ = y - exp(F), which is also the hessian
+    for(i=0; i<nTrain; i++)
+    {
+        adH[i] = adY[i] - adZ[i];
+    }
+}
+
+
 void CPoisson::InitF
 (
     const double *adY,
@@ -67,7 +98,9 @@ void CPoisson::InitF
         }
     }
 
-    dInitF = std::log(dSum/dDenom);
+    double adSums[2] = {dSum, dDenom};
+    Reduce(adSums, 2);
+    dInitF = std::log(adSums[0]/adSums[1]);
 }
 
 
@@ -81,29 +114,21 @@ double CPoisson::Deviance
     unsigned long cLength
 )
 {
-    unsigned long i=0;
     double dL = 0.0;
     double dW = 0.0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
 
-    if(adOffset == NULL)
+    for(iStart=0; iStart<cLength; iStart+=cBlock)
     {
-        for(i=0; i<cLength; i++)
-        {
-            dL += adWeight[i]*(adY[i]*adF[i] - std::exp(adF[i]));
-            dW += adWeight[i];
-        }
-    }
-    else
-    {
-        for(i=0; i<cLength; i++)
-        {
-            dL += adWeight[i]*(adY[i]*(adOffset[i]+adF[i]) -
-                               std::exp(adOffset[i]+adF[i]));
-            dW += adWeight[i];
-       }
+        cBlock = std::min(cVecBlock, cLength-iStart);
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, NULL);
     }
 
-    return -2*dL/dW;
+    double adSums[2] = {dL, dW};
+    Reduce(adSums, 2);
+    return -2*adSums[0]/adSums[1];
 }
 
 
@@ -115,7 +140,7 @@ void CPoisson::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long>& aiNodeAssign,
+    const CNodeAssign& aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -146,9 +171,9 @@ void CPoisson::FitBestConstant
                 vecdDen[aiNodeAssign[iObs]] += adW[iObs]*std::exp(adF[iObs]);
             }
             vecdMax[aiNodeAssign[iObs]] =
-               R::fmax2(adF[iObs],vecdMax[aiNodeAssign[iObs]]);
+               std::max(adF[iObs],vecdMax[aiNodeAssign[iObs]]);
             vecdMin[aiNodeAssign[iObs]] =
-               R::fmin2(adF[iObs],vecdMin[aiNodeAssign[iObs]]);
+               std::min(adF[iObs],vecdMin[aiNodeAssign[iObs]]);
         }
     }
     else
@@ -163,6 +188,11 @@ void CPoisson::FitBestConstant
             }
         }
     }
+
+    // the sums of the nodes over the rows of all workers
+    Reduce(&vecdNum[0], cTermNodes);
+    Reduce(&vecdDen[0], cTermNodes);
+
     for(iNode=0; iNode<cTermNodes; iNode++)
     {
         if(vecpTermNodes[iNode]!=NULL)
@@ -185,10 +215,10 @@ void CPoisson::FitBestConstant
                     std::log(vecdNum[iNode]/vecdDen[iNode]);
             }
             vecpTermNodes[iNode]->dPrediction =
-               R::fmin2(vecpTermNodes[iNode]->dPrediction,
+               std::min(vecpTermNodes[iNode]->dPrediction,
                      19-vecdMax[iNode]);
             vecpTermNodes[iNode]->dPrediction =
-               R::fmax2(vecpTermNodes[iNode]->dPrediction,
+               std::max(vecpTermNodes[iNode]->dPrediction,
                      -19-vecdMin[iNode]);
         }
     }
@@ -209,25 +239,154 @@ double CPoisson::BagImprovement
 )
 {
     double dReturnValue = 0.0;
-    double dF = 0.0;
     double dW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+
+    while((cRows = NextOutOfBag(afInBag, nTrain, iNext, aiRow)) > 0)
+    {
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dReturnValue, dW);
+    }
+
+    double adSums[2] = {dReturnValue, dW};
+    Reduce(adSums, 2);
+    return adSums[0]/adSums[1];
+}
+
+
+void CPoisson::BagImprovementBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    const double *adFadj,
+    double dStepSize,
+    const unsigned long *aiRow,
+    unsigned long cRows,
+    double &dReturnValue,
+    double &dW
+) const
+{
+    double adExpF[cVecBlock];
+    double adExpFNew[cVecBlock];
     unsigned long i = 0;
+    unsigned long k = 0;
 
-    for(i=0; i<nTrain; i++)
+    for(k=0; k<cRows; k++)
     {
-        if(!afInBag[i])
-        {
-            dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
+        i = aiRow[k];
+        adExpF[k] = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
+        adExpFNew[k] = adExpF[k] + dStepSize*adFadj[i];
+    }
+    vecmath.Exp(adExpF, cRows);
+    vecmath.Exp(adExpFNew, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        dReturnValue += adWeight[i]*
+                        (adY[i]*dStepSize*adFadj[i] -
+                         adExpFNew[k] +
+                         adExpF[k]);
+        dW += adWeight[i];
+    }
+}
+
+
+bool CPoisson::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
+    double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
 
-            dReturnValue += adWeight[i]*
-                            (adY[i]*dStepSize*adFadj[i] -
-                             std::exp(dF+dStepSize*adFadj[i]) +
-                             std::exp(dF));
-            dW += adWeight[i];
+    // one sweep in blocks: out-of-bag improvement at the old scores, the
+    // step, then the deviance and the next working response at the new
+    // scores
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
+    {
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+
+        iNext = iStart;
+        cRows = NextOutOfBag(afInBag, iStart+cBlock, iNext, aiRow);
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dOOBag, dOOBagW);
+
+        for(i=iStart; i<iStart+cBlock; i++)
+        {
+            adF[i] += dStepSize * adFadj[i];
         }
+
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, adZ);
     }
 
-    return dReturnValue/dW;
+    double adSums[4] = {dOOBag, dOOBagW, dL, dW};
+    Reduce(adSums, 4);
+    dOOBagImprove = adSums[0]/adSums[1];
+    dTrainError = -2*adSums[2]/adSums[3];
+
+    return true;
 }
 
 
+void CPoisson::DevianceBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    unsigned long iStart,
+    unsigned long cRows,
+    double &dL,
+    double &dW,
+    double *adZ
+) const
+{
+    double adFB[cVecBlock];
+    double adExpF[cVecBlock];
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    AddOffset(adF, adOffset, iStart, cRows, adFB);
+    AddOffset(adF, adOffset, iStart, cRows, adExpF);
+    vecmath.Exp(adExpF, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = iStart + k;
+        dL += adWeight[i]*(adY[i]*adFB[k] - adExpF[k]);
+        dW += adWeight[i];
+    }
+
+    if(adZ != NULL)
+    {
+        for(k=0; k<cRows; k++)
+        {
+            adZ[iStart+k] = adY[iStart+k] - adExpF[k];
+        }
+    }
+}
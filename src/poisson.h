@@ -16,7 +16,7 @@
 #ifndef POISSON_H
 #define POISSON_H
 
-#include <Rmath.h>
+#include <algorithm>
 #include "distribution.h"
 
 class CPoisson : public CDistribution
@@ -45,6 +45,17 @@ public:
                     const double *adF,
                     unsigned long cLength);
 
+    bool HasHessian() const { return true; }
+    bool CanDistribute() const { return true; }
+
+    void ComputeHessian(const double *adY,
+			const double *adMisc,
+			const double *adOffset,
+			const double *adF,
+			const double *adZ,
+			double *adH,
+			unsigned long nTrain);
+
     void InitF(const double *adY,
 	       const double *adMisc,
 	       const double *adOffset,
@@ -58,7 +69,7 @@ public:
 			 const double *adW,
 			 const double *adF,
 			 double *adZ,
-			 const std::vector<unsigned long>& aiNodeAssign,
+			 const CNodeAssign& aiNodeAssign,
 			 unsigned long nTrain,
 			 VEC_P_NODETERMINAL vecpTermNodes,
 			 unsigned long cTermNodes,
@@ -76,7 +87,46 @@ public:
                           double dStepSize,
                           unsigned long nTrain);
 
+    bool UpdateScores(const double *adY,
+                      const double *adMisc,
+                      const double *adOffset,
+                      const double *adWeight,
+                      double *adF,
+                      const double *adFadj,
+                      const bag& afInBag,
+                      double dStepSize,
+                      unsigned long nTrain,
+                      double *adZ,
+                      double &dTrainError,
+                      double &dOOBagImprove);
+
 private:
+
+    // loss summands of the rows iStart, ..., iStart+cRows-1 (at most
+    // cVecBlock) added to dL and dW; also their working response if adZ
+    // is not NULL
+    void DevianceBlock(const double *adY,
+                       const double *adOffset,
+                       const double *adWeight,
+                       const double *adF,
+                       unsigned long iStart,
+                       unsigned long cRows,
+                       double &dL,
+                       double &dW,
+                       double *adZ) const;
+
+    // out-of-bag improvement summands of the rows listed in aiRow
+    void BagImprovementBlock(const double *adY,
+                             const double *adOffset,
+                             const double *adWeight,
+                             const double *adF,
+                             const double *adFadj,
+                             double dStepSize,
+                             const unsigned long *aiRow,
+                             unsigned long cRows,
+                             double &dReturnValue,
+                             double &dW) const;
+
     vector<double> vecdNum;
     vector<double> vecdDen;
     vector<double> vecdMax;
@@ -0,0 +1,166 @@
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+
+#include <algorithm>
+#include <vector>
+
+#include "presort.h"
+#include "dataset.h"
+#include "threads.h"
+#include "gbmexcept.h"
+
+namespace {
+  class CIsMissing {
+  public:
+    CIsMissing(const double *adCol) : adCol(adCol) {}
+    bool operator()(int iRow) const { return is_missing(adCol[iRow]); }
+  private:
+    const double *adCol;
+  };
+
+  class CLessValue {
+  public:
+    CLessValue(const double *adCol) : adCol(adCol) {}
+    bool operator()(int iRow1, int iRow2) const
+    {
+      return adCol[iRow1] < adCol[iRow2];
+    }
+  private:
+    const double *adCol;
+  };
+}
+
+
+void PresortColumns
+(
+ const double *adX,
+ unsigned long cRows,
+ unsigned long cCols,
+ unsigned long cTrain,
+ int *aiXOrder,
+ int cThreads
+)
+{
+  std::vector<const double*> vecpXColumns(cCols);
+
+  for (unsigned long iVar = 0; iVar < cCols; iVar++)
+    {
+      vecpXColumns[iVar] = adX + iVar * cRows;
+    }
+  PresortColumns(cCols > 0 ? &vecpXColumns[0] : 0, cRows, cCols, cTrain,
+		 aiXOrder, cThreads);
+}
+
+
+void PresortColumns
+(
+ const double *const *apdXColumns,
+ unsigned long cRows,
+ unsigned long cCols,
+ unsigned long cTrain,
+ int *aiXOrder,
+ int cThreads
+)
+{
+  if (cTrain > cRows)
+    {
+      throw GBM::invalid_argument("more training rows than rows in the data");
+    }
+
+  const long cVars = static_cast<long>(cCols);
+  long iVar = 0;
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(ThreadCount(cThreads))
+  for (iVar = 0; iVar < cVars; iVar++)
+    {
+      const double *adCol = apdXColumns[iVar];
+      int *aiCol = aiXOrder + iVar * cTrain;
+
+      for (unsigned long iObs = 0; iObs < cTrain; iObs++)
+	{
+	  aiCol[iObs] = static_cast<int>(iObs);
+	}
+
+      // missing values first, then the rest sorted by value; both steps
+      // are stable so ties stay in row order
+      int *aiFirstValue = std::stable_partition(aiCol, aiCol + cTrain,
+						CIsMissing(adCol));
+      std::stable_sort(aiFirstValue, aiCol + cTrain, CLessValue(adCol));
+    }
+}
+
+
+void SortedValues
+(
+ const double *const *apdXColumns,
+ unsigned long cCols,
+ unsigned long cTrain,
+ const int *aiXOrder,
+ double *adXSorted,
+ int cThreads
+)
+{
+  const long cVars = static_cast<long>(cCols);
+  long iVar = 0;
+
+#pragma omp parallel for schedule(static) num_threads(ThreadCount(cThreads))
+  for (iVar = 0; iVar < cVars; iVar++)
+    {
+      const double *adCol = apdXColumns[iVar];
+      const int *aiCol = aiXOrder + iVar * cTrain;
+      double *adSortedCol = adXSorted + iVar * cTrain;
+
+      for (unsigned long iOrderObs = 0; iOrderObs < cTrain; iOrderObs++)
+	{
+	  adSortedCol[iOrderObs] = adCol[aiCol[iOrderObs]];
+	}
+    }
+}
+
+
+void SubsetOrder
+(
+ const int *aiXOrder,
+ unsigned long cTrain,
+ unsigned long cCols,
+ const int *aiNewRow,
+ unsigned long cSubTrain,
+ int *aiSubOrder,
+ int cThreads
+)
+{
+  // count the subset's training rows once so that a bad map is caught
+  // before any column is written
+  unsigned long cKept = 0;
+  for (unsigned long iObs = 0; iObs < cTrain; iObs++)
+    {
+      if ((aiNewRow[iObs] >= 0) &&
+	  (static_cast<unsigned long>(aiNewRow[iObs]) < cSubTrain))
+	{
+	  cKept++;
+	}
+    }
+  if (cKept != cSubTrain)
+    {
+      throw GBM::invalid_argument("row map does not select the training rows of the subset");
+    }
+
+  const long cVars = static_cast<long>(cCols);
+  long iVar = 0;
+
+#pragma omp parallel for schedule(static) num_threads(ThreadCount(cThreads))
+  for (iVar = 0; iVar < cVars; iVar++)
+    {
+      const int *aiCol = aiXOrder + iVar * cTrain;
+      int *aiSubCol = aiSubOrder + iVar * cSubTrain;
+      unsigned long iSubObs = 0;
+
+      for (unsigned long iOrderObs = 0; iOrderObs < cTrain; iOrderObs++)
+	{
+	  const int iNewRow = aiNewRow[aiCol[iOrderObs]];
+	  if ((iNewRow >= 0) && (static_cast<unsigned long>(iNewRow) < cSubTrain))
+	    {
+	      aiSubCol[iSubObs++] = iNewRow;
+	    }
+	}
+    }
+}
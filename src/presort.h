@@ -0,0 +1,64 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       presort.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   construction of the per-variable order index used by CDataset
+//
+//------------------------------------------------------------------------------
+
+#ifndef PRESORT_H
+#define PRESORT_H
+
+// The order index holds, for each variable iVar, the 0-based row numbers of
+// the first cTrain observations sorted by increasing value of that variable,
+// in aiXOrder[iVar*cTrain + iOrderObs].  Missing values come first and ties
+// keep their row order, which is what R's order(x, na.last=FALSE) returns.
+
+// Sort every column of the column-major cRows x cCols matrix adX.
+// Columns are distributed over cThreads threads (cThreads < 1 means the
+// OpenMP default).
+void PresortColumns(const double *adX,
+		    unsigned long cRows,
+		    unsigned long cCols,
+		    unsigned long cTrain,
+		    int *aiXOrder,
+		    int cThreads);
+
+// The same with the columns given by one pointer each.
+void PresortColumns(const double *const *apdXColumns,
+		    unsigned long cRows,
+		    unsigned long cCols,
+		    unsigned long cTrain,
+		    int *aiXOrder,
+		    int cThreads);
+
+// Fill adXSorted with the values of the training rows of every column in
+// the order of the index: adXSorted[iVar*cTrain + iOrderObs] is the value
+// of row aiXOrder[iVar*cTrain + iOrderObs].  With these the split search
+// reads each column front to back instead of picking its values by row
+// (see CDataset::SetSortedValues()).
+void SortedValues(const double *const *apdXColumns,
+		  unsigned long cCols,
+		  unsigned long cTrain,
+		  const int *aiXOrder,
+		  double *adXSorted,
+		  int cThreads);
+
+// Derive the order index of a subset of the rows from the order index of
+// the full data without re-sorting.  aiNewRow maps each of the cTrain rows
+// of the full index to its row number in the subset; the rows mapped into
+// [0, cSubTrain) are the training rows of the subset, all other rows are
+// dropped.  Filtering is stable, so when the subset keeps its rows in their
+// original relative order the result is the same as sorting the subset.
+void SubsetOrder(const int *aiXOrder,
+		 unsigned long cTrain,
+		 unsigned long cCols,
+		 const int *aiNewRow,
+		 unsigned long cSubTrain,
+		 int *aiSubOrder,
+		 int cThreads);
+
+#endif // PRESORT_H
@@ -115,7 +115,7 @@ void CQuantile::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long> &aiNodeAssign,
+    const CNodeAssign &aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -206,3 +206,78 @@ double CQuantile::BagImprovement
     return dReturnValue/dW;
 }
 
+
+bool CQuantile::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
+    double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    double dOffset = 0.0;
+    double dF = 0.0;
+    unsigned long i = 0;
+
+    // one sweep: out-of-bag improvement at the old scores, the step, then
+    // the deviance and the next working response at the new scores
+    for(i=0; i<nTrain; i++)
+    {
+        dOffset = (adOffset==NULL) ? 0.0 : adOffset[i];
+        if(!afInBag[i])
+        {
+            dF = adF[i] + dOffset;
+            if(adY[i] > dF)
+            {
+                dOOBag += adWeight[i]*dAlpha*(adY[i]-dF);
+            }
+            else
+            {
+                dOOBag += adWeight[i]*(1-dAlpha)*(dF-adY[i]);
+            }
+
+            if(adY[i] > dF+dStepSize*adFadj[i])
+            {
+                dOOBag -= adWeight[i]*dAlpha*
+                          (adY[i] - dF-dStepSize*adFadj[i]);
+            }
+            else
+            {
+                dOOBag -= adWeight[i]*(1-dAlpha)*
+                          (dF+dStepSize*adFadj[i] - adY[i]);
+            }
+            dOOBagW += adWeight[i];
+        }
+
+        adF[i] += dStepSize * adFadj[i];
+
+        if(adY[i] > adF[i] + dOffset)
+        {
+            dL += adWeight[i]*dAlpha      *(adY[i] - adF[i] - dOffset);
+            adZ[i] = dAlpha;
+        }
+        else
+        {
+            dL += adWeight[i]*(1.0-dAlpha)*(adF[i] + dOffset - adY[i]);
+            adZ[i] = -(1.0-dAlpha);
+        }
+        dW += adWeight[i];
+    }
+
+    dOOBagImprove = dOOBag/dOOBagW;
+    dTrainError = dL/dW;
+
+    return true;
+}
@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       random.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   source of uniform random numbers for the engine
+//
+//------------------------------------------------------------------------------
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstddef>
+
+// CRandom is the only source of random numbers of the engine: the bag
+// draws, the order of the candidate variables and the seeds of the
+// pairwise group streams.  The caller owns it and hands it to CGBM, so
+// each model can have its own generator; the R package wraps unif_rand()
+// (CRRandom in gbmentry.cpp).  A generator is only ever called by one
+// thread: outside parallel regions, or by the thread fitting the model it
+// belongs to in a cross-validation or grid (crossval.h).  With
+// CGBM::SetStreams() the engine only takes the key of each iteration from
+// it, and the consumers draw from streams of that key (philox.h).
+
+class CRandom
+{
+public:
+
+    virtual ~CRandom() {}
+
+    // a uniform draw from [0, 1)
+    virtual double Uniform() = 0;
+};
+
+// A 64 bit linear congruential generator with its own state, for callers
+// without R's generator (gbmtool) or that need one generator per thread
+// (the models of a cross-validation or grid).  Uniform() uses the upper
+// 53 bits.
+class CSeededRandom : public CRandom
+{
+public:
+
+    explicit CSeededRandom(unsigned long ulSeed)
+        : ullState(ulSeed*2862933555777941757ULL + 3037000493ULL) {}
+
+    double Uniform() {
+        ullState = ullState*6364136223846793005ULL + 1442695040888963407ULL;
+        return ((ullState >> 11) + 0.5)*(1.0/9007199254740992.0);
+    }
+
+private:
+
+    unsigned long long ullState;
+};
+
+// adapts a CRandom to the generator argument of std::random_shuffle()
+class CShuffler
+{
+public:
+
+    explicit CShuffler(CRandom &random) : random(random) {}
+
+    std::ptrdiff_t operator()(std::ptrdiff_t n) {
+        return std::ptrdiff_t(n * random.Uniform());
+    }
+
+private:
+
+    CRandom &random;
+};
+
+#endif // RANDOM_H
@@ -111,7 +111,7 @@ void CTDist::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long>& aiNodeAssign,
+    const CNodeAssign& aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -185,5 +185,56 @@ double CTDist::BagImprovement
 }
 
 
+bool CTDist::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
+    double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    double dOffset = 0.0;
+    double dF = 0.0;
+    double dU = 0.0;
+    double dV = 0.0;
+    unsigned long i = 0;
 
+    // one sweep: out-of-bag improvement at the old scores, the step, then
+    // the deviance and the next working response at the new scores
+    for(i=0; i<nTrain; i++)
+    {
+        dOffset = (adOffset==NULL) ? 0.0 : adOffset[i];
+        if(!afInBag[i])
+        {
+            dF = adF[i] + dOffset;
+            dU = (adY[i] - dF);
+            dV = (adY[i] - dF - dStepSize * adFadj[i]);
+            dOOBag += adWeight[i] * (std::log(mdNu + (dU * dU)) - log(mdNu + (dV * dV)));
+            dOOBagW += adWeight[i];
+        }
+
+        adF[i] += dStepSize * adFadj[i];
+
+        dU = adY[i] - dOffset - adF[i];
+        dL += adWeight[i] * std::log(mdNu + (dU * dU));
+        adZ[i] = (2 * dU) / (mdNu + (dU * dU));
+        dW += adWeight[i];
+    }
+
+    dOOBagImprove = dOOBag/dOOBagW;
+    dTrainError = dL/dW;
 
+    return true;
+}
@@ -0,0 +1,41 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       threads.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   OpenMP thread count and thread number, with fallbacks for
+//              compilers without OpenMP
+//
+//------------------------------------------------------------------------------
+
+#ifndef THREADS_H
+#define THREADS_H
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// The number of threads to use for cThreads requested by the user; values
+// below 1 mean the OpenMP default.  Always 1 without OpenMP.
+inline int ThreadCount(int cThreads)
+{
+#ifdef _OPENMP
+  return (cThreads > 0) ? cThreads : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// The number of the calling thread within the current parallel region
+inline int ThreadNum()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+#endif // THREADS_H
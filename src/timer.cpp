@@ -0,0 +1,58 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       timer.cpp
+//
+//------------------------------------------------------------------------------
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "timer.h"
+
+CPhaseTimer::CPhaseTimer()
+{
+    fEnabled = false;
+    Clear();
+}
+
+
+void CPhaseTimer::Clear()
+{
+    int i = 0;
+
+    for(i=0; i<PHASES; i++)
+    {
+        adStart[i] = 0.0;
+        adSeconds[i] = 0.0;
+        adRows[i] = 0.0;
+        adNodes[i] = 0.0;
+    }
+}
+
+
+const char *CPhaseTimer::Name(Phase phase)
+{
+    static const char *aszNames[PHASES] =
+        {"bag", "response", "grow", "fit", "update", "valid", "transfer"};
+
+    return aszNames[phase];
+}
+
+
+double CPhaseTimer::Now()
+{
+#ifdef _WIN32
+    LARGE_INTEGER count;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return double(count.QuadPart)/double(frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+}
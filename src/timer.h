@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       timer.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   wall clock time and work counters for the phases of an
+//              iteration
+//
+//------------------------------------------------------------------------------
+
+#ifndef TIMER_H
+#define TIMER_H
+
+// CPhaseTimer accumulates, for each phase of a boosting iteration, the
+// elapsed time on a monotonic clock, the number of rows visited and the
+// number of nodes evaluated.  Clear() starts a new iteration.  When the
+// timer is disabled Start() and Stop() return at once, so the calls stay
+// in place in the engine.
+
+class CPhaseTimer
+{
+public:
+
+    enum Phase
+    {
+        BAG = 0,        // drawing the bag
+        RESPONSE,       // working response, hessian and parameters
+        GROW,           // split search and growing the tree
+        FIT,            // terminal node predictions
+        UPDATE,         // training scores, deviance and OOB improvement
+        VALID,          // validation scores and deviance
+        TRANSFER,       // copying the tree into R objects
+        PHASES
+    };
+
+    CPhaseTimer();
+
+    void SetEnabled(bool fEnabled) { this->fEnabled = fEnabled; }
+    bool IsEnabled() const { return fEnabled; }
+
+    void Clear();
+
+    void Start(Phase phase)
+    {
+        if(fEnabled) adStart[phase] = Now();
+    }
+    void Stop(Phase phase, double cRows = 0.0, double cNodes = 0.0)
+    {
+        if(fEnabled)
+        {
+            adSeconds[phase] += Now() - adStart[phase];
+            adRows[phase] += cRows;
+            adNodes[phase] += cNodes;
+        }
+    }
+
+    double Seconds(Phase phase) const { return adSeconds[phase]; }
+    double Rows(Phase phase) const { return adRows[phase]; }
+    double Nodes(Phase phase) const { return adNodes[phase]; }
+    static const char *Name(Phase phase);
+
+    static double Now();    // seconds on a monotonic clock
+
+private:
+
+    bool fEnabled;
+    double adStart[PHASES];
+    double adSeconds[PHASES];
+    double adRows[PHASES];
+    double adNodes[PHASES];
+};
+
+#endif // TIMER_H
@@ -1,13 +1,50 @@
 //  GBM by Greg Ridgeway  Copyright (C) 2003
 #include <algorithm>
+#include <limits>
 
 #include "tree.h"
 
+namespace {
+  // the values of column iVar in the order of the index, or NULL when the
+  // search has to pick them by row
+  inline const double *SortedColumn(const CDataset &data, int iVar,
+				    unsigned long nTrain)
+  {
+    return data.sorted_x_ptr() ?
+      data.sorted_x_ptr() + std::size_t(iVar)*nTrain : 0;
+  }
+
+  // asks the pager of an out-of-core dataset for the column after it
+  inline void FetchNext(const CDataset &data,
+			CDataset::index_vector::const_iterator it,
+			CDataset::index_vector::const_iterator final)
+  {
+    if(data.pager() && (++it != final))
+      {
+	data.pager()->Fetch(*it);
+      }
+  }
+
+  inline void ReleaseColumn(const CDataset &data, int iVar)
+  {
+    if(data.pager())
+      {
+	data.pager()->Release(iVar);
+      }
+  }
+}
+
 CCARTTree::CCARTTree()
 {
     pRootNode = NULL;
     pNodeFactory = NULL;
     dShrink = 1.0;
+    cClasses = 1;
+    cRowsScanned = 0.0;
+    cNodesSearched = 0.0;
+    pHistogram = NULL;
+    pAllreduce = NULL;
+    columnSampling = CColumnSampler::LEVEL;
 }
 
 
@@ -63,13 +100,19 @@ void CCARTTree::grow
  unsigned long cMaxDepth,
  unsigned long cMinObsInNode,
  const bag& afInBag,
- std::vector<unsigned long>& aiNodeAssign,
+ CNodeAssign& aiNodeAssign,
  CNodeSearch *aNodeSearch,
- VEC_P_NODETERMINAL &vecpTermNodes
+ VEC_P_NODETERMINAL &vecpTermNodes,
+ CRandom &random,
+ unsigned long cClasses,
+ unsigned long cClassStride,
+ const double *adWH
 )
 {
+  unsigned long k = 0;
+
 #ifdef NOISY_DEBUG
-  Rprintf("Growing tree\n");
+  LogMessage("Growing tree\n");
 #endif
   
   if((adZ==NULL) || (adW==NULL) || (adF==NULL) ||
@@ -81,23 +124,71 @@ void CCARTTree::grow
   dSumZ = 0.0;
   dSumZ2 = 0.0;
   dTotalW = 0.0;
+  this->cClasses = cClasses;
   
 #ifdef NOISY_DEBUG
-  Rprintf("initial tree calcs\n");
+  LogMessage("initial tree calcs\n");
 #endif
+  if(cClasses > 1)
+    {
+      // the trees of the classes share their splits, which are searched
+      // once for all classes; the class k response of row i is
+      // adZ[k*cClassStride + i]
+      vecdClassZ.resize(nTrain*cClasses);
+      vecdClassSumZ.assign(cClasses, 0.0);
+      dError = 0.0;
+      for(iObs=0; iObs<nTrain; iObs++)
+	{
+	  aiNodeAssign.set(iObs, 0);
+	  if(afInBag[iObs])
+	    {
+	      for(k=0; k<cClasses; k++)
+		{
+		  const double dZ = adZ[k*cClassStride + iObs];
+		  vecdClassZ[iObs*cClasses + k] = dZ;
+		  vecdClassSumZ[k] += adW[iObs]*dZ;
+		  dError += adW[iObs]*dZ*dZ;
+		}
+	      dTotalW += adW[iObs];
+	    }
+	}
+      for(k=0; k<cClasses; k++)
+	{
+	  dError -= vecdClassSumZ[k]*vecdClassSumZ[k]/dTotalW;
+	}
+      dSumZ = vecdClassSumZ[0];
+    }
+  else
+    {
   for(iObs=0; iObs<nTrain; iObs++)
     {
       // aiNodeAssign tracks to which node each training obs belongs
-      aiNodeAssign[iObs] = 0;
+      aiNodeAssign.set(iObs, 0);
       if(afInBag[iObs])
         {
 	  // get the initial sums and sum of squares and total weight
 	  dSumZ += adW[iObs]*adZ[iObs];
 	  dSumZ2 += adW[iObs]*adZ[iObs]*adZ[iObs];
-	  dTotalW += adW[iObs];
+	  dTotalW += (adWH==NULL) ? adW[iObs] : adWH[iObs];
         }
     }
+  if(pAllreduce)
+    {
+      // the root holds the bags of all workers
+      double adSums[4] = {dSumZ, dSumZ2, dTotalW, double(nBagged)};
+      pAllreduce->Sum(adSums, 4);
+      dSumZ = adSums[0];
+      dSumZ2 = adSums[1];
+      dTotalW = adSums[2];
+      nBagged = (unsigned long)(adSums[3]);
+    }
   dError = dSumZ2-dSumZ*dSumZ/dTotalW;
+    }
+  // the validation rows start at the root too
+  for(iObs=nTrain; iObs<aiNodeAssign.size(); iObs++)
+    {
+      aiNodeAssign.set(iObs, 0);
+    }
   
   pInitialRootNode = pNodeFactory->GetNewNodeTerminal();
   pInitialRootNode->dPrediction = dSumZ/dTotalW;
@@ -106,33 +197,78 @@ void CCARTTree::grow
   vecpTermNodes[0] = pInitialRootNode;
   pRootNode = pInitialRootNode;
 
-  aNodeSearch[0].Set(dSumZ,dTotalW,nBagged,
-		     pInitialRootNode,
-		     &pRootNode,
-		     pNodeFactory);
+  if(cClasses > 1)
+    {
+      aNodeSearch[0].Set(&vecdClassSumZ[0],dTotalW,nBagged,
+			 pInitialRootNode,
+			 &pRootNode,
+			 pNodeFactory);
+    }
+  else
+    {
+      aNodeSearch[0].Set(dSumZ,dTotalW,nBagged,
+			 pInitialRootNode,
+			 &pRootNode,
+			 pNodeFactory);
+    }
   
   // build the tree structure
 #ifdef NOISY_DEBUG
-  Rprintf("Building tree 1 ");
+  LogMessage("Building tree 1 ");
 #endif
   cTotalNodeCount = 1;
   cTerminalNodes = 1;
+  cRowsScanned = 0.0;
+  cNodesSearched = 0.0;
+  vecaiNewNodes.assign(1, 0);
   for(cDepth=0; cDepth<cMaxDepth; cDepth++)
     {
 #ifdef NOISY_DEBUG
-      Rprintf("%d ",cDepth);
+      LogMessage("%d ",cDepth);
 #endif
-      GetBestSplit(data,
-		   nTrain,
-		   nFeatures,
-		   aNodeSearch,
-		   cTerminalNodes,
-		   aiNodeAssign,
-		   afInBag,
-		   adZ,
-		   adW,
-		   iBestNode,
-		   dBestNodeImprovement);
+      DrawColumns(data, nFeatures, random);
+      cRowsScanned += double(nTrain)*vecaiColumns.size();
+      cNodesSearched += double(cTerminalNodes)*nFeatures;
+      if(pHistogram)
+	{
+	  GetBestHistogramSplit(data,
+				nTrain,
+				aNodeSearch,
+				cTerminalNodes,
+				aiNodeAssign,
+				afInBag,
+				adZ,
+				adW,
+				adWH,
+				iBestNode,
+				dBestNodeImprovement);
+	}
+      else if(cClasses > 1)
+	{
+	  GetBestClassSplit(data,
+			    nTrain,
+			    aNodeSearch,
+			    cTerminalNodes,
+			    aiNodeAssign,
+			    afInBag,
+			    adW);
+	  SelectBestNode(aNodeSearch, cTerminalNodes,
+			 iBestNode, dBestNodeImprovement);
+	}
+      else
+	{
+	  GetBestSplit(data,
+		       nTrain,
+		       aNodeSearch,
+		       cTerminalNodes,
+		       aiNodeAssign,
+		       afInBag,
+		       adZ,
+		       adW,
+		       adWH,
+		       iBestNode,
+		       dBestNodeImprovement);
+	}
       
       if(dBestNodeImprovement == 0.0)
         {
@@ -149,9 +285,13 @@ void CCARTTree::grow
       vecpTermNodes[iBestNode] = pNewLeftNode;
       vecpTermNodes[cTerminalNodes-2] = pNewRightNode;
       vecpTermNodes[cTerminalNodes-1] = pNewMissingNode;
+      vecaiNewNodes.resize(3);
+      vecaiNewNodes[0] = iBestNode;
+      vecaiNewNodes[1] = cTerminalNodes-2;
+      vecaiNewNodes[2] = cTerminalNodes-1;
       
         // assign observations to the correct node
-      for(iObs=0; iObs < nTrain; iObs++)
+      for(iObs=0; iObs < aiNodeAssign.size(); iObs++)
         {
 	  iWhichNode = aiNodeAssign[iObs];
 	  if(iWhichNode==iBestNode)
@@ -159,16 +299,40 @@ void CCARTTree::grow
 	      schWhichNode = pNewSplitNode->WhichNode(data,iObs);
 	      if(schWhichNode == 1) // goes right
                 {
-		  aiNodeAssign[iObs] = cTerminalNodes-2;
+		  aiNodeAssign.set(iObs, cTerminalNodes-2);
                 }
 	      else if(schWhichNode == 0) // is missing
                 {
-		  aiNodeAssign[iObs] = cTerminalNodes-1;
+		  aiNodeAssign.set(iObs, cTerminalNodes-1);
                 }
 	      // those to the left stay with the same node assignment
             }
         }
       
+      if(cClasses > 1)
+	{
+	  CNodeSearch &ns = aNodeSearch[iBestNode];
+	  aNodeSearch[cTerminalNodes-2].Set(&(ns.vecdBestRightSumZ[0]),
+					    ns.dBestRightTotalW,
+					    ns.cBestRightN,
+					    pNewRightNode,
+					    &(pNewSplitNode->pRightNode),
+					    pNodeFactory);
+	  aNodeSearch[cTerminalNodes-1].Set(&(ns.vecdBestMissingSumZ[0]),
+					    ns.dBestMissingTotalW,
+					    ns.cBestMissingN,
+					    pNewMissingNode,
+					    &(pNewSplitNode->pMissingNode),
+					    pNodeFactory);
+	  ns.Set(&(ns.vecdBestLeftSumZ[0]),
+		 ns.dBestLeftTotalW,
+		 ns.cBestLeftN,
+		 pNewLeftNode,
+		 &(pNewSplitNode->pLeftNode),
+		 pNodeFactory);
+	  continue;
+	}
+
       // set up the node search for the new right node
       aNodeSearch[cTerminalNodes-2].Set(aNodeSearch[iBestNode].dBestRightSumZ,
 					aNodeSearch[iBestNode].dBestRightTotalW,
@@ -199,17 +363,101 @@ void CCARTTree::grow
 }
 
 
+// Draws the variables the split search of this level tries into
+// vecaiColumns: the nodes made by the last split share one draw for LEVEL
+// and have one each for NODE, vecaiColumns being the union of those; TREE
+// draws once, at the root.  The workers of data-parallel training all
+// search the draws of worker 0.
+void CCARTTree::DrawColumns
+(
+ const CDataset &data,
+ unsigned long nFeatures,
+ CRandom &random
+)
+{
+  const int cCols = data.ncol();
+  const bool fNodes = (columnSampling == CColumnSampler::NODE);
+  const unsigned long cDraws = fNodes ? vecaiNewNodes.size() : 1;
+  std::vector<int> &aiDrawn = fNodes ? vecaiDrawn : vecaiColumns;
+  unsigned long iDraw = 0;
+  unsigned long k = 0;
+
+  if((columnSampling == CColumnSampler::TREE) && (cDepth > 0))
+    {
+      return;
+    }
+
+  aiDrawn.resize(cDraws*nFeatures);
+  for(iDraw=0; iDraw<cDraws; iDraw++)
+    {
+      sampler.Draw(random, cCols, nFeatures);
+      std::copy(sampler.Columns(), sampler.Columns() + nFeatures,
+		aiDrawn.begin() + iDraw*nFeatures);
+    }
+  if(pAllreduce)
+    {
+      std::vector<double> adDrawn(aiDrawn.begin(), aiDrawn.end());
+      Broadcast(*pAllreduce, &adDrawn[0], adDrawn.size());
+      for(k=0; k<aiDrawn.size(); k++)
+	{
+	  aiDrawn[k] = int(adDrawn[k]);
+	}
+    }
+  if(!fNodes)
+    {
+      return;
+    }
+
+  // clear the bits of the last level, set only for its columns
+  vecfColumnNode.resize(cCols, 0);
+  for(k=0; k<vecaiColumns.size(); k++)
+    {
+      vecfColumnNode[vecaiColumns[k]] = 0;
+    }
+  vecaiColumns.clear();
+  for(iDraw=0; iDraw<cDraws; iDraw++)
+    {
+      for(k=0; k<nFeatures; k++)
+	{
+	  const int iVar = aiDrawn[iDraw*nFeatures + k];
+	  if(vecfColumnNode[iVar] == 0)
+	    {
+	      vecaiColumns.push_back(iVar);
+	    }
+	  vecfColumnNode[iVar] |= (unsigned char)(1 << iDraw);
+	}
+    }
+}
+
+
+// With NODE sampling, sets vecfNodeSearch to whether each of the
+// cTerminalNodes nodes tries iVar; the nodes searched before this level
+// have their splits and try none.
+void CCARTTree::SetNodeSearch
+(
+ int iVar,
+ unsigned long cTerminalNodes
+)
+{
+  vecfNodeSearch.assign(cTerminalNodes, 0);
+  for(unsigned long k=0; k<vecaiNewNodes.size(); k++)
+    {
+      vecfNodeSearch[vecaiNewNodes[k]] = (vecfColumnNode[iVar] >> k) & 1;
+    }
+}
+
+
 void CCARTTree::GetBestSplit
 (
  const CDataset &data,
  unsigned long nTrain,
- unsigned long nFeatures,
  CNodeSearch *aNodeSearch,
  unsigned long cTerminalNodes,
- std::vector<unsigned long>& aiNodeAssign,
+ const CNodeAssign& aiNodeAssign,
  const bag& afInBag,
  double *adZ,
  const double *adW,
+ const double *adWH,
  unsigned long &iBestNode,
  double &dBestNodeImprovement
  )
@@ -218,20 +466,33 @@ void CCARTTree::GetBestSplit
   unsigned long iNode = 0;
   unsigned long iOrderObs = 0;
   unsigned long iWhichObs = 0;
+  const bool fAllNodes = (columnSampling != CColumnSampler::NODE);
   
-  const CDataset::index_vector colNumbers(data.random_order());
-  const CDataset::index_vector::const_iterator final = colNumbers.begin() + nFeatures;
+  const CDataset::index_vector::const_iterator final = vecaiColumns.end();
+  if(data.pager() && !vecaiColumns.empty())
+    {
+      data.pager()->Fetch(vecaiColumns[0]);
+    }
   
-  for(CDataset::index_vector::const_iterator it=colNumbers.begin();
+  for(CDataset::index_vector::const_iterator it=vecaiColumns.begin();
       it != final;
       it++)
     {
       const int iVar = *it;
       const int cVarClasses = data.varclass(iVar);
+      const double *adXSorted = SortedColumn(data, iVar, nTrain);
+      FetchNext(data, it, final);
+      if(!fAllNodes)
+	{
+	  SetNodeSearch(iVar, cTerminalNodes);
+	}
       
       for(iNode=0; iNode < cTerminalNodes; iNode++)
         {
-	  aNodeSearch[iNode].ResetForNewVar(iVar, cVarClasses);
+	  if(fAllNodes || vecfNodeSearch[iNode])
+	    {
+	      aNodeSearch[iNode].ResetForNewVar(iVar, cVarClasses);
+	    }
         }
 
       // distribute the observations in order to the correct node search
@@ -241,15 +502,29 @@ void CCARTTree::GetBestSplit
 	  if(afInBag[iWhichObs])
             {
 	      const int iNode = aiNodeAssign[iWhichObs];
-	      const double dX = data.x_value(iWhichObs, iVar);
-	      aNodeSearch[iNode].IncorporateObs(dX,
-						adZ[iWhichObs],
-						adW[iWhichObs],
-						data.monotone(iVar));
+	      if(!fAllNodes && !vecfNodeSearch[iNode]) continue;
+	      const double dX = adXSorted ? adXSorted[iOrderObs] :
+		data.x_value(iWhichObs, iVar);
+	      if(adWH == NULL)
+		{
+		  aNodeSearch[iNode].IncorporateObs(dX,
+						    adZ[iWhichObs],
+						    adW[iWhichObs],
+						    data.monotone(iVar));
+		}
+	      else
+		{
+		  aNodeSearch[iNode].IncorporateNewtonObs(dX,
+							  adW[iWhichObs]*adZ[iWhichObs],
+							  adWH[iWhichObs],
+							  data.monotone(iVar));
+		}
             }
         }
+        ReleaseColumn(data, iVar);
         for(iNode=0; iNode<cTerminalNodes; iNode++)
         {
+            if(!fAllNodes && !vecfNodeSearch[iNode]) continue;
             if(cVarClasses != 0) // evaluate if categorical split
             {
 	      aNodeSearch[iNode].EvaluateCategoricalSplit();
@@ -258,6 +533,198 @@ void CCARTTree::GetBestSplit
         }
     }
 
+    SelectBestNode(aNodeSearch, cTerminalNodes,
+                   iBestNode, dBestNodeImprovement);
+}
+
+
+void CCARTTree::GetBestClassSplit
+(
+ const CDataset &data,
+ unsigned long nTrain,
+ CNodeSearch *aNodeSearch,
+ unsigned long cTerminalNodes,
+ const CNodeAssign& aiNodeAssign,
+ const bag& afInBag,
+ const double *adW
+ )
+{
+  unsigned long iNode = 0;
+  unsigned long iOrderObs = 0;
+  unsigned long iWhichObs = 0;
+  const bool fAllNodes = (columnSampling != CColumnSampler::NODE);
+
+  const CDataset::index_vector::const_iterator final = vecaiColumns.end();
+  if(data.pager() && !vecaiColumns.empty())
+    {
+      data.pager()->Fetch(vecaiColumns[0]);
+    }
+
+  // one pass over the order index per variable accumulates the sums of
+  // all classes
+  for(CDataset::index_vector::const_iterator it=vecaiColumns.begin();
+      it != final;
+      it++)
+    {
+      const int iVar = *it;
+      const int cVarClasses = data.varclass(iVar);
+      const double *adXSorted = SortedColumn(data, iVar, nTrain);
+      FetchNext(data, it, final);
+      if(!fAllNodes)
+	{
+	  SetNodeSearch(iVar, cTerminalNodes);
+	}
+
+      for(iNode=0; iNode < cTerminalNodes; iNode++)
+        {
+	  if(fAllNodes || vecfNodeSearch[iNode])
+	    {
+	      aNodeSearch[iNode].ResetForNewVar(iVar, cVarClasses);
+	    }
+        }
+
+      for(iOrderObs=0; iOrderObs < nTrain; iOrderObs++)
+        {
+	  iWhichObs = data.order_ptr()[iVar*nTrain + iOrderObs];
+	  if(afInBag[iWhichObs])
+            {
+	      const int iNode = aiNodeAssign[iWhichObs];
+	      if(!fAllNodes && !vecfNodeSearch[iNode]) continue;
+	      const double dX = adXSorted ? adXSorted[iOrderObs] :
+		data.x_value(iWhichObs, iVar);
+	      aNodeSearch[iNode].IncorporateObs(dX,
+						&vecdClassZ[iWhichObs*cClasses],
+						adW[iWhichObs]);
+            }
+        }
+      ReleaseColumn(data, iVar);
+      for(iNode=0; iNode<cTerminalNodes; iNode++)
+        {
+	  if(!fAllNodes && !vecfNodeSearch[iNode]) continue;
+	  if(cVarClasses != 0) // evaluate if categorical split
+            {
+	      aNodeSearch[iNode].EvaluateCategoricalSplit();
+            }
+	  aNodeSearch[iNode].WrapUpCurrentVariable();
+        }
+    }
+}
+
+
+// The split search of data-parallel training: the sums of the bins of each
+// terminal node and sampled variable over the rows of this worker, summed
+// over the workers in one call, are scanned by the node searches as the
+// presorted search scans the rows.  The variables are those of worker 0
+// (DrawColumns()).
+void CCARTTree::GetBestHistogramSplit
+(
+ const CDataset &data,
+ unsigned long nTrain,
+ CNodeSearch *aNodeSearch,
+ unsigned long cTerminalNodes,
+ const CNodeAssign& aiNodeAssign,
+ const bag& afInBag,
+ const double *adZ,
+ const double *adW,
+ const double *adWH,
+ unsigned long &iBestNode,
+ double &dBestNodeImprovement
+)
+{
+  const unsigned long cColumns = vecaiColumns.size();
+  const bool fAllNodes = (columnSampling != CColumnSampler::NODE);
+  unsigned long iNode = 0;
+  unsigned long iVarOrder = 0;
+  unsigned long iWhichObs = 0;
+  int iBin = 0;
+
+  // a slot of three sums (weighted response, weight, rows) per bin, the
+  // missing bin last, per node per variable
+  vecHistogramOffset.resize(cColumns + 1);
+  vecHistogramOffset[0] = 0;
+  for(iVarOrder=0; iVarOrder<cColumns; iVarOrder++)
+    {
+      vecHistogramOffset[iVarOrder+1] = vecHistogramOffset[iVarOrder] +
+	3*cTerminalNodes*(pHistogram->Bins(vecaiColumns[iVarOrder]) + 1);
+    }
+  vecdHistogram.assign(vecHistogramOffset[cColumns], 0.0);
+
+  for(iVarOrder=0; iVarOrder<cColumns; iVarOrder++)
+    {
+      const int iVar = vecaiColumns[iVarOrder];
+      const unsigned long cSlots = pHistogram->Bins(iVar) + 1;
+      const unsigned short *aiCode = pHistogram->Codes(iVar);
+      double *adHistogram = &vecdHistogram[vecHistogramOffset[iVarOrder]];
+
+      for(iWhichObs=0; iWhichObs<nTrain; iWhichObs++)
+	{
+	  if(afInBag[iWhichObs])
+	    {
+	      double *adSlot = adHistogram +
+		3*(aiNodeAssign[iWhichObs]*cSlots + aiCode[iWhichObs]);
+	      adSlot[0] += adW[iWhichObs]*adZ[iWhichObs];
+	      adSlot[1] += (adWH == NULL) ? adW[iWhichObs] : adWH[iWhichObs];
+	      adSlot[2] += 1.0;
+	    }
+	}
+    }
+
+  pAllreduce->Sum(&vecdHistogram[0], vecdHistogram.size());
+
+  for(iVarOrder=0; iVarOrder<cColumns; iVarOrder++)
+    {
+      const int iVar = vecaiColumns[iVarOrder];
+      const int cVarClasses = data.varclass(iVar);
+      const int cBins = pHistogram->Bins(iVar);
+      if(!fAllNodes)
+	{
+	  SetNodeSearch(iVar, cTerminalNodes);
+	}
+
+      for(iNode=0; iNode<cTerminalNodes; iNode++)
+	{
+	  if(!fAllNodes && !vecfNodeSearch[iNode]) continue;
+	  const double *adSlot = &vecdHistogram[vecHistogramOffset[iVarOrder] +
+						3*iNode*(cBins + 1)];
+	  CNodeSearch &search = aNodeSearch[iNode];
+
+	  // the missing rows go first, as in the presorted index
+	  search.ResetForNewVar(iVar, cVarClasses);
+	  search.IncorporateBin(std::numeric_limits<double>::quiet_NaN(),
+				adSlot[3*cBins], adSlot[3*cBins+1],
+				(unsigned long)(adSlot[3*cBins+2]),
+				data.monotone(iVar));
+	  for(iBin=0; iBin<cBins; iBin++)
+	    {
+	      search.IncorporateBin((cVarClasses != 0) ? double(iBin) :
+				    pHistogram->LowerEdge(iVar, iBin),
+				    adSlot[3*iBin], adSlot[3*iBin+1],
+				    (unsigned long)(adSlot[3*iBin+2]),
+				    data.monotone(iVar));
+	    }
+	  if(cVarClasses != 0)
+	    {
+	      search.EvaluateCategoricalSplit();
+	    }
+	  search.WrapUpCurrentVariable();
+	}
+    }
+
+  SelectBestNode(aNodeSearch, cTerminalNodes,
+		 iBestNode, dBestNodeImprovement);
+}
+
+
+void CCARTTree::SelectBestNode
+(
+ CNodeSearch *aNodeSearch,
+ unsigned long cTerminalNodes,
+ unsigned long &iBestNode,
+ double &dBestNodeImprovement
+)
+{
+    unsigned long iNode = 0;
+
     // search for the best split
     iBestNode = 0;
     dBestNodeImprovement = 0.0;
@@ -283,24 +750,6 @@ void CCARTTree::GetNodeCount
 
 
 
-void CCARTTree::PredictValid
-(
- const CDataset &data,
- unsigned long nValid,
- double *adFadj
- )
-{
-  int i=0;
-  
-  for(i=data.nrow() - nValid; i<data.nrow(); i++)
-    {
-      pRootNode->Predict(data, i, adFadj[i]);
-      adFadj[i] *= dShrink;
-    }
-}
-
-
-
 void CCARTTree::Predict
 (
     double *adX,
@@ -326,9 +775,9 @@ void CCARTTree::Predict
 
 void CCARTTree::Adjust
 (
- std::vector<unsigned long>& aiNodeAssign,
+ const CNodeAssign& aiNodeAssign,
  double *adFadj,
- unsigned long cTrain,
+ unsigned long cRows,
  VEC_P_NODETERMINAL &vecpTermNodes,
  unsigned long cMinObsInNode
 )
@@ -337,21 +786,50 @@ void CCARTTree::Adjust
   
   pRootNode->Adjust(cMinObsInNode);
   
-  // predict for the training observations
-  for(iObs=0; iObs<cTrain; iObs++)
+  // predict for the observations routed by grow()
+  for(iObs=0; iObs<cRows; iObs++)
     {
       adFadj[iObs] = vecpTermNodes[aiNodeAssign[iObs]]->dPrediction;
     }
 }
 
 
+void CCARTTree::AdjustNodes
+(
+ unsigned long cMinObsInNode
+)
+{
+  pRootNode->Adjust(cMinObsInNode);
+}
+
+
+void CCARTTree::SetNodeWeights
+(
+ const double *adNodeW,
+ VEC_P_NODETERMINAL &vecpTermNodes,
+ unsigned long cTermNodes
+)
+{
+  unsigned long iNode = 0;
+
+  for(iNode=0; iNode<cTermNodes; iNode++)
+    {
+      if(vecpTermNodes[iNode] != NULL)
+	{
+	  vecpTermNodes[iNode]->dTrainW = adNodeW[iNode];
+	}
+    }
+  pRootNode->AddUpTrainW();
+}
+
+
 void CCARTTree::Print()
 {
     if(pRootNode)
     {
       pRootNode->PrintSubtree(0);
-      Rprintf("shrinkage: %f\n",dShrink);
-      Rprintf("initial error: %f\n\n",dError);
+      LogMessage("shrinkage: %f\n",dShrink);
+      LogMessage("initial error: %f\n\n",dError);
     }
 }
 
@@ -21,9 +21,13 @@
 #include <cfloat>
 #include <algorithm>
 #include <vector>
+#include "allreduce.h"
+#include "column_sampler.h"
 #include "dataset.h"
+#include "histogram.h"
 #include "node_factory.h"
 #include "node_search.h"
+#include "node_assign.h"
 #include <ctime>
 
 
@@ -35,6 +39,31 @@ public:
     ~CCARTTree();
 
     void Initialize(CNodeFactory *pNodeFactory);
+
+    // Data-parallel training (allreduce.h): grow() searches the splits of
+    // the histograms of pHistogram, summed over the workers with
+    // pAllreduce, as are the sums at the root.  Both NULL is the presorted
+    // search.  Single-class models only.
+    void SetHistogram(const CHistogramIndex *pHistogram,
+		      CAllreduce *pAllreduce)
+    {
+        this->pHistogram = pHistogram;
+        this->pAllreduce = pAllreduce;
+    }
+
+    // how often grow() draws the nFeatures variables the split search
+    // tries (column_sampler.h); LEVEL by default
+    void SetColumnSampling(CColumnSampler::Mode columnSampling)
+    {
+        this->columnSampling = columnSampling;
+    }
+
+    // adWH, if not NULL, holds the weighted hessian of each observation,
+    // which replaces its weight in the split search (Newton boosting).
+    // random draws the variables considered at each split.  aiNodeAssign
+    // may be longer than nTrain: the rows after the training rows (the
+    // validation rows) are routed to their terminal nodes with them, but
+    // take no part in the split search.
     void grow(double *adZ,
 	      const CDataset &pData,
 	      const double *adAlgW,
@@ -46,9 +75,13 @@ public:
 	      unsigned long cMaxDepth,
 	      unsigned long cMinObsInNode,
 	      const bag& afInBag,
-	      std::vector<unsigned long>& aiNodeAssign,
+	      CNodeAssign& aiNodeAssign,
 	      CNodeSearch *aNodeSearch,
-	      VEC_P_NODETERMINAL &vecpTermNodes);
+	      VEC_P_NODETERMINAL &vecpTermNodes,
+	      CRandom &random,
+	      unsigned long cClasses = 1,
+	      unsigned long cClassStride = 0,
+	      const double *adWH = NULL);
     void Reset();
 
     void TransferTreeToRList(const CDataset &pData,
@@ -64,22 +97,36 @@ public:
 			     int cCatSplitsOld,
 			     double dShrinkage);
 
-    void PredictValid(const CDataset &pData,
-		      unsigned long nValid,
-		      double *adFadj);
-    
     void Predict(double *adX,
 		 unsigned long cRow,
 		 unsigned long cCol,
 		 unsigned long iRow,
 		 double &dFadj);
-    void Adjust(std::vector<unsigned long>& aiNodeAssign,
+    // recomputes the nonterminal node predictions and sets adFadj of
+    // the first cRows rows of aiNodeAssign to those of their terminal
+    // nodes, without the shrinkage
+    void Adjust(const CNodeAssign& aiNodeAssign,
 		double *adFadj,
-		unsigned long cTrain,
+		unsigned long cRows,
 		VEC_P_NODETERMINAL &vecpTermNodes,
 		unsigned long cMinObsInNode);
+    // recomputes the predictions of the nonterminal nodes from those of
+    // the terminal nodes, as Adjust() does without the training rows
+    void AdjustNodes(unsigned long cMinObsInNode);
+    // sets the weights of the terminal nodes to adNodeW and those of the
+    // nonterminal nodes to the sums of their children
+    void SetNodeWeights(const double *adNodeW,
+			VEC_P_NODETERMINAL &vecpTermNodes,
+			unsigned long cTermNodes);
     
     void GetNodeCount(int &cNodes);
+    // the rows visited and the node-variable pairs searched by the split
+    // search of the last grow()
+    void GetSearchCounts(double &cRowsScanned, double &cNodesSearched) const
+    {
+        cRowsScanned = this->cRowsScanned;
+        cNodesSearched = this->cNodesSearched;
+    }
     void SetShrinkage(double dShrink)
     {
         this->dShrink = dShrink;
@@ -92,17 +139,43 @@ public:
 
     double dError; // total squared error before carrying out the splits
 private:
+    void DrawColumns(const CDataset &pData,
+		     unsigned long nFeatures,
+		     CRandom &random);
+    void SetNodeSearch(int iVar, unsigned long cTerminalNodes);
     void GetBestSplit(const CDataset &pData,
 		      unsigned long nTrain,
-		      unsigned long nFeatures,
 		      CNodeSearch *aNodeSearch,
 		      unsigned long cTerminalNodes,
-		      std::vector<unsigned long>& aiNodeAssign,
+		      const CNodeAssign& aiNodeAssign,
 		      const bag& afInBag,
 		      double *adZ,
 		      const double *adW,
+		      const double *adWH,
 		      unsigned long &iBestNode,
 		      double &dBestNodeImprovement);
+    void GetBestClassSplit(const CDataset &pData,
+			   unsigned long nTrain,
+			   CNodeSearch *aNodeSearch,
+			   unsigned long cTerminalNodes,
+			   const CNodeAssign& aiNodeAssign,
+			   const bag& afInBag,
+			   const double *adW);
+    void GetBestHistogramSplit(const CDataset &pData,
+			       unsigned long nTrain,
+			       CNodeSearch *aNodeSearch,
+			       unsigned long cTerminalNodes,
+			       const CNodeAssign& aiNodeAssign,
+			       const bag& afInBag,
+			       const double *adZ,
+			       const double *adW,
+			       const double *adWH,
+			       unsigned long &iBestNode,
+			       double &dBestNodeImprovement);
+    void SelectBestNode(CNodeSearch *aNodeSearch,
+			unsigned long cTerminalNodes,
+			unsigned long &iBestNode,
+			double &dBestNodeImprovement);
     
     CNode *pRootNode;
     double dShrink;
@@ -111,6 +184,8 @@ private:
     unsigned long cDepth;
     unsigned long cTerminalNodes;
     unsigned long cTotalNodeCount;
+    double cRowsScanned;
+    double cNodesSearched;
     unsigned long iObs;
     unsigned long iWhichNode;
 
@@ -120,8 +195,33 @@ private:
     double dSumZ;
     double dSumZ2;
     double dTotalW;
+
+    // multi-class models: the working responses of the in-bag rows laid
+    // out row by row (cClasses values each), and their sums at the root
+    unsigned long cClasses;
+    std::vector<double> vecdClassZ;
+    std::vector<double> vecdClassSumZ;
     signed char schWhichNode;
 
+    // the variables the split search of a level tries: vecaiColumns
+    // holds them; with NODE sampling vecaiDrawn holds the draw of each
+    // node made by the last split (vecaiNewNodes), bit k of
+    // vecfColumnNode[iVar] is set if the k-th of them tries iVar, and
+    // vecfNodeSearch says which nodes try the variable being searched
+    CColumnSampler::Mode columnSampling;
+    CColumnSampler sampler;
+    std::vector<int> vecaiColumns;
+    std::vector<int> vecaiDrawn;
+    std::vector<unsigned long> vecaiNewNodes;
+    std::vector<unsigned char> vecfColumnNode;
+    std::vector<unsigned char> vecfNodeSearch;
+
+    // the data-parallel split search, or NULL
+    const CHistogramIndex *pHistogram;
+    CAllreduce *pAllreduce;
+    std::vector<double> vecdHistogram;
+    std::vector<std::size_t> vecHistogramOffset;
+
     CNodeFactory *pNodeFactory;
     CNodeNonterminal *pNewSplitNode;
     CNodeTerminal *pNewLeftNode;
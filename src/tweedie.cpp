@@ -3,6 +3,8 @@
 
 // Parameter dPower defaults to 1.5
 
+#include <algorithm>
+
 #include "tweedie.h"
 #include <math.h>
 #include <typeinfo>
@@ -18,29 +20,81 @@ CTweedie::~CTweedie()
 
 void CTweedie::ComputeWorkingResponse
 (
- const double *adY,
- const double *adMisc,
- const double *adOffset,
- const double *adF, 
- double *adZ, 
- const double *adWeight,
- const bag& afInBag,
- unsigned long nTrain
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    double *adZ,
+    const double *adWeight,
+    const bag& afInBag,
+    unsigned long nTrain
 )
 {
+    double adExp1[cVecBlock];
+    double adExp2[cVecBlock];
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
 
-  unsigned long i = 0;
-  double dF = 0.0;
-    
-  if( ! (adY && adF && adZ && adWeight) )
+    if( ! (adY && adF && adZ && adWeight) )
     {
-      throw GBM::invalid_argument();
+        throw GBM::invalid_argument();
     }
 
-  for(i=0; i<nTrain; i++)
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
     {
-      dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-      adZ[i] = adY[i]*std::exp(dF*(1.0-dPower)) - exp(dF*(2.0-dPower));
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+        AddOffset(adF, adOffset, iStart, cBlock, adExp1);
+        for(i=0; i<cBlock; i++)
+        {
+            adExp2[i] = adExp1[i]*(2.0-dPower);
+            adExp1[i] = adExp1[i]*(1.0-dPower);
+        }
+        vecmath.Exp(adExp1, cBlock);
+        vecmath.Exp(adExp2, cBlock);
+
+        for(i=0; i<cBlock; i++)
+        {
+            adZ[iStart+i] = adY[iStart+i]*adExp1[i] - adExp2[i];
+        }
+    }
+}
+
+
+void CTweedie::ComputeHessian
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adF,
+    const double *adZ,
+    double *adH,
+    unsigned long nTrain
+)
+{
+    double adExp1[cVecBlock];
+    double adExp2[cVecBlock];
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
+
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
+    {
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+        AddOffset(adF, adOffset, iStart, cBlock, adExp1);
+        for(i=0; i<cBlock; i++)
+        {
+            adExp2[i] = adExp1[i]*(2.0-dPower);
+            adExp1[i] = adExp1[i]*(1.0-dPower);
+        }
+        vecmath.Exp(adExp1, cBlock);
+        vecmath.Exp(adExp2, cBlock);
+
+        for(i=0; i<cBlock; i++)
+        {
+            adH[iStart+i] = (dPower-1.0)*adY[iStart+i]*adExp1[i] +
+                            (2.0-dPower)*adExp2[i];
+        }
     }
 }
 
@@ -90,26 +144,25 @@ double CTweedie::Deviance
 (
     const double *adY,
     const double *adMisc,
-    const double *adOffset, 
+    const double *adOffset,
     const double *adWeight,
     const double *adF,
     unsigned long cLength
 )
 {
-  double dF = 0.0;
-  unsigned long i=0;
-  double dL = 0.0;
-  double dW = 0.0;
-  
-  for(i=0; i<cLength; i++)
+    double dL = 0.0;
+    double dW = 0.0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+
+    for(iStart=0; iStart<cLength; iStart+=cBlock)
     {
-      dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-      dL += adWeight[i]*(pow(adY[i],2.0-dPower)/((1.0-dPower)*(2.0-dPower)) -
-			 adY[i]*std::exp(dF*(1.0-dPower))/(1.0-dPower) + exp(dF*(2.0-dPower))/(2.0-dPower) );
-      dW += adWeight[i];
+        cBlock = std::min(cVecBlock, cLength-iStart);
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, NULL);
     }
-  
-  return 2.0*dL/dW;
+
+    return 2.0*dL/dW;
 }
 
 
@@ -121,7 +174,7 @@ void CTweedie::FitBestConstant
     const double *adW,
     const double *adF,
     double *adZ,
-    const std::vector<unsigned long>& aiNodeAssign,
+    const CNodeAssign& aiNodeAssign,
     unsigned long nTrain,
     VEC_P_NODETERMINAL vecpTermNodes,
     unsigned long cTermNodes,
@@ -156,8 +209,8 @@ void CTweedie::FitBestConstant
 	  vecdDen[aiNodeAssign[iObs]] += adW[iObs]*std::exp(dF*(2.0-dPower));
 
 	  // Keep track of largest and smallest prediction in each node
-	  vecdMax[aiNodeAssign[iObs]] = R::fmax2(dF,vecdMax[aiNodeAssign[iObs]]);
-	  vecdMin[aiNodeAssign[iObs]] = R::fmin2(dF,vecdMin[aiNodeAssign[iObs]]);
+	  vecdMax[aiNodeAssign[iObs]] = std::max(dF,vecdMax[aiNodeAssign[iObs]]);
+	  vecdMin[aiNodeAssign[iObs]] = std::min(dF,vecdMin[aiNodeAssign[iObs]]);
 	}
     }
 
@@ -191,34 +244,175 @@ void CTweedie::FitBestConstant
 
 double CTweedie::BagImprovement
 (
-	const double *adY,
-	const double *adMisc,
-	const double *adOffset,
-	const double *adWeight,
-	const double *adF,
-	const double *adFadj,
-	const bag& afInBag,
-	double dStepSize,
-	unsigned long nTrain
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain
 )
 {
-	double dReturnValue = 0.0;
-	double dF = 0.0;
-	double dW = 0.0;
-	unsigned long i = 0;
+    double dReturnValue = 0.0;
+    double dW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+
+    while((cRows = NextOutOfBag(afInBag, nTrain, iNext, aiRow)) > 0)
+    {
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dReturnValue, dW);
+    }
+
+    return 2.0*dReturnValue/dW;
+}
+
+
+void CTweedie::BagImprovementBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    const double *adFadj,
+    double dStepSize,
+    const unsigned long *aiRow,
+    unsigned long cRows,
+    double &dReturnValue,
+    double &dW
+) const
+{
+    double adExp1[cVecBlock];
+    double adExp2[cVecBlock];
+    double adExpStep1[cVecBlock];
+    double adExpStep2[cVecBlock];
+    double dF = 0.0;
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
+        adExp1[k] = dF*(1.0-dPower);
+        adExp2[k] = dF*(2.0-dPower);
+        adExpStep1[k] = dStepSize*adFadj[i]*(1.0-dPower);
+        adExpStep2[k] = dStepSize*adFadj[i]*(2.0-dPower);
+    }
+    vecmath.Exp(adExp1, cRows);
+    vecmath.Exp(adExp2, cRows);
+    vecmath.Exp(adExpStep1, cRows);
+    vecmath.Exp(adExpStep2, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = aiRow[k];
+        dReturnValue += adWeight[i]*( adExp1[k]*adY[i]/(1.0-dPower)*
+            (adExpStep1[k]-1.0) +
+            adExp2[k]/(2.0-dPower)*(1.0-adExpStep2[k]) );
+        dW += adWeight[i];
+    }
+}
 
-	for(i=0; i<nTrain; i++)
-	{
-		if(!afInBag[i])
-		{
-			dF = adF[i] + ((adOffset==NULL) ? 0.0 : adOffset[i]);
-
-			dReturnValue += adWeight[i]*( std::exp(dF*(1.0-dPower))*adY[i]/(1.0-dPower)*
-				(std::exp(dStepSize*adFadj[i]*(1.0-dPower))-1.0) +
-				std::exp(dF*(2.0-dPower))/(2.0-dPower)*(1.0-exp(dStepSize*adFadj[i]*(2.0-dPower))) );
-			dW += adWeight[i];
-		}
-	}
 
-	return 2.0*dReturnValue/dW;
+bool CTweedie::UpdateScores
+(
+    const double *adY,
+    const double *adMisc,
+    const double *adOffset,
+    const double *adWeight,
+    double *adF,
+    const double *adFadj,
+    const bag& afInBag,
+    double dStepSize,
+    unsigned long nTrain,
+    double *adZ,
+    double &dTrainError,
+    double &dOOBagImprove
+)
+{
+    double dL = 0.0;
+    double dW = 0.0;
+    double dOOBag = 0.0;
+    double dOOBagW = 0.0;
+    unsigned long aiRow[cVecBlock];
+    unsigned long cRows = 0;
+    unsigned long iNext = 0;
+    unsigned long iStart = 0;
+    unsigned long cBlock = 0;
+    unsigned long i = 0;
+
+    // one sweep in blocks: out-of-bag improvement at the old scores, the
+    // step, then the deviance and the next working response at the new
+    // scores
+    for(iStart=0; iStart<nTrain; iStart+=cBlock)
+    {
+        cBlock = std::min(cVecBlock, nTrain-iStart);
+
+        iNext = iStart;
+        cRows = NextOutOfBag(afInBag, iStart+cBlock, iNext, aiRow);
+        BagImprovementBlock(adY, adOffset, adWeight, adF, adFadj, dStepSize,
+                            aiRow, cRows, dOOBag, dOOBagW);
+
+        for(i=iStart; i<iStart+cBlock; i++)
+        {
+            adF[i] += dStepSize * adFadj[i];
+        }
+
+        DevianceBlock(adY, adOffset, adWeight, adF, iStart, cBlock,
+                      dL, dW, adZ);
+    }
+
+    dOOBagImprove = 2.0*dOOBag/dOOBagW;
+    dTrainError = 2.0*dL/dW;
+
+    return true;
+}
+
+
+void CTweedie::DevianceBlock
+(
+    const double *adY,
+    const double *adOffset,
+    const double *adWeight,
+    const double *adF,
+    unsigned long iStart,
+    unsigned long cRows,
+    double &dL,
+    double &dW,
+    double *adZ
+) const
+{
+    double adExp1[cVecBlock];
+    double adExp2[cVecBlock];
+    unsigned long i = 0;
+    unsigned long k = 0;
+
+    AddOffset(adF, adOffset, iStart, cRows, adExp1);
+    for(k=0; k<cRows; k++)
+    {
+        adExp2[k] = adExp1[k]*(2.0-dPower);
+        adExp1[k] = adExp1[k]*(1.0-dPower);
+    }
+    vecmath.Exp(adExp1, cRows);
+    vecmath.Exp(adExp2, cRows);
+
+    for(k=0; k<cRows; k++)
+    {
+        i = iStart + k;
+        dL += adWeight[i]*(pow(adY[i],2.0-dPower)/((1.0-dPower)*(2.0-dPower)) -
+                           adY[i]*adExp1[k]/(1.0-dPower) + adExp2[k]/(2.0-dPower) );
+        dW += adWeight[i];
+    }
+
+    if(adZ != NULL)
+    {
+        for(k=0; k<cRows; k++)
+        {
+            adZ[iStart+k] = adY[iStart+k]*adExp1[k] - adExp2[k];
+        }
+    }
 }
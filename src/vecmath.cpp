@@ -0,0 +1,190 @@
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <limits>
+#include <stdint.h>
+
+#include "vecmath.h"
+
+// The kernels select with ?: instead of branching.  Without SIMD masking
+// (SSE2, AVX2) GCC only turns such selects into blends if floating-point
+// comparisons are allowed to be evaluated unconditionally; this does not
+// change any result.  Only the avx512f clone below has FMA, and
+// contracting a*b+c into it would round differently from the other clones,
+// so a fit would depend on the machine; contraction is off.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize ("no-trapping-math", "fp-contract=off")
+#endif
+
+// Runtime dispatch needs the ifunc support of GCC and the GNU C library.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && \
+    defined(__x86_64__) && defined(__GLIBC__) && !defined(GBM_NO_TARGET_CLONES)
+#define GBM_TARGET_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define GBM_TARGET_CLONES
+#endif
+
+namespace {
+  const uint64_t uMantissaMask = 0x000FFFFFFFFFFFFFULL;
+  const uint64_t uExponentOne  = 0x3FF0000000000000ULL;  // bits of 1.0
+  const uint64_t uExponent52   = 0x4330000000000000ULL;  // bits of 2^52
+
+  const double dTwo52    = 4503599627370496.0;      // 2^52
+  const double dTwo54    = 18014398509481984.0;     // 2^54
+  const double dRoundMagic = 6755399441055744.0;    // 1.5 * 2^52
+  const double dLog2E    = 1.44269504088896338700e+00;
+  const double dLn2Hi    = 6.93147180369123816490e-01;  // 32 significant bits
+  const double dLn2Lo    = 1.90821492927058770002e-10;  // ln 2 - dLn2Hi
+  const double dSqrt2    = 1.41421356237309514547e+00;
+
+  inline double AsDouble(uint64_t uBits)
+  {
+    double dX;
+    std::memcpy(&dX, &uBits, sizeof(dX));
+    return dX;
+  }
+
+  inline uint64_t AsBits(double dX)
+  {
+    uint64_t uBits;
+    std::memcpy(&uBits, &dX, sizeof(uBits));
+    return uBits;
+  }
+
+  // exp(x) = 2^n exp(r) with n = round(x / ln 2) and |r| <= ln(2)/2
+  inline double ExpKernel(double dX)
+  {
+    // beyond these bounds the result is 0 or inf; clamping keeps the
+    // exponent arithmetic in range (NaN fails both tests and stays NaN)
+    dX = (dX < -746.0) ? -746.0 : dX;
+    dX = (dX > 710.0) ? 710.0 : dX;
+
+    // adding 1.5*2^52 rounds to an integer, which ends up in the low
+    // mantissa bits of dT
+    const double dT = dX * dLog2E + dRoundMagic;
+    const double dN = dT - dRoundMagic;
+    const double dR = (dX - dN * dLn2Hi) - dN * dLn2Lo;
+
+    // Taylor series to r^13, below half an ulp for |r| <= ln(2)/2
+    double dP = 1.0 / 6227020800.0;
+    dP = dP * dR + 1.0 / 479001600.0;
+    dP = dP * dR + 1.0 / 39916800.0;
+    dP = dP * dR + 1.0 / 3628800.0;
+    dP = dP * dR + 1.0 / 362880.0;
+    dP = dP * dR + 1.0 / 40320.0;
+    dP = dP * dR + 1.0 / 5040.0;
+    dP = dP * dR + 1.0 / 720.0;
+    dP = dP * dR + 1.0 / 120.0;
+    dP = dP * dR + 1.0 / 24.0;
+    dP = dP * dR + 1.0 / 6.0;
+    dP = dP * dR + 0.5;
+    dP = dP * dR + 1.0;
+    dP = dP * dR + 1.0;
+
+    // n lies in [-1076, 1024]; 2^n is applied as 2^n1 * 2^n2 with both
+    // factors normal so that denormal results are rounded only once
+    const int64_t iN = static_cast<int64_t>(AsBits(dT) & uMantissaMask) -
+      (static_cast<int64_t>(1) << 51);
+    const uint64_t uN1 = static_cast<uint64_t>(iN + 2048) >> 1;   // n1 + 1024
+    const uint64_t uN2 = static_cast<uint64_t>(iN + 2047) - uN1;  // n2 + 1023
+
+    return dP * AsDouble((uN1 - 1) << 52) * AsDouble(uN2 << 52);
+  }
+
+  // log(x) = e ln 2 + log(m) with m in [sqrt(1/2), sqrt(2)), and
+  // log(m) = 2 atanh(s) with s = (m-1)/(m+1), |s| <= 0.1716
+  inline double LogKernel(double dX)
+  {
+    // bring denormals into the normal range
+    const bool fDenormal = (dX < DBL_MIN);
+    const double dXn = fDenormal ? dX * dTwo54 : dX;
+
+    const uint64_t uBits = AsBits(dXn);
+    double dM = AsDouble((uBits & uMantissaMask) | uExponentOne);
+    double dE = (AsDouble(uExponent52 | (uBits >> 52)) - dTwo52) - 1023.0;
+    dE = fDenormal ? dE - 54.0 : dE;
+
+    const bool fHigh = (dM > dSqrt2);
+    dM = fHigh ? 0.5 * dM : dM;
+    dE = fHigh ? dE + 1.0 : dE;
+
+    const double dS = (dM - 1.0) / (dM + 1.0);
+    const double dS2 = dS * dS;
+
+    // 2 atanh(s) = 2s + s^3 (2/3 + 2/5 s^2 + ... + 2/23 s^20)
+    double dQ = 2.0 / 23.0;
+    dQ = dQ * dS2 + 2.0 / 21.0;
+    dQ = dQ * dS2 + 2.0 / 19.0;
+    dQ = dQ * dS2 + 2.0 / 17.0;
+    dQ = dQ * dS2 + 2.0 / 15.0;
+    dQ = dQ * dS2 + 2.0 / 13.0;
+    dQ = dQ * dS2 + 2.0 / 11.0;
+    dQ = dQ * dS2 + 2.0 / 9.0;
+    dQ = dQ * dS2 + 2.0 / 7.0;
+    dQ = dQ * dS2 + 2.0 / 5.0;
+    dQ = dQ * dS2 + 2.0 / 3.0;
+
+    double dResult = dE * dLn2Hi + ((2.0 * dS + dS * dS2 * dQ) + dE * dLn2Lo);
+
+    dResult = (dX == 0.0) ? -HUGE_VAL : dResult;
+    dResult = (dX == HUGE_VAL) ? HUGE_VAL : dResult;
+    dResult = ((dX < 0.0) || (dX != dX)) ?
+      std::numeric_limits<double>::quiet_NaN() : dResult;
+
+    return dResult;
+  }
+
+  GBM_TARGET_CLONES
+  void ExpBlock(double *adX, unsigned long cLength)
+  {
+#pragma omp simd
+    for (unsigned long i = 0; i < cLength; i++)
+      {
+	adX[i] = ExpKernel(adX[i]);
+      }
+  }
+
+  GBM_TARGET_CLONES
+  void LogBlock(double *adX, unsigned long cLength)
+  {
+#pragma omp simd
+    for (unsigned long i = 0; i < cLength; i++)
+      {
+	adX[i] = LogKernel(adX[i]);
+      }
+  }
+}
+
+
+void CVecMath::Exp(double *adX, unsigned long cLength) const
+{
+  if (fVector)
+    {
+      ExpBlock(adX, cLength);
+    }
+  else
+    {
+      for (unsigned long i = 0; i < cLength; i++)
+	{
+	  adX[i] = std::exp(adX[i]);
+	}
+    }
+}
+
+
+void CVecMath::Log(double *adX, unsigned long cLength) const
+{
+  if (fVector)
+    {
+      LogBlock(adX, cLength);
+    }
+  else
+    {
+      for (unsigned long i = 0; i < cLength; i++)
+	{
+	  adX[i] = std::log(adX[i]);
+	}
+    }
+}
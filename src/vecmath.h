@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+//  GBM by Greg Ridgeway  Copyright (C) 2003
+//
+//  File:       vecmath.h
+//
+//  License:    GNU GPL (version 2 or later)
+//
+//  Contents:   exp() and log() over blocks of scores, written so that the
+//              compiler vectorizes them
+//
+//------------------------------------------------------------------------------
+
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <cstddef>
+
+// The exponential family distributions spend most of their time in exp()
+// and log(), which libm evaluates one element at a time.  CVecMath
+// evaluates them over a block of values with a branch-free polynomial that
+// the compiler turns into SIMD code.  On x86-64 with GCC the block routines
+// are compiled for AVX-512, AVX2 and the baseline instruction set, and the
+// best version for the CPU is picked when the library is loaded; elsewhere
+// only the baseline version exists.
+//
+// The results are within 2 ulp of the libm functions for arguments whose
+// exp() is a normal number and for normal positive arguments of log();
+// exp() of very small arguments underflows to (possibly denormal) values
+// with absolute error below 2^-1074.  Infinite and NaN arguments give the
+// same results as libm.  With SetVector(false) the block routines call
+// std::exp() and std::log(), which reproduces the scalar code exactly.
+//
+// Distributions process their scores in blocks of cVecBlock elements so
+// that the intermediate values stay in the L1 cache.
+
+const unsigned long cVecBlock = 256;
+
+class CVecMath
+{
+public:
+  CVecMath() : fVector(true) {}
+
+  void SetVector(bool fVector) { this->fVector = fVector; }
+  bool IsVector() const { return fVector; }
+
+  // adX[i] = exp(adX[i]) for i < cLength
+  void Exp(double *adX, unsigned long cLength) const;
+
+  // adX[i] = log(adX[i]) for i < cLength
+  void Log(double *adX, unsigned long cLength) const;
+
+private:
+  bool fVector;
+};
+
+// adOut[i] = adF[iStart+i] + adOffset[iStart+i] for i < cLength, or
+// adF[iStart+i] if there is no offset
+inline void AddOffset
+(
+ const double *adF,
+ const double *adOffset,
+ unsigned long iStart,
+ unsigned long cLength,
+ double *adOut
+)
+{
+  unsigned long i = 0;
+
+  if (adOffset == NULL)
+    {
+      for (i = 0; i < cLength; i++)
+	{
+	  adOut[i] = adF[iStart + i];
+	}
+    }
+  else
+    {
+      for (i = 0; i < cLength; i++)
+	{
+	  adOut[i] = adF[iStart + i] + adOffset[iStart + i];
+	}
+    }
+}
+
+#endif // VECMATH_H